@@ -723,6 +723,52 @@ static unsigned long tegra_dc_calc_win_bandwidth(struct tegra_dc *dc,
 	return ret;
 }
 
+/* window flags tegra_dc_calc_win_bandwidth() and the latency allowance use */
+#define TEGRA_WIN_BW_FLAGS (TEGRA_WIN_FLAG_ENABLED | \
+			    TEGRA_WIN_FLAG_SCAN_COLUMN | \
+			    TEGRA_WIN_FLAG_TILED | \
+			    TEGRA_WIN_FLAG_BLOCKLINEAR)
+
+/*
+ * Return the window bandwidth, recomputing it only when one of its inputs
+ * changed since the last call. Any change bumps dc->bw_cache.win_gen so
+ * tegra_dc_program_bandwidth() knows the latency allowance must be redone.
+ */
+static unsigned long tegra_dc_win_bandwidth_cached(struct tegra_dc *dc,
+	struct tegra_dc_win *w)
+{
+	u32 flags = w->flags & TEGRA_WIN_BW_FLAGS;
+
+	if (!dc)
+		return 0;
+
+	if (w->bw_cache.valid &&
+	    w->bw_cache.fmt == w->fmt &&
+	    w->bw_cache.flags == flags &&
+	    w->bw_cache.w.full == w->w.full &&
+	    w->bw_cache.h.full == w->h.full &&
+	    w->bw_cache.out_w == w->out_w &&
+	    w->bw_cache.out_h == w->out_h &&
+	    w->bw_cache.pclk == dc->mode.pclk) {
+		atomic64_inc(&dc->bw_cache.win_hits);
+		return w->bw_cache.bw;
+	}
+
+	w->bw_cache.valid = true;
+	w->bw_cache.fmt = w->fmt;
+	w->bw_cache.flags = flags;
+	w->bw_cache.w = w->w;
+	w->bw_cache.h = w->h;
+	w->bw_cache.out_w = w->out_w;
+	w->bw_cache.out_h = w->out_h;
+	w->bw_cache.pclk = dc->mode.pclk;
+	w->bw_cache.bw = tegra_dc_calc_win_bandwidth(dc, w);
+	atomic64_inc(&dc->bw_cache.win_misses);
+	dc->bw_cache.win_gen++;
+
+	return w->bw_cache.bw;
+}
+
 unsigned long tegra_dc_get_bandwidth(
 	struct tegra_dc_win *windows[], int n)
 {
@@ -740,7 +786,7 @@ unsigned long tegra_dc_get_bandwidth(
 
 		if (w)
 			w->new_bandwidth =
-				tegra_dc_calc_win_bandwidth(w->dc, w);
+				tegra_dc_win_bandwidth_cached(w->dc, w);
 	}
 
 	return tegra_dc_find_max_bandwidth(windows, n);
@@ -767,6 +813,7 @@ void tegra_dc_clear_bandwidth(struct tegra_dc *dc)
 		tegra_dc_process_bandwidth_renegotiate(dc, NULL);
 	}
 	dc->bw_kbps = 0;
+	dc->bw_cache.valid = false;
 }
 #else
 /* to save power, call when display memory clients would be idle */
@@ -779,6 +826,7 @@ void tegra_dc_clear_bandwidth(struct tegra_dc *dc)
 	if (tegra_dc_is_clk_enabled(dc->emc_clk))
 		tegra_disp_clk_disable_unprepare(dc->emc_clk);
 	dc->bw_kbps = 0;
+	dc->bw_cache.valid = false;
 }
 
 /* bw in kByte/second. returns Hz for EMC frequency */
@@ -799,15 +847,41 @@ static inline unsigned long tegra_dc_kbps_to_emc(unsigned long bw)
 }
 #endif
 
+/* true if a forced update would reprogram exactly what is already set */
+static bool tegra_dc_bandwidth_unchanged(struct tegra_dc *dc)
+{
+	struct tegra_dc_bw_cache *cache = &dc->bw_cache;
+	unsigned i;
+
+	if (!cache->valid || cache->bw_kbps != dc->new_bw_kbps ||
+	    dc->bw_kbps != dc->new_bw_kbps ||
+	    cache->programmed_gen != cache->win_gen ||
+	    memcmp(&cache->mode, &dc->mode, sizeof(dc->mode)))
+		return false;
+
+	for_each_set_bit(i, &dc->valid_windows,
+			tegra_dc_get_numof_dispwindows()) {
+		struct tegra_dc_win *w = tegra_dc_get_window(dc, i);
+
+		if (w->bandwidth != w->new_bandwidth)
+			return false;
+	}
+
+	return true;
+}
+
 /* use the larger of dc->bw_kbps or dc->new_bw_kbps, and copies
  * dc->new_bw_kbps into dc->bw_kbps.
  * calling this function both before and after a flip is sufficient to select
  * the best possible frequency and latency allowance.
- * set use_new to true to force dc->new_bw_kbps programming.
+ * set use_new to true to force dc->new_bw_kbps programming; this is skipped
+ * when neither the bandwidth nor any window's inputs changed since the last
+ * forced programming.
  */
 void tegra_dc_program_bandwidth(struct tegra_dc *dc, bool use_new)
 {
 	unsigned i;
+	bool reserved = true;
 
 	if (tegra_dc_is_nvdisplay())
 		return;
@@ -818,6 +892,11 @@ void tegra_dc_program_bandwidth(struct tegra_dc *dc, bool use_new)
 	if (!tegra_platform_is_silicon())
 		return;
 
+	if (use_new && tegra_dc_bandwidth_unchanged(dc)) {
+		atomic64_inc(&dc->bw_cache.skipped);
+		return;
+	}
+
 	if (use_new || dc->bw_kbps != dc->new_bw_kbps) {
 		long bw = max(dc->bw_kbps, dc->new_bw_kbps);
 
@@ -838,6 +917,7 @@ void tegra_dc_program_bandwidth(struct tegra_dc *dc, bool use_new)
 			dev_dbg(&dc->ndev->dev, "Failed to reserve bw %ld.\n",
 									bw);
 			tegra_dc_process_bandwidth_renegotiate(dc, NULL);
+			reserved = false;
 		}
 #else /* EMC version */
 		int emc_freq;
@@ -856,6 +936,8 @@ void tegra_dc_program_bandwidth(struct tegra_dc *dc, bool use_new)
 			tegra_disp_clk_disable_unprepare(dc->emc_clk);
 #endif
 		dc->bw_kbps = dc->new_bw_kbps;
+		if (!use_new)
+			dc->bw_cache.valid = false;
 	}
 
 	for_each_set_bit(i, &dc->valid_windows,
@@ -868,6 +950,14 @@ void tegra_dc_program_bandwidth(struct tegra_dc *dc, bool use_new)
 		trace_program_bandwidth(dc);
 		w->bandwidth = w->new_bandwidth;
 	}
+
+	if (use_new) {
+		dc->bw_cache.valid = reserved;
+		dc->bw_cache.bw_kbps = dc->bw_kbps;
+		dc->bw_cache.programmed_gen = dc->bw_cache.win_gen;
+		dc->bw_cache.mode = dc->mode;
+		atomic64_inc(&dc->bw_cache.programmed);
+	}
 }
 
 int tegra_dc_set_dynamic_emc(struct tegra_dc *dc)
@@ -935,17 +1025,20 @@ long tegra_calc_min_bandwidth(struct tegra_dc *dc)
 }
 
 #ifdef CONFIG_TEGRA_ISOMGR
-int tegra_dc_bandwidth_negotiate_bw(struct tegra_dc *dc,
-			struct tegra_dc_win *windows[], int n)
+/*
+ * Reserve the bandwidth of windows[] if it is above the current reservation.
+ * When undo is given, it records what is needed to give the reservation
+ * back with tegra_dc_bandwidth_undo_heads().
+ */
+static int __tegra_dc_bandwidth_negotiate_bw(struct tegra_dc *dc,
+			struct tegra_dc_win *windows[], int n,
+			struct tegra_dc_bw_undo *undo)
 {
 	int i;
 	u32 bw;
 	int err;
 	int latency;
 
-	if (tegra_dc_is_nvdisplay())
-		return 0;
-
 	mutex_lock(&dc->lock);
 	/*
 	 * isomgr will update available bandwidth through a callback.
@@ -975,6 +1068,11 @@ int tegra_dc_bandwidth_negotiate_bw(struct tegra_dc *dc,
 	 * If realized, update dc->bw_kbps
 	 */
 	if (dc->reserved_bw < bw) {
+		if (undo) {
+			undo->reserved_bw = dc->reserved_bw;
+			undo->bw_kbps = dc->bw_kbps;
+			undo->new_reserved_bw = bw;
+		}
 		dc->reserved_bw = bw;
 		latency = tegra_isomgr_realize(dc->isomgr_handle);
 		if (!latency) {
@@ -1003,8 +1101,95 @@ int tegra_dc_bandwidth_negotiate_bw(struct tegra_dc *dc,
 
 	return 0;
 }
+
+int tegra_dc_bandwidth_negotiate_bw(struct tegra_dc *dc,
+			struct tegra_dc_win *windows[], int n)
+{
+	if (tegra_dc_is_nvdisplay())
+		return 0;
+
+	return __tegra_dc_bandwidth_negotiate_bw(dc, windows, n, NULL);
+}
 EXPORT_SYMBOL(tegra_dc_bandwidth_negotiate_bw);
 
+/*
+ * Give back the reservations that tegra_dc_bandwidth_negotiate_bw_heads()
+ * grew. A head whose reservation has changed again since then, e.g. by a
+ * flip programming its bandwidth, is left alone.
+ */
+void tegra_dc_bandwidth_undo_heads(struct tegra_dc *dcs[],
+			struct tegra_dc_bw_undo undo[], int nr_heads)
+{
+	int i;
+
+	for (i = 0; i < nr_heads; i++) {
+		struct tegra_dc *dc = dcs[i];
+
+		if (!undo[i].new_reserved_bw)
+			continue;
+
+		mutex_lock(&dc->lock);
+		if (dc->reserved_bw == undo[i].new_reserved_bw &&
+		    tegra_isomgr_reserve(dc->isomgr_handle,
+					 undo[i].reserved_bw, 1000) &&
+		    tegra_isomgr_realize(dc->isomgr_handle)) {
+			dc->reserved_bw = undo[i].reserved_bw;
+			dc->bw_kbps = undo[i].bw_kbps;
+		}
+		mutex_unlock(&dc->lock);
+		undo[i].new_reserved_bw = 0;
+	}
+}
+EXPORT_SYMBOL(tegra_dc_bandwidth_undo_heads);
+
+/*
+ * Negotiate the bandwidth of a multi-head flip as a whole. Every head's
+ * proposal is first checked against the bandwidth isomgr has made available
+ * to it; this catches a head over budget early, but says nothing about the
+ * other heads drawing on the same pool. The heads are then reserved one by
+ * one, and if one of them fails the reservations already grown for the
+ * others are given back. The caller gives them back the same way, with
+ * tegra_dc_bandwidth_undo_heads(), if the flip fails later on.
+ */
+int tegra_dc_bandwidth_negotiate_bw_heads(struct tegra_dc *dcs[],
+			struct tegra_dc_win **windows[], int n[], int nr_heads,
+			struct tegra_dc_bw_undo undo[])
+{
+	int i;
+
+	memset(undo, 0, sizeof(*undo) * nr_heads);
+
+	if (tegra_dc_is_nvdisplay())
+		return 0;
+
+	for (i = 0; i < nr_heads; i++) {
+		struct tegra_dc *dc = dcs[i];
+		u32 bw;
+
+		mutex_lock(&dc->lock);
+		bw = tegra_dc_get_bandwidth(windows[i], n[i]);
+		if (bw > dc->available_bw) {
+			dev_dbg(&dc->ndev->dev,
+				"proposed bw %u above available bw %u\n",
+				bw, dc->available_bw);
+			mutex_unlock(&dc->lock);
+			return -EBUSY;
+		}
+		mutex_unlock(&dc->lock);
+	}
+
+	for (i = 0; i < nr_heads; i++) {
+		if (__tegra_dc_bandwidth_negotiate_bw(dcs[i], windows[i], n[i],
+						      &undo[i])) {
+			tegra_dc_bandwidth_undo_heads(dcs, undo, i + 1);
+			return -EBUSY;
+		}
+	}
+
+	return 0;
+}
+EXPORT_SYMBOL(tegra_dc_bandwidth_negotiate_bw_heads);
+
 void tegra_dc_bandwidth_renegotiate(void *p, u32 avail_bw)
 {
 	struct tegra_dc_bw_data data;
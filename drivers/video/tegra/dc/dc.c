@@ -1302,6 +1302,9 @@ static ssize_t dbg_dc_out_type_set(struct file *file,
 	if (dc->enabled)
 		tegra_dc_disable(dc);
 
+	/* the in-memory window register backend is for fake outputs only */
+	tegra_dc_shadow_set_mem(dc, false);
+
 	/* Clear EDID error flags */
 	if (dc->edid)
 		dc->edid->errors = 0;
@@ -2461,6 +2464,8 @@ static ssize_t dbg_window_toggle_write(struct file *file,
 		tegra_dc_writel(dc, WIN_A_ACT_REQ << i, DC_CMD_STATE_CONTROL);
 
 	}
+	/* WIN_OPTIONS changed behind the window register shadow */
+	tegra_dc_shadow_invalidate(dc);
 	tegra_dc_put(dc);
 	mutex_unlock(&dc->lock);
 
@@ -2819,7 +2824,11 @@ static const struct file_operations dbg_hw_index_ops = {
 
 static int dbg_flip_stats_show(struct seq_file *m, void *unused)
 {
+	static const char * const stage[] = { "worker", "commit", "vblank" };
 	struct tegra_dc *dc = m->private;
+	struct tegra_dc_flip_latency lat[ARRAY_SIZE(stage)];
+	u64 samples;
+	int i;
 
 	if (WARN_ON(!dc || !dc->out))
 		return -EINVAL;
@@ -2830,6 +2839,24 @@ static int dbg_flip_stats_show(struct seq_file *m, void *unused)
 		atomic64_read(&dc->flip_stats.flips_skipped));
 	seq_printf(m, "Flips completed: %ld\n",
 		atomic64_read(&dc->flip_stats.flips_cmpltd));
+	seq_printf(m, "Pin cache hits: %ld\n",
+		atomic64_read(&dc->flip_stats.pin_cache_hits));
+	seq_printf(m, "Pin cache misses: %ld\n",
+		atomic64_read(&dc->flip_stats.pin_cache_misses));
+
+	spin_lock(&dc->flip_stats.latency_lock);
+	samples = dc->flip_stats.latency_samples;
+	lat[0] = dc->flip_stats.to_worker;
+	lat[1] = dc->flip_stats.to_commit;
+	lat[2] = dc->flip_stats.to_vblank;
+	spin_unlock(&dc->flip_stats.latency_lock);
+
+	seq_printf(m, "Flip latency samples: %llu\n", samples);
+	for (i = 0; i < ARRAY_SIZE(lat); i++)
+		seq_printf(m, "Flip latency to %s (us): avg %llu max %llu\n",
+			stage[i],
+			samples ? div64_u64(lat[i].total, samples * 1000) : 0,
+			div64_u64(lat[i].max, 1000));
 
 	return 0;
 }
@@ -2846,6 +2873,125 @@ static const struct file_operations dbg_flip_stats_ops = {
 	.release = single_release,
 };
 
+/*
+ * Window register shadow statistics. With the in-memory backend enabled
+ * (write 1, fake outputs only) the flushed register file is dumped as well.
+ * Writing 0 returns to HW; either write clears the statistics.
+ */
+static int dbg_win_shadow_show(struct seq_file *m, void *unused)
+{
+	struct tegra_dc *dc = m->private;
+	struct tegra_dc_reg_shadow *rs;
+	int i, j;
+
+	if (WARN_ON(!dc || !dc->out))
+		return -EINVAL;
+
+	rs = &dc->reg_shadow;
+
+	mutex_lock(&dc->lock);
+	seq_printf(m, "backend: %s\n", rs->mem ? "memory" : "mmio");
+	seq_printf(m, "flips: %llu\n", rs->flips);
+	seq_printf(m, "writes flushed: %llu\n", rs->writes_flushed);
+	seq_printf(m, "writes elided: %llu\n", rs->writes_elided);
+	seq_printf(m, "mmio per flip: last %u max %u avg %llu\n",
+		rs->mmio_last, rs->mmio_max,
+		rs->flips ? div64_u64(rs->mmio_total, rs->flips) : 0);
+
+	for (i = 0; rs->mem && i < DC_N_WINDOWS; i++) {
+		u32 *mem = &rs->mem[i * TEGRA_DC_SHADOW_NUM_REGS];
+
+		if (!test_bit(i, &dc->valid_windows))
+			continue;
+
+		seq_printf(m, "win %d:\n", i);
+		for (j = 0; j < TEGRA_DC_SHADOW_NUM_REGS; j++) {
+			unsigned long reg = j < TEGRA_DC_SHADOW_WIN_NUM ?
+				TEGRA_DC_SHADOW_WIN_BASE + j :
+				TEGRA_DC_SHADOW_WINBUF_BASE + j -
+				TEGRA_DC_SHADOW_WIN_NUM;
+
+			if (test_bit(j, rs->win[i].valid))
+				seq_printf(m, "  %#05lx: %08x\n", reg, mem[j]);
+		}
+	}
+	mutex_unlock(&dc->lock);
+
+	return 0;
+}
+
+static int dbg_win_shadow_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, dbg_win_shadow_show, inode->i_private);
+}
+
+static ssize_t dbg_win_shadow_write(struct file *file,
+		const char __user *addr, size_t len, loff_t *pos)
+{
+	struct seq_file *m = file->private_data;
+	struct tegra_dc *dc = m->private;
+	long enable;
+	int ret;
+
+	if (!dc)
+		return -EINVAL;
+
+	ret = kstrtol_from_user(addr, len, 10, &enable);
+	if (ret < 0)
+		return ret;
+
+	ret = tegra_dc_shadow_set_mem(dc, !!enable);
+	if (ret)
+		return ret;
+
+	return len;
+}
+
+static const struct file_operations dbg_win_shadow_ops = {
+	.open = dbg_win_shadow_open,
+	.read = seq_read,
+	.write = dbg_win_shadow_write,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static int dbg_bw_cache_show(struct seq_file *m, void *unused)
+{
+	struct tegra_dc *dc = m->private;
+	struct tegra_dc_bw_cache *cache;
+	u64 skipped, programmed;
+
+	if (WARN_ON(!dc))
+		return -EINVAL;
+
+	cache = &dc->bw_cache;
+
+	skipped = atomic64_read(&cache->skipped);
+	programmed = atomic64_read(&cache->programmed);
+	seq_printf(m, "win hits: %llu\n",
+		(u64)atomic64_read(&cache->win_hits));
+	seq_printf(m, "win misses: %llu\n",
+		(u64)atomic64_read(&cache->win_misses));
+	seq_printf(m, "programmed: %llu\n", programmed);
+	seq_printf(m, "skipped: %llu\n", skipped);
+	seq_printf(m, "skip rate: %llu%%\n", skipped + programmed ?
+		div64_u64(skipped * 100, skipped + programmed) : 0);
+
+	return 0;
+}
+
+static int dbg_bw_cache_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, dbg_bw_cache_show, inode->i_private);
+}
+
+static const struct file_operations dbg_bw_cache_ops = {
+	.open = dbg_bw_cache_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
 static int dbg_measure_latency_show(struct seq_file *m, void *unused)
 {
 	struct tegra_dc *dc = m->private;
@@ -3031,6 +3177,18 @@ static void tegra_dc_create_debugfs(struct tegra_dc *dc)
 	if (!retval)
 		goto remove_out;
 
+	retval = debugfs_create_file("bw_cache", 0444, dc->debugdir,
+				dc, &dbg_bw_cache_ops);
+	if (!retval)
+		goto remove_out;
+
+	if (!tegra_dc_is_nvdisplay()) {
+		retval = debugfs_create_file("win_shadow", 0644,
+					dc->debugdir, dc, &dbg_win_shadow_ops);
+		if (!retval)
+			goto remove_out;
+	}
+
 	if (dc->out_ops->get_connector_instance) {
 		char sor_path[CHAR_BUF_SIZE_MAX];
 		int ctrl_num = -1;
@@ -5423,6 +5581,9 @@ static int tegra_dc_init(struct tegra_dc *dc)
 	int int_enable;
 	u32 val;
 
+	/* window registers were reset, reprogram all of them on next flip */
+	tegra_dc_shadow_invalidate(dc);
+
 	tegra_dc_io_start(dc);
 	tegra_dc_writel(dc, 0x00000100, DC_CMD_GENERAL_INCR_SYNCPT_CNTRL);
 	tegra_dc_writel(dc, 0x00000100 | dc->vblank_syncpt,
@@ -6635,6 +6796,9 @@ static int tegra_dc_probe(struct platform_device *ndev)
 	atomic64_set(&dc->flip_stats.flips_queued, 0);
 	atomic64_set(&dc->flip_stats.flips_skipped, 0);
 	atomic64_set(&dc->flip_stats.flips_cmpltd, 0);
+	atomic64_set(&dc->flip_stats.pin_cache_hits, 0);
+	atomic64_set(&dc->flip_stats.pin_cache_misses, 0);
+	spin_lock_init(&dc->flip_stats.latency_lock);
 
 	tegra_dc_create_debugfs(dc);
 
@@ -6830,6 +6994,7 @@ static int tegra_dc_remove(struct platform_device *ndev)
 
 	kfree(dc->flip_buf.data);
 	kfree(dc->crc_buf.data);
+	kfree(dc->reg_shadow.mem);
 
 	if (dc->out->flags & TEGRA_DC_OUT_ONE_SHOT_MODE) {
 		mutex_lock(&dc->one_shot_lock);
@@ -245,6 +245,10 @@ void tegra_dc_win_partial_update(struct tegra_dc *dc, struct tegra_dc_win *win,
 	unsigned int xoff, unsigned int yoff, unsigned int width,
 	unsigned int height);
 void tegra_dc_set_background_color(struct tegra_dc *dc, u32 background_color);
+void tegra_dc_shadow_invalidate(struct tegra_dc *dc);
+void tegra_dc_shadow_invalidate_reg(struct tegra_dc *dc, int win_idx,
+				    unsigned long reg);
+int tegra_dc_shadow_set_mem(struct tegra_dc *dc, bool enable);
 int tegra_dc_slgc_disp0(struct notifier_block *nb, unsigned long unused0,
 	void *unused1);
 
@@ -544,6 +548,7 @@ static inline void tegra_dc_writel(struct tegra_dc *dc, unsigned long val,
 
 	trace_display_writel(dc, val, (char *)dc->base + reg * 4);
 	writel(val, dc->base + reg * 4);
+	dc->reg_writes++;
 }
 
 static inline void tegra_dc_power_on(struct tegra_dc *dc)
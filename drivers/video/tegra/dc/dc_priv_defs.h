@@ -248,10 +248,77 @@ struct tegra_dc_topology {
 	int conn_inst;	/* SOR/DSI instance number. */
 };
 
+/* Time in ns from the flip ioctl to one stage of the flip worker */
+struct tegra_dc_flip_latency {
+	u64 total;
+	u64 max;
+};
+
 struct tegra_dc_flip_stats {
 	atomic64_t flips_skipped;
 	atomic64_t flips_queued;
 	atomic64_t flips_cmpltd;
+	atomic64_t pin_cache_hits;
+	atomic64_t pin_cache_misses;
+
+	/* latency of completed flips, protected by latency_lock */
+	spinlock_t latency_lock;
+	u64 latency_samples;
+	struct tegra_dc_flip_latency to_worker;	/* worker started */
+	struct tegra_dc_flip_latency to_commit;	/* registers committed */
+	struct tegra_dc_flip_latency to_vblank;	/* latched at vblank */
+};
+
+/*
+ * Per-window shadow of the assembly registers programmed on every flip by
+ * the legacy (T21x) window path. Registers 0x700-0x71f land in
+ * val[0x00-0x1f] and 0x800-0x83f in val[0x20-0x5f]. A register is only
+ * written to HW at flush time if its dirty bit is set, and only marked dirty
+ * if the new value differs from the last value flushed (valid bit set).
+ */
+#define TEGRA_DC_SHADOW_WIN_BASE	0x700
+#define TEGRA_DC_SHADOW_WIN_NUM		0x20
+#define TEGRA_DC_SHADOW_WINBUF_BASE	0x800
+#define TEGRA_DC_SHADOW_WINBUF_NUM	0x40
+#define TEGRA_DC_SHADOW_NUM_REGS	(TEGRA_DC_SHADOW_WIN_NUM + \
+					 TEGRA_DC_SHADOW_WINBUF_NUM)
+
+struct tegra_dc_win_shadow {
+	u32 val[TEGRA_DC_SHADOW_NUM_REGS];
+	DECLARE_BITMAP(valid, TEGRA_DC_SHADOW_NUM_REGS);
+	DECLARE_BITMAP(dirty, TEGRA_DC_SHADOW_NUM_REGS);
+};
+
+/*
+ * What tegra_dc_program_bandwidth() last programmed in full, so that a
+ * forced update which would program the same thing again can be skipped.
+ * win_gen is bumped whenever a window's bandwidth inputs change.
+ */
+struct tegra_dc_bw_cache {
+	bool valid;
+	unsigned long bw_kbps;
+	u64 win_gen;
+	u64 programmed_gen;
+	struct tegra_dc_mode mode;
+	/* statistics, bumped from the flip worker without dc->lock */
+	atomic64_t win_hits;
+	atomic64_t win_misses;
+	atomic64_t skipped;
+	atomic64_t programmed;
+};
+
+struct tegra_dc_reg_shadow {
+	struct tegra_dc_win_shadow win[DC_N_WINDOWS];
+	unsigned long dirty_wins;
+	/* in-memory register backend, see tegra_dc_shadow_set_mem() */
+	u32 *mem;
+	/* statistics, updated under dc->lock */
+	u64 flips;
+	u64 writes_elided;
+	u64 writes_flushed;
+	u64 mmio_total;
+	u32 mmio_last;
+	u32 mmio_max;
 };
 
 /*
@@ -655,6 +722,13 @@ struct tegra_dc {
 	struct tegra_dc_clients_info clients_info;
 	struct tegra_dc_flip_stats flip_stats;
 
+	/* assembly register shadow for the legacy window path */
+	struct tegra_dc_reg_shadow reg_shadow;
+	/* number of tegra_dc_writel() MMIO writes issued */
+	u64 reg_writes;
+
+	struct tegra_dc_bw_cache bw_cache;
+
 	struct tegra_dc_ring_buf flip_buf; /* Buffer to save flip requests */
 	struct tegra_dc_ring_buf crc_buf; /* Buffer to save HW generated CRCs */
 	struct tegra_dc_crc_ref_cnt crc_ref_cnt;
@@ -29,6 +29,8 @@
 #include <linux/version.h>
 #include <linux/string.h>
 #include <linux/nospec.h>
+#include <linux/nvhost.h>
+#include <linux/nvhost_ioctl.h>
 #include <video/tegra_dc_ext.h>
 #include <trace/events/display.h>
 
@@ -136,6 +138,27 @@ struct tegra_dc_ext_flip_data {
 	struct tegra_dc_flip_buf_ele *flip_buf_ele;
 	bool background_color_update_needed;
 	u32 background_color;
+	bool has_timestamp;
+	/* never shown, the worker only retires the syncpoints */
+	bool cancelled;
+	struct tegra_dc_ext_flip_group *group;
+	/* user whose flip pool this came from, NULL if kzalloc()ed */
+	struct tegra_dc_ext_user *pool_user;
+	ktime_t ioctl_ts;
+	struct tegra_dc_win blank_win;
+};
+
+/*
+ * A multi-head flip queues one flip per head, all sharing one group. Each
+ * head's worker waits at the release point, right before it latches its
+ * windows, until every head of the group has reached it.
+ */
+#define TEGRA_DC_EXT_FLIP_GROUP_TIMEOUT_MS	6000
+
+struct tegra_dc_ext_flip_group {
+	atomic_t		pending;
+	atomic_t		refs;
+	wait_queue_head_t	wq;
 };
 
 struct tegra_dc_ext_scanline_data {
@@ -146,6 +169,7 @@ struct tegra_dc_ext_scanline_data {
 };
 
 static int tegra_dc_ext_set_vblank(struct tegra_dc_ext *ext, bool enable);
+static void tegra_dc_ext_flip_abort(struct tegra_dc_ext_flip_data *data);
 static void tegra_dc_ext_unpin_window(struct tegra_dc_ext_win *win);
 static void tegra_dc_flip_trace(struct tegra_dc_ext_flip_data *data,
 				display_syncpt_notifier trace_fn);
@@ -215,6 +239,15 @@ static int tegra_dc_ext_get_window(struct tegra_dc_ext_user *user,
 	return ret;
 }
 
+/* Late latching needs an up to date frame end timestamp. */
+static void tegra_dc_ext_set_latch_margin(struct tegra_dc_ext_win *win,
+					  u32 margin_us)
+{
+	if (!win->latch_margin_us != !margin_us)
+		tegra_dc_config_frame_end_intr(win->ext->dc, !!margin_us);
+	win->latch_margin_us = margin_us;
+}
+
 static int tegra_dc_ext_put_window(struct tegra_dc_ext_user *user,
 				   unsigned int n)
 {
@@ -233,6 +266,10 @@ static int tegra_dc_ext_put_window(struct tegra_dc_ext_user *user,
 
 	if (win->user == user) {
 		kthread_flush_worker(&win->flip_worker);
+		tegra_dc_ext_pin_cache_flush(win);
+		tegra_dc_ext_set_latch_margin(win, 0);
+		win->flip_mode = TEGRA_DC_EXT_FLIP_QUEUE_FIFO;
+		win->flip_depth = 0;
 		win->user = NULL;
 		win->enabled = false;
 	} else {
@@ -244,6 +281,52 @@ static int tegra_dc_ext_put_window(struct tegra_dc_ext_user *user,
 	return ret;
 }
 
+static int tegra_dc_ext_set_flip_queue(struct tegra_dc_ext_user *user,
+				       struct tegra_dc_ext_flip_queue *args)
+{
+	struct tegra_dc_ext *ext = user->ext;
+	struct tegra_dc_ext_win *win;
+	unsigned int n = args->win;
+	int ret = 0;
+
+	if ((n >= tegra_dc_get_numof_dispwindows()) ||
+		!(ext->dc->valid_windows & BIT(n)))
+		return -EINVAL;
+	n = array_index_nospec(n, tegra_dc_get_numof_dispwindows());
+
+	if (args->mode != TEGRA_DC_EXT_FLIP_QUEUE_FIFO &&
+		args->mode != TEGRA_DC_EXT_FLIP_QUEUE_MAILBOX)
+		return -EINVAL;
+
+	/*
+	 * Late latch extrapolates vblank from dc->frame_end_timestamp, which
+	 * only the continuous mode ISR stamps. One-shot panels scan out on
+	 * demand, so there is no next vblank to latch ahead of.
+	 */
+	if (args->mode == TEGRA_DC_EXT_FLIP_QUEUE_MAILBOX &&
+		args->latch_margin_us &&
+		(ext->dc->out->flags & TEGRA_DC_OUT_ONE_SHOT_MODE))
+		return -EOPNOTSUPP;
+
+	win = &ext->win[n];
+
+	mutex_lock(&win->lock);
+
+	if (win->user == user) {
+		tegra_dc_ext_set_latch_margin(win,
+			args->mode == TEGRA_DC_EXT_FLIP_QUEUE_MAILBOX ?
+			args->latch_margin_us : 0);
+		win->flip_mode = args->mode;
+		win->flip_depth = args->depth;
+	} else {
+		ret = -EACCES;
+	}
+
+	mutex_unlock(&win->lock);
+
+	return ret;
+}
+
 static unsigned long tegra_dc_ext_get_winmask(struct tegra_dc_ext_user *user)
 {
 	return user->ext->dc->valid_windows;
@@ -508,6 +591,23 @@ static void tegra_dc_ext_set_windowattr_basic(struct tegra_dc_win *win,
 
 
 
+/* Waiting again once the pre-fence has signalled returns right away. */
+static void tegra_dc_ext_wait_prefence(struct tegra_dc_ext *ext,
+			       const struct tegra_dc_ext_flip_win *flip_win)
+{
+#ifdef CONFIG_TEGRA_GRHOST_SYNC
+	if (flip_win->pre_syncpt_fence) {
+		sync_fence_wait(flip_win->pre_syncpt_fence, 5000);
+	} else
+#endif
+	if ((s32)flip_win->attr.pre_syncpt_id >= 0) {
+		nvhost_syncpt_wait_timeout_ext(ext->dc->ndev,
+				flip_win->attr.pre_syncpt_id,
+				flip_win->attr.pre_syncpt_val,
+				msecs_to_jiffies(5000), NULL, NULL);
+	}
+}
+
 static int tegra_dc_ext_set_windowattr(struct tegra_dc_ext *ext,
 			       struct tegra_dc_win *win,
 			       const struct tegra_dc_ext_flip_win *flip_win)
@@ -574,18 +674,11 @@ static int tegra_dc_ext_set_windowattr(struct tegra_dc_ext *ext,
 		dev_err(&ext->dc->ndev->dev,
 				"Window atrributes are invalid.\n");
 
+	tegra_dc_ext_wait_prefence(ext, flip_win);
 #ifdef CONFIG_TEGRA_GRHOST_SYNC
-	if (flip_win->pre_syncpt_fence) {
-		sync_fence_wait(flip_win->pre_syncpt_fence, 5000);
+	if (flip_win->pre_syncpt_fence)
 		sync_fence_put(flip_win->pre_syncpt_fence);
-	} else
 #endif
-	if ((s32)flip_win->attr.pre_syncpt_id >= 0) {
-		nvhost_syncpt_wait_timeout_ext(ext->dc->ndev,
-				flip_win->attr.pre_syncpt_id,
-				flip_win->attr.pre_syncpt_val,
-				msecs_to_jiffies(5000), NULL, NULL);
-	}
 
 	if (err < 0)
 		return err;
@@ -878,14 +971,73 @@ static void tegra_dc_ext_unpin_handles(struct tegra_dc_dmabuf *unpin_handles[],
 {
 	int i;
 
-	for (i = 0; i < nr_unpin; i++) {
-		dma_buf_unmap_attachment(unpin_handles[i]->attach,
-			unpin_handles[i]->sgt, DMA_TO_DEVICE);
-		dma_buf_detach(unpin_handles[i]->buf,
-			       unpin_handles[i]->attach);
-		dma_buf_put(unpin_handles[i]->buf);
-		kfree(unpin_handles[i]);
+	for (i = 0; i < nr_unpin; i++)
+		tegra_dc_ext_unpin_dmabuf(unpin_handles[i]);
+}
+
+/*
+ * Take a flip context from the user's pool. Only when the client has more
+ * than TEGRA_DC_EXT_FLIP_POOL_SIZE flips in flight does this allocate.
+ */
+static struct tegra_dc_ext_flip_data *tegra_dc_ext_flip_data_get(
+	struct tegra_dc_ext_user *user)
+{
+	struct tegra_dc_ext_flip_data *data = NULL;
+
+	spin_lock(&user->flip_pool_lock);
+	if (user->nr_flip_pool)
+		data = user->flip_pool[--user->nr_flip_pool];
+	spin_unlock(&user->flip_pool_lock);
+
+	if (!data)
+		return kzalloc(sizeof(*data), GFP_KERNEL);
+
+	memset(data, 0, sizeof(*data));
+	data->pool_user = user;
+
+	return data;
+}
+
+static void tegra_dc_ext_flip_data_put(struct tegra_dc_ext_flip_data *data)
+{
+	struct tegra_dc_ext_user *user = data->pool_user;
+
+	if (!user) {
+		kfree(data);
+		return;
 	}
+
+	spin_lock(&user->flip_pool_lock);
+	user->flip_pool[user->nr_flip_pool++] = data;
+	wake_up(&user->flip_pool_wq);
+	spin_unlock(&user->flip_pool_lock);
+}
+
+static void tegra_dc_ext_flip_latency_add(struct tegra_dc_flip_latency *lat,
+					  ktime_t from, ktime_t to)
+{
+	u64 ns = ktime_to_ns(ktime_sub(to, from));
+
+	lat->total += ns;
+	if (ns > lat->max)
+		lat->max = ns;
+}
+
+static void tegra_dc_ext_flip_latency_account(struct tegra_dc *dc,
+	struct tegra_dc_ext_flip_data *data, ktime_t worker_ts,
+	ktime_t commit_ts, ktime_t vblank_ts)
+{
+	struct tegra_dc_flip_stats *stats = &dc->flip_stats;
+
+	spin_lock(&stats->latency_lock);
+	stats->latency_samples++;
+	tegra_dc_ext_flip_latency_add(&stats->to_worker, data->ioctl_ts,
+				      worker_ts);
+	tegra_dc_ext_flip_latency_add(&stats->to_commit, data->ioctl_ts,
+				      commit_ts);
+	tegra_dc_ext_flip_latency_add(&stats->to_vblank, data->ioctl_ts,
+				      vblank_ts);
+	spin_unlock(&stats->latency_lock);
 }
 
 static void tegra_dc_flip_trace(struct tegra_dc_ext_flip_data *data,
@@ -1010,6 +1162,110 @@ static void tegra_dc_ext_store_latency_msrmnt_info(struct tegra_dc *dc,
 	mutex_unlock(&dc->msrmnt_info.lock);
 }
 
+static struct tegra_dc_ext_flip_group *tegra_dc_ext_flip_group_alloc(
+	int nr_heads)
+{
+	struct tegra_dc_ext_flip_group *group;
+
+	group = kzalloc(sizeof(*group), GFP_KERNEL);
+	if (!group)
+		return NULL;
+
+	atomic_set(&group->pending, nr_heads);
+	atomic_set(&group->refs, 1);
+	init_waitqueue_head(&group->wq);
+
+	return group;
+}
+
+static void tegra_dc_ext_flip_group_put(struct tegra_dc_ext_flip_group *group)
+{
+	if (atomic_dec_and_test(&group->refs))
+		kfree(group);
+}
+
+/*
+ * Mark nr heads as having reached the release point. Also used to account
+ * for heads whose flip was dropped or never queued.
+ */
+static void tegra_dc_ext_flip_group_arrive(
+	struct tegra_dc_ext_flip_group *group, int nr)
+{
+	if (atomic_sub_and_test(nr, &group->pending))
+		wake_up_all(&group->wq);
+}
+
+static void tegra_dc_ext_flip_group_sync(struct tegra_dc *dc,
+	struct tegra_dc_ext_flip_group *group)
+{
+	tegra_dc_ext_flip_group_arrive(group, 1);
+
+	if (!wait_event_timeout(group->wq, atomic_read(&group->pending) <= 0,
+			msecs_to_jiffies(TEGRA_DC_EXT_FLIP_GROUP_TIMEOUT_MS)))
+		dev_warn(&dc->ndev->dev,
+			"multi-head flip release timed out, latching alone\n");
+}
+
+/*
+ * Hold back a flip whose windows are all in mailbox mode with a latch
+ * margin until that margin before the next vblank, once its pre-fences
+ * have signalled. A flip queued in the meantime replaces this one when the
+ * worker then processes the windows. Flips that are already replaced, or
+ * whose deadline has passed, go ahead right away.
+ *
+ * The frame end timestamp comes from tegra_dc_irq() on both T21x and
+ * nvdisplay; a latch margin keeps FRAME_END_INT unmasked so it stays
+ * current. Until the first frame end after the margin is set there is
+ * nothing to extrapolate from and the flip is not held back.
+ */
+static void tegra_dc_ext_flip_late_latch(struct tegra_dc_ext_flip_data *data)
+{
+	struct tegra_dc_ext *ext = data->ext;
+	struct tegra_dc *dc = ext->dc;
+	s64 now, frame_end, next_vblank, deadline;
+	u32 margin_us = 0;
+	ktime_t expires;
+	int i;
+
+	for (i = 0; i < data->act_window_num; i++) {
+		int index = data->win[i].attr.index;
+		struct tegra_dc_ext_win *ext_win;
+
+		if (index < 0 || !test_bit(index, &dc->valid_windows))
+			continue;
+
+		ext_win = &ext->win[index];
+		if (ext_win->flip_mode != TEGRA_DC_EXT_FLIP_QUEUE_MAILBOX ||
+			!ext_win->latch_margin_us ||
+			atomic_read(&ext_win->nr_pending_flips) > 1)
+			return;
+
+		margin_us = max(margin_us, ext_win->latch_margin_us);
+	}
+
+	if (!margin_us || !dc->frametime_ns || !dc->frame_end_timestamp)
+		return;
+
+	for (i = 0; i < data->act_window_num; i++)
+		tegra_dc_ext_wait_prefence(ext, &data->win[i]);
+
+	now = ktime_to_ns(ktime_get());
+	frame_end = dc->frame_end_timestamp;
+	if (now < frame_end)
+		return;
+
+	next_vblank = frame_end + dc->frametime_ns *
+		(div64_s64(now - frame_end, dc->frametime_ns) + 1);
+	deadline = next_vblank - (s64)margin_us * NSEC_PER_USEC;
+	if (deadline <= now)
+		return;
+
+	expires = ns_to_ktime(deadline);
+	set_current_state(TASK_UNINTERRUPTIBLE);
+	schedule_hrtimeout_range(&expires, 50 * NSEC_PER_USEC,
+				 HRTIMER_MODE_ABS);
+}
+
 static void tegra_dc_ext_flip_worker(struct kthread_work *work)
 {
 	struct tegra_dc_ext_flip_data *data =
@@ -1017,7 +1273,7 @@ static void tegra_dc_ext_flip_worker(struct kthread_work *work)
 	int win_num = data->act_window_num;
 	struct tegra_dc_ext *ext = data->ext;
 	struct tegra_dc_win *wins[DC_N_WINDOWS];
-	struct tegra_dc_win *blank_win;
+	struct tegra_dc_win *blank_win = &data->blank_win;
 	struct tegra_dc_dmabuf *unpin_handles[DC_N_WINDOWS *
 					       TEGRA_DC_NUM_PLANES];
 	struct tegra_dc_dmabuf *old_handle;
@@ -1029,13 +1285,30 @@ static void tegra_dc_ext_flip_worker(struct kthread_work *work)
 	bool show_background =
 		tegra_dc_ext_should_show_background(data, win_num);
 	struct tegra_dc_flip_buf_ele *flip_ele = data->flip_buf_ele;
+	ktime_t worker_ts = ktime_get(), commit_ts;
 
 	if (flip_ele)
 		flip_ele->state = TEGRA_DC_FLIP_STATE_DEQUEUED;
 
-	blank_win = kzalloc(sizeof(*blank_win), GFP_KERNEL);
-	if (!blank_win)
-		dev_err(&ext->dc->ndev->dev, "Failed to allocate blank_win.\n");
+	/* A cancelled flip only has to retire its syncpoints. */
+	if (data->cancelled) {
+		for (i = 0; i < win_num; i++) {
+			struct tegra_dc_ext_flip_win *flip_win = &data->win[i];
+			int index = flip_win->attr.index;
+
+			if (index < 0 || !test_bit(index, &dc->valid_windows))
+				continue;
+
+			atomic_dec(&ext->win[index].nr_pending_flips);
+			tegra_dc_incr_syncpt_min(dc, index,
+					flip_win->syncpt_max);
+		}
+		atomic64_inc(&dc->flip_stats.flips_skipped);
+		tegra_dc_ext_flip_abort(data);
+		return;
+	}
+
+	tegra_dc_ext_flip_late_latch(data);
 
 	tegra_dc_scrncapt_disp_pause_lock(dc);
 
@@ -1059,8 +1332,14 @@ static void tegra_dc_ext_flip_worker(struct kthread_work *work)
 			continue;
 		ext_win = &ext->win[index];
 
+		/*
+		 * Cursor updates and windows in mailbox mode only show the
+		 * newest of their queued flips.
+		 */
 		if (!(atomic_dec_and_test(&ext_win->nr_pending_flips)) &&
-			(flip_win->attr.flags & TEGRA_DC_EXT_FLIP_FLAG_CURSOR))
+			((flip_win->attr.flags &
+			  TEGRA_DC_EXT_FLIP_FLAG_CURSOR) ||
+			 ext_win->flip_mode == TEGRA_DC_EXT_FLIP_QUEUE_MAILBOX))
 			win_skip_flip = true;
 
 		mutex_lock(&ext_win->queue_lock);
@@ -1195,6 +1474,11 @@ static void tegra_dc_ext_flip_worker(struct kthread_work *work)
 
 		if (!win_skip_flip)
 			tegra_dc_ext_set_windowattr(ext, win, &data->win[i]);
+#ifdef CONFIG_TEGRA_GRHOST_SYNC
+		/* Mailbox mode skips flips routinely, don't leak the fence. */
+		if (win_skip_flip && flip_win->pre_syncpt_fence)
+			sync_fence_put(flip_win->pre_syncpt_fence);
+#endif
 
 		if (dc->yuv_bypass) {
 			reg_val = tegra_dc_readl(dc,
@@ -1211,7 +1495,7 @@ static void tegra_dc_ext_flip_worker(struct kthread_work *work)
 		/* Hijack first disabled, scaling capable window to host
 		 * the background pattern.
 		 */
-		if (blank_win && !ext_win->enabled && show_background &&
+		if (!ext_win->enabled && show_background &&
 			tegra_dc_feature_has_scaling(ext->dc, win->idx)) {
 			tegra_dc_ext_get_background(ext, blank_win);
 			blank_win->idx = win->idx;
@@ -1262,11 +1546,17 @@ static void tegra_dc_ext_flip_worker(struct kthread_work *work)
 		if (dc->yuv_bypass_dirty || dc->yuv_bypass)
 			dc->yuv_bypass_dirty = false;
 
+		if (data->group)
+			tegra_dc_ext_flip_group_sync(dc, data->group);
+
 		tegra_dc_update_windows(wins, nr_win,
 			data->dirty_rect_valid ? data->dirty_rect : NULL,
 			wait_for_vblank, lock_flip);
+		commit_ts = ktime_get();
 		/* TODO: implement swapinterval here */
 		tegra_dc_sync_windows(wins, nr_win);
+		tegra_dc_ext_flip_latency_account(dc, data, worker_ts,
+						  commit_ts, ktime_get());
 
 		if (flip_ele)
 			flip_ele->state = TEGRA_DC_FLIP_STATE_FLIPPED;
@@ -1290,6 +1580,10 @@ static void tegra_dc_ext_flip_worker(struct kthread_work *work)
 							data->imp_session_id);
 		}
 	} else {
+		/* Don't hold back the other heads of a multi-head flip. */
+		if (data->group)
+			tegra_dc_ext_flip_group_arrive(data->group, 1);
+
 		trace_dc_flip_dropped(dc->enabled, skip_flip);
 	}
 
@@ -1321,13 +1615,18 @@ static void tegra_dc_ext_flip_worker(struct kthread_work *work)
 	/* now DC has submitted buffer for display, try to release fbmem */
 	tegra_fb_release_fbmem(ext->dc->fb);
 #endif
-	kfree(data);
-	kfree(blank_win);
+	if (data->group)
+		tegra_dc_ext_flip_group_put(data->group);
+	tegra_dc_ext_flip_data_put(data);
 }
 
-static int lock_windows_for_flip(struct tegra_dc_ext_user *user,
+/*
+ * With nest_lock set, the windows are locked under that outer lock instead
+ * of by window index, so several heads' windows can be held at once.
+ */
+static int __lock_windows_for_flip(struct tegra_dc_ext_user *user,
 			struct tegra_dc_ext_flip_windowattr_v2 *win_attr,
-			int win_num)
+			int win_num, struct mutex *nest_lock)
 {
 	struct tegra_dc_ext *ext = user->ext;
 	u8 idx_mask = 0;
@@ -1350,7 +1649,10 @@ static int lock_windows_for_flip(struct tegra_dc_ext_user *user,
 
 		win = &ext->win[i];
 
-		mutex_lock_nested(&win->lock, i);
+		if (nest_lock)
+			mutex_lock_nest_lock(&win->lock, nest_lock);
+		else
+			mutex_lock_nested(&win->lock, i);
 
 		if (win->user != user) {
 			goto fail_unlock;
@@ -1370,6 +1672,13 @@ fail_unlock:
 	return -EACCES;
 }
 
+static int lock_windows_for_flip(struct tegra_dc_ext_user *user,
+			struct tegra_dc_ext_flip_windowattr_v2 *win_attr,
+			int win_num)
+{
+	return __lock_windows_for_flip(user, win_attr, win_num, NULL);
+}
+
 static void unlock_windows_for_flip(struct tegra_dc_ext_user *user,
 				struct tegra_dc_ext_flip_windowattr_v2 *win,
 				int win_num)
@@ -1520,6 +1829,7 @@ static int tegra_dc_ext_pin_windows(struct tegra_dc_ext_user *user,
 
 	for (i = 0; i < win_num; i++) {
 		struct tegra_dc_ext_flip_win *flip_win = &flip_wins[i];
+		struct tegra_dc_ext_win *ext_win;
 		int index = wins[i].index;
 
 		memcpy(&flip_win->attr, &wins[i], sizeof(flip_win->attr));
@@ -1537,15 +1847,17 @@ static int tegra_dc_ext_pin_windows(struct tegra_dc_ext_user *user,
 
 		if (index < 0 || !test_bit(index, &dc->valid_windows))
 			continue;
+		ext_win = &user->ext->win[index];
 
-		ret = tegra_dc_ext_pin_window(user, flip_win->attr.buff_id,
+		ret = tegra_dc_ext_pin_window_cached(user, ext_win,
+					      flip_win->attr.buff_id,
 					      &flip_win->handle[TEGRA_DC_Y],
 					      &flip_win->phys_addr);
 		if (ret)
 			return ret;
 
 		if (flip_win->attr.buff_id_u) {
-			ret = tegra_dc_ext_pin_window(user,
+			ret = tegra_dc_ext_pin_window_cached(user, ext_win,
 					      flip_win->attr.buff_id_u,
 					      &flip_win->handle[TEGRA_DC_U],
 					      &flip_win->phys_addr_u);
@@ -1557,7 +1869,7 @@ static int tegra_dc_ext_pin_windows(struct tegra_dc_ext_user *user,
 		}
 
 		if (flip_win->attr.buff_id_v) {
-			ret = tegra_dc_ext_pin_window(user,
+			ret = tegra_dc_ext_pin_window_cached(user, ext_win,
 					      flip_win->attr.buff_id_v,
 					      &flip_win->handle[TEGRA_DC_V],
 					      &flip_win->phys_addr_v);
@@ -1573,7 +1885,7 @@ static int tegra_dc_ext_pin_windows(struct tegra_dc_ext_user *user,
 			__u32 cde_buff_id = flip_win->attr.cde.buff_id;
 			if (!cde_buff_id)
 				cde_buff_id = flip_win->attr.buff_id;
-			ret = tegra_dc_ext_pin_window(user,
+			ret = tegra_dc_ext_pin_window_cached(user, ext_win,
 					      cde_buff_id,
 					      &flip_win->handle[TEGRA_DC_CDE],
 					      &flip_win->phys_addr_cde);
@@ -1883,21 +2195,48 @@ static int tegra_dc_ext_read_user_data(struct tegra_dc_ext_flip_data *data,
 	return ret;
 }
 
-static int tegra_dc_ext_flip(struct tegra_dc_ext_user *user,
-			     struct tegra_dc_ext_flip_windowattr_v2 *win,
-			     int win_num,
-			     __u32 *syncpt_id, __u32 *syncpt_val,
-			     int *syncpt_fd, __u16 *dirty_rect, u8 flip_flags,
-			     struct tegra_dc_ext_flip_user_data *flip_user_data,
-			     int nr_user_data, u64 *flip_id)
+static void tegra_dc_ext_flip_abort(struct tegra_dc_ext_flip_data *data)
+{
+	struct tegra_dc_ext *ext = data->ext;
+	int i;
+
+	for (i = 0; i < DC_N_WINDOWS; i++) {
+		int j;
+
+		for (j = 0; j < TEGRA_DC_NUM_PLANES; j++) {
+			if (data->win[i].handle[j])
+				tegra_dc_ext_unpin_dmabuf(
+					data->win[i].handle[j]);
+		}
+#ifdef CONFIG_TEGRA_GRHOST_SYNC
+		if (data->win[i].pre_syncpt_fence)
+			sync_fence_put(data->win[i].pre_syncpt_fence);
+#endif
+	}
+
+	/* Release the COMMON channel in case of failure. */
+	if (data->imp_dirty)
+		tegra_dc_release_common_channel(ext->dc);
+
+	tegra_dc_ext_flip_data_put(data);
+}
+
+/*
+ * Validate a flip request and pin its buffers. Nothing is visible to the
+ * flip workers yet; on success the caller either hands the returned data to
+ * tegra_dc_ext_flip_commit() or releases it with tegra_dc_ext_flip_abort().
+ */
+static int tegra_dc_ext_flip_prepare(struct tegra_dc_ext_user *user,
+			struct tegra_dc_ext_flip_windowattr_v2 *win,
+			int win_num, __u16 *dirty_rect, bool syncpt_fd,
+			struct tegra_dc_ext_flip_user_data *flip_user_data,
+			int nr_user_data, struct tegra_dc_ext_flip_data **out)
 {
 	struct tegra_dc_ext *ext = user->ext;
 	struct tegra_dc_ext_flip_data *data;
-	int work_index = -1;
-	__u32 post_sync_val = 0, post_sync_id = NVSYNCPT_INVALID;
-	int i, ret = 0;
 	bool has_timestamp = false;
-	u64 flip_id_local;
+	ktime_t ioctl_ts = ktime_get();
+	int ret;
 
 	/* If display has been disconnected return with error. */
 	if (!ext->dc->connected)
@@ -1906,13 +2245,14 @@ static int tegra_dc_ext_flip(struct tegra_dc_ext_user *user,
 	if (ret)
 		return ret;
 
-	data = kzalloc(sizeof(*data), GFP_KERNEL);
+	data = tegra_dc_ext_flip_data_get(user);
 	if (!data)
 		return -ENOMEM;
 
 	kthread_init_work(&data->work, &tegra_dc_ext_flip_worker);
 	data->ext = ext;
 	data->act_window_num = win_num;
+	data->ioctl_ts = ioctl_ts;
 
 	if (dirty_rect) {
 		memcpy(data->dirty_rect, dirty_rect, sizeof(data->dirty_rect));
@@ -1923,9 +2263,10 @@ static int tegra_dc_ext_flip(struct tegra_dc_ext_user *user,
 
 	ret = tegra_dc_ext_pin_windows(user, win, win_num,
 				     data->win, &has_timestamp,
-				     syncpt_fd != NULL);
+				     syncpt_fd);
 	if (ret)
 		goto fail_pin;
+	data->has_timestamp = has_timestamp;
 
 	ret = tegra_dc_ext_read_user_data(data, flip_user_data, nr_user_data);
 	if (ret)
@@ -1957,18 +2298,33 @@ static int tegra_dc_ext_flip(struct tegra_dc_ext_user *user,
 							data->imp_session_id);
 	}
 
-	ret = lock_windows_for_flip(user, win, win_num);
-	if (ret)
-		goto fail_pin;
+	*out = data;
 
-	if (!ext->enabled) {
-		ret = -ENXIO;
-		goto unlock;
-	}
+	return 0;
+
+fail_pin:
+	tegra_dc_ext_flip_abort(data);
+
+	return ret;
+}
+
+/*
+ * Check that a prepared flip can be queued right now. Must be called with
+ * the flip's windows locked; nothing is changed on failure.
+ */
+static int tegra_dc_ext_flip_check(struct tegra_dc_ext_user *user,
+			     struct tegra_dc_ext_flip_windowattr_v2 *win,
+			     int win_num)
+{
+	struct tegra_dc_ext *ext = user->ext;
+	bool has_win = false;
+	int i;
+
+	if (!ext->enabled)
+		return -ENXIO;
 
 	BUG_ON(win_num > tegra_dc_get_numof_dispwindows());
 	for (i = 0; i < win_num; i++) {
-		u32 syncpt_max;
 		int index = win[i].index;
 		struct tegra_dc_ext_win *ext_win;
 
@@ -1976,6 +2332,41 @@ static int tegra_dc_ext_flip(struct tegra_dc_ext_user *user,
 			continue;
 
 		ext_win = &ext->win[index];
+		/* in mailbox mode a new flip replaces the unlatched one */
+		if (ext_win->flip_mode == TEGRA_DC_EXT_FLIP_QUEUE_FIFO &&
+			ext_win->flip_depth &&
+			atomic_read(&ext_win->nr_pending_flips) >=
+			ext_win->flip_depth)
+			return -EAGAIN;
+
+		has_win = true;
+	}
+
+	return has_win ? 0 : -EINVAL;
+}
+
+/*
+ * Assign syncpoints to a checked flip. Returns the window whose flip worker
+ * runs the flip, and the post syncpoint the client should wait for.
+ */
+static int tegra_dc_ext_flip_assign(struct tegra_dc_ext_user *user,
+			     struct tegra_dc_ext_flip_data *data,
+			     struct tegra_dc_ext_flip_windowattr_v2 *win,
+			     int win_num, u32 *post_sync_id, u32 *post_sync_val)
+{
+	struct tegra_dc_ext *ext = user->ext;
+	int work_index = -1;
+	int i;
+
+	*post_sync_id = NVSYNCPT_INVALID;
+	*post_sync_val = 0;
+
+	for (i = 0; i < win_num; i++) {
+		u32 syncpt_max;
+		int index = win[i].index;
+
+		if (index < 0 || !test_bit(index, &ext->dc->valid_windows))
+			continue;
 
 		syncpt_max = tegra_dc_incr_syncpt_max(ext->dc, index);
 
@@ -1985,50 +2376,35 @@ static int tegra_dc_ext_flip(struct tegra_dc_ext_user *user,
 		 * Any of these windows' syncpoints should be equivalent for
 		 * the client, so we just send back an arbitrary one of them
 		 */
-		post_sync_val = syncpt_max;
-		post_sync_id = tegra_dc_get_syncpt_id(ext->dc, index);
+		*post_sync_val = syncpt_max;
+		*post_sync_id = tegra_dc_get_syncpt_id(ext->dc, index);
 
 		work_index = index;
 
 		atomic_inc(&ext->win[work_index].nr_pending_flips);
 	}
-	if (work_index < 0) {
-		ret = -EINVAL;
-		goto unlock;
-	}
 #ifdef CONFIG_ANDROID
-	work_index = ffs(ext->dc->valid_windows);
-	if (!work_index) {
-		dev_err(&ext->dc->ndev->dev, "no valid window\n");
-		ret = -EINVAL;
-		goto unlock;
-	}
-	work_index -= 1; /* window index starts from 0 */
+	/* window index starts from 0 */
+	work_index = ffs(ext->dc->valid_windows) - 1;
 #endif
 
-	if (syncpt_fd) {
-		if (post_sync_id != NVSYNCPT_INVALID) {
-			ret = nvhost_syncpt_create_fence_single_ext(
-					ext->dc->ndev, post_sync_id,
-					post_sync_val + 1, "flip-fence",
-					syncpt_fd);
-			if (ret) {
-				dev_err(&ext->dc->ndev->dev,
-					"Failed creating fence err:%d\n", ret);
-				goto unlock;
-			}
-		}
-	} else {
-		*syncpt_val = post_sync_val;
-		*syncpt_id = post_sync_id;
-	}
-
-	if (trace_flip_rcvd_syncpt_upd_enabled())
-		tegra_dc_flip_trace(data, trace_flip_rcvd_syncpt_upd);
+	return work_index;
+}
+
+/* Hand an assigned flip to its flip worker. */
+static void tegra_dc_ext_flip_queue(struct tegra_dc_ext_user *user,
+			     struct tegra_dc_ext_flip_data *data,
+			     int work_index, u8 flip_flags, u64 *flip_id)
+{
+	struct tegra_dc_ext *ext = user->ext;
+	u64 flip_id_local;
+
+	if (trace_flip_rcvd_syncpt_upd_enabled())
+		tegra_dc_flip_trace(data, trace_flip_rcvd_syncpt_upd);
 
 	/* Avoid queueing timestamps on Android, to disable skipping flips */
 #ifndef CONFIG_ANDROID
-	if (has_timestamp) {
+	if (data->has_timestamp) {
 		mutex_lock(&ext->win[work_index].queue_lock);
 		list_add_tail(&data->timestamp_node, &ext->win[work_index].timestamp_queue);
 		mutex_unlock(&ext->win[work_index].queue_lock);
@@ -2057,37 +2433,110 @@ static int tegra_dc_ext_flip(struct tegra_dc_ext_user *user,
 		data->flip_buf_ele = in_q_ptr;
 	}
 
-	kthread_queue_work(&ext->win[work_index].flip_worker, &data->work);
+	if (data->group)
+		atomic_inc(&data->group->refs);
 
-	unlock_windows_for_flip(user, win, win_num);
+	kthread_queue_work(&ext->win[work_index].flip_worker, &data->work);
+}
 
-	return 0;
+/*
+ * Drop an assigned flip that must not be shown. It still goes through its
+ * flip worker, which only retires the syncpoints, so that they advance in
+ * order with the flips queued before it.
+ */
+static void tegra_dc_ext_flip_cancel(struct tegra_dc_ext_user *user,
+			     struct tegra_dc_ext_flip_data *data,
+			     int work_index)
+{
+	data->cancelled = true;
+	data->group = NULL;
 
-unlock:
-	unlock_windows_for_flip(user, win, win_num);
+	kthread_queue_work(&user->ext->win[work_index].flip_worker,
+			   &data->work);
+}
 
-fail_pin:
+/*
+ * Assign syncpoints to a prepared flip and queue it to the flip worker.
+ * Must be called with the flip's windows locked and after
+ * tegra_dc_ext_flip_check() succeeded. The data is consumed either way:
+ * if the post-fence cannot be created the flip is cancelled.
+ */
+static int tegra_dc_ext_flip_commit(struct tegra_dc_ext_user *user,
+			     struct tegra_dc_ext_flip_data *data,
+			     struct tegra_dc_ext_flip_windowattr_v2 *win,
+			     int win_num,
+			     __u32 *syncpt_id, __u32 *syncpt_val,
+			     int *syncpt_fd, u8 flip_flags, u64 *flip_id)
+{
+	struct tegra_dc_ext *ext = user->ext;
+	u32 post_sync_id, post_sync_val;
+	int work_index;
+	int ret;
 
-	for (i = 0; i < win_num; i++) {
-		int j;
-		for (j = 0; j < TEGRA_DC_NUM_PLANES; j++) {
-			if (!data->win[i].handle[j])
-				continue;
+	work_index = tegra_dc_ext_flip_assign(user, data, win, win_num,
+					      &post_sync_id, &post_sync_val);
 
-			dma_buf_unmap_attachment(data->win[i].handle[j]->attach,
-				data->win[i].handle[j]->sgt, DMA_TO_DEVICE);
-			dma_buf_detach(data->win[i].handle[j]->buf,
-				data->win[i].handle[j]->attach);
-			dma_buf_put(data->win[i].handle[j]->buf);
-			kfree(data->win[i].handle[j]);
+	if (syncpt_fd) {
+		if (post_sync_id != NVSYNCPT_INVALID) {
+			ret = nvhost_syncpt_create_fence_single_ext(
+					ext->dc->ndev, post_sync_id,
+					post_sync_val + 1, "flip-fence",
+					syncpt_fd);
+			if (ret) {
+				dev_err(&ext->dc->ndev->dev,
+					"Failed creating fence err:%d\n", ret);
+				tegra_dc_ext_flip_cancel(user, data,
+							 work_index);
+				return ret;
+			}
 		}
+	} else {
+		*syncpt_val = post_sync_val;
+		*syncpt_id = post_sync_id;
 	}
 
-	/* Release the COMMON channel in case of failure. */
-	if (data->imp_dirty)
-		tegra_dc_release_common_channel(ext->dc);
+	tegra_dc_ext_flip_queue(user, data, work_index, flip_flags, flip_id);
 
-	kfree(data);
+	return 0;
+}
+
+static int tegra_dc_ext_flip(struct tegra_dc_ext_user *user,
+			     struct tegra_dc_ext_flip_windowattr_v2 *win,
+			     int win_num,
+			     __u32 *syncpt_id, __u32 *syncpt_val,
+			     int *syncpt_fd, __u16 *dirty_rect, u8 flip_flags,
+			     struct tegra_dc_ext_flip_user_data *flip_user_data,
+			     int nr_user_data, u64 *flip_id)
+{
+	struct tegra_dc_ext_flip_data *data;
+	int ret;
+
+	ret = tegra_dc_ext_flip_prepare(user, win, win_num, dirty_rect,
+				syncpt_fd != NULL, flip_user_data,
+				nr_user_data, &data);
+	if (ret)
+		return ret;
+
+	ret = lock_windows_for_flip(user, win, win_num);
+	if (ret)
+		goto fail_pin;
+
+	ret = tegra_dc_ext_flip_check(user, win, win_num);
+	if (ret)
+		goto unlock;
+
+	ret = tegra_dc_ext_flip_commit(user, data, win, win_num, syncpt_id,
+				syncpt_val, syncpt_fd, flip_flags, flip_id);
+
+	unlock_windows_for_flip(user, win, win_num);
+
+	return ret;
+
+unlock:
+	unlock_windows_for_flip(user, win, win_num);
+
+fail_pin:
+	tegra_dc_ext_flip_abort(data);
 
 	return ret;
 }
@@ -2788,6 +3237,572 @@ static int tegra_dc_copy_flip_id_to_user(struct tegra_dc_ext_flip_4 *args,
 	return 0;
 }
 
+/*
+ * Post-fence of one head of a multi-head flip. The fd is reserved and the
+ * fence created before any head is queued, and the fence is installed only
+ * once every head is, so a failure leaves nothing in the caller's fd table.
+ */
+struct tegra_dc_ext_flip_fence {
+	int					fd;
+	struct sync_fence			*fence;
+};
+
+/* One head's FLIP4 request, copied in from userspace. */
+struct tegra_dc_ext_flip_req {
+	struct tegra_dc_ext_user		*user;
+	struct file				*file;
+	struct tegra_dc_ext_flip_4		args;
+	struct tegra_dc_ext_flip_windowattr_v2	*win;
+	struct tegra_dc_ext_flip_user_data	*user_data;
+	int					nr_user_data;
+	u32					usr_win_size;
+	u32					*syncpt_id;
+	u32					*syncpt_val;
+	int					*syncpt_fd;
+	int					syncpt_idx;
+	u64					flip_id;
+	struct tegra_dc_ext_flip_data		*data;
+	/* win and user_data point into the user's inline copy-in buffers */
+	bool					inline_bufs;
+	int					work_index;
+	u32					post_sync_id;
+	u32					post_sync_val;
+	struct tegra_dc_ext_flip_fence		fence;
+};
+
+static int tegra_dc_ext_flip_fence_reserve(struct tegra_dc_ext_flip_fence *f)
+{
+	f->fence = NULL;
+	f->fd = get_unused_fd_flags(O_CLOEXEC);
+
+	return f->fd < 0 ? f->fd : 0;
+}
+
+static int tegra_dc_ext_flip_fence_create(struct tegra_dc *dc,
+				struct tegra_dc_ext_flip_fence *f,
+				u32 id, u32 thresh)
+{
+#ifdef CONFIG_TEGRA_GRHOST_SYNC
+	struct nvhost_ctrl_sync_fence_info pts = { id, thresh };
+	struct sync_fence *fence;
+
+	/* Like a single flip, no syncpoint means no fence is returned. */
+	if (id == NVSYNCPT_INVALID)
+		return 0;
+
+	fence = nvhost_sync_create_fence(dc->ndev, &pts, 1, "flip-fence");
+	if (IS_ERR(fence)) {
+		dev_err(&dc->ndev->dev, "Failed creating fence err:%ld\n",
+			PTR_ERR(fence));
+		return PTR_ERR(fence);
+	}
+	f->fence = fence;
+
+	return 0;
+#else
+	return -EINVAL;
+#endif
+}
+
+static void tegra_dc_ext_flip_fence_release(struct tegra_dc_ext_flip_fence *f)
+{
+#ifdef CONFIG_TEGRA_GRHOST_SYNC
+	if (f->fence)
+		sync_fence_put(f->fence);
+#endif
+	if (f->fd >= 0)
+		put_unused_fd(f->fd);
+	f->fence = NULL;
+	f->fd = -1;
+}
+
+static void tegra_dc_ext_flip_fence_install(struct tegra_dc_ext_flip_fence *f,
+				int *fence_fd)
+{
+#ifdef CONFIG_TEGRA_GRHOST_SYNC
+	if (f->fence) {
+		sync_fence_install(f->fence, f->fd);
+		*fence_fd = f->fd;
+		f->fence = NULL;
+		f->fd = -1;
+	}
+#endif
+	/* the fd stays unused if there was no syncpoint to fence */
+	tegra_dc_ext_flip_fence_release(f);
+}
+
+static int tegra_dc_ext_flip_req_copy_in(struct tegra_dc_ext_flip_req *req)
+{
+	struct tegra_dc_ext_flip_4 *args = &req->args;
+	int ret;
+
+	req->usr_win_size = sizeof(struct tegra_dc_ext_flip_windowattr);
+	if (args->flags & TEGRA_DC_EXT_FLIP_HEAD_FLAG_V2_ATTR)
+		req->usr_win_size =
+			sizeof(struct tegra_dc_ext_flip_windowattr_v2);
+
+	req->nr_user_data = args->nr_elements;
+
+	/*
+	 * A request that fits uses the user's preallocated copy-in buffers,
+	 * unless another flip ioctl on the same fd holds them.
+	 */
+	if (args->win_num <= ARRAY_SIZE(req->user->flip_req_win) &&
+		req->nr_user_data <=
+			ARRAY_SIZE(req->user->flip_req_user_data) &&
+		!test_and_set_bit_lock(0, &req->user->flip_req_busy)) {
+		req->inline_bufs = true;
+		req->win = req->user->flip_req_win;
+		req->user_data = req->user->flip_req_user_data;
+		memset(req->win, 0, sizeof(*req->win) * args->win_num);
+	} else {
+		req->win = kcalloc(args->win_num, sizeof(*req->win),
+				   GFP_KERNEL);
+		if (!req->win)
+			return -ENOMEM;
+
+		req->user_data = kcalloc(req->nr_user_data,
+					 sizeof(*req->user_data), GFP_KERNEL);
+		if (!req->user_data)
+			return -ENOMEM;
+	}
+
+	if (dev_cpy_from_usr(req->win, (void *)args->win,
+				req->usr_win_size, args->win_num))
+		return -EFAULT;
+
+	if (req->nr_user_data > 0) {
+		if (copy_from_user(req->user_data,
+			(void __user *) (uintptr_t)args->data,
+			sizeof(*req->user_data) * req->nr_user_data))
+			return -EFAULT;
+	}
+
+	/*
+	 * Check if the client is explicitly requesting syncpts via flip
+	 * user data. If so, populate the syncpt variables accordingly.
+	 * Else, default to sync fds and use the original post_syncpt_fd
+	 * fence.
+	 */
+	req->syncpt_idx = -1;
+	ret = tegra_dc_copy_syncpts_from_user(req->user->ext->dc,
+		req->user_data, req->nr_user_data, &req->syncpt_id,
+		&req->syncpt_val, &req->syncpt_fd, &req->syncpt_idx);
+	if (ret)
+		return ret;
+
+	if (req->syncpt_idx == -1)
+		req->syncpt_fd = &args->post_syncpt_fd;
+
+	return 0;
+}
+
+static int tegra_dc_ext_flip_req_copy_out(struct tegra_dc_ext_flip_req *req,
+					  void __user *user_args)
+{
+	int ret;
+
+	/*
+	 * If the client requested post syncpt values via user data,
+	 * copy them back.
+	 */
+	if (req->syncpt_idx > -1) {
+		req->args.post_syncpt_fd = -1;
+		ret = tegra_dc_copy_syncpts_to_user(req->user_data,
+				req->syncpt_idx, (u8 *)(void *)req->args.data);
+		if (ret)
+			return ret;
+	}
+
+	if (dev_cpy_to_usr((void *)req->args.win, req->usr_win_size,
+				req->win, req->args.win_num) ||
+		copy_to_user(user_args, &req->args, sizeof(req->args)))
+		return -EFAULT;
+
+	return tegra_dc_copy_flip_id_to_user(&req->args, req->user_data,
+					     req->nr_user_data, req->flip_id);
+}
+
+static void tegra_dc_ext_flip_req_free(struct tegra_dc_ext_flip_req *req)
+{
+	if (req->inline_bufs) {
+		clear_bit_unlock(0, &req->user->flip_req_busy);
+		return;
+	}
+
+	kfree(req->user_data);
+	kfree(req->win);
+}
+
+#ifdef CONFIG_TEGRA_ISOMGR
+static int tegra_dc_ext_negotiate_bw_heads(struct tegra_dc_ext_flip_req *reqs,
+					   int nr_heads,
+					   struct tegra_dc_bw_undo *undo)
+{
+	struct tegra_dc_win *head_wins[TEGRA_DC_EXT_FLIP_MULTI_MAX_HEADS]
+				      [DC_N_WINDOWS];
+	struct tegra_dc_win **windows[TEGRA_DC_EXT_FLIP_MULTI_MAX_HEADS];
+	struct tegra_dc *dcs[TEGRA_DC_EXT_FLIP_MULTI_MAX_HEADS];
+	int n[TEGRA_DC_EXT_FLIP_MULTI_MAX_HEADS];
+	int i, j;
+
+	for (i = 0; i < nr_heads; i++) {
+		struct tegra_dc *dc = reqs[i].user->ext->dc;
+		struct tegra_dc_ext_flip_windowattr_v2 *wins = reqs[i].win;
+
+		dcs[i] = dc;
+		windows[i] = head_wins[i];
+		n[i] = 0;
+
+		for (j = 0; j < reqs[i].args.win_num; j++) {
+			int idx = wins[j].index;
+
+			if (idx < 0)
+				continue;
+
+			if (wins[j].buff_id > 0) {
+				tegra_dc_ext_set_windowattr_basic(
+					&dc->tmp_wins[idx], &wins[j]);
+			} else {
+				dc->tmp_wins[idx].flags = 0;
+				dc->tmp_wins[idx].new_bandwidth = 0;
+			}
+			head_wins[i][n[i]++] = &dc->tmp_wins[idx];
+		}
+	}
+
+	return tegra_dc_bandwidth_negotiate_bw_heads(dcs, windows, n,
+						     nr_heads, undo);
+}
+
+static void tegra_dc_ext_undo_bw_heads(struct tegra_dc_ext_flip_req *reqs,
+				       int nr_heads,
+				       struct tegra_dc_bw_undo *undo)
+{
+	struct tegra_dc *dcs[TEGRA_DC_EXT_FLIP_MULTI_MAX_HEADS];
+	int i;
+
+	for (i = 0; i < nr_heads; i++)
+		dcs[i] = reqs[i].user->ext->dc;
+
+	tegra_dc_bandwidth_undo_heads(dcs, undo, nr_heads);
+}
+#endif
+
+static const struct file_operations tegra_dc_devops;
+
+/*
+ * Serializes queueing of multi-head flips, so that every head sees the
+ * flip groups in the same order, and is the outer lock for holding the
+ * windows of several heads at once.
+ */
+static DEFINE_MUTEX(tegra_dc_ext_flip_multi_lock);
+
+/*
+ * Flip several heads as one update. Every head is copied in, validated and
+ * pinned, and the combined bandwidth is reserved, before any of them is
+ * queued. Then the windows of all heads are locked and every head is
+ * checked, so either all heads are queued or none is; if none is, the
+ * bandwidth reserved for them is given back. The queued flips share a flip
+ * group, so no head latches its windows until the flips of all heads are
+ * ready to.
+ */
+static int tegra_dc_ext_flip_multi(struct tegra_dc_ext_user *user,
+				   void __user *user_arg)
+{
+	struct tegra_dc_ext_flip_multi args;
+	struct tegra_dc_ext_flip_multi_head *heads = NULL;
+	struct tegra_dc_ext_flip_req *reqs = NULL;
+	struct tegra_dc_ext_flip_group *group = NULL;
+	int order[TEGRA_DC_EXT_FLIP_MULTI_MAX_HEADS];
+#ifdef CONFIG_TEGRA_ISOMGR
+	struct tegra_dc_bw_undo bw_undo[TEGRA_DC_EXT_FLIP_MULTI_MAX_HEADS];
+#endif
+	bool imp_tagged = false;
+	int nr_prepared = 0, nr_locked = 0;
+	int i, j, ret = 0;
+
+	if (copy_from_user(&args, user_arg, sizeof(args)))
+		return -EFAULT;
+
+	if (!args.nr_heads ||
+		args.nr_heads > TEGRA_DC_EXT_FLIP_MULTI_MAX_HEADS ||
+		memchr_inv(args.reserved, 0, sizeof(args.reserved)))
+		return -EINVAL;
+
+	heads = kcalloc(args.nr_heads, sizeof(*heads), GFP_KERNEL);
+	reqs = kcalloc(args.nr_heads, sizeof(*reqs), GFP_KERNEL);
+	if (!heads || !reqs) {
+		ret = -ENOMEM;
+		goto free;
+	}
+
+	if (copy_from_user(heads, (void __user *)(uintptr_t)args.heads,
+			   sizeof(*heads) * args.nr_heads)) {
+		ret = -EFAULT;
+		goto free;
+	}
+
+	for (i = 0; i < args.nr_heads; i++) {
+		struct tegra_dc_ext_flip_req *req = &reqs[i];
+
+		if (heads[i].reserved) {
+			ret = -EINVAL;
+			goto put_files;
+		}
+
+		if (heads[i].dc_fd == -1) {
+			req->user = user;
+		} else {
+			req->file = fget(heads[i].dc_fd);
+			if (!req->file || req->file->f_op != &tegra_dc_devops) {
+				ret = -EBADF;
+				goto put_files;
+			}
+			req->user = req->file->private_data;
+		}
+
+		for (j = 0; j < i; j++) {
+			if (reqs[j].user->ext == req->user->ext) {
+				ret = -EINVAL;
+				goto put_files;
+			}
+		}
+
+		req->args = heads[i].flip;
+		req->fence.fd = -1;
+	}
+
+	for (i = 0; i < args.nr_heads; i++) {
+		ret = tegra_dc_ext_flip_req_copy_in(&reqs[i]);
+		if (ret)
+			goto free_reqs;
+
+		/* Only one head at a time can own the COMMON channel. */
+		for (j = 0; j < reqs[i].nr_user_data; j++) {
+			if (reqs[i].user_data[j].data_type !=
+					TEGRA_DC_EXT_FLIP_USER_DATA_IMP_TAG)
+				continue;
+
+			if (imp_tagged) {
+				ret = -EINVAL;
+				goto free_reqs;
+			}
+			imp_tagged = true;
+			break;
+		}
+	}
+
+	/* Validate every window of every head before anything is pinned. */
+	for (i = 0; i < args.nr_heads; i++) {
+		struct tegra_dc_ext_flip_req *req = &reqs[i];
+		struct tegra_dc *dc = req->user->ext->dc;
+		__u16 *dirty_rect = req->args.dirty_rect;
+		bool bypass;
+
+		bypass = !!(req->args.flags &
+			    TEGRA_DC_EXT_FLIP_HEAD_FLAG_YUVBYPASS);
+		if (tegra_dc_is_t21x() &&
+			!!(dc->mode.vmode & FB_VMODE_YUV_MASK) != bypass) {
+			ret = -EINVAL;
+			goto free_reqs;
+		}
+
+		ret = sanitize_flip_args(req->user, req->win,
+					 req->args.win_num, &dirty_rect);
+		if (ret)
+			goto free_reqs;
+	}
+
+#ifdef CONFIG_TEGRA_ISOMGR
+	ret = tegra_dc_ext_negotiate_bw_heads(reqs, args.nr_heads, bw_undo);
+	if (ret)
+		goto free_reqs;
+#endif
+
+	group = tegra_dc_ext_flip_group_alloc(args.nr_heads);
+	if (!group) {
+		ret = -ENOMEM;
+#ifdef CONFIG_TEGRA_ISOMGR
+		tegra_dc_ext_undo_bw_heads(reqs, args.nr_heads, bw_undo);
+#endif
+		goto free_reqs;
+	}
+
+	for (; nr_prepared < args.nr_heads; nr_prepared++) {
+		struct tegra_dc_ext_flip_req *req = &reqs[nr_prepared];
+
+		ret = tegra_dc_ext_flip_prepare(req->user, req->win,
+				req->args.win_num, req->args.dirty_rect,
+				req->syncpt_fd != NULL, req->user_data,
+				req->nr_user_data, &req->data);
+		if (ret)
+			goto abort;
+	}
+
+	/* Lock the windows of every head, in ctrl_num order. */
+	for (i = 0; i < args.nr_heads; i++) {
+		order[i] = i;
+		for (j = i; j > 0; j--) {
+			if (reqs[order[j - 1]].user->ext->dc->ctrl_num <
+			    reqs[order[j]].user->ext->dc->ctrl_num)
+				break;
+			swap(order[j - 1], order[j]);
+		}
+	}
+
+	mutex_lock(&tegra_dc_ext_flip_multi_lock);
+
+	for (; nr_locked < args.nr_heads; nr_locked++) {
+		struct tegra_dc_ext_flip_req *req = &reqs[order[nr_locked]];
+
+		ret = __lock_windows_for_flip(req->user, req->win,
+					req->args.win_num,
+					&tegra_dc_ext_flip_multi_lock);
+		if (ret)
+			goto unlock;
+	}
+
+	/* Nothing is queued unless every head can be. */
+	for (i = 0; i < args.nr_heads; i++) {
+		struct tegra_dc_ext_flip_req *req = &reqs[i];
+
+		ret = tegra_dc_ext_flip_check(req->user, req->win,
+					      req->args.win_num);
+		if (ret)
+			goto unlock;
+	}
+
+	for (i = 0; i < args.nr_heads; i++) {
+		if (!reqs[i].syncpt_fd)
+			continue;
+
+		ret = tegra_dc_ext_flip_fence_reserve(&reqs[i].fence);
+		if (ret)
+			goto release_fences;
+	}
+
+	for (i = 0; i < args.nr_heads; i++) {
+		struct tegra_dc_ext_flip_req *req = &reqs[i];
+
+		req->work_index = tegra_dc_ext_flip_assign(req->user,
+				req->data, req->win, req->args.win_num,
+				&req->post_sync_id, &req->post_sync_val);
+	}
+
+	for (i = 0; i < args.nr_heads; i++) {
+		struct tegra_dc_ext_flip_req *req = &reqs[i];
+
+		if (!req->syncpt_fd)
+			continue;
+
+		ret = tegra_dc_ext_flip_fence_create(req->user->ext->dc,
+				&req->fence, req->post_sync_id,
+				req->post_sync_val + 1);
+		if (ret)
+			goto cancel;
+	}
+
+	for (i = 0; i < args.nr_heads; i++) {
+		struct tegra_dc_ext_flip_req *req = &reqs[i];
+		struct tegra_dc *dc = req->user->ext->dc;
+		bool bypass;
+
+		bypass = !!(req->args.flags &
+			    TEGRA_DC_EXT_FLIP_HEAD_FLAG_YUVBYPASS);
+		if (bypass != dc->yuv_bypass)
+			dc->yuv_bypass_dirty = true;
+		dc->yuv_bypass = bypass;
+
+		if (req->syncpt_fd) {
+			tegra_dc_ext_flip_fence_install(&req->fence,
+							req->syncpt_fd);
+		} else {
+			*req->syncpt_id = req->post_sync_id;
+			*req->syncpt_val = req->post_sync_val;
+		}
+
+		req->data->group = group;
+		tegra_dc_ext_flip_queue(req->user, req->data,
+				req->work_index, req->args.flags,
+				&req->flip_id);
+
+		/* The flip worker owns the data from here on. */
+		req->data = NULL;
+	}
+
+	goto unlock;
+
+cancel:
+	/* Syncpoints are assigned, let the workers retire them. */
+	for (i = 0; i < args.nr_heads; i++) {
+		tegra_dc_ext_flip_cancel(reqs[i].user, reqs[i].data,
+					 reqs[i].work_index);
+		reqs[i].data = NULL;
+	}
+
+release_fences:
+	for (i = 0; i < args.nr_heads; i++)
+		tegra_dc_ext_flip_fence_release(&reqs[i].fence);
+
+unlock:
+	while (nr_locked--) {
+		struct tegra_dc_ext_flip_req *req = &reqs[order[nr_locked]];
+
+		unlock_windows_for_flip(req->user, req->win,
+					req->args.win_num);
+	}
+
+	mutex_unlock(&tegra_dc_ext_flip_multi_lock);
+
+	if (ret)
+		goto abort;
+
+	for (i = 0; i < args.nr_heads; i++) {
+		void __user *head_args = (void __user *)(uintptr_t)args.heads +
+			sizeof(*heads) * i +
+			offsetof(struct tegra_dc_ext_flip_multi_head, flip);
+
+		ret = tegra_dc_ext_flip_req_copy_out(&reqs[i], head_args);
+		if (ret)
+			break;
+	}
+
+	goto put_group;
+
+abort:
+#ifdef CONFIG_TEGRA_ISOMGR
+	/* nothing was queued, give back what the heads reserved */
+	tegra_dc_ext_undo_bw_heads(reqs, args.nr_heads, bw_undo);
+#endif
+	for (i = 0; i < nr_prepared; i++) {
+		if (!reqs[i].data)
+			continue;
+
+		reqs[i].data->group = NULL;
+		tegra_dc_ext_flip_abort(reqs[i].data);
+	}
+
+put_group:
+	tegra_dc_ext_flip_group_put(group);
+
+free_reqs:
+	for (i = 0; i < args.nr_heads; i++)
+		tegra_dc_ext_flip_req_free(&reqs[i]);
+
+put_files:
+	for (i = 0; i < args.nr_heads; i++) {
+		if (reqs[i].file)
+			fput(reqs[i].file);
+	}
+
+free:
+	kfree(reqs);
+	kfree(heads);
+
+	return ret;
+}
+
 static long tegra_dc_ioctl(struct file *filp, unsigned int cmd,
 			   unsigned long arg)
 {
@@ -2805,6 +3820,16 @@ static long tegra_dc_ioctl(struct file *filp, unsigned int cmd,
 		ret = tegra_dc_ext_put_window(user, arg);
 		return ret;
 
+	case TEGRA_DC_EXT_SET_FLIP_QUEUE:
+	{
+		struct tegra_dc_ext_flip_queue args;
+
+		if (copy_from_user(&args, user_arg, sizeof(args)))
+			return -EFAULT;
+
+		return tegra_dc_ext_set_flip_queue(user, &args);
+	}
+
 	case TEGRA_DC_EXT_GET_WINMASK:
 	{
 		u32 winmask = tegra_dc_ext_get_winmask(user);
@@ -2820,23 +3845,14 @@ static long tegra_dc_ioctl(struct file *filp, unsigned int cmd,
 	case TEGRA_DC_EXT_FLIP4:
 	{
 		int ret;
-		int win_num;
-		int nr_user_data;
-		struct tegra_dc_ext_flip_4 args;
-		struct tegra_dc_ext_flip_windowattr_v2 *win;
-		struct tegra_dc_ext_flip_user_data *flip_user_data;
+		struct tegra_dc_ext_flip_req req = { .user = user };
 		bool bypass;
-		u32 *syncpt_id = NULL, *syncpt_val = NULL;
-		int *syncpt_fd = NULL;
-		int syncpt_idx = -1;
-		u64 flip_id;
-
-		u32 usr_win_size = sizeof(struct tegra_dc_ext_flip_windowattr);
 
-		if (copy_from_user(&args, user_arg, sizeof(args)))
+		if (copy_from_user(&req.args, user_arg, sizeof(req.args)))
 			return -EFAULT;
 
-		bypass = !!(args.flags & TEGRA_DC_EXT_FLIP_HEAD_FLAG_YUVBYPASS);
+		bypass = !!(req.args.flags &
+			    TEGRA_DC_EXT_FLIP_HEAD_FLAG_YUVBYPASS);
 
 		if (tegra_dc_is_t21x()) {
 			if (!!(user->ext->dc->mode.vmode & FB_VMODE_YUV_MASK) !=
@@ -2847,91 +3863,27 @@ static long tegra_dc_ioctl(struct file *filp, unsigned int cmd,
 		if (bypass != user->ext->dc->yuv_bypass)
 			user->ext->dc->yuv_bypass_dirty = true;
 		user->ext->dc->yuv_bypass = bypass;
-		win_num = args.win_num;
-		win = kzalloc(sizeof(*win) * win_num, GFP_KERNEL);
-
-		if (args.flags &
-				TEGRA_DC_EXT_FLIP_HEAD_FLAG_V2_ATTR)
-			usr_win_size =
-				sizeof(struct tegra_dc_ext_flip_windowattr_v2);
-
-		if (dev_cpy_from_usr(win, (void *)args.win,
-					usr_win_size, win_num)) {
-			kfree(win);
-			return -EFAULT;
-		}
-
-		nr_user_data = args.nr_elements;
-		flip_user_data = kzalloc(sizeof(*flip_user_data)
-					* nr_user_data, GFP_KERNEL);
-		if (nr_user_data > 0) {
-			if (copy_from_user(flip_user_data,
-				(void __user *) (uintptr_t)args.data,
-				sizeof(*flip_user_data) * nr_user_data)) {
-				kfree(flip_user_data);
-				kfree(win);
-				return -EFAULT;
-			}
-		}
-
-		/*
-		 * Check if the client is explicitly requesting syncpts via flip
-		 * user data. If so, populate the syncpt variables accordingly.
-		 * Else, default to sync fds and use the original post_syncpt_fd
-		 * fence.
-		 */
-		ret = tegra_dc_copy_syncpts_from_user(user->ext->dc,
-			flip_user_data, nr_user_data, &syncpt_id, &syncpt_val,
-			&syncpt_fd, &syncpt_idx);
-		if (ret) {
-			kfree(flip_user_data);
-			kfree(win);
-			return ret;
-		}
-
-		if (syncpt_idx == -1)
-			syncpt_fd = &args.post_syncpt_fd;
 
-		ret = tegra_dc_ext_flip(user, win, win_num,
-			syncpt_id, syncpt_val, syncpt_fd, args.dirty_rect,
-			args.flags, flip_user_data, nr_user_data, &flip_id);
+		ret = tegra_dc_ext_flip_req_copy_in(&req);
 		if (ret) {
-			kfree(flip_user_data);
-			kfree(win);
+			tegra_dc_ext_flip_req_free(&req);
 			return ret;
 		}
 
-		/*
-		 * If the client requested post syncpt values via user data,
-		 * copy them back.
-		 */
-		if (syncpt_idx > -1) {
-			args.post_syncpt_fd = -1;
-			ret = tegra_dc_copy_syncpts_to_user(flip_user_data,
-					syncpt_idx, (u8 *)(void *)args.data);
-			if (ret) {
-				kfree(flip_user_data);
-				kfree(win);
-				return ret;
-			}
-		}
-
-		if (dev_cpy_to_usr((void *)args.win, usr_win_size,
-					win, win_num) ||
-			copy_to_user(user_arg, &args, sizeof(args))) {
-			kfree(flip_user_data);
-			kfree(win);
-			return -EFAULT;
-		}
-
-		ret = tegra_dc_copy_flip_id_to_user(&args, flip_user_data,
-						    nr_user_data, flip_id);
+		ret = tegra_dc_ext_flip(user, req.win, req.args.win_num,
+			req.syncpt_id, req.syncpt_val, req.syncpt_fd,
+			req.args.dirty_rect, req.args.flags, req.user_data,
+			req.nr_user_data, &req.flip_id);
+		if (!ret)
+			ret = tegra_dc_ext_flip_req_copy_out(&req, user_arg);
 
-		kfree(flip_user_data);
-		kfree(win);
+		tegra_dc_ext_flip_req_free(&req);
 		return ret;
 	}
 
+	case TEGRA_DC_EXT_FLIP_MULTI:
+		return tegra_dc_ext_flip_multi(user, user_arg);
+
 	case TEGRA_DC_EXT_GET_IMP_USER_INFO:
 	{
 		struct tegra_dc_ext_imp_user_info *info;
@@ -3570,16 +4522,47 @@ free_and_ret:
 	}
 }
 
+static void tegra_dc_ext_flip_pool_free(struct tegra_dc_ext_user *user)
+{
+	int i;
+
+	/* Wait for the flip workers to hand back every flip context. */
+	wait_event(user->flip_pool_wq, READ_ONCE(user->nr_flip_pool) ==
+		   TEGRA_DC_EXT_FLIP_POOL_SIZE);
+
+	/* Let the last tegra_dc_ext_flip_data_put() leave the lock. */
+	spin_lock(&user->flip_pool_lock);
+	spin_unlock(&user->flip_pool_lock);
+
+	for (i = 0; i < user->nr_flip_pool; i++)
+		kfree(user->flip_pool[i]);
+}
+
 static int tegra_dc_open(struct inode *inode, struct file *filp)
 {
 	struct tegra_dc_ext_user *user;
 	struct tegra_dc_ext *ext;
 	int open_count;
+	int i;
 
 	user = kzalloc(sizeof(*user), GFP_KERNEL);
 	if (!user)
 		return -ENOMEM;
 
+	spin_lock_init(&user->flip_pool_lock);
+	init_waitqueue_head(&user->flip_pool_wq);
+	for (i = 0; i < TEGRA_DC_EXT_FLIP_POOL_SIZE; i++) {
+		user->flip_pool[i] = kzalloc(sizeof(*user->flip_pool[i]),
+					     GFP_KERNEL);
+		if (!user->flip_pool[i]) {
+			while (i--)
+				kfree(user->flip_pool[i]);
+			kfree(user);
+			return -ENOMEM;
+		}
+		user->nr_flip_pool++;
+	}
+
 	ext = container_of(inode->i_cdev, struct tegra_dc_ext, cdev);
 	user->ext = ext;
 
@@ -3624,6 +4607,7 @@ static int tegra_dc_release(struct inode *inode, struct file *filp)
 	if (ext->cursor.user == user)
 		tegra_dc_ext_put_cursor(user);
 
+	tegra_dc_ext_flip_pool_free(user);
 	kfree(user);
 
 	open_count = atomic_dec_return(&dc_open_count);
@@ -3676,6 +4660,7 @@ static int tegra_dc_ext_setup_windows(struct tegra_dc_ext *ext)
 
 		mutex_init(&win->lock);
 		mutex_init(&win->queue_lock);
+		mutex_init(&win->pin_lock);
 		INIT_LIST_HEAD(&win->timestamp_queue);
 	}
 
@@ -3781,6 +4766,7 @@ void tegra_dc_ext_unregister(struct tegra_dc_ext *ext)
 
 		kthread_flush_worker(&win->flip_worker);
 		kthread_stop(win->flip_kthread);
+		tegra_dc_ext_pin_cache_flush(win);
 	}
 
 	/* Remove scanline work */
@@ -25,22 +25,48 @@
 #include <linux/list.h>
 #include <linux/mutex.h>
 #include <linux/poll.h>
+#include <linux/spinlock.h>
+#include <linux/wait.h>
 #include <video/tegra_dc_ext.h>
 
 #include "../dc.h"
 
 struct tegra_dc_ext;
+struct tegra_dc_ext_flip_data;
+
+/* Flip contexts preallocated per user at open time */
+#define TEGRA_DC_EXT_FLIP_POOL_SIZE		4
+/* User data entries a FLIP4 request can carry without allocating */
+#define TEGRA_DC_EXT_FLIP_INLINE_USER_DATA	8
 
 struct tegra_dc_ext_user {
 	struct tegra_dc_ext	*ext;
+
+	/* free flip contexts, returned by the flip worker when done */
+	spinlock_t			flip_pool_lock;
+	wait_queue_head_t		flip_pool_wq;
+	struct tegra_dc_ext_flip_data	*flip_pool[TEGRA_DC_EXT_FLIP_POOL_SIZE];
+	int				nr_flip_pool;
+
+	/* copy-in buffers for one FLIP4 request at a time */
+	unsigned long				flip_req_busy;
+	struct tegra_dc_ext_flip_windowattr_v2	flip_req_win[DC_N_WINDOWS];
+	struct tegra_dc_ext_flip_user_data
+		flip_req_user_data[TEGRA_DC_EXT_FLIP_INLINE_USER_DATA];
 };
 
 struct tegra_dc_dmabuf {
 	struct dma_buf *buf;
 	struct dma_buf_attachment *attach;
 	struct sg_table *sgt;
+	dma_addr_t phys_addr;
+	/* one per flip or window using it, plus one while in a pin cache */
+	atomic_t refs;
 };
 
+/* Pinned dma-bufs kept per window for reuse by later flips */
+#define TEGRA_DC_EXT_PIN_CACHE_SIZE	8
+
 enum {
 	TEGRA_DC_Y,
 	TEGRA_DC_U,
@@ -71,6 +97,15 @@ struct tegra_dc_ext_win {
 	struct list_head	timestamp_queue;
 
 	bool			enabled;
+
+	/* flip queue configuration, see struct tegra_dc_ext_flip_queue */
+	u32			flip_mode;
+	u32			flip_depth;
+	u32			latch_margin_us;
+
+	/* most recently used first */
+	struct mutex		pin_lock;
+	struct tegra_dc_dmabuf	*pin_cache[TEGRA_DC_EXT_PIN_CACHE_SIZE];
 };
 
 struct tegra_dc_ext {
@@ -148,6 +183,12 @@ extern struct class *tegra_dc_ext_class;
 extern int tegra_dc_ext_pin_window(struct tegra_dc_ext_user *user, u32 id,
 				   struct tegra_dc_dmabuf **handle,
 				   dma_addr_t *phys_addr);
+extern int tegra_dc_ext_pin_window_cached(struct tegra_dc_ext_user *user,
+					  struct tegra_dc_ext_win *win, u32 id,
+					  struct tegra_dc_dmabuf **handle,
+					  dma_addr_t *phys_addr);
+extern void tegra_dc_ext_unpin_dmabuf(struct tegra_dc_dmabuf *handle);
+extern void tegra_dc_ext_pin_cache_flush(struct tegra_dc_ext_win *win);
 
 extern int tegra_dc_ext_cpy_caps_from_user(void __user *user_arg,
 				struct tegra_dc_ext_caps **caps_ptr,
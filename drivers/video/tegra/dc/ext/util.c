@@ -21,30 +21,23 @@
 #include <linux/dma-buf.h>
 
 #include "../dc.h"
+#include "../dc_priv_defs.h"
 #include "tegra_dc_ext_priv.h"
 
 
-int tegra_dc_ext_pin_window(struct tegra_dc_ext_user *user, u32 fd,
-			    struct tegra_dc_dmabuf **dc_buf,
-			    dma_addr_t *phys_addr)
+/* Attach and map buf for the display, consuming the caller's reference. */
+static int tegra_dc_ext_pin_buf(struct tegra_dc_ext *ext, struct dma_buf *buf,
+				struct tegra_dc_dmabuf **dc_buf)
 {
-	struct tegra_dc_ext *ext = user->ext;
 	struct tegra_dc_dmabuf *dc_dmabuf;
 	dma_addr_t dma_addr;
 
-	*dc_buf = NULL;
-	*phys_addr = -1;
-	if (!fd)
-		return 0;
-
 	dc_dmabuf = kzalloc(sizeof(*dc_dmabuf), GFP_KERNEL);
 	if (!dc_dmabuf)
-		return -ENOMEM;
-
-	dc_dmabuf->buf = dma_buf_get(fd);
-	if (IS_ERR_OR_NULL(dc_dmabuf->buf))
 		goto buf_fail;
 
+	dc_dmabuf->buf = buf;
+
 	dc_dmabuf->attach = dma_buf_attach(dc_dmabuf->buf, ext->dev->parent);
 	if (IS_ERR_OR_NULL(dc_dmabuf->attach))
 		goto attach_fail;
@@ -63,10 +56,11 @@ int tegra_dc_ext_pin_window(struct tegra_dc_ext_user *user, u32 fd,
 
 	dma_addr = sg_dma_address(dc_dmabuf->sgt->sgl);
 	if (dma_addr)
-		*phys_addr = dma_addr;
+		dc_dmabuf->phys_addr = dma_addr;
 	else
-		*phys_addr = sg_phys(dc_dmabuf->sgt->sgl);
+		dc_dmabuf->phys_addr = sg_phys(dc_dmabuf->sgt->sgl);
 
+	atomic_set(&dc_dmabuf->refs, 1);
 	*dc_buf = dc_dmabuf;
 
 	return 0;
@@ -76,12 +70,133 @@ iommu_fail:
 sgt_fail:
 	dma_buf_detach(dc_dmabuf->buf, dc_dmabuf->attach);
 attach_fail:
-	dma_buf_put(dc_dmabuf->buf);
-buf_fail:
 	kfree(dc_dmabuf);
+buf_fail:
+	dma_buf_put(buf);
 	return -ENOMEM;
 }
 
+int tegra_dc_ext_pin_window(struct tegra_dc_ext_user *user, u32 fd,
+			    struct tegra_dc_dmabuf **dc_buf,
+			    dma_addr_t *phys_addr)
+{
+	struct dma_buf *buf;
+	int ret;
+
+	*dc_buf = NULL;
+	*phys_addr = -1;
+	if (!fd)
+		return 0;
+
+	buf = dma_buf_get(fd);
+	if (IS_ERR_OR_NULL(buf))
+		return -ENOMEM;
+
+	ret = tegra_dc_ext_pin_buf(user->ext, buf, dc_buf);
+	if (ret)
+		return ret;
+
+	*phys_addr = (*dc_buf)->phys_addr;
+
+	return 0;
+}
+
+/*
+ * Same as tegra_dc_ext_pin_window(), but reuses the pin of a dma-buf that
+ * was recently flipped on win. Only a miss attaches and maps the buffer;
+ * the new pin then replaces the least recently used cache entry.
+ */
+int tegra_dc_ext_pin_window_cached(struct tegra_dc_ext_user *user,
+				   struct tegra_dc_ext_win *win, u32 fd,
+				   struct tegra_dc_dmabuf **dc_buf,
+				   dma_addr_t *phys_addr)
+{
+	struct tegra_dc_dmabuf *dc_dmabuf = NULL, *evict;
+	struct tegra_dc *dc = user->ext->dc;
+	struct dma_buf *buf;
+	int i, ret;
+
+	*dc_buf = NULL;
+	*phys_addr = -1;
+	if (!fd)
+		return 0;
+
+	buf = dma_buf_get(fd);
+	if (IS_ERR_OR_NULL(buf))
+		return -ENOMEM;
+
+	mutex_lock(&win->pin_lock);
+	for (i = 0; i < TEGRA_DC_EXT_PIN_CACHE_SIZE; i++) {
+		if (!win->pin_cache[i] || win->pin_cache[i]->buf != buf)
+			continue;
+
+		dc_dmabuf = win->pin_cache[i];
+		atomic_inc(&dc_dmabuf->refs);
+		memmove(&win->pin_cache[1], &win->pin_cache[0],
+			sizeof(win->pin_cache[0]) * i);
+		win->pin_cache[0] = dc_dmabuf;
+		break;
+	}
+	mutex_unlock(&win->pin_lock);
+
+	if (dc_dmabuf) {
+		/* the cached pin holds its own reference on buf */
+		dma_buf_put(buf);
+		atomic64_inc(&dc->flip_stats.pin_cache_hits);
+		goto done;
+	}
+
+	ret = tegra_dc_ext_pin_buf(user->ext, buf, &dc_dmabuf);
+	if (ret)
+		return ret;
+	atomic64_inc(&dc->flip_stats.pin_cache_misses);
+
+	atomic_inc(&dc_dmabuf->refs);
+	mutex_lock(&win->pin_lock);
+	evict = win->pin_cache[TEGRA_DC_EXT_PIN_CACHE_SIZE - 1];
+	memmove(&win->pin_cache[1], &win->pin_cache[0],
+		sizeof(win->pin_cache[0]) * (TEGRA_DC_EXT_PIN_CACHE_SIZE - 1));
+	win->pin_cache[0] = dc_dmabuf;
+	mutex_unlock(&win->pin_lock);
+
+	if (evict)
+		tegra_dc_ext_unpin_dmabuf(evict);
+
+done:
+	*dc_buf = dc_dmabuf;
+	*phys_addr = dc_dmabuf->phys_addr;
+
+	return 0;
+}
+
+void tegra_dc_ext_unpin_dmabuf(struct tegra_dc_dmabuf *dc_buf)
+{
+	if (!atomic_dec_and_test(&dc_buf->refs))
+		return;
+
+	dma_buf_unmap_attachment(dc_buf->attach, dc_buf->sgt, DMA_TO_DEVICE);
+	dma_buf_detach(dc_buf->buf, dc_buf->attach);
+	dma_buf_put(dc_buf->buf);
+	kfree(dc_buf);
+}
+
+/* Drop the cache's references; pins still in use stay until unpinned. */
+void tegra_dc_ext_pin_cache_flush(struct tegra_dc_ext_win *win)
+{
+	struct tegra_dc_dmabuf *cache[TEGRA_DC_EXT_PIN_CACHE_SIZE];
+	int i;
+
+	mutex_lock(&win->pin_lock);
+	memcpy(cache, win->pin_cache, sizeof(cache));
+	memset(win->pin_cache, 0, sizeof(win->pin_cache));
+	mutex_unlock(&win->pin_lock);
+
+	for (i = 0; i < TEGRA_DC_EXT_PIN_CACHE_SIZE; i++) {
+		if (cache[i])
+			tegra_dc_ext_unpin_dmabuf(cache[i]);
+	}
+}
+
 int tegra_dc_ext_cpy_caps_from_user(void __user *user_arg,
 				struct tegra_dc_ext_caps **caps_ptr,
 				u32 *nr_elements_ptr)
@@ -79,6 +79,8 @@ void tegra_dc_set_lut(struct tegra_dc *dc, struct tegra_dc_win *win)
 		val &= ~CP_ENABLE;
 
 	tegra_dc_writel(dc, val, DC_WIN_WIN_OPTIONS);
+	/* written behind the window register shadow */
+	tegra_dc_shadow_invalidate_reg(dc, win->idx, DC_WIN_WIN_OPTIONS);
 }
 
 static int tegra_dc_update_winlut(struct tegra_dc *dc, int win_idx, int fbovr)
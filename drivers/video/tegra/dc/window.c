@@ -20,6 +20,7 @@
 #include <linux/moduleparam.h>
 #include <linux/export.h>
 #include <linux/delay.h>
+#include <linux/slab.h>
 #include <soc/tegra/fuse.h>
 #include <trace/events/display.h>
 #include <linux/fb.h>
@@ -35,6 +36,204 @@ int no_vsync;
 
 module_param_named(no_vsync, no_vsync, int, 0644);
 
+static inline int tegra_dc_shadow_index(unsigned long reg)
+{
+	if (reg >= TEGRA_DC_SHADOW_WIN_BASE &&
+	    reg < TEGRA_DC_SHADOW_WIN_BASE + TEGRA_DC_SHADOW_WIN_NUM)
+		return reg - TEGRA_DC_SHADOW_WIN_BASE;
+
+	if (reg >= TEGRA_DC_SHADOW_WINBUF_BASE &&
+	    reg < TEGRA_DC_SHADOW_WINBUF_BASE + TEGRA_DC_SHADOW_WINBUF_NUM)
+		return TEGRA_DC_SHADOW_WIN_NUM +
+			reg - TEGRA_DC_SHADOW_WINBUF_BASE;
+
+	return -EINVAL;
+}
+
+static inline unsigned long tegra_dc_shadow_reg(int index)
+{
+	if (index < TEGRA_DC_SHADOW_WIN_NUM)
+		return TEGRA_DC_SHADOW_WIN_BASE + index;
+
+	return TEGRA_DC_SHADOW_WINBUF_BASE + index - TEGRA_DC_SHADOW_WIN_NUM;
+}
+
+/*
+ * Stage a write to an assembly register of window win_idx. Nothing reaches
+ * HW until tegra_dc_shadow_flush(); a value equal to the one already staged
+ * or flushed is dropped. Must be called with dc->lock held.
+ */
+static void tegra_dc_shadow_writel(struct tegra_dc *dc, int win_idx,
+				   u32 val, unsigned long reg)
+{
+	struct tegra_dc_reg_shadow *rs = &dc->reg_shadow;
+	struct tegra_dc_win_shadow *ws = &rs->win[win_idx];
+	int index = tegra_dc_shadow_index(reg);
+
+	if (WARN_ON_ONCE(index < 0)) {
+		tegra_dc_writel(dc, WINDOW_A_SELECT << win_idx,
+				DC_CMD_DISPLAY_WINDOW_HEADER);
+		tegra_dc_writel(dc, val, reg);
+		return;
+	}
+
+	if (test_bit(index, ws->valid) && ws->val[index] == val) {
+		rs->writes_elided++;
+		return;
+	}
+
+	ws->val[index] = val;
+	set_bit(index, ws->valid);
+	set_bit(index, ws->dirty);
+	set_bit(win_idx, &rs->dirty_wins);
+}
+
+static inline void tegra_dc_win_writel(struct tegra_dc_win *win,
+				       u32 val, unsigned long reg)
+{
+	tegra_dc_shadow_writel(win->dc, win->idx, val, reg);
+}
+
+/*
+ * Write every dirty shadow register to HW, one window at a time and in
+ * ascending register order. With the in-memory backend enabled the values
+ * land in reg_shadow.mem instead and no window MMIO is issued at all.
+ */
+static void tegra_dc_shadow_flush(struct tegra_dc *dc)
+{
+	struct tegra_dc_reg_shadow *rs = &dc->reg_shadow;
+	int i, index;
+
+	if (!rs->dirty_wins)
+		return;
+
+	if (!rs->mem && tegra_dc_is_accessible(dc)) {
+		tegra_dc_shadow_invalidate(dc);
+		return;
+	}
+
+	for_each_set_bit(i, &rs->dirty_wins, DC_N_WINDOWS) {
+		struct tegra_dc_win_shadow *ws = &rs->win[i];
+		u32 *mem = rs->mem ?
+			&rs->mem[i * TEGRA_DC_SHADOW_NUM_REGS] : NULL;
+
+		if (!mem)
+			tegra_dc_writel(dc, WINDOW_A_SELECT << i,
+					DC_CMD_DISPLAY_WINDOW_HEADER);
+
+		for_each_set_bit(index, ws->dirty, TEGRA_DC_SHADOW_NUM_REGS) {
+			if (mem)
+				mem[index] = ws->val[index];
+			else
+				tegra_dc_writel(dc, ws->val[index],
+						tegra_dc_shadow_reg(index));
+			rs->writes_flushed++;
+		}
+		bitmap_zero(ws->dirty, TEGRA_DC_SHADOW_NUM_REGS);
+	}
+	rs->dirty_wins = 0;
+}
+
+static void tegra_dc_shadow_account(struct tegra_dc *dc, u64 mmio)
+{
+	struct tegra_dc_reg_shadow *rs = &dc->reg_shadow;
+
+	rs->flips++;
+	rs->mmio_total += mmio;
+	rs->mmio_last = mmio;
+	if (mmio > rs->mmio_max)
+		rs->mmio_max = mmio;
+}
+
+/*
+ * Forget everything the shadow knows about HW state, so that the next flip
+ * programs every register again. Needed whenever window registers are
+ * reset or written behind the shadow's back.
+ */
+void tegra_dc_shadow_invalidate(struct tegra_dc *dc)
+{
+	struct tegra_dc_reg_shadow *rs = &dc->reg_shadow;
+	int i;
+
+	for (i = 0; i < DC_N_WINDOWS; i++) {
+		bitmap_zero(rs->win[i].valid, TEGRA_DC_SHADOW_NUM_REGS);
+		bitmap_zero(rs->win[i].dirty, TEGRA_DC_SHADOW_NUM_REGS);
+	}
+	rs->dirty_wins = 0;
+}
+
+/*
+ * Forget one register of window win_idx, for code that writes it behind the
+ * shadow's back, so that the next flip programs it again. Must be called
+ * with dc->lock held.
+ */
+void tegra_dc_shadow_invalidate_reg(struct tegra_dc *dc, int win_idx,
+				    unsigned long reg)
+{
+	int index = tegra_dc_shadow_index(reg);
+
+	if (WARN_ON_ONCE(index < 0))
+		return;
+
+	clear_bit(index, dc->reg_shadow.win[win_idx].valid);
+}
+
+static bool tegra_dc_out_is_fake(struct tegra_dc *dc)
+{
+	switch (dc->out->type) {
+	case TEGRA_DC_OUT_FAKE_DP:
+	case TEGRA_DC_OUT_FAKE_DSIA:
+	case TEGRA_DC_OUT_FAKE_DSIB:
+	case TEGRA_DC_OUT_FAKE_DSI_GANGED:
+	case TEGRA_DC_OUT_NULL:
+		return true;
+	default:
+		return false;
+	}
+}
+
+/*
+ * Redirect flushed window registers to an in-memory register file, so that
+ * the flip path can be exercised and checked on a fake panel without the
+ * window assembly registers being touched. Only fake outputs are allowed.
+ */
+int tegra_dc_shadow_set_mem(struct tegra_dc *dc, bool enable)
+{
+	struct tegra_dc_reg_shadow *rs = &dc->reg_shadow;
+	u32 *mem = NULL;
+
+	if (enable) {
+		if (tegra_dc_is_nvdisplay())
+			return -EOPNOTSUPP;
+
+		mem = kcalloc(DC_N_WINDOWS * TEGRA_DC_SHADOW_NUM_REGS,
+			      sizeof(*mem), GFP_KERNEL);
+		if (!mem)
+			return -ENOMEM;
+	}
+
+	mutex_lock(&dc->lock);
+	if (enable && !tegra_dc_out_is_fake(dc)) {
+		mutex_unlock(&dc->lock);
+		kfree(mem);
+		return -EINVAL;
+	}
+
+	swap(rs->mem, mem);
+	tegra_dc_shadow_invalidate(dc);
+	rs->flips = 0;
+	rs->writes_elided = 0;
+	rs->writes_flushed = 0;
+	rs->mmio_total = 0;
+	rs->mmio_last = 0;
+	rs->mmio_max = 0;
+	mutex_unlock(&dc->lock);
+
+	kfree(mem);
+
+	return 0;
+}
+
 static bool tegra_dc_windows_are_clean(struct tegra_dc_win *windows[],
 					     int n)
 {
@@ -152,16 +351,18 @@ static void tegra_dc_blend_parallel(struct tegra_dc *dc,
 	while (mask) {
 		int idx = get_topmost_window(blend->z, &mask, win_num);
 
-		tegra_dc_writel(dc, WINDOW_A_SELECT << idx,
-				DC_CMD_DISPLAY_WINDOW_HEADER);
-		tegra_dc_writel(dc, BLEND(NOKEY, FIX, 0xff, 0xff),
+		tegra_dc_shadow_writel(dc, idx,
+				BLEND(NOKEY, FIX, 0xff, 0xff),
 				DC_WIN_BLEND_NOKEY);
-		tegra_dc_writel(dc, blend_2win(idx, mask, blend->flags, 0,
-				win_num), DC_WIN_BLEND_2WIN_X);
-		tegra_dc_writel(dc, blend_2win(idx, mask, blend->flags, 1,
-				win_num), DC_WIN_BLEND_2WIN_Y);
-		tegra_dc_writel(dc, blend_3win(idx, mask, blend->flags,
-				win_num), DC_WIN_BLEND_3WIN_XY);
+		tegra_dc_shadow_writel(dc, idx,
+				blend_2win(idx, mask, blend->flags, 0, win_num),
+				DC_WIN_BLEND_2WIN_X);
+		tegra_dc_shadow_writel(dc, idx,
+				blend_2win(idx, mask, blend->flags, 1, win_num),
+				DC_WIN_BLEND_2WIN_Y);
+		tegra_dc_shadow_writel(dc, idx,
+				blend_3win(idx, mask, blend->flags, win_num),
+				DC_WIN_BLEND_3WIN_XY);
 	}
 	tegra_dc_io_end(dc);
 }
@@ -177,63 +378,60 @@ static void tegra_dc_blend_sequential(struct tegra_dc *dc,
 		if (!tegra_dc_feature_is_gen2_blender(dc, idx))
 			continue;
 
-		tegra_dc_writel(dc, WINDOW_A_SELECT << idx,
-				DC_CMD_DISPLAY_WINDOW_HEADER);
-
 		if (blend->flags[idx] & TEGRA_WIN_FLAG_BLEND_COVERAGE) {
-			tegra_dc_writel(dc,
+			tegra_dc_shadow_writel(dc, idx,
 					WIN_K1(blend->alpha[idx]) |
 					WIN_K2(0xff) |
 					WIN_BLEND_ENABLE |
 					WIN_DEPTH(dc->blend.z[idx]),
 					DC_WINBUF_BLEND_LAYER_CONTROL);
 
-			tegra_dc_writel(dc,
+			tegra_dc_shadow_writel(dc, idx,
 			WIN_BLEND_FACT_SRC_COLOR_MATCH_SEL_K1_TIMES_SRC |
 			WIN_BLEND_FACT_DST_COLOR_MATCH_SEL_NEG_K1_TIMES_SRC |
 			WIN_BLEND_FACT_SRC_ALPHA_MATCH_SEL_K2 |
 			WIN_BLEND_FACT_DST_ALPHA_MATCH_SEL_ZERO,
 			DC_WINBUF_BLEND_MATCH_SELECT);
 
-			tegra_dc_writel(dc,
+			tegra_dc_shadow_writel(dc, idx,
 			WIN_BLEND_FACT_SRC_COLOR_NOMATCH_SEL_K1_TIMES_SRC |
 			WIN_BLEND_FACT_DST_COLOR_NOMATCH_SEL_NEG_K1_TIMES_SRC |
 			WIN_BLEND_FACT_SRC_ALPHA_NOMATCH_SEL_K2 |
 			WIN_BLEND_FACT_DST_ALPHA_NOMATCH_SEL_ZERO,
 			DC_WINBUF_BLEND_NOMATCH_SELECT);
 
-			tegra_dc_writel(dc,
+			tegra_dc_shadow_writel(dc, idx,
 					WIN_ALPHA_1BIT_WEIGHT0(0) |
 					WIN_ALPHA_1BIT_WEIGHT1(0xff),
 					DC_WINBUF_BLEND_ALPHA_1BIT);
 		} else if (blend->flags[idx] & TEGRA_WIN_FLAG_BLEND_PREMULT) {
-			tegra_dc_writel(dc,
+			tegra_dc_shadow_writel(dc, idx,
 					WIN_K1(blend->alpha[idx]) |
 					WIN_K2(0xff) |
 					WIN_BLEND_ENABLE |
 					WIN_DEPTH(dc->blend.z[idx]),
 					DC_WINBUF_BLEND_LAYER_CONTROL);
 
-			tegra_dc_writel(dc,
+			tegra_dc_shadow_writel(dc, idx,
 			WIN_BLEND_FACT_SRC_COLOR_MATCH_SEL_K1 |
 			WIN_BLEND_FACT_DST_COLOR_MATCH_SEL_NEG_K1_TIMES_SRC |
 			WIN_BLEND_FACT_SRC_ALPHA_MATCH_SEL_K2 |
 			WIN_BLEND_FACT_DST_ALPHA_MATCH_SEL_ZERO,
 			DC_WINBUF_BLEND_MATCH_SELECT);
 
-			tegra_dc_writel(dc,
+			tegra_dc_shadow_writel(dc, idx,
 			WIN_BLEND_FACT_SRC_COLOR_NOMATCH_SEL_NEG_K1_TIMES_DST |
 			WIN_BLEND_FACT_DST_COLOR_NOMATCH_SEL_K1 |
 			WIN_BLEND_FACT_SRC_ALPHA_NOMATCH_SEL_K2 |
 			WIN_BLEND_FACT_DST_ALPHA_NOMATCH_SEL_ZERO,
 			DC_WINBUF_BLEND_NOMATCH_SELECT);
 
-			tegra_dc_writel(dc,
+			tegra_dc_shadow_writel(dc, idx,
 					WIN_ALPHA_1BIT_WEIGHT0(0) |
 					WIN_ALPHA_1BIT_WEIGHT1(0xff),
 					DC_WINBUF_BLEND_ALPHA_1BIT);
 		} else {
-			tegra_dc_writel(dc,
+			tegra_dc_shadow_writel(dc, idx,
 					WIN_BLEND_BYPASS |
 					WIN_DEPTH(dc->blend.z[idx]),
 					DC_WINBUF_BLEND_LAYER_CONTROL);
@@ -342,24 +540,24 @@ static inline void __maybe_unused tegra_dc_update_scaling(
 		if (tegra_dc_feature_has_interlace(dc, win->idx)
 			&& (dc->mode.vmode == FB_VMODE_INTERLACED)) {
 			if (WIN_IS_INTERLACE(win))
-				tegra_dc_writel(dc,
+				tegra_dc_win_writel(win,
 					V_PRESCALED_SIZE(dfixed_trunc(win->w)) |
 					H_PRESCALED_SIZE(dfixed_trunc(win->h)
 					* Bpp),
 					DC_WIN_PRESCALED_SIZE);
 			else
-				tegra_dc_writel(dc,
+				tegra_dc_win_writel(win,
 					V_PRESCALED_SIZE(dfixed_trunc(win->w))
 					| H_PRESCALED_SIZE(dfixed_trunc(win->h)
 					* Bpp), DC_WIN_PRESCALED_SIZE);
 		} else {
-			tegra_dc_writel(dc,
+			tegra_dc_win_writel(win,
 				V_PRESCALED_SIZE(dfixed_trunc(win->w)) |
 				H_PRESCALED_SIZE(dfixed_trunc(win->h) * Bpp),
 				DC_WIN_PRESCALED_SIZE);
 		}
-		tegra_dc_writel(dc, v_dda_init, DC_WIN_H_INITIAL_DDA);
-		tegra_dc_writel(dc, h_dda_init, DC_WIN_V_INITIAL_DDA);
+		tegra_dc_win_writel(win, v_dda_init, DC_WIN_H_INITIAL_DDA);
+		tegra_dc_win_writel(win, h_dda_init, DC_WIN_V_INITIAL_DDA);
 		h_dda = compute_dda_inc(win->h, win->out_w,
 				false, Bpp_bw);
 		v_dda = compute_dda_inc(win->w, win->out_h,
@@ -368,25 +566,25 @@ static inline void __maybe_unused tegra_dc_update_scaling(
 		if (tegra_dc_feature_has_interlace(dc, win->idx)
 			&& (dc->mode.vmode == FB_VMODE_INTERLACED)) {
 			if (WIN_IS_INTERLACE(win))
-				tegra_dc_writel(dc,
+				tegra_dc_win_writel(win,
 					V_PRESCALED_SIZE(dfixed_trunc(win->h)
 					>> 1) |
 					H_PRESCALED_SIZE(dfixed_trunc(win->w)
 					* Bpp), DC_WIN_PRESCALED_SIZE);
 			else
-				tegra_dc_writel(dc,
+				tegra_dc_win_writel(win,
 					V_PRESCALED_SIZE(dfixed_trunc(win->h)) |
 					H_PRESCALED_SIZE(dfixed_trunc(win->w)
 					* Bpp),
 					DC_WIN_PRESCALED_SIZE);
 		} else {
-			tegra_dc_writel(dc,
+			tegra_dc_win_writel(win,
 				V_PRESCALED_SIZE(dfixed_trunc(win->h)) |
 				H_PRESCALED_SIZE(dfixed_trunc(win->w) * Bpp),
 				DC_WIN_PRESCALED_SIZE);
 		}
-		tegra_dc_writel(dc, h_dda_init, DC_WIN_H_INITIAL_DDA);
-		tegra_dc_writel(dc, v_dda_init, DC_WIN_V_INITIAL_DDA);
+		tegra_dc_win_writel(win, h_dda_init, DC_WIN_H_INITIAL_DDA);
+		tegra_dc_win_writel(win, v_dda_init, DC_WIN_V_INITIAL_DDA);
 		h_dda = compute_dda_inc(win->w, win->out_w,
 				false, Bpp_bw);
 		v_dda = compute_dda_inc(win->h, win->out_h,
@@ -396,14 +594,14 @@ static inline void __maybe_unused tegra_dc_update_scaling(
 	if (tegra_dc_feature_has_interlace(dc, win->idx) &&
 		(dc->mode.vmode == FB_VMODE_INTERLACED)) {
 		if (WIN_IS_INTERLACE(win))
-			tegra_dc_writel(dc, V_DDA_INC(v_dda) |
+			tegra_dc_win_writel(win, V_DDA_INC(v_dda) |
 				H_DDA_INC(h_dda), DC_WIN_DDA_INCREMENT);
 		else
-			tegra_dc_writel(dc, V_DDA_INC(v_dda << 1) |
+			tegra_dc_win_writel(win, V_DDA_INC(v_dda << 1) |
 				H_DDA_INC(h_dda), DC_WIN_DDA_INCREMENT);
 
 	} else {
-		tegra_dc_writel(dc, V_DDA_INC(v_dda) |
+		tegra_dc_win_writel(win, V_DDA_INC(v_dda) |
 			H_DDA_INC(h_dda), DC_WIN_DDA_INCREMENT);
 	}
 }
@@ -449,7 +647,7 @@ void tegra_dc_win_partial_update(struct tegra_dc *dc, struct tegra_dc_win *win,
 		(win->out_y >= (yoff + height)) ||
 		(xoff >= (win->out_x + win->out_w)) ||
 		(yoff >= (win->out_y + win->out_h))) {
-		tegra_dc_writel(dc, 0, DC_WIN_WIN_OPTIONS);
+		tegra_dc_win_writel(win, 0, DC_WIN_WIN_OPTIONS);
 		return;
 	} else {
 		u64 tmp_64;
@@ -570,6 +768,7 @@ static int _tegra_dc_program_windows(struct tegra_dc *dc,
 	unsigned int width;
 	unsigned int height;
 	enum tegra_revision rev;
+	u64 reg_writes = dc->reg_writes;
 
 	if (dirty_rect) {
 		xoff = dirty_rect[0];
@@ -621,16 +820,13 @@ static int _tegra_dc_program_windows(struct tegra_dc *dc,
 
 		scan_column = (win->flags & TEGRA_WIN_FLAG_SCAN_COLUMN);
 
-		tegra_dc_writel(dc, WINDOW_A_SELECT << win->idx,
-				DC_CMD_DISPLAY_WINDOW_HEADER);
-
 		if (!no_vsync)
 			update_mask |= WIN_A_ACT_REQ << win->idx;
 
 		if (!WIN_IS_ENABLED(win)) {
 
 			dc_win->dirty = no_vsync ? 0 : 1;
-			tegra_dc_writel(dc, 0, DC_WIN_WIN_OPTIONS);
+			tegra_dc_win_writel(win, 0, DC_WIN_WIN_OPTIONS);
 			if (dc->yuv_bypass) {
 				if (tegra_dc_is_yuv420_8bpc(&dc->mode))
 					color = RGB_TO_YUV420_8BPC_BLACK_PIX;
@@ -662,9 +858,6 @@ static int _tegra_dc_program_windows(struct tegra_dc *dc,
 				update_blend_par = true;
 		}
 
-		tegra_dc_writel(dc, WINDOW_A_SELECT << win->idx,
-				DC_CMD_DISPLAY_WINDOW_HEADER);
-
 		update_mask |= WIN_A_ACT_REQ << win->idx;
 
 		if (wait_for_vblank)
@@ -673,20 +866,22 @@ static int _tegra_dc_program_windows(struct tegra_dc *dc,
 			act_control |= WIN_ACT_CNTR_SEL_HCOUNTER(win->idx);
 
 		if (win->cde.cde_addr) {
-			tegra_dc_writel(dc, ENABLESURFACE0,
+			tegra_dc_win_writel(win, ENABLESURFACE0,
 				DC_WINBUF_CDE_CONTROL);
-			tegra_dc_writel(dc, tegra_dc_reg_l32(win->cde.cde_addr),
+			tegra_dc_win_writel(win,
+				tegra_dc_reg_l32(win->cde.cde_addr),
 				DC_WINBUF_CDE_COMPTAG_BASE_0);
-			tegra_dc_writel(dc, tegra_dc_reg_h32(win->cde.cde_addr),
+			tegra_dc_win_writel(win,
+				tegra_dc_reg_h32(win->cde.cde_addr),
 				DC_WINBUF_CDE_COMPTAG_BASEHI_0);
 
-			tegra_dc_writel(dc, win->cde.zbc_color,
+			tegra_dc_win_writel(win, win->cde.zbc_color,
 				DC_WINBUF_CDE_ZBC_COLOR_0);
 
-			tegra_dc_writel(dc, win->cde.offset_x |
+			tegra_dc_win_writel(win, win->cde.offset_x |
 				((u32)win->cde.offset_y << 16),
 				DC_WINBUF_CDE_SURFACE_OFFSET_0);
-			tegra_dc_writel(dc, win->cde.ctb_entry,
+			tegra_dc_win_writel(win, win->cde.ctb_entry,
 				DC_WINBUF_CDE_CTB_ENTRY_0);
 			rev = tegra_chip_get_revision();
 #if (LINUX_VERSION_CODE < KERNEL_VERSION(4, 4, 0))
@@ -697,16 +892,17 @@ static int _tegra_dc_program_windows(struct tegra_dc *dc,
 			if (rev == TEGRA210_REVISION_A01 ||
 					rev == TEGRA210_REVISION_A01q)
 #endif
-				tegra_dc_writel(dc, 0, DC_WINBUF_CDE_CG_SW_OVR);
+				tegra_dc_win_writel(win, 0,
+					DC_WINBUF_CDE_CG_SW_OVR);
 		} else {
-			tegra_dc_writel(dc, 0, DC_WINBUF_CDE_CONTROL);
-			tegra_dc_writel(dc, 0x00000001,
+			tegra_dc_win_writel(win, 0, DC_WINBUF_CDE_CONTROL);
+			tegra_dc_win_writel(win, 0x00000001,
 				DC_WINBUF_CDE_CG_SW_OVR);
 		}
 
-		tegra_dc_writel(dc, tegra_dc_fmt(win->fmt),
+		tegra_dc_win_writel(win, tegra_dc_fmt(win->fmt),
 			DC_WIN_COLOR_DEPTH);
-		tegra_dc_writel(dc, tegra_dc_fmt_byteorder(win->fmt),
+		tegra_dc_win_writel(win, tegra_dc_fmt_byteorder(win->fmt),
 			DC_WIN_BYTE_SWAP);
 
 
@@ -714,18 +910,18 @@ static int _tegra_dc_program_windows(struct tegra_dc *dc,
 			tegra_dc_win_partial_update(dc, win, xoff, yoff,
 				width, height);
 
-		tegra_dc_writel(dc,
+		tegra_dc_win_writel(win,
 			V_POSITION(win->out_y) | H_POSITION(win->out_x),
 			DC_WIN_POSITION);
 
 		if (tegra_dc_feature_has_interlace(dc, win->idx) &&
 			(dc->mode.vmode == FB_VMODE_INTERLACED)) {
-				tegra_dc_writel(dc,
+				tegra_dc_win_writel(win,
 					V_SIZE((win->out_h) >> 1) |
 					H_SIZE(win->out_w),
 					DC_WIN_SIZE);
 		} else {
-			tegra_dc_writel(dc,
+			tegra_dc_win_writel(win,
 				V_SIZE(win->out_h) | H_SIZE(win->out_w),
 				DC_WIN_SIZE);
 		}
@@ -742,31 +938,38 @@ static int _tegra_dc_program_windows(struct tegra_dc *dc,
 			tegra_dc_update_scaling(dc, win, Bpp, Bpp_bw,
 								scan_column);
 
-		tegra_dc_writel(dc, tegra_dc_reg_l32(win->phys_addr),
+		tegra_dc_win_writel(win, tegra_dc_reg_l32(win->phys_addr),
 			DC_WINBUF_START_ADDR);
-		tegra_dc_writel(dc, tegra_dc_reg_h32(win->phys_addr),
+		tegra_dc_win_writel(win, tegra_dc_reg_h32(win->phys_addr),
 			DC_WINBUF_START_ADDR_HI);
 		if (!yuvp && !yuvsp) {
-			tegra_dc_writel(dc, win->stride, DC_WIN_LINE_STRIDE);
+			tegra_dc_win_writel(win, win->stride,
+				DC_WIN_LINE_STRIDE);
 		} else if (yuvp) {
-			tegra_dc_writel(dc, tegra_dc_reg_l32(win->phys_addr_u),
+			tegra_dc_win_writel(win,
+				tegra_dc_reg_l32(win->phys_addr_u),
 				DC_WINBUF_START_ADDR_U);
-			tegra_dc_writel(dc, tegra_dc_reg_h32(win->phys_addr_u),
+			tegra_dc_win_writel(win,
+				tegra_dc_reg_h32(win->phys_addr_u),
 				DC_WINBUF_START_ADDR_HI_U);
-			tegra_dc_writel(dc, tegra_dc_reg_l32(win->phys_addr_v),
+			tegra_dc_win_writel(win,
+				tegra_dc_reg_l32(win->phys_addr_v),
 				DC_WINBUF_START_ADDR_V);
-			tegra_dc_writel(dc, tegra_dc_reg_h32(win->phys_addr_v),
+			tegra_dc_win_writel(win,
+				tegra_dc_reg_h32(win->phys_addr_v),
 				DC_WINBUF_START_ADDR_HI_V);
-			tegra_dc_writel(dc,
+			tegra_dc_win_writel(win,
 				LINE_STRIDE(win->stride) |
 				UV_LINE_STRIDE(win->stride_uv),
 				DC_WIN_LINE_STRIDE);
 		} else {
-			tegra_dc_writel(dc, tegra_dc_reg_l32(win->phys_addr_u),
+			tegra_dc_win_writel(win,
+				tegra_dc_reg_l32(win->phys_addr_u),
 				DC_WINBUF_START_ADDR_U);
-			tegra_dc_writel(dc, tegra_dc_reg_h32(win->phys_addr_u),
+			tegra_dc_win_writel(win,
+				tegra_dc_reg_h32(win->phys_addr_u),
 				DC_WINBUF_START_ADDR_HI_U);
-			tegra_dc_writel(dc,
+			tegra_dc_win_writel(win,
 					LINE_STRIDE(win->stride) |
 					UV_LINE_STRIDE(win->stride_uv),
 					DC_WIN_LINE_STRIDE);
@@ -784,9 +987,9 @@ static int _tegra_dc_program_windows(struct tegra_dc *dc,
 		if (invert_v)
 			v_offset.full += win->h.full - dfixed_const(1);
 
-		tegra_dc_writel(dc, dfixed_trunc(h_offset),
+		tegra_dc_win_writel(win, dfixed_trunc(h_offset),
 				DC_WINBUF_ADDR_H_OFFSET);
-		tegra_dc_writel(dc, dfixed_trunc(v_offset),
+		tegra_dc_win_writel(win, dfixed_trunc(v_offset),
 				DC_WINBUF_ADDR_V_OFFSET);
 
 	if ((dc->mode.vmode == FB_VMODE_INTERLACED) && WIN_IS_FB(win)) {
@@ -796,45 +999,51 @@ static int _tegra_dc_program_windows(struct tegra_dc *dc,
 
 	if ((tegra_dc_feature_has_interlace(dc, win->idx)) &&
 	    (dc->mode.vmode == FB_VMODE_INTERLACED)) {
-		tegra_dc_writel(dc, win->phys_addr2,
+		tegra_dc_win_writel(win, win->phys_addr2,
 				DC_WINBUF_START_ADDR_FIELD2);
 		if (yuvp) {
-			tegra_dc_writel(dc, tegra_dc_reg_l32(win->phys_addr_u2),
+			tegra_dc_win_writel(win,
+				tegra_dc_reg_l32(win->phys_addr_u2),
 				DC_WINBUF_START_ADDR_FIELD2_U);
-			tegra_dc_writel(dc, tegra_dc_reg_h32(win->phys_addr_u2),
+			tegra_dc_win_writel(win,
+				tegra_dc_reg_h32(win->phys_addr_u2),
 				DC_WINBUF_START_ADDR_FIELD2_HI_U);
 
-			tegra_dc_writel(dc, tegra_dc_reg_l32(win->phys_addr_v2),
+			tegra_dc_win_writel(win,
+				tegra_dc_reg_l32(win->phys_addr_v2),
 				DC_WINBUF_START_ADDR_FIELD2_V);
-			tegra_dc_writel(dc, tegra_dc_reg_h32(win->phys_addr_v2),
+			tegra_dc_win_writel(win,
+				tegra_dc_reg_h32(win->phys_addr_v2),
 				DC_WINBUF_START_ADDR_FIELD2_HI_V);
 		} else if (yuvsp) {
-			tegra_dc_writel(dc, tegra_dc_reg_l32(win->phys_addr_u2),
+			tegra_dc_win_writel(win,
+				tegra_dc_reg_l32(win->phys_addr_u2),
 				DC_WINBUF_START_ADDR_FIELD2_U);
-			tegra_dc_writel(dc, tegra_dc_reg_h32(win->phys_addr_u2),
+			tegra_dc_win_writel(win,
+				tegra_dc_reg_h32(win->phys_addr_u2),
 				DC_WINBUF_START_ADDR_FIELD2_HI_U);
 		}
-		tegra_dc_writel(dc, dfixed_trunc(h_offset),
+		tegra_dc_win_writel(win, dfixed_trunc(h_offset),
 			DC_WINBUF_ADDR_H_OFFSET_FIELD2);
 
 		if (WIN_IS_INTERLACE(win)) {
-			tegra_dc_writel(dc, dfixed_trunc(v_offset),
+			tegra_dc_win_writel(win, dfixed_trunc(v_offset),
 					DC_WINBUF_ADDR_V_OFFSET_FIELD2);
 		} else {
 			v_offset.full += dfixed_const(1);
-			tegra_dc_writel(dc, dfixed_trunc(v_offset),
+			tegra_dc_win_writel(win, dfixed_trunc(v_offset),
 					DC_WINBUF_ADDR_V_OFFSET_FIELD2);
 		}
 	}
 
 		if (tegra_dc_feature_has_tiling(dc, win->idx)) {
 			if (WIN_IS_TILED(win))
-				tegra_dc_writel(dc,
+				tegra_dc_win_writel(win,
 					DC_WIN_BUFFER_ADDR_MODE_TILE |
 					DC_WIN_BUFFER_ADDR_MODE_TILE_UV,
 					DC_WIN_BUFFER_ADDR_MODE);
 			else
-				tegra_dc_writel(dc,
+				tegra_dc_win_writel(win,
 					DC_WIN_BUFFER_ADDR_MODE_LINEAR |
 					DC_WIN_BUFFER_ADDR_MODE_LINEAR_UV,
 					DC_WIN_BUFFER_ADDR_MODE);
@@ -843,17 +1052,17 @@ static int _tegra_dc_program_windows(struct tegra_dc *dc,
 		if (tegra_dc_feature_has_blocklinear(dc, win->idx) ||
 			tegra_dc_feature_has_tiling(dc, win->idx)) {
 				if (WIN_IS_BLOCKLINEAR(win)) {
-					tegra_dc_writel(dc,
+					tegra_dc_win_writel(win,
 						DC_WIN_BUFFER_SURFACE_BL_16B2 |
 						(win->block_height_log2
 							<< BLOCK_HEIGHT_SHIFT),
 						DC_WIN_BUFFER_SURFACE_KIND);
 				} else if (WIN_IS_TILED(win)) {
-					tegra_dc_writel(dc,
+					tegra_dc_win_writel(win,
 						DC_WIN_BUFFER_SURFACE_TILED,
 						DC_WIN_BUFFER_SURFACE_KIND);
 				} else {
-					tegra_dc_writel(dc,
+					tegra_dc_win_writel(win,
 						DC_WIN_BUFFER_SURFACE_PITCH,
 						DC_WIN_BUFFER_SURFACE_KIND);
 				}
@@ -878,9 +1087,10 @@ static int _tegra_dc_program_windows(struct tegra_dc *dc,
 		if (!tegra_dc_feature_is_gen2_blender(dc, win->idx)) {
 			/* Update global alpha if blender is gen1. */
 			if (win->global_alpha == 255) {
-				tegra_dc_writel(dc, 0, DC_WIN_GLOBAL_ALPHA);
+				tegra_dc_win_writel(win, 0,
+					DC_WIN_GLOBAL_ALPHA);
 			} else {
-				tegra_dc_writel(dc, GLOBAL_ALPHA_ENABLE |
+				tegra_dc_win_writel(win, GLOBAL_ALPHA_ENABLE |
 					win->global_alpha, DC_WIN_GLOBAL_ALPHA);
 				win_options |= CP_ENABLE;
 			}
@@ -896,6 +1106,9 @@ static int _tegra_dc_program_windows(struct tegra_dc *dc,
 				win_options |= INTERLACE_ENABLE;
 		}
 		if (dc_win->csc_dirty) {
+			/* CSC is not shadowed, select the window header */
+			tegra_dc_writel(dc, WINDOW_A_SELECT << win->idx,
+					DC_CMD_DISPLAY_WINDOW_HEADER);
 			tegra_dc_set_win_csc(dc, &dc_win->win_csc);
 			dc_win->csc_dirty = false;
 		}
@@ -903,7 +1116,7 @@ static int _tegra_dc_program_windows(struct tegra_dc *dc,
 		if (dc->yuv_bypass)
 			win_options &= ~CP_ENABLE;
 
-		tegra_dc_writel(dc, win_options, DC_WIN_WIN_OPTIONS);
+		tegra_dc_win_writel(win, win_options, DC_WIN_WIN_OPTIONS);
 
 		dc_win->dirty = 1;
 
@@ -927,9 +1140,15 @@ static int _tegra_dc_program_windows(struct tegra_dc *dc,
 
 	tegra_dc_set_dynamic_emc(dc);
 
+	/* push the registers that changed since the last flip */
+	tegra_dc_shadow_flush(dc);
+
 	/* prevent FIFO from taking in stale data after a reset */
-	if (tegra_dc_is_t21x())
+	if (tegra_dc_is_t21x()) {
+		tegra_dc_writel(dc, WINDOW_A_SELECT << windows[n - 1]->idx,
+				DC_CMD_DISPLAY_WINDOW_HEADER);
 		tegra_dc_writel(dc, MEMFETCH_RESET, DC_WINBUF_MEMFETCH_CONTROL);
+	}
 
 	/* WIN_x_UPDATE is the same as WIN_x_ACT_REQ << 8 */
 	tegra_dc_writel(dc, update_mask << 8, DC_CMD_STATE_CONTROL);
@@ -967,6 +1186,8 @@ static int _tegra_dc_program_windows(struct tegra_dc *dc,
 	else
 		tegra_dc_writel(dc, update_mask, DC_CMD_STATE_CONTROL);
 
+	tegra_dc_shadow_account(dc, dc->reg_writes - reg_writes);
+
 	if (!wait_for_vblank) {
 		/* Don't use a interrupt handler for the update, but leave
 		   vblank interrupts unmasked since they could be used by other
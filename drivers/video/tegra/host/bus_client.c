@@ -31,6 +31,8 @@
 #include <soc/tegra/chip-id.h>
 #include <linux/anon_inodes.h>
 #include <linux/crc32.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 
 #include <trace/events/nvhost.h>
 #include <uapi/linux/nvhost_events.h>
@@ -253,6 +255,10 @@ struct nvhost_channel_userctx {
 	/* lock to protect this structure from concurrent ioctl usage */
 	struct mutex ioctl_lock;
 
+	/* packed submit descriptor copy, reused across submits */
+	void *submit_desc;
+	u32 submit_desc_size;
+
 	/* used for attaching to ctx list in device pdata */
 	struct list_head node;
 };
@@ -314,6 +320,7 @@ static int nvhost_channelrelease(struct inode *inode, struct file *filp)
 	if (pdata->keepalive)
 		nvhost_module_idle(priv->pdev);
 
+	kfree(priv->submit_desc);
 	kfree(priv);
 	return 0;
 }
@@ -521,6 +528,27 @@ static inline u32 get_job_fence(struct nvhost_job *job, u32 id)
 	return fence;
 }
 
+static int submit_add_gather(struct nvhost_job *job,
+			     struct nvhost_device_data *pdata,
+			     const struct nvhost_cmdbuf *cmdbuf,
+			     int pre_fence, u32 class_id)
+{
+	/* verify that the given class id is valid for this engine */
+	if (class_id &&
+	    class_id != pdata->class &&
+	    class_id != NV_HOST1X_CLASS_ID) {
+		nvhost_err(&pdata->pdev->dev,
+			   "invalid class id 0x%x",
+			   class_id);
+		return -EINVAL;
+	}
+
+	nvhost_job_add_gather(job, cmdbuf->mem, cmdbuf->words,
+			      cmdbuf->offset, class_id, pre_fence);
+
+	return 0;
+}
+
 static int submit_add_gathers(struct nvhost_submit_args *args,
 			      struct nvhost_job *job,
 			      struct nvhost_device_data *pdata)
@@ -575,20 +603,10 @@ static int submit_add_gathers(struct nvhost_submit_args *args,
 		if (err)
 			cmdbuf_ext.pre_fence = -1;
 
-		/* verify that the given class id is valid for this engine */
-		if (class_id &&
-		    class_id != pdata->class &&
-		    class_id != NV_HOST1X_CLASS_ID) {
-			nvhost_err(&pdata->pdev->dev,
-				   "invalid class id 0x%x",
-				   class_id);
-			err = -EINVAL;
+		err = submit_add_gather(job, pdata, &cmdbuf,
+					cmdbuf_ext.pre_fence, class_id);
+		if (err)
 			goto free_local_class_ids;
-		}
-
-		nvhost_job_add_gather(job, cmdbuf.mem, cmdbuf.words,
-				      cmdbuf.offset, class_id,
-				      cmdbuf_ext.pre_fence);
 	}
 
 	kfree(local_class_ids);
@@ -650,9 +668,10 @@ static int submit_copy_relocs(struct nvhost_submit_args *args,
 	return 0;
 }
 
-static int submit_get_syncpoints(struct nvhost_submit_args *args,
-				 struct nvhost_job *job,
-				 struct nvhost_channel_userctx *ctx)
+static int submit_set_syncpoint(struct nvhost_job *job,
+				struct nvhost_channel_userctx *ctx,
+				u32 index,
+				const struct nvhost_syncpt_incr *sp)
 {
 	struct nvhost_device_data *pdata = platform_get_drvdata(ctx->pdev);
 
@@ -661,6 +680,42 @@ static int submit_get_syncpoints(struct nvhost_submit_args *args,
 		ctx->syncpts :
 		ctx->ch->syncpts;
 
+	int j;
+
+	/* Validate the trivial case */
+	if (sp->syncpt_id == 0) {
+		nvhost_err(&pdata->pdev->dev,
+			   "syncpt_id 0 forbidden");
+		return -EINVAL;
+	}
+
+	/* ..and then ensure that the syncpoints have been reserved
+	 * for this client */
+	for (j = 0; j < NVHOST_MODULE_MAX_SYNCPTS; j++) {
+		if (syncpt_array[j] == sp->syncpt_id)
+			break;
+	}
+
+	if (j == NVHOST_MODULE_MAX_SYNCPTS) {
+		nvhost_err(&pdata->pdev->dev,
+			   "tried to use unreserved syncpoint %u",
+			   sp->syncpt_id);
+		return -EINVAL;
+	}
+
+	/* Store and get a reference */
+	job->sp[index].id = sp->syncpt_id;
+	job->sp[index].incrs = sp->syncpt_incrs;
+
+	return 0;
+}
+
+static int submit_get_syncpoints(struct nvhost_submit_args *args,
+				 struct nvhost_job *job,
+				 struct nvhost_channel_userctx *ctx)
+{
+	struct nvhost_device_data *pdata = platform_get_drvdata(ctx->pdev);
+
 	struct nvhost_syncpt_incr __user *syncpt_incrs =
 		(struct nvhost_syncpt_incr __user *)
 				(uintptr_t)args->syncpt_incrs;
@@ -685,8 +740,6 @@ static int submit_get_syncpoints(struct nvhost_submit_args *args,
 
 	for (i = 0; i < args->num_syncpt_incrs; ++i) {
 		struct nvhost_syncpt_incr sp;
-		bool found = false;
-		int j;
 
 		/* Copy */
 		err = copy_from_user(&sp, syncpt_incrs + i, sizeof(sp));
@@ -697,32 +750,9 @@ static int submit_get_syncpoints(struct nvhost_submit_args *args,
 			return -EINVAL;
 		}
 
-		/* Validate the trivial case */
-		if (sp.syncpt_id == 0) {
-			nvhost_err(&pdata->pdev->dev,
-				   "syncpt_id 0 forbidden");
-			return -EINVAL;
-		}
-
-		/* ..and then ensure that the syncpoints have been reserved
-		 * for this client */
-		for (j = 0; j < NVHOST_MODULE_MAX_SYNCPTS; j++) {
-			if (syncpt_array[j] == sp.syncpt_id) {
-				found = true;
-				break;
-			}
-		}
-
-		if (!found) {
-			nvhost_err(&pdata->pdev->dev,
-				   "tried to use unreserved syncpoint %u",
-				   sp.syncpt_id);
-			return -EINVAL;
-		}
-
-		/* Store and get a reference */
-		job->sp[i].id = sp.syncpt_id;
-		job->sp[i].incrs = sp.syncpt_incrs;
+		err = submit_set_syncpoint(job, ctx, i, &sp);
+		if (err)
+			return err;
 	}
 
 	return 0;
@@ -781,22 +811,18 @@ static int submit_deliver_fences(struct nvhost_submit_args *args,
 	return 0;
 }
 
-static int nvhost_ioctl_channel_submit(struct nvhost_channel_userctx *ctx,
-		struct nvhost_submit_args *args)
+static struct nvhost_job *submit_job_alloc(struct nvhost_channel_userctx *ctx,
+					   struct nvhost_submit_args *args)
 {
-	struct nvhost_job *job;
-	struct nvhost_waitchk __user *waitchks =
-		(struct nvhost_waitchk __user *)(uintptr_t)args->waitchks;
 	struct nvhost_device_data *pdata = platform_get_drvdata(ctx->pdev);
-
-	int err;
+	struct nvhost_job *job;
 
 	if ((args->num_syncpt_incrs < 1) || (args->num_syncpt_incrs >
 		nvhost_syncpt_nb_pts(&nvhost_get_host(ctx->pdev)->syncpt))) {
 		nvhost_err(&pdata->pdev->dev,
 			   "invalid num_syncpt_incrs=%u",
 			   args->num_syncpt_incrs);
-		return -EINVAL;
+		return ERR_PTR(-EINVAL);
 	}
 
 	job = nvhost_job_alloc(ctx->ch,
@@ -805,7 +831,7 @@ static int nvhost_ioctl_channel_submit(struct nvhost_channel_userctx *ctx,
 			args->num_waitchks,
 			args->num_syncpt_incrs);
 	if (!job)
-		return -ENOMEM;
+		return ERR_PTR(-ENOMEM);
 
 	job->num_syncpts = args->num_syncpt_incrs;
 	job->clientid = ctx->clientid;
@@ -820,28 +846,20 @@ static int nvhost_ioctl_channel_submit(struct nvhost_channel_userctx *ctx,
 		job->error_notifier_offset = ctx->error_notifier_offset;
 	}
 
-	err = submit_add_gathers(args, job, pdata);
-	if (err)
-		goto put_job;
-
-	err = submit_copy_relocs(args, job);
-	if (err)
-		goto put_job;
-
-	job->num_waitchk = args->num_waitchks;
-	err = copy_from_user(job->waitchk,
-			waitchks, sizeof(*waitchks) * args->num_waitchks);
-	if (err) {
-		nvhost_err(&pdata->pdev->dev,
-			   "failed to copy user input: waitchks=%px num_waitchks=%u",
-			   waitchks, args->num_waitchks);
-		err = -EINVAL;
-		goto put_job;
-	}
+	return job;
+}
 
-	err = submit_get_syncpoints(args, job, ctx);
-	if (err)
-		goto put_job;
+/*
+ * Pin and submit a job whose gathers, relocs, waitchks and syncpoints have
+ * been filled in, then hand the fences back. Drops the caller's job
+ * reference.
+ */
+static int submit_job_run(struct nvhost_channel_userctx *ctx,
+			  struct nvhost_submit_args *args,
+			  struct nvhost_job *job)
+{
+	struct nvhost_device_data *pdata = platform_get_drvdata(ctx->pdev);
+	int err;
 
 	trace_nvhost_channel_submit(ctx->pdev->name,
 		job->num_gathers, job->num_relocs, job->num_waitchk,
@@ -889,6 +907,308 @@ put_job:
 	return err;
 }
 
+static void submit_account_parse(struct nvhost_device_data *pdata,
+				 bool packed, u64 start_ns)
+{
+	atomic64_add(ktime_get_ns() - start_ns,
+		     &pdata->submit_parse_ns[packed]);
+	atomic64_inc(&pdata->submit_parse_count[packed]);
+}
+
+static int nvhost_ioctl_channel_submit(struct nvhost_channel_userctx *ctx,
+		struct nvhost_submit_args *args)
+{
+	struct nvhost_job *job;
+	struct nvhost_waitchk __user *waitchks =
+		(struct nvhost_waitchk __user *)(uintptr_t)args->waitchks;
+	struct nvhost_device_data *pdata = platform_get_drvdata(ctx->pdev);
+	u64 start_ns = ktime_get_ns();
+
+	int err;
+
+	job = submit_job_alloc(ctx, args);
+	if (IS_ERR(job))
+		return PTR_ERR(job);
+
+	err = submit_add_gathers(args, job, pdata);
+	if (err)
+		goto put_job;
+
+	err = submit_copy_relocs(args, job);
+	if (err)
+		goto put_job;
+
+	job->num_waitchk = args->num_waitchks;
+	err = copy_from_user(job->waitchk,
+			waitchks, sizeof(*waitchks) * args->num_waitchks);
+	if (err) {
+		nvhost_err(&pdata->pdev->dev,
+			   "failed to copy user input: waitchks=%px num_waitchks=%u",
+			   waitchks, args->num_waitchks);
+		err = -EINVAL;
+		goto put_job;
+	}
+
+	err = submit_get_syncpoints(args, job, ctx);
+	if (err)
+		goto put_job;
+
+	submit_account_parse(pdata, false, start_ns);
+
+	return submit_job_run(ctx, args, job);
+
+put_job:
+	nvhost_job_put(job);
+
+	nvhost_err(&pdata->pdev->dev, "failed with err %d", err);
+
+	return err;
+}
+
+/*
+ * Return a pointer to an array of count elements of elem_size bytes at
+ * byte offset off of the packed descriptor, or NULL if it does not fit.
+ */
+static void *submit_packed_array(void *desc, u32 desc_size, u32 off,
+				 u32 count, size_t elem_size)
+{
+	if (!off || !IS_ALIGNED(off, 4) ||
+	    off < sizeof(struct nvhost_submit_packed_hdr) ||
+	    (u64)off + (u64)count * elem_size > desc_size)
+		return NULL;
+
+	return desc + off;
+}
+
+static int submit_parse_packed(struct nvhost_channel_userctx *ctx,
+			       struct nvhost_job *job,
+			       void *desc, u32 desc_size)
+{
+	struct nvhost_device_data *pdata = platform_get_drvdata(ctx->pdev);
+	struct nvhost_submit_packed_hdr *hdr = desc;
+	struct nvhost_syncpt_incr *syncpt_incrs;
+	struct nvhost_cmdbuf *cmdbufs;
+	struct nvhost_cmdbuf_ext *cmdbuf_exts = NULL;
+	u32 *class_ids = NULL;
+	struct nvhost_reloc *relocs = NULL;
+	struct nvhost_reloc_shift *reloc_shifts = NULL;
+	struct nvhost_reloc_type *reloc_types = NULL;
+	struct nvhost_waitchk *waitchks = NULL;
+	int err;
+	u32 i;
+
+	/* validate the whole layout before touching the job */
+	syncpt_incrs = submit_packed_array(desc, desc_size, hdr->syncpt_incrs,
+				hdr->num_syncpt_incrs, sizeof(*syncpt_incrs));
+	cmdbufs = submit_packed_array(desc, desc_size, hdr->cmdbufs,
+				hdr->num_cmdbufs, sizeof(*cmdbufs));
+	if (!syncpt_incrs || (hdr->num_cmdbufs && !cmdbufs))
+		goto invalid;
+
+	if (hdr->cmdbuf_exts) {
+		cmdbuf_exts = submit_packed_array(desc, desc_size,
+				hdr->cmdbuf_exts, hdr->num_cmdbufs,
+				sizeof(*cmdbuf_exts));
+		if (!cmdbuf_exts)
+			goto invalid;
+	}
+
+	if (hdr->class_ids) {
+		class_ids = submit_packed_array(desc, desc_size,
+				hdr->class_ids, hdr->num_cmdbufs,
+				sizeof(*class_ids));
+		if (!class_ids)
+			goto invalid;
+	}
+
+	if (hdr->num_relocs) {
+		relocs = submit_packed_array(desc, desc_size, hdr->relocs,
+				hdr->num_relocs, sizeof(*relocs));
+		reloc_shifts = submit_packed_array(desc, desc_size,
+				hdr->reloc_shifts, hdr->num_relocs,
+				sizeof(*reloc_shifts));
+		if (!relocs || !reloc_shifts)
+			goto invalid;
+
+		if (hdr->reloc_types) {
+			reloc_types = submit_packed_array(desc, desc_size,
+					hdr->reloc_types, hdr->num_relocs,
+					sizeof(*reloc_types));
+			if (!reloc_types)
+				goto invalid;
+		}
+	}
+
+	if (hdr->num_waitchks) {
+		waitchks = submit_packed_array(desc, desc_size, hdr->waitchks,
+				hdr->num_waitchks, sizeof(*waitchks));
+		if (!waitchks)
+			goto invalid;
+	}
+
+	for (i = 0; i < hdr->num_cmdbufs; i++) {
+		err = submit_add_gather(job, pdata, &cmdbufs[i],
+				cmdbuf_exts ? cmdbuf_exts[i].pre_fence : -1,
+				class_ids ? class_ids[i] : 0);
+		if (err)
+			return err;
+	}
+
+	job->num_relocs = hdr->num_relocs;
+	if (relocs) {
+		memcpy(job->relocarray, relocs,
+		       sizeof(*relocs) * hdr->num_relocs);
+		memcpy(job->relocshiftarray, reloc_shifts,
+		       sizeof(*reloc_shifts) * hdr->num_relocs);
+	}
+	if (reloc_types)
+		memcpy(job->reloctypearray, reloc_types,
+		       sizeof(*reloc_types) * hdr->num_relocs);
+
+	job->num_waitchk = hdr->num_waitchks;
+	if (waitchks)
+		memcpy(job->waitchk, waitchks,
+		       sizeof(*waitchks) * hdr->num_waitchks);
+
+	for (i = 0; i < hdr->num_syncpt_incrs; i++) {
+		err = submit_set_syncpoint(job, ctx, i, &syncpt_incrs[i]);
+		if (err)
+			return err;
+	}
+
+	return 0;
+
+invalid:
+	nvhost_err(&pdata->pdev->dev, "malformed packed submit descriptor");
+	return -EINVAL;
+}
+
+static int nvhost_ioctl_channel_submit_packed(
+	struct nvhost_channel_userctx *ctx,
+	struct nvhost_submit_packed_args *pargs)
+{
+	struct nvhost_device_data *pdata = platform_get_drvdata(ctx->pdev);
+	struct nvhost_submit_packed_hdr *hdr;
+	struct nvhost_submit_args args;
+	struct nvhost_job *job;
+	u64 start_ns = ktime_get_ns();
+	u32 size = pargs->desc_size;
+	int err;
+
+	if (size < sizeof(*hdr) || size > NVHOST_SUBMIT_PACKED_MAX_SIZE) {
+		nvhost_err(&pdata->pdev->dev,
+			   "invalid packed submit size %u", size);
+		return -EINVAL;
+	}
+
+	/* the descriptor buffer is reused by later submits on this fd */
+	if (size > ctx->submit_desc_size) {
+		void *desc = kmalloc(size, GFP_KERNEL);
+
+		if (!desc)
+			return -ENOMEM;
+		kfree(ctx->submit_desc);
+		ctx->submit_desc = desc;
+		ctx->submit_desc_size = size;
+	}
+
+	if (copy_from_user(ctx->submit_desc,
+			   (void __user *)(uintptr_t)pargs->desc, size)) {
+		nvhost_err(&pdata->pdev->dev,
+			   "failed to copy user input: desc=%llx size=%u",
+			   pargs->desc, size);
+		return -EFAULT;
+	}
+
+	hdr = ctx->submit_desc;
+	if (hdr->version != NVHOST_SUBMIT_PACKED_VERSION ||
+	    hdr->size != size) {
+		nvhost_err(&pdata->pdev->dev,
+			   "unsupported packed submit version=%u size=%u",
+			   hdr->version, hdr->size);
+		return -EINVAL;
+	}
+
+	if (hdr->num_syncpt_incrs > NVHOST_SUBMIT_MAX_NUM_SYNCPT_INCRS) {
+		nvhost_err(&pdata->pdev->dev,
+			   "num_syncpt_incrs=%u is larger than max=%u",
+			   hdr->num_syncpt_incrs,
+			   NVHOST_SUBMIT_MAX_NUM_SYNCPT_INCRS);
+		return -EINVAL;
+	}
+
+	memset(&args, 0, sizeof(args));
+	args.num_syncpt_incrs = hdr->num_syncpt_incrs;
+	args.num_cmdbufs = hdr->num_cmdbufs;
+	args.num_relocs = hdr->num_relocs;
+	args.num_waitchks = hdr->num_waitchks;
+	args.timeout = hdr->timeout;
+	args.flags = hdr->flags;
+	args.fences = pargs->fences;
+
+	job = submit_job_alloc(ctx, &args);
+	if (IS_ERR(job))
+		return PTR_ERR(job);
+
+	err = submit_parse_packed(ctx, job, ctx->submit_desc, size);
+	if (err) {
+		nvhost_job_put(job);
+		nvhost_err(&pdata->pdev->dev, "failed with err %d", err);
+		return err;
+	}
+
+	submit_account_parse(pdata, true, start_ns);
+
+	err = submit_job_run(ctx, &args, job);
+	pargs->fence = args.fence;
+
+	return err;
+}
+
+/*
+ * Map a channel for a submit ioctl and synchronize the client's syncpoints
+ * into it. The caller drops the channel reference after the submit.
+ */
+static int nvhost_ioctl_submit_map_channel(struct nvhost_channel_userctx *priv)
+{
+	struct nvhost_device_data *pdata = platform_get_drvdata(priv->pdev);
+	void *identifier;
+	int err;
+
+	if (pdata->resource_policy == RESOURCE_PER_DEVICE &&
+	    !pdata->exclusive)
+		identifier = (void *)pdata;
+	else
+		identifier = (void *)priv;
+
+	/* first, get a channel */
+	err = nvhost_channel_map(pdata, &priv->ch, identifier);
+	if (err)
+		return err;
+
+	/* ..then, synchronize syncpoint information.
+	 *
+	 * This information is updated only in this ioctl and
+	 * channel destruction. We already hold channel
+	 * reference and this ioctl is serialized => no-one is
+	 * modifying the syncpoint field concurrently.
+	 *
+	 * Synchronization is not destructing anything
+	 * in the structure; We can only allocate new
+	 * syncpoints, and hence old ones cannot be released
+	 * by following operation. If some syncpoint is stored
+	 * into the channel structure, it remains there. */
+
+	if (pdata->resource_policy == RESOURCE_PER_CHANNEL_INSTANCE) {
+		memcpy(priv->ch->syncpts, priv->syncpts,
+		       sizeof(priv->syncpts));
+		priv->ch->client_managed_syncpt =
+			priv->client_managed_syncpt;
+	}
+
+	return 0;
+}
+
 static int moduleid_to_index(struct platform_device *dev, u32 moduleid)
 {
 	int i;
@@ -1431,17 +1751,8 @@ static long nvhost_channelctl(struct file *filp,
 		break;
 	case NVHOST32_IOCTL_CHANNEL_SUBMIT:
 	{
-		struct nvhost_device_data *pdata =
-			platform_get_drvdata(priv->pdev);
 		struct nvhost32_submit_args *args32 = (void *)buf;
 		struct nvhost_submit_args args;
-		void *identifier;
-
-		if (pdata->resource_policy == RESOURCE_PER_DEVICE &&
-		    !pdata->exclusive)
-			identifier = (void *)pdata;
-		else
-			identifier = (void *)priv;
 
 		memset(&args, 0, sizeof(args));
 		args.submit_version = args32->submit_version;
@@ -1460,31 +1771,10 @@ static long nvhost_channelctl(struct file *filp,
 		args.class_ids = args32->class_ids;
 		args.fences = args32->fences;
 
-		/* first, get a channel */
-		err = nvhost_channel_map(pdata, &priv->ch, identifier);
+		err = nvhost_ioctl_submit_map_channel(priv);
 		if (err)
 			break;
 
-		/* ..then, synchronize syncpoint information.
-		 *
-		 * This information is updated only in this ioctl and
-		 * channel destruction. We already hold channel
-		 * reference and this ioctl is serialized => no-one is
-		 * modifying the syncpoint field concurrently.
-		 *
-		 * Synchronization is not destructing anything
-		 * in the structure; We can only allocate new
-		 * syncpoints, and hence old ones cannot be released
-		 * by following operation. If some syncpoint is stored
-		 * into the channel structure, it remains there. */
-
-		if (pdata->resource_policy == RESOURCE_PER_CHANNEL_INSTANCE) {
-			memcpy(priv->ch->syncpts, priv->syncpts,
-			       sizeof(priv->syncpts));
-			priv->ch->client_managed_syncpt =
-				priv->client_managed_syncpt;
-		}
-
 		/* submit work */
 		err = nvhost_ioctl_channel_submit(priv, &args);
 
@@ -1497,41 +1787,10 @@ static long nvhost_channelctl(struct file *filp,
 	}
 	case NVHOST_IOCTL_CHANNEL_SUBMIT:
 	{
-		struct nvhost_device_data *pdata =
-			platform_get_drvdata(priv->pdev);
-		void *identifier;
-
-		if (pdata->resource_policy == RESOURCE_PER_DEVICE &&
-		    !pdata->exclusive)
-			identifier = (void *)pdata;
-		else
-			identifier = (void *)priv;
-
-		/* first, get a channel */
-		err = nvhost_channel_map(pdata, &priv->ch, identifier);
+		err = nvhost_ioctl_submit_map_channel(priv);
 		if (err)
 			break;
 
-		/* ..then, synchronize syncpoint information.
-		 *
-		 * This information is updated only in this ioctl and
-		 * channel destruction. We already hold channel
-		 * reference and this ioctl is serialized => no-one is
-		 * modifying the syncpoint field concurrently.
-		 *
-		 * Synchronization is not destructing anything
-		 * in the structure; We can only allocate new
-		 * syncpoints, and hence old ones cannot be released
-		 * by following operation. If some syncpoint is stored
-		 * into the channel structure, it remains there. */
-
-		if (pdata->resource_policy == RESOURCE_PER_CHANNEL_INSTANCE) {
-			memcpy(priv->ch->syncpts, priv->syncpts,
-			       sizeof(priv->syncpts));
-			priv->ch->client_managed_syncpt =
-				priv->client_managed_syncpt;
-		}
-
 		/* submit work */
 		err = nvhost_ioctl_channel_submit(priv, (void *)buf);
 
@@ -1540,6 +1799,18 @@ static long nvhost_channelctl(struct file *filp,
 
 		break;
 	}
+	case NVHOST_IOCTL_CHANNEL_SUBMIT_PACKED:
+	{
+		err = nvhost_ioctl_submit_map_channel(priv);
+		if (err)
+			break;
+
+		err = nvhost_ioctl_channel_submit_packed(priv, (void *)buf);
+
+		nvhost_putchannel(priv->ch, 1);
+
+		break;
+	}
 	case NVHOST_IOCTL_CHANNEL_SET_ERROR_NOTIFIER:
 		err = nvhost_init_error_notifier(priv,
 			(struct nvhost_set_error_notifier *)buf);
@@ -1734,6 +2005,36 @@ static void nvhost_client_user_deinit(struct platform_device *dev)
 	unregister_chrdev_region(pdata->cdev_region, NVHOST_NUM_CDEV);
 }
 
+static int submit_stats_show(struct seq_file *s, void *unused)
+{
+	struct nvhost_device_data *pdata = s->private;
+	static const char * const names[] = { "legacy", "packed" };
+	int i;
+
+	seq_printf(s, "%-8s %12s %12s\n", "ioctl", "submits", "avg_parse_ns");
+	for (i = 0; i < ARRAY_SIZE(names); i++) {
+		u64 count = atomic64_read(&pdata->submit_parse_count[i]);
+		u64 ns = atomic64_read(&pdata->submit_parse_ns[i]);
+
+		seq_printf(s, "%-8s %12llu %12llu\n", names[i], count,
+			   count ? div64_u64(ns, count) : 0);
+	}
+
+	return 0;
+}
+
+static int submit_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, submit_stats_show, inode->i_private);
+}
+
+static const struct file_operations submit_stats_fops = {
+	.open		= submit_stats_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
 int nvhost_client_device_init(struct platform_device *dev)
 {
 	int err;
@@ -1747,6 +2048,9 @@ int nvhost_client_device_init(struct platform_device *dev)
 
 	/* Create debugfs directory for the device */
 	nvhost_device_debug_init(dev);
+	if (!IS_ERR_OR_NULL(pdata->debugfs))
+		debugfs_create_file("submit_stats", S_IRUGO, pdata->debugfs,
+				    pdata, &submit_stats_fops);
 
 	err = nvhost_client_user_init(dev);
 	if (err)
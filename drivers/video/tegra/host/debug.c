@@ -218,6 +218,106 @@ static const struct file_operations nvhost_debug_fops = {
 	.release	= single_release,
 };
 
+static const char * const cdma_lat_names[NVHOST_CDMA_LAT_COUNT] = {
+	[NVHOST_CDMA_LAT_SUBMIT_PUSH] = "submit_push",
+	[NVHOST_CDMA_LAT_PUSH_COMPLETE] = "push_complete",
+	[NVHOST_CDMA_LAT_COMPLETE_CLEANUP] = "complete_cleanup",
+};
+
+static void show_cdma_stats(struct seq_file *s, struct nvhost_channel *ch)
+{
+	struct nvhost_cdma_stats *stats = &ch->cdma.stats;
+	int i, j;
+
+	seq_printf(s, "channel %d - %s\n", ch->chid,
+		   ch->dev ? ch->dev->name : "unmapped");
+
+	for (i = 0; i < NVHOST_CDMA_LAT_COUNT; i++) {
+		int count = atomic_read(&stats->lat_count[i]);
+
+		seq_printf(s, "  %-16s count %d avg_ns %llu\n   ",
+			   cdma_lat_names[i], count,
+			   count ? div_u64(atomic64_read(
+				&stats->lat_total_ns[i]), count) : 0);
+		for (j = 0; j < NVHOST_CDMA_LAT_BUCKETS; j++)
+			seq_printf(s, " %d",
+				   atomic_read(&stats->lat_hist[i][j]));
+		seq_puts(s, "\n");
+	}
+
+	seq_printf(s, "  pb_max_used %u/%u\n   ", stats->pb_max_used,
+		   PUSH_BUFFER_SIZE / 8);
+	for (j = 0; j < NVHOST_CDMA_PB_BUCKETS; j++)
+		seq_printf(s, " %d", atomic_read(&stats->pb_hist[j]));
+	seq_puts(s, "\n");
+
+	i = CDMA_EVENT_PUSH_BUFFER_SPACE;
+	seq_printf(s, "  pb_space_waits %d wait_ns %lld\n",
+		   atomic_read(&stats->waits[i]),
+		   atomic64_read(&stats->wait_ns[i]));
+	i = CDMA_EVENT_SYNC_QUEUE_EMPTY;
+	seq_printf(s, "  sync_queue_waits %d wait_ns %lld\n",
+		   atomic_read(&stats->waits[i]),
+		   atomic64_read(&stats->wait_ns[i]));
+	seq_printf(s, "  timeouts %d\n", atomic_read(&stats->timeouts));
+}
+
+static int nvhost_debug_cdma_stats_show(struct seq_file *s, void *unused)
+{
+	struct nvhost_master *m = s->private;
+	int index;
+
+	seq_printf(s, "latency buckets: log2(usec), %d; pb buckets: 1/%d of pb\n",
+		   NVHOST_CDMA_LAT_BUCKETS, NVHOST_CDMA_PB_BUCKETS);
+
+	mutex_lock(&m->chlist_mutex);
+	for (index = 0; index < nvhost_channel_nb_channels(m); index++) {
+		struct nvhost_channel *ch = m->chlist[index];
+
+		if (!ch || !atomic_read(&ch->cdma.stats.lat_count[
+				NVHOST_CDMA_LAT_COMPLETE_CLEANUP]))
+			continue;
+
+		show_cdma_stats(s, ch);
+	}
+	mutex_unlock(&m->chlist_mutex);
+
+	return 0;
+}
+
+static int nvhost_debug_cdma_stats_open(struct inode *inode,
+					struct file *file)
+{
+	return single_open(file, nvhost_debug_cdma_stats_show,
+			   inode->i_private);
+}
+
+static ssize_t nvhost_debug_cdma_stats_write(struct file *file,
+					     const char __user *buf,
+					     size_t count, loff_t *ppos)
+{
+	struct seq_file *s = file->private_data;
+	struct nvhost_master *m = s->private;
+	int index;
+
+	/* any write clears the statistics of all channels */
+	mutex_lock(&m->chlist_mutex);
+	for (index = 0; index < nvhost_channel_nb_channels(m); index++)
+		if (m->chlist[index])
+			nvhost_cdma_stats_clear(&m->chlist[index]->cdma.stats);
+	mutex_unlock(&m->chlist_mutex);
+
+	return count;
+}
+
+static const struct file_operations nvhost_debug_cdma_stats_fops = {
+	.open		= nvhost_debug_cdma_stats_open,
+	.read		= seq_read,
+	.write		= nvhost_debug_cdma_stats_write,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
 void nvhost_device_debug_init(struct platform_device *dev)
 {
 	struct nvhost_device_data *pdata = platform_get_drvdata(dev);
@@ -253,6 +353,8 @@ void nvhost_debug_init(struct nvhost_master *master)
 			master, &nvhost_debug_fops);
 	debugfs_create_file("status_all", S_IRUGO, de,
 			master, &nvhost_debug_all_fops);
+	debugfs_create_file("cdma_stats", S_IRUGO|S_IWUSR, de,
+			master, &nvhost_debug_cdma_stats_fops);
 
 	debugfs_create_u32("trace_cmdbuf", S_IRUGO|S_IWUSR, de,
 			&nvhost_debug_trace_cmdbuf);
@@ -274,6 +376,11 @@ void nvhost_debug_init(struct nvhost_master *master)
 			&pdata->nvhost_timeout_default);
 	debugfs_create_u32("trace_actmon", S_IRUGO|S_IWUSR, de,
 			&nvhost_debug_trace_actmon);
+
+	nvhost_job_debug_init(master, de);
+	nvhost_intr_debug_init(&master->intr, de);
+	nvhost_syncpt_debug_init(&master->syncpt, de);
+	nvhost_cdma_debug_init(de);
 }
 
 void nvhost_register_dump_device(
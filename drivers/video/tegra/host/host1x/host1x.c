@@ -177,6 +177,16 @@ static int nvhost_ioctl_ctrl_syncpt_incr(struct nvhost_ctrl_userctx *ctx,
 	return 0;
 }
 
+static u32 syncpt_wait_flags(struct nvhost_ctrl_userctx *ctx)
+{
+	u32 flags = NVHOST_SYNCPT_WAIT_INTERRUPTIBLE;
+
+	if (READ_ONCE(ctx->dev->syncpt.wait_hybrid))
+		flags |= NVHOST_SYNCPT_WAIT_HYBRID;
+
+	return flags;
+}
+
 static int nvhost_ioctl_ctrl_syncpt_waitex(struct nvhost_ctrl_userctx *ctx,
 	struct nvhost_ctrl_syncpt_waitex_args *args)
 {
@@ -197,9 +207,9 @@ static int nvhost_ioctl_ctrl_syncpt_waitex(struct nvhost_ctrl_userctx *ctx,
 	else
 		timeout = (u32)msecs_to_jiffies(args->timeout);
 
-	err = nvhost_syncpt_wait_timeout(&ctx->dev->syncpt, args->id,
+	err = nvhost_syncpt_wait_timeout_flags(&ctx->dev->syncpt, args->id,
 					args->thresh, timeout, &args->value,
-					NULL, true);
+					NULL, syncpt_wait_flags(ctx));
 	trace_nvhost_ioctl_ctrl_syncpt_wait(args->id, args->thresh,
 	  args->timeout, args->value, err);
 
@@ -220,9 +230,9 @@ static int nvhost_ioctl_ctrl_syncpt_waitmex(struct nvhost_ctrl_userctx *ctx,
 	else
 		timeout = (u32)msecs_to_jiffies(args->timeout);
 
-	err = nvhost_syncpt_wait_timeout(&ctx->dev->syncpt, args->id,
+	err = nvhost_syncpt_wait_timeout_flags(&ctx->dev->syncpt, args->id,
 					args->thresh, timeout, &args->value,
-					&nvts, true);
+					&nvts, syncpt_wait_flags(ctx));
 	args->tv_sec = nvts.ts.tv_sec;
 	args->tv_nsec = nvts.ts.tv_nsec;
 	args->clock_id = nvts.clock;
@@ -393,7 +393,7 @@ static int host1x_channel_submit(struct nvhost_job *job)
 
 error:
 	for (i = 0; i < job->num_syncpts; ++i)
-		kfree(completed_waiters[i]);
+		nvhost_intr_free_waiter(completed_waiters[i]);
 	return err;
 }
 
@@ -392,6 +392,8 @@ int nvdla_put_cmd_memory(struct platform_device *pdev, int index);
 int nvdla_set_queue_state(struct nvhost_queue *queue, int cmd);
 int nvdla_get_task_mem(struct nvhost_queue *queue,
 				struct nvdla_task **task);
+int nvdla_get_task_mem_batch(struct nvhost_queue *queue,
+			struct nvdla_task **tasks, unsigned int num_tasks);
 void nvdla_put_task_mem(struct nvdla_task *task);
 size_t nvdla_get_max_task_size(void);
 int nvdla_alloc_gcov_region(struct platform_device *pdev);
@@ -401,6 +403,17 @@ int nvdla_emulator_submit(struct nvhost_queue *queue,
 				struct nvdla_emu_task *task);
 void task_free(struct kref *ref);
 int nvdla_get_postfences(struct nvhost_queue *queue, void *in_task);
+
+/**
+ * nvdla_task_abort()	release a filled task that was never submitted
+ *
+ * @task		Pointer to task in operation
+ *
+ * Return		void
+ *
+ * This function unpins the task memory and drops the initial task reference
+ */
+void nvdla_task_abort(struct nvdla_task *task);
 int nvdla_send_gos_region(struct platform_device *pdev);
 
 #endif /* End of __NVHOST_NVDLA_H__ */
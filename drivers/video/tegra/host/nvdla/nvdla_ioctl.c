@@ -746,17 +746,32 @@ exit:
 	return 0;
 }
 
+static void nvdla_release_tasks(struct nvdla_task **tasks,
+				unsigned int first, unsigned int num_filled,
+				unsigned int num_tasks)
+{
+	unsigned int i;
+
+	for (i = first; i < num_tasks; i++) {
+		if (i < num_filled)
+			nvdla_task_abort(tasks[i]);
+		else
+			nvdla_put_task_mem(tasks[i]);
+	}
+}
+
 static int nvdla_submit(struct nvdla_private *priv, void *arg)
 {
 	struct nvdla_submit_args *args =
 			(struct nvdla_submit_args *)arg;
 	struct nvdla_ioctl_submit_task __user *user_tasks;
 	struct nvdla_ioctl_submit_task local_tasks[MAX_TASKS_PER_SUBMIT];
+	struct nvdla_task *tasks[MAX_TASKS_PER_SUBMIT];
 	struct platform_device *pdev;
 	struct nvhost_queue *queue;
 	struct nvhost_buffers *buffers;
+	unsigned int num_filled = 0, num_submitted = 0;
 	u32 num_tasks;
-	struct nvdla_task *task;
 	int err = 0, i = 0;
 
 	if (!args || !priv)
@@ -789,24 +804,26 @@ static int nvdla_submit(struct nvdla_private *priv, void *arg)
 	}
 	nvdla_dbg_info(pdev, "copy of user tasks done");
 
-	for (i = 0; i < num_tasks; i++) {
-
-		nvdla_dbg_info(pdev, "submit [%d]th task", i + 1);
+	/* task descriptors of a submit are allocated next to each other */
+	err = nvdla_get_task_mem_batch(queue, tasks, num_tasks);
+	if (err) {
+		nvdla_dbg_err(pdev, "failed to get mem for %u tasks",
+				num_tasks);
+		goto fail_to_get_task_mem;
+	}
+	nvdla_dbg_info(pdev, "task mem allocate done");
 
-		err = nvdla_get_task_mem(queue, &task);
-		if (err) {
-			nvdla_dbg_err(pdev, "failed to get task[%d] mem", i + 1);
-			goto fail_to_get_task_mem;
-		}
-		nvdla_dbg_info(pdev, "task[%d] mem allocate done", i + 1);
+	/* pin and fill every task before handing the batch to the engine */
+	for (i = 0; i < num_tasks; i++) {
+		struct nvdla_task *task = tasks[i];
 
 		/* fill local task param from user args */
 		err = nvdla_fill_task(queue, buffers, local_tasks + i, task);
 		if (err) {
 			nvdla_dbg_err(pdev, "failed to fill task[%d]", i + 1);
-			kref_put(&task->ref, task_free);
 			goto fail_to_fill_task;
 		}
+		num_filled++;
 		nvdla_dbg_info(pdev, "local task[%d] filled", i + 1);
 
 		/* dump task input parameters */
@@ -820,42 +837,39 @@ static int nvdla_submit(struct nvdla_private *priv, void *arg)
 			goto fail_to_fill_task_desc;
 		}
 		nvdla_dbg_info(pdev, "task[%d] desc filled", i + 1);
+	}
 
-		/* get expected postfences prior to submit */
-		err = nvdla_get_postfences(queue, task);
-		if (err) {
-			nvdla_dbg_err(pdev, "fail to get fences%d", i + 1);
-			goto fail_to_get_fences;
+	/* send jobs to engine through queue framework */
+	err = nvhost_queue_submit_batch(queue, (void **)tasks, num_tasks,
+					&num_submitted);
+	if (err)
+		nvdla_dbg_err(pdev, "fail to submit task: %u",
+				num_submitted + 1);
+	nvdla_dbg_info(pdev, "%u tasks submitted", num_submitted);
+
+	/* update fences to user; the queue holds its own task refs */
+	for (i = 0; i < num_submitted; i++) {
+		if (!err) {
+			err = nvdla_update_postfences(tasks[i],
+						      local_tasks + i);
+			if (err)
+				nvdla_dbg_err(pdev, "fail update postfence%d",
+						i + 1);
 		}
-		nvdla_dbg_info(pdev, "task[%d] got fences", i + 1);
+		kref_put(&tasks[i]->ref, task_free);
+	}
 
-		/* update fences to user */
-		err = nvdla_update_postfences(task, local_tasks + i);
-		if (err) {
-			nvdla_dbg_err(pdev, "fail update postfence%d", i + 1);
-			goto fail_to_update_postfences;
-		}
-		nvdla_dbg_info(pdev, "postfences of task[%d] update", i + 1);
+	if (err)
+		goto fail_to_submit_task;
 
-		/* send job to engine through queue framework */
-		err = nvhost_queue_submit(queue, task);
-		if (err) {
-			nvdla_dbg_err(pdev, "fail to submit task: %d", i + 1);
-			goto fail_to_submit_task;
-		}
-		nvdla_dbg_info(pdev, "task[%d] submitted", i + 1);
-		kref_put(&task->ref, task_free);
-	}
 	nvdla_dbg_fn(pdev, "Task submitted, done!");
 
 	return 0;
 
 fail_to_submit_task:
-fail_to_update_postfences:
-fail_to_get_fences:
 fail_to_fill_task_desc:
 fail_to_fill_task:
-	/*TODO: traverse list in reverse and delete jobs */
+	nvdla_release_tasks(tasks, num_submitted, num_filled, num_tasks);
 fail_to_get_task_mem:
 fail_to_copy_task:
 	return err;
@@ -965,6 +979,8 @@ static int nvdla_open(struct inode *inode, struct file *file)
 		goto err_alloc_buffer;
 	}
 
+	nvhost_buffer_set_cache_stats(priv->buffers, &priv->queue->pin_cache);
+
 	return nonseekable_open(inode, file);
 
 err_alloc_buffer:
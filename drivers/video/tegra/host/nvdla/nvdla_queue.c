@@ -113,6 +113,51 @@ fail_to_assign_pool:
 	return err;
 }
 
+int nvdla_get_task_mem_batch(struct nvhost_queue *queue,
+			struct nvdla_task **tasks, unsigned int num_tasks)
+{
+	struct nvhost_queue_task_mem_info task_mem_info[MAX_TASKS_PER_SUBMIT];
+	struct platform_device *pdev = queue->pool->pdev;
+	unsigned int i;
+	int err;
+
+	nvdla_dbg_fn(pdev, "");
+
+	if (num_tasks > MAX_TASKS_PER_SUBMIT)
+		return -EINVAL;
+
+	err = nvhost_queue_alloc_task_memory_batch(queue, task_mem_info,
+						   num_tasks);
+	if (err < 0)
+		return err;
+
+	/* check if IOVAs are correctly aligned */
+	for (i = 0; i < num_tasks; i++) {
+		if (task_mem_info[i].dma_addr & 0xff) {
+			err = -EFAULT;
+			goto fail_to_aligned_dma;
+		}
+	}
+
+	for (i = 0; i < num_tasks; i++) {
+		struct nvdla_task *task = task_mem_info[i].kmem_addr;
+
+		task->queue = queue;
+		task->task_desc = task_mem_info[i].va;
+		task->task_desc_pa = task_mem_info[i].dma_addr;
+		task->pool_index = task_mem_info[i].pool_index;
+		tasks[i] = task;
+	}
+
+	return 0;
+
+fail_to_aligned_dma:
+	for (i = 0; i < num_tasks; i++)
+		nvhost_queue_free_task_memory(queue,
+					      task_mem_info[i].pool_index);
+	return err;
+}
+
 void nvdla_put_task_mem(struct nvdla_task *task)
 {
 	/* release allocated task desc and task mem */
@@ -1157,9 +1202,9 @@ int nvdla_get_postfences(struct nvhost_queue *queue, void *in_task)
 }
 
 /* Queue management API */
-static int nvdla_queue_submit(struct nvhost_queue *queue, void *in_task)
+static int nvdla_queue_submit_locked(struct nvhost_queue *queue,
+				     struct nvdla_task *task)
 {
-	struct nvdla_task *task = (struct nvdla_task *)in_task;
 	struct nvdla_task *last_task = NULL;
 	struct platform_device *pdev = queue->pool->pdev;
 	struct nvhost_device_data *pdata = platform_get_drvdata(pdev);
@@ -1172,8 +1217,6 @@ static int nvdla_queue_submit(struct nvhost_queue *queue, void *in_task)
 
 	nvdla_dbg_fn(pdev, "");
 
-	mutex_lock(&queue->list_lock);
-
 	/* get fence from nvhost for MMIO mode*/
 	if (nvdla_dev->submit_mode == NVDLA_SUBMIT_MODE_MMIO) {
 		task->fence = nvhost_syncpt_incr_max(task->sp,
@@ -1251,18 +1294,69 @@ static int nvdla_queue_submit(struct nvhost_queue *queue, void *in_task)
 					task->fence);
 		}
 	}
-	mutex_unlock(&queue->list_lock);
 	return err;
 
 fail_to_register:
 fail_to_channel_submit:
 	nvhost_module_idle(pdev);
 fail_to_poweron:
+	return err;
+}
+
+static int nvdla_queue_submit(struct nvhost_queue *queue, void *in_task)
+{
+	int err;
+
+	mutex_lock(&queue->list_lock);
+	err = nvdla_queue_submit_locked(queue, in_task);
+	mutex_unlock(&queue->list_lock);
+
+	return err;
+}
+
+/*
+ * Submit a batch of filled tasks under a single hold of the queue list
+ * lock. Postfences are assigned right before each task is submitted so
+ * that they account for the increments of the earlier tasks in the batch.
+ * The engine still takes one SUBMIT_TASK command per descriptor.
+ *
+ * A task that fails in nvdla_queue_submit_locked() is already linked on
+ * the task list, so it is counted in num_submitted and left to the queue.
+ */
+static int nvdla_queue_submit_batch(struct nvhost_queue *queue,
+				    void **in_tasks, unsigned int num_tasks,
+				    unsigned int *num_submitted)
+{
+	unsigned int i;
+	int err = 0;
+
+	mutex_lock(&queue->list_lock);
+	for (i = 0; i < num_tasks; i++) {
+		struct nvdla_task *task = in_tasks[i];
+
+		err = nvdla_get_postfences(queue, task);
+		if (err)
+			break;
+
+		err = nvdla_queue_submit_locked(queue, task);
+		if (err) {
+			i++;
+			break;
+		}
+	}
 	mutex_unlock(&queue->list_lock);
 
+	*num_submitted = i;
+
 	return err;
 }
 
+void nvdla_task_abort(struct nvdla_task *task)
+{
+	nvdla_unmap_task_memory(task);
+	kref_put(&task->ref, task_free);
+}
+
 int nvdla_set_queue_state(struct nvhost_queue *queue, int cmd)
 {
 	struct platform_device *pdev = queue->pool->pdev;
@@ -1370,6 +1464,7 @@ list_empty:
 struct nvhost_queue_ops nvdla_queue_ops = {
 	.abort = nvdla_queue_abort,
 	.submit = nvdla_queue_submit,
+	.submit_batch = nvdla_queue_submit_batch,
 	.get_task_size =  nvdla_get_task_desc_memsize,
 	.dump = nvdla_queue_dump,
 };
@@ -22,6 +22,7 @@
 #include <linux/slab.h>
 #include <linux/dma-buf.h>
 #include <linux/cvnas.h>
+#include <linux/jiffies.h>
 
 #include "dev.h"
 #include "nvhost_buffer.h"
@@ -36,8 +37,12 @@
  * @size:		Size of the buffer
  * @user_map_count:	Buffer reference count from user space
  * @submit_map_count:	Buffer reference count from task submit
+ * @cached:		Mapping was made by a task submit and may be kept
+ *			on the lru list while idle
+ * @last_used:		jiffies of the last task submit using the buffer
  * @rb_node:		pinned buffer node
  * @list_head:		List entry
+ * @lru_node:		Entry in the lru list while idle and cached
  *
  */
 struct nvhost_vm_buffer {
@@ -52,10 +57,19 @@ struct nvhost_vm_buffer {
 	s32 user_map_count;
 	s32 submit_map_count;
 
+	bool cached;
+	unsigned long last_used;
+
 	struct rb_node rb_node;
 	struct list_head list_head;
+	struct list_head lru_node;
 };
 
+/* Budget for idle mappings kept by the pin cache of a buffer list */
+#define NVHOST_BUFFER_CACHE_MAX_ENTRIES	64
+#define NVHOST_BUFFER_CACHE_MAX_BYTES	(256UL << 20)
+#define NVHOST_BUFFER_CACHE_MAX_AGE	(5 * HZ)
+
 static struct nvhost_vm_buffer *nvhost_find_map_buffer(
 		struct nvhost_buffers *nvhost_buffers, struct dma_buf *dmabuf)
 {
@@ -177,6 +191,7 @@ static int nvhost_buffer_map(struct platform_device *pdev,
 	vm->size = dmabuf->size;
 	vm->addr = dma_addr;
 	vm->user_map_count = 1;
+	INIT_LIST_HEAD(&vm->lru_node);
 
 	return err;
 
@@ -213,6 +228,84 @@ static void nvhost_buffer_unmap(struct nvhost_buffers *nvhost_buffers,
 	kfree(vm);
 }
 
+static void nvhost_buffer_cache_del(struct nvhost_buffers *nvhost_buffers,
+				    struct nvhost_vm_buffer *vm)
+{
+	list_del_init(&vm->lru_node);
+	nvhost_buffers->lru_count--;
+	nvhost_buffers->lru_bytes -= vm->size;
+
+	atomic_dec(&nvhost_buffers->stats->cached);
+	atomic_long_sub(vm->size, &nvhost_buffers->stats->cached_bytes);
+}
+
+/* Unmap idle mappings beyond the size budget or older than the age budget */
+static void nvhost_buffer_cache_trim(struct nvhost_buffers *nvhost_buffers)
+{
+	struct nvhost_vm_buffer *vm;
+
+	while (!list_empty(&nvhost_buffers->lru)) {
+		vm = list_last_entry(&nvhost_buffers->lru,
+				     struct nvhost_vm_buffer, lru_node);
+
+		if (nvhost_buffers->lru_count <=
+				NVHOST_BUFFER_CACHE_MAX_ENTRIES &&
+		    nvhost_buffers->lru_bytes <=
+				NVHOST_BUFFER_CACHE_MAX_BYTES &&
+		    time_before(jiffies,
+				vm->last_used + NVHOST_BUFFER_CACHE_MAX_AGE))
+			break;
+
+		nvhost_buffer_cache_del(nvhost_buffers, vm);
+		atomic_inc(&nvhost_buffers->stats->evictions);
+
+		vm->cached = false;
+		nvhost_buffer_unmap(nvhost_buffers, vm);
+	}
+}
+
+static void nvhost_buffer_cache_work(struct work_struct *work)
+{
+	struct nvhost_buffers *nvhost_buffers =
+		container_of(to_delayed_work(work), struct nvhost_buffers,
+			     lru_work);
+
+	mutex_lock(&nvhost_buffers->mutex);
+	nvhost_buffer_cache_trim(nvhost_buffers);
+	if (!list_empty(&nvhost_buffers->lru))
+		schedule_delayed_work(&nvhost_buffers->lru_work,
+				      NVHOST_BUFFER_CACHE_MAX_AGE);
+	mutex_unlock(&nvhost_buffers->mutex);
+}
+
+/*
+ * Drop a reference to a mapping. Mappings made by task submits are kept
+ * on the lru list once idle, all others are unmapped.
+ */
+static void nvhost_buffer_put_map(struct nvhost_buffers *nvhost_buffers,
+				  struct nvhost_vm_buffer *vm)
+{
+	if ((vm->user_map_count != 0) || (vm->submit_map_count != 0))
+		return;
+
+	if (!vm->cached || nvhost_buffers->released) {
+		nvhost_buffer_unmap(nvhost_buffers, vm);
+		return;
+	}
+
+	list_add(&vm->lru_node, &nvhost_buffers->lru);
+	nvhost_buffers->lru_count++;
+	nvhost_buffers->lru_bytes += vm->size;
+
+	atomic_inc(&nvhost_buffers->stats->cached);
+	atomic_long_add(vm->size, &nvhost_buffers->stats->cached_bytes);
+
+	nvhost_buffer_cache_trim(nvhost_buffers);
+	if (!list_empty(&nvhost_buffers->lru))
+		schedule_delayed_work(&nvhost_buffers->lru_work,
+				      NVHOST_BUFFER_CACHE_MAX_AGE);
+}
+
 struct nvhost_buffers *nvhost_buffer_init(struct platform_device *pdev)
 {
 	struct nvhost_buffers *nvhost_buffers;
@@ -229,6 +322,9 @@ struct nvhost_buffers *nvhost_buffer_init(struct platform_device *pdev)
 	nvhost_buffers->rb_root = RB_ROOT;
 	INIT_LIST_HEAD(&nvhost_buffers->list_head);
 	kref_init(&nvhost_buffers->kref);
+	INIT_LIST_HEAD(&nvhost_buffers->lru);
+	INIT_DELAYED_WORK(&nvhost_buffers->lru_work, nvhost_buffer_cache_work);
+	nvhost_buffers->stats = &nvhost_buffers->own_stats;
 
 	return nvhost_buffers;
 
@@ -236,6 +332,20 @@ nvhost_buffer_init_err:
 	return ERR_PTR(err);
 }
 
+void nvhost_buffer_set_cache_stats(struct nvhost_buffers *nvhost_buffers,
+				   struct nvhost_buffer_cache_stats *stats)
+{
+	mutex_lock(&nvhost_buffers->mutex);
+	atomic_sub(nvhost_buffers->lru_count,
+		   &nvhost_buffers->stats->cached);
+	atomic_long_sub(nvhost_buffers->lru_bytes,
+			&nvhost_buffers->stats->cached_bytes);
+	nvhost_buffers->stats = stats;
+	atomic_add(nvhost_buffers->lru_count, &stats->cached);
+	atomic_long_add(nvhost_buffers->lru_bytes, &stats->cached_bytes);
+	mutex_unlock(&nvhost_buffers->mutex);
+}
+
 int nvhost_buffer_submit_pin(struct nvhost_buffers *nvhost_buffers,
 			     struct dma_buf **dmabufs, u32 count,
 			     dma_addr_t *paddr, size_t *psize,
@@ -250,10 +360,34 @@ int nvhost_buffer_submit_pin(struct nvhost_buffers *nvhost_buffers,
 
 	for (i = 0; i < count; i++) {
 		vm = nvhost_find_map_buffer(nvhost_buffers, dmabufs[i]);
-		if (vm == NULL)
-			goto submit_err;
+		if (vm) {
+			atomic_inc(&nvhost_buffers->stats->hits);
+			if (!list_empty(&vm->lru_node))
+				nvhost_buffer_cache_del(nvhost_buffers, vm);
+		} else {
+			if (nvhost_buffers->released)
+				goto submit_err;
+
+			vm = kzalloc(sizeof(struct nvhost_vm_buffer),
+				     GFP_KERNEL);
+			if (!vm)
+				goto submit_err;
+
+			if (nvhost_buffer_map(nvhost_buffers->pdev,
+					      dmabufs[i], vm)) {
+				kfree(vm);
+				goto submit_err;
+			}
+
+			/* only referenced by the task, cache it once idle */
+			vm->user_map_count = 0;
+			vm->cached = true;
+			nvhost_buffer_insert_map_buffer(nvhost_buffers, vm);
+			atomic_inc(&nvhost_buffers->stats->misses);
+		}
 
 		vm->submit_map_count++;
+		vm->last_used = jiffies;
 		paddr[i] = vm->addr;
 		psize[i] = vm->size;
 
@@ -288,6 +422,8 @@ int nvhost_buffer_pin(struct nvhost_buffers *nvhost_buffers,
 	for (i = 0; i < count; i++) {
 		vm = nvhost_find_map_buffer(nvhost_buffers, dmabufs[i]);
 		if (vm) {
+			if (!list_empty(&vm->lru_node))
+				nvhost_buffer_cache_del(nvhost_buffers, vm);
 			vm->user_map_count++;
 			continue;
 		}
@@ -336,7 +472,7 @@ void nvhost_buffer_submit_unpin(struct nvhost_buffers *nvhost_buffers,
 
 		if (vm->submit_map_count-- < 0)
 			vm->submit_map_count = 0;
-		nvhost_buffer_unmap(nvhost_buffers, vm);
+		nvhost_buffer_put_map(nvhost_buffers, vm);
 	}
 
 	mutex_unlock(&nvhost_buffers->mutex);
@@ -358,9 +494,15 @@ void nvhost_buffer_unpin(struct nvhost_buffers *nvhost_buffers,
 		if (vm == NULL)
 			continue;
 
-		if (vm->user_map_count-- < 0)
+		/* user is done with the buffer, do not keep it cached */
+		if (!list_empty(&vm->lru_node)) {
+			nvhost_buffer_cache_del(nvhost_buffers, vm);
+			atomic_inc(&nvhost_buffers->stats->invalidations);
+		} else if (vm->user_map_count-- < 0) {
 			vm->user_map_count = 0;
-		nvhost_buffer_unmap(nvhost_buffers, vm);
+		}
+		vm->cached = false;
+		nvhost_buffer_put_map(nvhost_buffers, vm);
 	}
 
 	mutex_unlock(&nvhost_buffers->mutex);
@@ -372,12 +514,20 @@ void nvhost_buffer_release(struct nvhost_buffers *nvhost_buffers)
 
 	/* Go through each entry and remove it safely */
 	mutex_lock(&nvhost_buffers->mutex);
+	nvhost_buffers->released = true;
 	list_for_each_entry_safe(vm, n, &nvhost_buffers->list_head,
 				 list_head) {
+		if (!list_empty(&vm->lru_node)) {
+			nvhost_buffer_cache_del(nvhost_buffers, vm);
+			atomic_inc(&nvhost_buffers->stats->invalidations);
+		}
 		vm->user_map_count = 0;
+		vm->cached = false;
 		nvhost_buffer_unmap(nvhost_buffers, vm);
 	}
 	mutex_unlock(&nvhost_buffers->mutex);
 
+	cancel_delayed_work_sync(&nvhost_buffers->lru_work);
+
 	kref_put(&nvhost_buffers->kref, nvhost_free_buffers);
 }
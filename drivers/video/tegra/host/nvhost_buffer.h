@@ -20,12 +20,34 @@
 #define __NVHOST_NVHOST_BUFFER_H__
 
 #include <linux/dma-buf.h>
+#include <linux/workqueue.h>
 
 enum nvhost_buffers_heap {
 	NVHOST_BUFFERS_HEAP_DRAM = 0,
 	NVHOST_BUFFERS_HEAP_CVNAS
 };
 
+/**
+ * @brief		Pin cache counters
+ *
+ * hits			Submit pins that found the buffer already mapped
+ * misses		Submit pins that had to map the buffer
+ * evictions		Idle mappings dropped for the size or age budget
+ * invalidations	Idle mappings dropped because the buffer was unpinned
+ *			or the buffer list was released
+ * cached		Idle mappings currently kept
+ * cached_bytes		Size of the idle mappings currently kept
+ *
+ */
+struct nvhost_buffer_cache_stats {
+	atomic_t hits;
+	atomic_t misses;
+	atomic_t evictions;
+	atomic_t invalidations;
+	atomic_t cached;
+	atomic_long_t cached_bytes;
+};
+
 /**
  * @brief		Information needed for buffers
  *
@@ -34,6 +56,13 @@ enum nvhost_buffers_heap {
  * list			List for traversing through all the buffers
  * mutex		Mutex for the buffer tree and the buffer list
  * kref			Reference count for the bufferlist
+ * lru			Idle mappings made by task submits, most recent first
+ * lru_count		Number of mappings on the lru list
+ * lru_bytes		Size of the mappings on the lru list
+ * lru_work		Drops lru mappings that exceed the age budget
+ * released		Set once the buffer list has been released
+ * stats		Pin cache counters, by default own_stats
+ * own_stats		Pin cache counters used when none are set
  *
  */
 struct nvhost_buffers {
@@ -44,6 +73,15 @@ struct nvhost_buffers {
 	struct mutex mutex;
 
 	struct kref kref;
+
+	struct list_head lru;
+	unsigned int lru_count;
+	size_t lru_bytes;
+	struct delayed_work lru_work;
+	bool released;
+
+	struct nvhost_buffer_cache_stats *stats;
+	struct nvhost_buffer_cache_stats own_stats;
 };
 
 /**
@@ -59,6 +97,18 @@ struct nvhost_buffers {
  */
 struct nvhost_buffers *nvhost_buffer_init(struct platform_device *pdev);
 
+/**
+ * @brief			Account pin cache activity to given counters
+ *
+ * @param nvhost_buffers	Pointer to nvhost_buffers struct
+ * @param stats			Counters to use. They must outlive the
+ *				buffer list.
+ * @return			None
+ *
+ */
+void nvhost_buffer_set_cache_stats(struct nvhost_buffers *nvhost_buffers,
+				   struct nvhost_buffer_cache_stats *stats);
+
 /**
  * @brief			Pin the memhandle using dma_buf functions
  *
@@ -92,7 +142,9 @@ void nvhost_buffer_unpin(struct nvhost_buffers *nvhost_buffers,
  * @brief			Pin the mapped buffer for a task submit
  *
  * This function increased the reference count for a mapped buffer during
- * task submission.
+ * task submission. A buffer that is not mapped yet gets mapped here and,
+ * once no task uses it anymore, stays mapped in a small LRU cache so
+ * that the next submit using it does not have to map it again.
  *
  * @param nvhost_buffers	Pointer to nvhost_buffer struct
  * @param dmabufs		Pointer to dmabuffer list
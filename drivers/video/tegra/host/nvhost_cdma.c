@@ -31,11 +31,14 @@
 #include <linux/kfifo.h>
 #include <trace/events/nvhost.h>
 #include <linux/interrupt.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/kthread.h>
+#include <linux/random.h>
+#include <linux/delay.h>
 
 /*
  * TODO:
- *   stats
- *     - for figuring out what to optimize further
  *   resizable push buffer
  *     - some channels hardly need any, some channels (3d) could use more
  */
@@ -99,10 +102,11 @@ static void nvhost_push_buffer_push_to(struct push_buffer *pb,
 {
 	u32 cur = pb->cur;
 	u32 *p = (u32 *)((uintptr_t)pb->mapped + cur);
-	WARN_ON(cur == pb->fence);
+	WARN_ON(cur == READ_ONCE(pb->fence));
 	*(p++) = op1;
 	*(p++) = op2;
-	pb->cur = (cur + 8) & (PUSH_BUFFER_SIZE - 1);
+	/* publish the slot contents before the new write position */
+	smp_store_release(&pb->cur, (cur + 8) & (PUSH_BUFFER_SIZE - 1));
 }
 
 /**
@@ -112,8 +116,9 @@ static void nvhost_push_buffer_push_to(struct push_buffer *pb,
 static void nvhost_push_buffer_pop_from(struct push_buffer *pb,
 		unsigned int slots)
 {
-	/* Advance the next write position */
-	pb->fence = (pb->fence + slots * 8) & (PUSH_BUFFER_SIZE - 1);
+	/* Advance the next write position; slots are free once this lands */
+	smp_store_release(&pb->fence,
+		(pb->fence + slots * 8) & (PUSH_BUFFER_SIZE - 1));
 }
 
 /**
@@ -121,12 +126,24 @@ static void nvhost_push_buffer_pop_from(struct push_buffer *pb,
  */
 static u32 nvhost_push_buffer_space(struct push_buffer *pb)
 {
-	return ((pb->fence - pb->cur) & (PUSH_BUFFER_SIZE - 1)) / 8;
+	/* pairs with the release in nvhost_push_buffer_pop_from() */
+	return ((smp_load_acquire(&pb->fence) - READ_ONCE(pb->cur)) &
+		(PUSH_BUFFER_SIZE - 1)) / 8;
+}
+
+/**
+ * Return the number of two word slots written but not yet popped
+ */
+static u32 nvhost_push_buffer_used(struct push_buffer *pb)
+{
+	/* pairs with the release in nvhost_push_buffer_push_to() */
+	return ((smp_load_acquire(&pb->cur) - READ_ONCE(pb->fence) - 8) &
+		(PUSH_BUFFER_SIZE - 1)) / 8;
 }
 
 u32 nvhost_push_buffer_putptr(struct push_buffer *pb)
 {
-	return pb->cur;
+	return READ_ONCE(pb->cur);
 }
 
 dma_addr_t nvhost_push_buffer_start(struct push_buffer *pb)
@@ -139,6 +156,25 @@ dma_addr_t nvhost_push_buffer_end(struct push_buffer *pb)
 	return pb->dma_addr + PUSH_BUFFER_SIZE + 4;
 }
 
+/**
+ * Account one pipeline stage latency in the channel statistics
+ */
+static void cdma_stats_latency(struct nvhost_cdma_stats *stats,
+			       enum nvhost_cdma_latency stage, u64 delta)
+{
+	int bucket = min_t(int, fls64(delta >> 10),
+			   NVHOST_CDMA_LAT_BUCKETS - 1);
+
+	atomic_inc(&stats->lat_hist[stage][bucket]);
+	atomic64_add(delta, &stats->lat_total_ns[stage]);
+	atomic_inc(&stats->lat_count[stage]);
+}
+
+void nvhost_cdma_stats_clear(struct nvhost_cdma_stats *stats)
+{
+	memset(stats, 0, sizeof(*stats));
+}
+
 /**
  * Add an entry to the sync queue.
  */
@@ -188,6 +224,7 @@ unsigned int nvhost_cdma_wait_locked(struct nvhost_cdma *cdma,
 		enum cdma_event event)
 {
 	struct mutex *lock;
+	u64 start = 0;
 
 	if (event == CDMA_EVENT_SYNC_QUEUE_EMPTY)
 		lock = &cdma->sync_queue_lock;
@@ -219,9 +256,17 @@ unsigned int nvhost_cdma_wait_locked(struct nvhost_cdma *cdma,
 		space = cdma_status_locked(cdma, event);
 		if (space) {
 			mutex_unlock(lock);
+			if (start) {
+				atomic_inc(&cdma->stats.waits[event]);
+				atomic64_add(ktime_get_ns() - start,
+					     &cdma->stats.wait_ns[event]);
+			}
 			return space;
 		}
 
+		if (!start)
+			start = ktime_get_ns();
+
 		trace_nvhost_wait_cdma(cdma_to_channel(cdma)->dev->name,
 				event);
 
@@ -238,6 +283,19 @@ unsigned int nvhost_cdma_wait_locked(struct nvhost_cdma *cdma,
 		}
 		cdma->event = event;
 
+		/*
+		 * Slots are popped without push_buffer_lock: announce the
+		 * wait before re-checking so that either we see the freed
+		 * space or the cleanup path sees the event. Pairs with the
+		 * barrier in update_cdma_locked().
+		 */
+		smp_mb();
+		space = cdma_status_locked(cdma, event);
+		if (space) {
+			cdma->event = CDMA_EVENT_NONE;
+			continue;
+		}
+
 		mutex_unlock(lock);
 		up_read(&cdma->lock);
 
@@ -323,6 +381,7 @@ static void update_cdma_locked(struct nvhost_cdma *cdma)
 	 */
 	while (1) {
 		bool completed = true;
+		u64 complete_ns, isr_ns, now;
 		int i;
 
 		mutex_lock(&cdma->sync_queue_lock);
@@ -353,6 +412,19 @@ static void update_cdma_locked(struct nvhost_cdma *cdma)
 		list_del(&job->list);
 		mutex_unlock(&cdma->sync_queue_lock);
 
+		/*
+		 * Prefer the submit-complete interrupt time as the completion
+		 * point if it was taken after this job was kicked.
+		 */
+		now = ktime_get_ns();
+		isr_ns = READ_ONCE(cdma->stats.isr_ns);
+		complete_ns = (isr_ns >= job->push_ns && isr_ns <= now) ?
+			isr_ns : now;
+		if (job->push_ns)
+			cdma_stats_latency(&cdma->stats,
+				NVHOST_CDMA_LAT_PUSH_COMPLETE,
+				complete_ns - job->push_ns);
+
 		/* Cancel timeout, when a buffer completes */
 		stop_cdma_timer_locked(cdma);
 
@@ -363,17 +435,34 @@ static void update_cdma_locked(struct nvhost_cdma *cdma)
 		/* Unpin the memory */
 		nvhost_job_unpin(job);
 
-		/* Pop push buffer slots */
-		mutex_lock(&cdma->push_buffer_lock);
+		/* Pop push buffer slots, and wake a waiting submitter */
 		if (job->num_slots) {
 			struct push_buffer *pb = &cdma->push_buffer;
+
 			nvhost_push_buffer_pop_from(pb, job->num_slots);
-			if (cdma->event == CDMA_EVENT_PUSH_BUFFER_SPACE) {
-				cdma->event = CDMA_EVENT_NONE;
-				up(&cdma->sem);
+			/* pairs with smp_mb() in nvhost_cdma_wait_locked() */
+			smp_mb();
+			if (READ_ONCE(cdma->event) ==
+					CDMA_EVENT_PUSH_BUFFER_SPACE) {
+				mutex_lock(&cdma->push_buffer_lock);
+				if (cdma->event ==
+						CDMA_EVENT_PUSH_BUFFER_SPACE) {
+					cdma->event = CDMA_EVENT_NONE;
+					up(&cdma->sem);
+				}
+				mutex_unlock(&cdma->push_buffer_lock);
 			}
 		}
-		mutex_unlock(&cdma->push_buffer_lock);
+
+		now = ktime_get_ns();
+		cdma_stats_latency(&cdma->stats,
+				   NVHOST_CDMA_LAT_COMPLETE_CLEANUP,
+				   now - complete_ns);
+		trace_nvhost_cdma_job_stats(job->ch->dev->name,
+			job->push_ns && job->submit_ns ?
+				job->push_ns - job->submit_ns : 0,
+			job->push_ns ? complete_ns - job->push_ns : 0,
+			now - complete_ns, job->num_slots);
 
 		nvhost_job_put(job);
 	}
@@ -479,6 +568,7 @@ out:
 
 		/* won't need a timeout when replayed */
 		job->timeout = 0;
+		atomic_inc(&cdma->stats.timeouts);
 
 		/* set notifier to userspace about submit timeout */
 		nvhost_job_set_notifier(job, NVHOST_CHANNEL_SUBMIT_TIMEOUT);
@@ -527,6 +617,7 @@ int nvhost_cdma_init(struct platform_device *pdev,
 	cdma->running = false;
 	cdma->torndown = false;
 	cdma->pdev = pdev;
+	nvhost_cdma_stats_clear(&cdma->stats);
 
 	err = cdma_pb_op().init(pb);
 	if (err)
@@ -628,9 +719,7 @@ void nvhost_cdma_push_gather(struct nvhost_cdma *cdma,
 	}
 	cdma->slots_free = slots_free - 1;
 	cdma->slots_used++;
-	mutex_lock(&cdma->push_buffer_lock);
 	nvhost_push_buffer_push_to(pb, op1, op2);
-	mutex_unlock(&cdma->push_buffer_lock);
 }
 
 /**
@@ -642,12 +731,28 @@ void nvhost_cdma_push_gather(struct nvhost_cdma *cdma,
 void nvhost_cdma_end(struct nvhost_cdma *cdma,
 		struct nvhost_job *job)
 {
+	struct nvhost_cdma_stats *stats = &cdma->stats;
+	unsigned int used;
 	bool was_idle;
 
 	mutex_lock(&cdma->sync_queue_lock);
 	was_idle = list_empty(&cdma->sync_queue);
 	mutex_unlock(&cdma->sync_queue_lock);
 
+	job->push_ns = ktime_get_ns();
+	if (job->submit_ns)
+		cdma_stats_latency(stats, NVHOST_CDMA_LAT_SUBMIT_PUSH,
+				   job->push_ns - job->submit_ns);
+
+	/* submits are serialized, so the high-water mark needs no lock */
+	used = PUSH_BUFFER_SIZE / 8 -
+		nvhost_push_buffer_space(&cdma->push_buffer);
+	atomic_inc(&stats->pb_hist[min_t(unsigned int,
+		used * NVHOST_CDMA_PB_BUCKETS / (PUSH_BUFFER_SIZE / 8),
+		NVHOST_CDMA_PB_BUCKETS - 1)]);
+	if (used > stats->pb_max_used)
+		stats->pb_max_used = used;
+
 	add_to_sync_queue(cdma,
 			job,
 			cdma->slots_used,
@@ -673,3 +778,178 @@ void nvhost_cdma_update(struct nvhost_cdma *cdma)
 	update_cdma_locked(cdma);
 	up_read(&cdma->lock);
 }
+
+/*** Push buffer ring simulation ***/
+
+/*
+ * Run a producer and a consumer thread against a private push buffer
+ * using the same push/pop/space helpers as the submit and cleanup paths,
+ * with randomized delays on both sides. Every slot carries a sequence
+ * number that the consumer checks in order.
+ */
+struct pb_stress {
+	struct push_buffer pb;
+	u32 nr;
+	u32 consumed;
+	u32 producer_stalls;
+	u32 consumer_stalls;
+	int err;
+	struct completion producer_done;
+};
+
+static DEFINE_MUTEX(pb_stress_lock);
+static struct pb_stress pb_stress_last;
+
+static void pb_stress_delay(void)
+{
+	u32 r = prandom_u32() % 16;
+
+	if (r < 2)
+		usleep_range(10, 50);
+	else if (r < 6)
+		udelay(r);
+}
+
+static int pb_stress_producer(void *data)
+{
+	struct pb_stress *t = data;
+	u32 seq;
+
+	for (seq = 0; seq < t->nr && !READ_ONCE(t->err); seq++) {
+		while (!nvhost_push_buffer_space(&t->pb)) {
+			t->producer_stalls++;
+			cpu_relax();
+			if (READ_ONCE(t->err))
+				goto out;
+			cond_resched();
+		}
+		nvhost_push_buffer_push_to(&t->pb, seq, ~seq);
+		pb_stress_delay();
+	}
+
+out:
+	complete(&t->producer_done);
+	return 0;
+}
+
+static void pb_stress_consume(struct pb_stress *t)
+{
+	while (t->consumed < t->nr && !t->err) {
+		u32 used = nvhost_push_buffer_used(&t->pb);
+		u32 batch, i;
+
+		if (!used) {
+			t->consumer_stalls++;
+			cond_resched();
+			continue;
+		}
+
+		batch = 1 + prandom_u32() % used;
+		for (i = 0; i < batch; i++) {
+			u32 pos = (t->pb.fence + 8 * (i + 1)) &
+				(PUSH_BUFFER_SIZE - 1);
+			u32 *p = (u32 *)((uintptr_t)t->pb.mapped + pos);
+			u32 seq = t->consumed + i;
+
+			if (p[0] != seq || p[1] != ~seq) {
+				WRITE_ONCE(t->err, -EINVAL);
+				return;
+			}
+		}
+
+		nvhost_push_buffer_pop_from(&t->pb, batch);
+		t->consumed += batch;
+		pb_stress_delay();
+	}
+}
+
+static int pb_stress_run(struct pb_stress *t)
+{
+	struct task_struct *producer;
+
+	t->pb.mapped = kzalloc(PUSH_BUFFER_SIZE + 4, GFP_KERNEL);
+	if (!t->pb.mapped)
+		return -ENOMEM;
+
+	t->pb.fence = PUSH_BUFFER_SIZE - 8;
+	t->pb.cur = 0;
+	init_completion(&t->producer_done);
+
+	producer = kthread_run(pb_stress_producer, t, "nvhost_pb_stress");
+	if (IS_ERR(producer)) {
+		kfree(t->pb.mapped);
+		return PTR_ERR(producer);
+	}
+
+	pb_stress_consume(t);
+	wait_for_completion(&t->producer_done);
+
+	if (!t->err && (t->consumed != t->nr ||
+			nvhost_push_buffer_used(&t->pb)))
+		t->err = -EINVAL;
+
+	kfree(t->pb.mapped);
+	t->pb.mapped = NULL;
+
+	return t->err;
+}
+
+static int pb_stress_show(struct seq_file *s, void *unused)
+{
+	mutex_lock(&pb_stress_lock);
+	if (pb_stress_last.nr) {
+		seq_printf(s, "slots: %u\n", pb_stress_last.nr);
+		seq_printf(s, "result: %s (%d)\n",
+			   pb_stress_last.err ? "FAIL" : "PASS",
+			   pb_stress_last.err);
+		seq_printf(s, "consumed: %u\n", pb_stress_last.consumed);
+		seq_printf(s, "producer_stalls: %u\n",
+			   pb_stress_last.producer_stalls);
+		seq_printf(s, "consumer_stalls: %u\n",
+			   pb_stress_last.consumer_stalls);
+	}
+	mutex_unlock(&pb_stress_lock);
+
+	return 0;
+}
+
+static int pb_stress_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, pb_stress_show, inode->i_private);
+}
+
+static ssize_t pb_stress_write(struct file *file, const char __user *buf,
+			       size_t count, loff_t *ppos)
+{
+	u32 nr;
+	int err;
+
+	err = kstrtou32_from_user(buf, count, 0, &nr);
+	if (err)
+		return err;
+
+	if (!nr)
+		return -EINVAL;
+
+	mutex_lock(&pb_stress_lock);
+	memset(&pb_stress_last, 0, sizeof(pb_stress_last));
+	pb_stress_last.nr = nr;
+	err = pb_stress_run(&pb_stress_last);
+	mutex_unlock(&pb_stress_lock);
+
+	return err == -ENOMEM ? err : count;
+}
+
+static const struct file_operations pb_stress_fops = {
+	.open		= pb_stress_open,
+	.read		= seq_read,
+	.write		= pb_stress_write,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+void nvhost_cdma_debug_init(struct dentry *de)
+{
+	debugfs_create_file("pb_stress", S_IRUGO|S_IWUSR, de,
+			NULL, &pb_stress_fops);
+}
@@ -29,6 +29,7 @@
 
 struct nvhost_syncpt;
 struct nvhost_userctx_timeout;
+struct dentry;
 struct nvhost_job;
 struct mem_mgr;
 struct mem_handle;
@@ -58,6 +59,12 @@ struct mem_handle;
  *	update - call to update sync queue and push buffer, unpin memory
  */
 
+/*
+ * The push buffer is a single-producer/single-consumer ring: only the
+ * (serialized) submit path advances cur and only the cleanup path
+ * advances fence, each publishing with a release store, so slots can be
+ * written and retired concurrently without a lock.
+ */
 struct push_buffer {
 	u32 *mapped;			/* mapped pushbuffer memory */
 	dma_addr_t dma_addr;		/* dma address of pushbuffer */
@@ -84,6 +91,34 @@ enum cdma_event {
 	CDMA_EVENT_PUSH_BUFFER_SPACE	/* wait for space in push buffer */
 };
 
+enum nvhost_cdma_latency {
+	NVHOST_CDMA_LAT_SUBMIT_PUSH,	/* submit entry to push buffer kick */
+	NVHOST_CDMA_LAT_PUSH_COMPLETE,	/* kick to syncpt threshold interrupt */
+	NVHOST_CDMA_LAT_COMPLETE_CLEANUP, /* interrupt to job cleaned up */
+	NVHOST_CDMA_LAT_COUNT
+};
+
+/* log2(usec) buckets; the last one collects everything above ~0.5s */
+#define NVHOST_CDMA_LAT_BUCKETS		20
+/* push buffer occupancy at kick, in eighths of the push buffer */
+#define NVHOST_CDMA_PB_BUCKETS		8
+
+/*
+ * Always-on per-channel pipeline statistics. Updated locklessly from the
+ * submit and cleanup paths; readers get a best-effort snapshot.
+ */
+struct nvhost_cdma_stats {
+	atomic_t lat_hist[NVHOST_CDMA_LAT_COUNT][NVHOST_CDMA_LAT_BUCKETS];
+	atomic64_t lat_total_ns[NVHOST_CDMA_LAT_COUNT];
+	atomic_t lat_count[NVHOST_CDMA_LAT_COUNT];
+	atomic_t pb_hist[NVHOST_CDMA_PB_BUCKETS];
+	unsigned int pb_max_used;	/* high-water mark, in slots */
+	atomic_t waits[CDMA_EVENT_PUSH_BUFFER_SPACE + 1];
+	atomic64_t wait_ns[CDMA_EVENT_PUSH_BUFFER_SPACE + 1];
+	atomic_t timeouts;		/* jobs finalized by the CPU */
+	u64 isr_ns;			/* last submit-complete interrupt */
+};
+
 /*
  * Notes on CDMA locking and synchronization :-
  *
@@ -110,6 +145,8 @@ enum cdma_event {
  * type : mutex
  *
  * We use this lock to protect handling of CDMA_EVENT_PUSH_BUFFER_SPACE event
+ * Pushing and popping push buffer slots does not take it; the cleanup path
+ * only takes it when a submitter has announced it is waiting for space
  *
  * 3) nvhost_cdma->sync_queue_lock
  * type : mutex
@@ -146,6 +183,7 @@ struct nvhost_cdma {
 	struct list_head sync_queue;	/* job queue */
 	struct buffer_timeout timeout;	/* channel's timeout state/wq */
 	struct platform_device *pdev;	/* pointer to host1x device */
+	struct nvhost_cdma_stats stats;	/* pipeline statistics */
 	bool running;
 	bool torndown;
 };
@@ -180,4 +218,6 @@ void nvhost_cdma_finalize_job_incrs(struct nvhost_syncpt *syncpt,
 					struct nvhost_job_syncpt *sp);
 void nvhost_cdma_update_sync_queue(struct nvhost_cdma *cdma,
 		struct nvhost_syncpt *syncpt, struct platform_device *dev);
+void nvhost_cdma_stats_clear(struct nvhost_cdma_stats *stats);
+void nvhost_cdma_debug_init(struct dentry *de);
 #endif
@@ -68,6 +68,7 @@ int nvhost_alloc_channels(struct nvhost_master *host)
 		nvhost_set_chanops(ch);
 		mutex_init(&ch->submitlock);
 		mutex_init(&ch->syncpts_lock);
+		nvhost_job_cache_init(&ch->job_cache);
 		ch->chid = nvhost_channel_get_id_from_index(host, index);
 
 		/* initialize channel cdma */
@@ -236,6 +237,9 @@ static void nvhost_channel_unmap_locked(struct kref *ref)
 
 err_module_busy:
 
+	/* timestamp slots are tied to the device, release them with it */
+	nvhost_job_cache_drain(&ch->job_cache);
+
 	/* drop reference to the vm */
 	nvhost_vm_put(ch->vm);
 
@@ -356,8 +360,11 @@ int nvhost_channel_list_free(struct nvhost_master *host)
 {
 	int i;
 
-	for (i = 0; i < nvhost_channel_nb_channels(host); i++)
+	for (i = 0; i < nvhost_channel_nb_channels(host); i++) {
+		if (host->chlist[i])
+			nvhost_job_cache_drain(&host->chlist[i]->job_cache);
 		kfree(host->chlist[i]);
+	}
 
 	dev_info(&host->dev->dev, "channel list free'd\n");
 
@@ -438,6 +445,8 @@ void nvhost_channel_init_gather_filter(struct platform_device *pdev,
 
 int nvhost_channel_submit(struct nvhost_job *job)
 {
+	job->submit_ns = ktime_get_ns();
+
 	return channel_op(job->ch).submit(job);
 }
 EXPORT_SYMBOL(nvhost_channel_submit);
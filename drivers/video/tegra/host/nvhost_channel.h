@@ -24,6 +24,7 @@
 #include <linux/cdev.h>
 #include <linux/io.h>
 #include "nvhost_cdma.h"
+#include "nvhost_job.h"
 
 #define NVHOST_MAX_WAIT_CHECKS		256
 #define NVHOST_MAX_GATHERS		512
@@ -64,6 +65,9 @@ struct nvhost_channel {
 	bool cdma_initialized;
 	/* owner identifier */
 	void *identifier;
+
+	/* recycled jobs and engine timestamp slots */
+	struct nvhost_job_cache job_cache;
 };
 
 #define channel_op(ch)		(ch->ops)
@@ -29,6 +29,10 @@
 #include <linux/interrupt.h>
 #include <linux/slab.h>
 #include <linux/irq.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/random.h>
+#include <linux/vmalloc.h>
 #include <trace/events/nvhost.h>
 
 #include "nvhost_channel.h"
@@ -36,6 +40,8 @@
 
 /*** Wait list management ***/
 
+static struct kmem_cache *waiter_cache;
+
 struct nvhost_waitlist_external_notifier {
 	struct nvhost_master *master;
 	void (*callback)(void *, int);
@@ -65,7 +71,7 @@ static void waiter_release(struct kref *kref)
 		container_of(kref, struct nvhost_waitlist, refcount);
 
 	nvhost_module_idle(waiter->host->dev);
-	kfree(waiter);
+	kmem_cache_free(waiter_cache, waiter);
 }
 
 int nvhost_intr_release_time(void *ref, struct nvhost_timespec *ts)
@@ -79,42 +85,69 @@ int nvhost_intr_release_time(void *ref, struct nvhost_timespec *ts)
 }
 
 /**
- * add a waiter to a waiter queue, sorted by threshold
+ * add a waiter to the wait tree of a sync point, sorted by wrapped
+ * threshold; waiters with equal thresholds keep their insertion order
  * returns true if it was added at the head of the queue
  */
 static bool add_waiter_to_queue(struct nvhost_waitlist *waiter,
-				struct list_head *queue)
+				struct nvhost_intr_syncpt *syncpt)
 {
-	struct nvhost_waitlist *pos;
+	struct rb_node **p = &syncpt->wait_tree.rb_node;
+	struct rb_node *parent = NULL;
 	u32 thresh = waiter->thresh;
+	bool first = true;
+
+	while (*p) {
+		struct nvhost_waitlist *pos;
 
-	list_for_each_entry_reverse(pos, queue, list)
+		parent = *p;
+		pos = rb_entry(parent, struct nvhost_waitlist, node);
 		if ((s32)(pos->thresh - thresh) <= 0) {
-			list_add(&waiter->list, &pos->list);
-			return false;
+			p = &parent->rb_right;
+			first = false;
+		} else {
+			p = &parent->rb_left;
 		}
+	}
+
+	rb_link_node(&waiter->node, parent, p);
+	rb_insert_color(&waiter->node, &syncpt->wait_tree);
+	if (first)
+		syncpt->wait_first = &waiter->node;
+
+	return first;
+}
 
-	list_add(&waiter->list, queue);
-	return true;
+static void remove_waiter_from_queue(struct nvhost_waitlist *waiter,
+				     struct nvhost_intr_syncpt *syncpt)
+{
+	if (syncpt->wait_first == &waiter->node)
+		syncpt->wait_first = rb_next(&waiter->node);
+	rb_erase(&waiter->node, &syncpt->wait_tree);
+	RB_CLEAR_NODE(&waiter->node);
 }
 
 /**
- * run through a waiter queue for a single sync point ID
+ * run through the wait tree for a single sync point ID
  * and gather all completed waiters into lists by actions
  */
-static void remove_completed_waiters(struct list_head *head, u32 sync,
-			struct nvhost_timespec isr_recv,
+static void remove_completed_waiters(struct nvhost_intr_syncpt *syncpt,
+			u32 sync, struct nvhost_timespec isr_recv,
 			struct list_head *completed[NVHOST_INTR_ACTION_COUNT])
 {
 	struct list_head *dest;
-	struct nvhost_waitlist *waiter, *next, *prev;
+	struct nvhost_waitlist *waiter, *prev;
 
-	list_for_each_entry_safe(waiter, next, head, list) {
+	while (syncpt->wait_first) {
 		bool removed = false;
 
+		waiter = rb_entry(syncpt->wait_first,
+				  struct nvhost_waitlist, node);
 		if ((s32)(waiter->thresh - sync) > 0)
 			break;
 
+		remove_waiter_from_queue(waiter, syncpt);
+
 		waiter->isr_recv = isr_recv;
 		dest = *(completed + waiter->action);
 
@@ -137,18 +170,18 @@ static void remove_completed_waiters(struct list_head *head, u32 sync,
 		if ((atomic_inc_return(&waiter->state) == WLS_HANDLED)
 								|| removed) {
 			atomic_set(&waiter->state, WLS_CLEANUP);
-			list_move(&waiter->list, dest);
+			list_add(&waiter->list, dest);
 		} else
-			list_move_tail(&waiter->list, dest);
+			list_add_tail(&waiter->list, dest);
 	}
 }
 
 static void reset_threshold_interrupt(struct nvhost_intr *intr,
-			       struct list_head *head,
+			       struct nvhost_intr_syncpt *syncpt,
 			       unsigned int id)
 {
-	u32 thresh = list_first_entry(head,
-				struct nvhost_waitlist, list)->thresh;
+	u32 thresh = rb_entry(syncpt->wait_first,
+				struct nvhost_waitlist, node)->thresh;
 
 	intr_op().set_syncpt_threshold(intr, id, thresh);
 	intr_op().enable_syncpt_intr(intr, id);
@@ -172,6 +205,10 @@ static void action_submit_complete(struct nvhost_waitlist *waiter)
 		return;
 	}
 
+	if (waiter->isr_recv.clock == NVHOST_CLOCK_MONOTONIC)
+		WRITE_ONCE(channel->cdma.stats.isr_ns,
+			   timespec_to_ns(&waiter->isr_recv.ts));
+
 	nvhost_cdma_update(&channel->cdma);
 	nvhost_module_idle_mult(channel->dev, nr_completed);
 
@@ -288,18 +325,17 @@ static int process_wait_list(struct nvhost_intr *intr,
 		completed[i] = syncpt->low_prio_handlers + j;
 
 	/* this functions fills completed data */
-	remove_completed_waiters(&syncpt->wait_head, threshold,
+	remove_completed_waiters(syncpt, threshold,
 		syncpt->isr_recv, completed);
 
 	/* check if there are still waiters left */
-	empty = list_empty(&syncpt->wait_head);
+	empty = RB_EMPTY_ROOT(&syncpt->wait_tree);
 
 	/* if not, disable interrupt. If yes, update the inetrrupt */
 	if (empty)
 		intr_op().disable_syncpt_intr(intr, syncpt->id);
 	else
-		reset_threshold_interrupt(intr, &syncpt->wait_head,
-					  syncpt->id);
+		reset_threshold_interrupt(intr, syncpt, syncpt->id);
 
 	/* remove low priority handlers from this list */
 	for (i = NVHOST_INTR_HIGH_PRIO_COUNT;
@@ -389,17 +425,20 @@ bool nvhost_intr_has_pending_jobs(struct nvhost_intr *intr, u32 id,
 {
 	struct nvhost_intr_syncpt *syncpt;
 	struct nvhost_waitlist *waiter;
+	struct rb_node *node;
 	bool res = false;
 
 	syncpt = intr->syncpt + id;
 	spin_lock(&syncpt->lock);
-	list_for_each_entry(waiter, &syncpt->wait_head, list)
+	for (node = syncpt->wait_first; node; node = rb_next(node)) {
+		waiter = rb_entry(node, struct nvhost_waitlist, node);
 		if (((waiter->action ==
 			NVHOST_INTR_ACTION_SUBMIT_COMPLETE) &&
 			(waiter->data != exclude_data))) {
 			res = true;
 			break;
 		}
+	}
 
 	spin_unlock(&syncpt->lock);
 
@@ -427,6 +466,7 @@ int nvhost_intr_add_action(struct nvhost_intr *intr, u32 id, u32 thresh,
 		return err;
 
 	/* initialize a new waiter */
+	RB_CLEAR_NODE(&waiter->node);
 	INIT_LIST_HEAD(&waiter->list);
 	init_waitqueue_head(&waiter->wq);
 	kref_init(&waiter->refcount);
@@ -443,9 +483,9 @@ int nvhost_intr_add_action(struct nvhost_intr *intr, u32 id, u32 thresh,
 
 	spin_lock(&syncpt->lock);
 
-	queue_was_empty = list_empty(&syncpt->wait_head);
+	queue_was_empty = RB_EMPTY_ROOT(&syncpt->wait_tree);
 
-	if (add_waiter_to_queue(waiter, &syncpt->wait_head)) {
+	if (add_waiter_to_queue(waiter, syncpt)) {
 		/* added at head of list - new threshold value */
 		intr_op().set_syncpt_threshold(intr, id, thresh);
 
@@ -463,8 +503,13 @@ int nvhost_intr_add_action(struct nvhost_intr *intr, u32 id, u32 thresh,
 
 void *nvhost_intr_alloc_waiter(void)
 {
-	return kzalloc(sizeof(struct nvhost_waitlist),
-			GFP_KERNEL);
+	return kmem_cache_zalloc(waiter_cache, GFP_KERNEL);
+}
+
+void nvhost_intr_free_waiter(void *waiter)
+{
+	if (waiter)
+		kmem_cache_free(waiter_cache, waiter);
 }
 
 static int __nvhost_intr_register_notifier(struct platform_device *pdev,
@@ -481,7 +526,7 @@ static int __nvhost_intr_register_notifier(struct platform_device *pdev,
 	if (!callback)
 		return -EINVAL;
 
-	waiter = kzalloc(sizeof(*waiter), GFP_KERNEL);
+	waiter = nvhost_intr_alloc_waiter();
 	if (!waiter) {
 		nvhost_err(&pdev->dev, "failed to allocate waiter");
 		err = -ENOMEM;
@@ -515,7 +560,7 @@ static int __nvhost_intr_register_notifier(struct platform_device *pdev,
 err_busy:
 	kfree(notifier);
 err_alloc_notifier:
-	kfree(waiter);
+	nvhost_intr_free_waiter(waiter);
 err_alloc_waiter:
 	return err;
 }
@@ -562,6 +607,37 @@ void nvhost_intr_put_ref(struct nvhost_intr *intr, u32 id, void *ref)
 
 /*** Init & shutdown ***/
 
+/* waiter_cache is shared by all host1x instances */
+static DEFINE_MUTEX(waiter_cache_lock);
+static unsigned int waiter_cache_users;
+
+static int nvhost_intr_waiter_cache_get(void)
+{
+	int err = 0;
+
+	mutex_lock(&waiter_cache_lock);
+	if (!waiter_cache_users) {
+		waiter_cache = KMEM_CACHE(nvhost_waitlist, 0);
+		if (!waiter_cache)
+			err = -ENOMEM;
+	}
+	if (!err)
+		waiter_cache_users++;
+	mutex_unlock(&waiter_cache_lock);
+
+	return err;
+}
+
+static void nvhost_intr_waiter_cache_put(void)
+{
+	mutex_lock(&waiter_cache_lock);
+	if (!--waiter_cache_users) {
+		kmem_cache_destroy(waiter_cache);
+		waiter_cache = NULL;
+	}
+	mutex_unlock(&waiter_cache_lock);
+}
+
 int nvhost_intr_init(struct nvhost_intr *intr, u32 irq_gen, u32 irq_sync)
 {
 	unsigned int id, i, err;
@@ -573,10 +649,15 @@ int nvhost_intr_init(struct nvhost_intr *intr, u32 irq_gen, u32 irq_sync)
 	intr->syncpt_irq = irq_sync;
 	intr->general_irq = irq_gen;
 
+	err = nvhost_intr_waiter_cache_get();
+	if (err)
+		return err;
+
 	intr->low_prio_wq = create_singlethread_workqueue("host_low_prio_wq");
 	if (!intr->low_prio_wq) {
 		nvhost_err(&host->dev->dev,
 			   "failed to create low prio waitqueue");
+		nvhost_intr_waiter_cache_put();
 		return -EINVAL;
 	}
 
@@ -586,7 +667,8 @@ int nvhost_intr_init(struct nvhost_intr *intr, u32 irq_gen, u32 irq_sync)
 		syncpt->intr = &host->intr;
 		syncpt->id = id;
 		spin_lock_init(&syncpt->lock);
-		INIT_LIST_HEAD(&syncpt->wait_head);
+		syncpt->wait_tree = RB_ROOT;
+		syncpt->wait_first = NULL;
 		snprintf(syncpt->thresh_irq_name,
 			sizeof(syncpt->thresh_irq_name),
 			"host_sp_%02d", id);
@@ -599,6 +681,7 @@ int nvhost_intr_init(struct nvhost_intr *intr, u32 irq_gen, u32 irq_sync)
 	err = intr_op().init(intr);
 	if (err) {
 		destroy_workqueue(intr->low_prio_wq);
+		nvhost_intr_waiter_cache_put();
 		return err;
 	}
 
@@ -610,6 +693,7 @@ void nvhost_intr_deinit(struct nvhost_intr *intr)
 	nvhost_intr_stop(intr);
 	intr_op().deinit(intr);
 	destroy_workqueue(intr->low_prio_wq);
+	nvhost_intr_waiter_cache_put();
 }
 
 int nvhost_intr_start(struct nvhost_intr *intr, u32 hz)
@@ -636,19 +720,23 @@ int nvhost_intr_stop(struct nvhost_intr *intr)
 	for (id = 0, syncpt = intr->syncpt;
 	     id < nb_pts;
 	     ++id, ++syncpt) {
-		struct nvhost_waitlist *waiter, *next;
+		struct rb_node *node, *next;
 
 		intr_op().disable_syncpt_intr(intr, id);
 
-		list_for_each_entry_safe(waiter, next, &syncpt->wait_head, list) {
+		for (node = syncpt->wait_first; node; node = next) {
+			struct nvhost_waitlist *waiter =
+				rb_entry(node, struct nvhost_waitlist, node);
+
+			next = rb_next(node);
 			if (atomic_cmpxchg(&waiter->state, WLS_CANCELLED, WLS_HANDLED)
 				== WLS_CANCELLED) {
-				list_del(&waiter->list);
+				remove_waiter_from_queue(waiter, syncpt);
 				kref_put(&waiter->refcount, waiter_release);
 			}
 		}
 
-		if (!list_empty(&syncpt->wait_head)) {  /* output diagnostics */
+		if (!RB_EMPTY_ROOT(&syncpt->wait_tree)) { /* diagnostics */
 			intr_op().enable_syncpt_intr(intr, id);
 			mutex_unlock(&intr->mutex);
 			return -EBUSY;
@@ -697,3 +785,161 @@ void nvhost_intr_disable_module_intr(struct nvhost_intr *intr, int module_irq)
 	intr_op().disable_module_intr(intr, module_irq);
 	mutex_unlock(&intr->mutex);
 }
+
+/*** Wait tree stress test ***/
+
+/*
+ * Queue nr waiters with scattered thresholds straddling the u32 wrap on a
+ * detached syncpt, then complete them in small batches the way the ISR
+ * does, checking that every batch holds exactly the expired waiters.
+ */
+static DEFINE_MUTEX(intr_stress_lock);
+static u32 intr_stress_nr;
+static u64 intr_stress_insert_ns;
+static u64 intr_stress_complete_ns;
+static int intr_stress_result;
+
+static int intr_stress_run(u32 nr)
+{
+	struct list_head done[NVHOST_INTR_ACTION_COUNT];
+	struct list_head *completed[NVHOST_INTR_ACTION_COUNT];
+	struct nvhost_timespec isr_recv = { };
+	struct nvhost_intr_syncpt *syncpt;
+	struct nvhost_waitlist **waiters;
+	u32 base = 0xffffffff - nr, sync = base;
+	u32 i, seen = 0;
+	u64 start;
+	int err = 0;
+
+	syncpt = kzalloc(sizeof(*syncpt), GFP_KERNEL);
+	waiters = vzalloc(nr * sizeof(*waiters));
+	if (!syncpt || !waiters) {
+		err = -ENOMEM;
+		goto out;
+	}
+
+	spin_lock_init(&syncpt->lock);
+	syncpt->wait_tree = RB_ROOT;
+	for (i = 0; i < NVHOST_INTR_ACTION_COUNT; i++) {
+		INIT_LIST_HEAD(&done[i]);
+		completed[i] = &done[i];
+	}
+
+	for (i = 0; i < nr; i++) {
+		waiters[i] = nvhost_intr_alloc_waiter();
+		if (!waiters[i]) {
+			err = -ENOMEM;
+			goto out;
+		}
+		INIT_LIST_HEAD(&waiters[i]->list);
+		kref_init(&waiters[i]->refcount);
+		waiters[i]->thresh = base + 1 + prandom_u32() % (2 * nr);
+		waiters[i]->action = NVHOST_INTR_ACTION_WAKEUP;
+		atomic_set(&waiters[i]->state, WLS_PENDING);
+		waiters[i]->count = 1;
+	}
+
+	start = ktime_get_ns();
+	spin_lock(&syncpt->lock);
+	for (i = 0; i < nr; i++)
+		add_waiter_to_queue(waiters[i], syncpt);
+	spin_unlock(&syncpt->lock);
+	intr_stress_insert_ns = ktime_get_ns() - start;
+
+	intr_stress_complete_ns = 0;
+	while (!RB_EMPTY_ROOT(&syncpt->wait_tree)) {
+		struct nvhost_waitlist *waiter, *next;
+
+		sync += 16;
+
+		start = ktime_get_ns();
+		spin_lock(&syncpt->lock);
+		remove_completed_waiters(syncpt, sync, isr_recv, completed);
+		spin_unlock(&syncpt->lock);
+		intr_stress_complete_ns += ktime_get_ns() - start;
+
+		if (syncpt->wait_first &&
+		    (s32)(rb_entry(syncpt->wait_first, struct nvhost_waitlist,
+				   node)->thresh - sync) <= 0)
+			err = -EINVAL;
+
+		for (i = 0; i < NVHOST_INTR_ACTION_COUNT; i++) {
+			list_for_each_entry_safe(waiter, next, &done[i], list) {
+				if ((s32)(waiter->thresh - sync) > 0)
+					err = -EINVAL;
+				list_del(&waiter->list);
+				seen++;
+			}
+		}
+	}
+
+	if (seen != nr)
+		err = -EINVAL;
+
+out:
+	if (waiters) {
+		for (i = 0; i < nr; i++)
+			nvhost_intr_free_waiter(waiters[i]);
+		vfree(waiters);
+	}
+	kfree(syncpt);
+	return err;
+}
+
+static int intr_stress_show(struct seq_file *s, void *unused)
+{
+	mutex_lock(&intr_stress_lock);
+	if (intr_stress_nr) {
+		seq_printf(s, "waiters: %u\n", intr_stress_nr);
+		seq_printf(s, "result: %s (%d)\n",
+			   intr_stress_result ? "FAIL" : "PASS",
+			   intr_stress_result);
+		seq_printf(s, "insert_ns_avg: %llu\n",
+			   div_u64(intr_stress_insert_ns, intr_stress_nr));
+		seq_printf(s, "complete_ns_avg: %llu\n",
+			   div_u64(intr_stress_complete_ns, intr_stress_nr));
+	}
+	mutex_unlock(&intr_stress_lock);
+
+	return 0;
+}
+
+static int intr_stress_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, intr_stress_show, inode->i_private);
+}
+
+static ssize_t intr_stress_write(struct file *file, const char __user *buf,
+				 size_t count, loff_t *ppos)
+{
+	u32 nr;
+	int err;
+
+	err = kstrtou32_from_user(buf, count, 0, &nr);
+	if (err)
+		return err;
+
+	if (!nr || nr > (1 << 20))
+		return -EINVAL;
+
+	mutex_lock(&intr_stress_lock);
+	intr_stress_result = intr_stress_run(nr);
+	intr_stress_nr = nr;
+	mutex_unlock(&intr_stress_lock);
+
+	return count;
+}
+
+static const struct file_operations intr_stress_fops = {
+	.open		= intr_stress_open,
+	.read		= seq_read,
+	.write		= intr_stress_write,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+void nvhost_intr_debug_init(struct nvhost_intr *intr, struct dentry *de)
+{
+	debugfs_create_file("intr_stress", S_IRUGO|S_IWUSR, de,
+			intr, &intr_stress_fops);
+}
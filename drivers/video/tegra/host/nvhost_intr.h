@@ -26,6 +26,7 @@
 #include <linux/interrupt.h>
 #include <linux/workqueue.h>
 #include <linux/spinlock.h>
+#include <linux/rbtree.h>
 #include <linux/version.h>
 #if LINUX_VERSION_CODE > KERNEL_VERSION(4, 13, 0)
 #include <linux/wait.h>
@@ -35,6 +36,7 @@
 
 struct nvhost_channel;
 struct platform_device;
+struct dentry;
 
 enum nvhost_intr_action {
 	/**
@@ -86,7 +88,8 @@ struct nvhost_intr;
 
 struct nvhost_waitlist {
 	struct nvhost_master *host;
-	struct list_head list;
+	struct rb_node node;		/* entry in the syncpt wait tree */
+	struct list_head list;		/* entry in a completed list */
 	struct kref refcount;
 	u32 thresh;
 	enum nvhost_intr_action action;
@@ -101,7 +104,8 @@ struct nvhost_intr_syncpt {
 	struct nvhost_intr *intr;
 	u32 id;
 	spinlock_t lock;
-	struct list_head wait_head;
+	struct rb_root wait_tree;	/* pending waiters by threshold */
+	struct rb_node *wait_first;	/* waiter with the lowest threshold */
 	char thresh_irq_name[12];
 	struct nvhost_timespec isr_recv;
 	struct work_struct low_prio_work;
@@ -146,6 +150,11 @@ bool nvhost_intr_has_pending_jobs(struct nvhost_intr *intr, u32 id,
  */
 void *nvhost_intr_alloc_waiter(void);
 
+/**
+ * Free a waiter that was never passed to nvhost_intr_add_action().
+ */
+void nvhost_intr_free_waiter(void *waiter);
+
 /**
  * Unreference an action submitted to nvhost_intr_add_action().
  * You must call this if you passed non-NULL as ref.
@@ -164,6 +173,7 @@ void nvhost_intr_enable_host_irq(struct nvhost_intr *intr, int irq,
 void nvhost_intr_disable_host_irq(struct nvhost_intr *intr, int irq);
 void nvhost_intr_enable_module_intr(struct nvhost_intr *intr, int module_irq);
 void nvhost_intr_disable_module_intr(struct nvhost_intr *intr, int module_irq);
+void nvhost_intr_debug_init(struct nvhost_intr *intr, struct dentry *de);
 
 void nvhost_syncpt_thresh_fn(void *dev_id);
 irqreturn_t nvhost_intr_irq_fn(int irq, void *dev_id);
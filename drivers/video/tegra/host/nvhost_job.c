@@ -24,6 +24,9 @@
 #include <linux/vmalloc.h>
 #include <linux/sort.h>
 #include <linux/scatterlist.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/ktime.h>
 #include <trace/events/nvhost.h>
 #include "nvhost_channel.h"
 #include "nvhost_vm.h"
@@ -50,7 +53,9 @@ static size_t job_size(u32 num_cmdbufs, u32 num_relocs, u32 num_waitchks,
 		+ (u64)num_cmdbufs * ALIGN(sizeof(struct nvhost_job_gather), 8)
 		+ num_unpins * ALIGN(sizeof(dma_addr_t), 8)
 		+ num_unpins * ALIGN(sizeof(struct nvhost_pinid), 8)
-		+ (u64)num_syncpts * ALIGN(sizeof(struct nvhost_job_syncpt), 8);
+		+ (u64)num_syncpts * ALIGN(sizeof(struct nvhost_job_syncpt), 8)
+		+ (u64)num_relocs *
+			ALIGN(sizeof(struct nvhost_job_reloc_order), 8);
 
 	if (total > UINT_MAX)
 		return 0;
@@ -91,11 +96,203 @@ static void init_fields(struct nvhost_job *job,
 	job->pin_ids = num_unpins ? mem : NULL;
 	mem += num_unpins * ALIGN(sizeof(struct nvhost_pinid), 8);
 	job->sp = num_syncpts ? mem : NULL;
+	mem += num_syncpts * ALIGN(sizeof(struct nvhost_job_syncpt), 8);
+	job->reloc_order = num_relocs ? mem : NULL;
 
 	job->reloc_addr_phys = job->addr_phys;
 	job->gather_addr_phys = &job->addr_phys[num_relocs];
 }
 
+static int job_cache_bucket(size_t size)
+{
+	int bucket;
+
+	if (size <= (1 << NVHOST_JOB_CACHE_MIN_SHIFT))
+		return 0;
+
+	bucket = order_base_2(size) - NVHOST_JOB_CACHE_MIN_SHIFT;
+	return bucket < NVHOST_JOB_CACHE_BUCKETS ? bucket : -1;
+}
+
+static void *job_mem_alloc(size_t size)
+{
+	if (size <= PAGE_SIZE)
+		return kmalloc(size, GFP_KERNEL);
+	else
+		return vmalloc(size);
+}
+
+static void job_mem_free(void *mem, size_t size)
+{
+	if (size <= PAGE_SIZE)
+		kfree(mem);
+	else
+		vfree(mem);
+}
+
+void nvhost_job_cache_init(struct nvhost_job_cache *cache)
+{
+	int i;
+
+	spin_lock_init(&cache->lock);
+	for (i = 0; i < NVHOST_JOB_CACHE_BUCKETS; i++)
+		INIT_LIST_HEAD(&cache->free[i]);
+	cache->depth = NVHOST_JOB_CACHE_DEPTH;
+}
+
+void nvhost_job_cache_drain(struct nvhost_job_cache *cache)
+{
+	struct nvhost_job *job, *n;
+	struct device *ts_dev = NULL;
+	u64 *ts_ptr = NULL;
+	dma_addr_t ts_dma = 0;
+	LIST_HEAD(jobs);
+	int i;
+
+	spin_lock(&cache->lock);
+	for (i = 0; i < NVHOST_JOB_CACHE_BUCKETS; i++) {
+		list_splice_init(&cache->free[i], &jobs);
+		cache->count[i] = 0;
+	}
+	/* jobs still holding a slot keep the page alive */
+	if (cache->ts_ptr &&
+	    bitmap_empty(cache->ts_used, NVHOST_JOB_TS_SLOTS)) {
+		ts_dev = cache->ts_dev;
+		ts_ptr = cache->ts_ptr;
+		ts_dma = cache->ts_dma;
+		cache->ts_dev = NULL;
+		cache->ts_ptr = NULL;
+	}
+	spin_unlock(&cache->lock);
+
+	list_for_each_entry_safe(job, n, &jobs, list)
+		job_mem_free(job, job->size);
+
+	if (ts_ptr)
+		dma_free_coherent(ts_dev, NVHOST_JOB_TS_POOL_SIZE,
+				  ts_ptr, ts_dma);
+}
+
+static struct nvhost_job *job_cache_get(struct nvhost_job_cache *cache,
+					int bucket)
+{
+	struct nvhost_job *job = NULL;
+
+	spin_lock(&cache->lock);
+	if (bucket >= 0 && !list_empty(&cache->free[bucket])) {
+		job = list_first_entry(&cache->free[bucket],
+				       struct nvhost_job, list);
+		list_del(&job->list);
+		cache->count[bucket]--;
+		cache->job_hits++;
+	} else {
+		cache->job_misses++;
+	}
+	spin_unlock(&cache->lock);
+
+	return job;
+}
+
+static bool job_cache_put(struct nvhost_job_cache *cache,
+			  struct nvhost_job *job)
+{
+	int bucket = job_cache_bucket(job->size);
+	bool kept = false;
+
+	if (bucket < 0)
+		return false;
+
+	spin_lock(&cache->lock);
+	if (cache->count[bucket] < cache->depth) {
+		list_add(&job->list, &cache->free[bucket]);
+		cache->count[bucket]++;
+		kept = true;
+	}
+	spin_unlock(&cache->lock);
+
+	return kept;
+}
+
+static void job_ts_pool_init(struct nvhost_job_cache *cache,
+			     struct device *dev)
+{
+	dma_addr_t dma;
+	u64 *ptr;
+
+	ptr = dma_alloc_coherent(dev, NVHOST_JOB_TS_POOL_SIZE, &dma,
+				 GFP_KERNEL);
+	if (!ptr)
+		return;
+
+	spin_lock(&cache->lock);
+	if (!cache->ts_ptr) {
+		cache->ts_dev = dev;
+		cache->ts_ptr = ptr;
+		cache->ts_dma = dma;
+		ptr = NULL;
+	}
+	spin_unlock(&cache->lock);
+
+	/* lost the race against another submit */
+	if (ptr)
+		dma_free_coherent(dev, NVHOST_JOB_TS_POOL_SIZE, ptr, dma);
+}
+
+static int job_ts_alloc(struct nvhost_job *job)
+{
+	struct nvhost_job_cache *cache = &job->ch->job_cache;
+	struct device *dev = &job->ch->vm->pdev->dev;
+	unsigned int slot = NVHOST_JOB_TS_SLOTS;
+
+	if (!READ_ONCE(cache->ts_ptr))
+		job_ts_pool_init(cache, dev);
+
+	spin_lock(&cache->lock);
+	if (cache->ts_ptr && cache->ts_dev == dev)
+		slot = find_first_zero_bit(cache->ts_used,
+					   NVHOST_JOB_TS_SLOTS);
+	if (slot < NVHOST_JOB_TS_SLOTS) {
+		__set_bit(slot, cache->ts_used);
+		job->engine_timestamps.ptr = &cache->ts_ptr[2 * slot];
+		job->engine_timestamps.dma = cache->ts_dma +
+					     2 * slot * sizeof(u64);
+		job->engine_timestamps.pooled = true;
+		cache->ts_hits++;
+	} else {
+		cache->ts_misses++;
+	}
+	spin_unlock(&cache->lock);
+
+	if (job->engine_timestamps.pooled) {
+		memset(job->engine_timestamps.ptr, 0, sizeof(u64) * 2);
+		return 0;
+	}
+
+	job->engine_timestamps.ptr =
+		dma_zalloc_coherent(dev, sizeof(u64) * 2,
+		&job->engine_timestamps.dma, GFP_KERNEL);
+
+	return job->engine_timestamps.ptr ? 0 : -ENOMEM;
+}
+
+static void job_ts_free(struct nvhost_job *job)
+{
+	struct nvhost_job_cache *cache = &job->ch->job_cache;
+	unsigned int slot;
+
+	if (!job->engine_timestamps.pooled) {
+		dma_free_coherent(&job->ch->vm->pdev->dev, sizeof(u64) * 2,
+			job->engine_timestamps.ptr,
+			job->engine_timestamps.dma);
+		return;
+	}
+
+	spin_lock(&cache->lock);
+	slot = (job->engine_timestamps.ptr - cache->ts_ptr) / 2;
+	__clear_bit(slot, cache->ts_used);
+	spin_unlock(&cache->lock);
+}
+
 struct nvhost_job *nvhost_job_alloc(struct nvhost_channel *ch,
 		int num_cmdbufs, int num_relocs, int num_waitchks,
 		int num_syncpts)
@@ -104,35 +301,38 @@ struct nvhost_job *nvhost_job_alloc(struct nvhost_channel *ch,
 	size_t size =
 		job_size(num_cmdbufs, num_relocs, num_waitchks, num_syncpts);
 	struct nvhost_device_data *pdata = nvhost_get_devdata(ch->dev);
+	size_t alloc_size = size;
+	int bucket;
 
 	if(!size) {
 		nvhost_err(&pdata->pdev->dev, "empty job requested");
 		return NULL;
 	}
-	if(size <= PAGE_SIZE)
-		job = kzalloc(size, GFP_KERNEL);
-	else
-		job = vzalloc(size);
+
+	bucket = job_cache_bucket(size);
+	if (bucket >= 0)
+		alloc_size = 1 << (bucket + NVHOST_JOB_CACHE_MIN_SHIFT);
+
+	job = job_cache_get(&ch->job_cache, bucket);
+	if (!job)
+		job = job_mem_alloc(alloc_size);
 	if (!job) {
 		nvhost_err(&pdata->pdev->dev, "failed to allocate job");
 		return NULL;
 	}
+	memset(job, 0, size);
 
 	kref_init(&job->ref);
 	job->ch = ch;
-	job->size = size;
+	job->size = alloc_size;
 
 	init_fields(job, num_cmdbufs, num_relocs, num_waitchks, num_syncpts);
 
-	if (pdata->enable_timestamps) {
-		job->engine_timestamps.ptr =
-			dma_zalloc_coherent(&ch->vm->pdev->dev, sizeof(u64) * 2,
-			&job->engine_timestamps.dma, GFP_KERNEL);
-		if (!job->engine_timestamps.ptr) {
-			nvhost_err(&pdata->pdev->dev,
-				   "failed to allocate engine timestamps");
-			return NULL;
-		}
+	if (pdata->enable_timestamps && job_ts_alloc(job)) {
+		nvhost_err(&pdata->pdev->dev,
+			   "failed to allocate engine timestamps");
+		nvhost_job_put(job);
+		return NULL;
 	}
 
 	return job;
@@ -159,17 +359,13 @@ static void job_free(struct kref *ref)
 				job->engine_timestamps.ptr[0] >> 5,
 				job->engine_timestamps.ptr[1] >> 5);
 		}
-		dma_free_coherent(&job->ch->vm->pdev->dev, sizeof(u64) * 2,
-			job->engine_timestamps.ptr,
-			job->engine_timestamps.dma);
+		job_ts_free(job);
 	}
 
 	if (job->error_notifier_ref)
 		dma_buf_put(job->error_notifier_ref);
-	if (job->size <= PAGE_SIZE)
-		kfree(job);
-	else
-		vfree(job);
+	if (!job_cache_put(&ch->job_cache, job))
+		job_mem_free(job, job->size);
 }
 
 void nvhost_job_put(struct nvhost_job *job)
@@ -477,107 +673,152 @@ static int pin_job_mem(struct nvhost_job *job)
 	return result;
 }
 
+static int reloc_order_cmp(const void *_r1, const void *_r2)
+{
+	u64 key1 = ((struct nvhost_job_reloc_order *)_r1)->key;
+	u64 key2 = ((struct nvhost_job_reloc_order *)_r2)->key;
+
+	if (key1 < key2)
+		return -1;
+	if (key1 > key2)
+		return 1;
+
+	return 0;
+}
+
+static void sort_relocs(struct nvhost_job *job)
+{
+	int i;
+
+	for (i = 0; i < job->num_relocs; i++) {
+		struct nvhost_reloc *reloc = &job->relocarray[i];
+
+		job->reloc_order[i].key = ((u64)reloc->cmdbuf_mem << 32) |
+					  reloc->cmdbuf_offset;
+		job->reloc_order[i].index = i;
+	}
+
+	sort(job->reloc_order, job->num_relocs, sizeof(*job->reloc_order),
+	     reloc_order_cmp, NULL);
+}
+
+static void patch_reloc(struct nvhost_job *job,
+		struct nvhost_device_data *pdata, int i, void *cmdbuf_addr)
+{
+	struct nvhost_reloc *reloc = &job->relocarray[i];
+	struct nvhost_reloc_shift *shift = &job->relocshiftarray[i];
+	struct nvhost_reloc_type *type = &job->reloctypearray[i];
+	dma_addr_t phys_addr;
+
+	if (pdata->get_reloc_phys_addr)
+		phys_addr = pdata->get_reloc_phys_addr(
+					job->reloc_addr_phys[i],
+					type->reloc_type);
+	else
+		phys_addr = job->reloc_addr_phys[i];
+
+	__raw_writel(
+		(phys_addr +
+			reloc->target_offset) >> shift->shift,
+		(void __iomem *)cmdbuf_addr);
+}
+
+/*
+ * Patch the relocs of one cmdbuf. Relocs are sorted by (cmdbuf_mem,
+ * cmdbuf_offset), so the ones for this cmdbuf form a single run. The
+ * buffer is vmapped once and covered by a single cpu access bracket;
+ * page-wise kmap is only used if the exporter cannot vmap.
+ */
 static int do_relocs(struct nvhost_job *job,
 		u32 cmdbuf_mem, struct dma_buf *buf)
 {
 	struct nvhost_device_data *pdata = platform_get_drvdata(job->ch->dev);
-	int i = 0;
-	int last_page = -1;
-	size_t last_offset;
-	void *cmdbuf_page_addr = NULL;
-	dma_addr_t phys_addr;
+	struct nvhost_job_reloc_order *order = job->reloc_order;
+	u64 key = (u64)cmdbuf_mem << 32;
+	int first = 0, last = job->num_relocs;
+	int i, page, last_page = -1;
+	size_t start, len;
+	void *vaddr, *cmdbuf_page_addr = NULL;
 	int err;
 
-	/* pin & patch the relocs for one gather */
-	while (i < job->num_relocs) {
-		struct nvhost_reloc *reloc = &job->relocarray[i];
-		struct nvhost_reloc_shift *shift = &job->relocshiftarray[i];
-		struct nvhost_reloc_type *type = &job->reloctypearray[i];
+	/* find the first reloc for this cmdbuf */
+	while (first < last) {
+		int mid = first + (last - first) / 2;
 
-		/* skip all other gathers */
-		if (cmdbuf_mem != reloc->cmdbuf_mem) {
-			i++;
-			continue;
-		}
+		if (order[mid].key < key)
+			first = mid + 1;
+		else
+			last = mid;
+	}
+
+	for (last = first; last < job->num_relocs; last++) {
+		u32 offset = lower_32_bits(order[last].key);
+
+		if (upper_32_bits(order[last].key) != cmdbuf_mem)
+			break;
 
-		if (reloc->cmdbuf_offset & 3 ||
-		    reloc->cmdbuf_offset >= buf->size) {
+		if (offset & 3 || offset >= buf->size) {
 			nvhost_err(&pdata->pdev->dev,
-				   "invalid cmdbuf_offset=0x%x",
-				   reloc->cmdbuf_offset);
+				   "invalid cmdbuf_offset=0x%x", offset);
 			return -EINVAL;
 		}
+	}
+
+	if (first == last)
+		return 0;
+
+	start = lower_32_bits(order[first].key) & PAGE_MASK;
+	len = PAGE_ALIGN(lower_32_bits(order[last - 1].key) + 4) - start;
+
+	err = dma_buf_begin_cpu_access(buf, start, len, DMA_TO_DEVICE);
+	if (err) {
+		nvhost_err(&pdata->pdev->dev,
+			"begin_cpu_access() failed for patching reloc %d",
+			err);
+		return err;
+	}
+
+	vaddr = dma_buf_vmap(buf);
+	if (vaddr) {
+		for (i = first; i < last; i++)
+			patch_reloc(job, pdata, order[i].index,
+				    vaddr + lower_32_bits(order[i].key));
+
+		dma_buf_vunmap(buf, vaddr);
+		goto done;
+	}
+
+	/* sorted by offset, so each page is mapped once */
+	for (i = first; i < last; i++) {
+		u32 offset = lower_32_bits(order[i].key);
 
-		if (last_page != reloc->cmdbuf_offset >> PAGE_SHIFT) {
-			if (cmdbuf_page_addr) {
+		page = offset >> PAGE_SHIFT;
+		if (page != last_page) {
+			if (cmdbuf_page_addr)
 				dma_buf_kunmap(buf, last_page,
-						cmdbuf_page_addr);
-				dma_buf_end_cpu_access(buf, last_offset,
-					PAGE_SIZE, DMA_TO_DEVICE);
-			}
+					       cmdbuf_page_addr);
 
-			cmdbuf_page_addr = dma_buf_kmap(buf,
-					reloc->cmdbuf_offset >> PAGE_SHIFT);
-			last_page = reloc->cmdbuf_offset >> PAGE_SHIFT;
-			last_offset = reloc->cmdbuf_offset & PAGE_MASK;
+			cmdbuf_page_addr = dma_buf_kmap(buf, page);
+			last_page = page;
 
 			if (unlikely(!cmdbuf_page_addr)) {
 				pr_err("Couldn't map cmdbuf for relocation\n");
-				return -ENOMEM;
-			}
-
-			err = dma_buf_begin_cpu_access(buf, last_offset,
-					PAGE_SIZE, DMA_TO_DEVICE);
-			if (err) {
-				nvhost_err(&pdata->pdev->dev,
-					"begin_cpu_access() failed for patching reloc %d",
-					err);
-				return err;
+				err = -ENOMEM;
+				goto done;
 			}
 		}
 
-		if (pdata->get_reloc_phys_addr)
-			phys_addr = pdata->get_reloc_phys_addr(
-						job->reloc_addr_phys[i],
-						type->reloc_type);
-		else
-			phys_addr = job->reloc_addr_phys[i];
-
-		__raw_writel(
-			(phys_addr +
-				reloc->target_offset) >> shift->shift,
-			(void __iomem *)(cmdbuf_page_addr +
-				(reloc->cmdbuf_offset & ~PAGE_MASK)));
-
-		/* remove completed reloc from the job */
-		if (i != job->num_relocs - 1) {
-			struct nvhost_reloc *reloc_last =
-				&job->relocarray[job->num_relocs - 1];
-			struct nvhost_reloc_shift *shift_last =
-				&job->relocshiftarray[job->num_relocs - 1];
-			struct nvhost_reloc_type *type_last =
-				&job->reloctypearray[job->num_relocs - 1];
-			reloc->cmdbuf_mem	= reloc_last->cmdbuf_mem;
-			reloc->cmdbuf_offset	= reloc_last->cmdbuf_offset;
-			reloc->target		= reloc_last->target;
-			reloc->target_offset	= reloc_last->target_offset;
-			shift->shift		= shift_last->shift;
-			type->reloc_type	= type_last->reloc_type;
-			job->reloc_addr_phys[i] =
-				job->reloc_addr_phys[job->num_relocs - 1];
-			job->num_relocs--;
-		} else {
-			break;
-		}
+		patch_reloc(job, pdata, order[i].index,
+			    cmdbuf_page_addr + (offset & ~PAGE_MASK));
 	}
 
-	if (cmdbuf_page_addr) {
+	if (cmdbuf_page_addr)
 		dma_buf_kunmap(buf, last_page, cmdbuf_page_addr);
-		dma_buf_end_cpu_access(buf, last_offset,
-				PAGE_SIZE, DMA_TO_DEVICE);
-	}
 
-	return 0;
+done:
+	dma_buf_end_cpu_access(buf, start, len, DMA_TO_DEVICE);
+
+	return err;
 }
 
 
@@ -603,6 +844,9 @@ int nvhost_job_pin(struct nvhost_job *job, struct nvhost_syncpt *sp)
 	if (err <= 0)
 		goto fail;
 
+	/* order relocs by patch location for do_relocs() */
+	sort_relocs(job);
+
 	/* patch gathers */
 	for (i = 0; i < job->num_gathers; i++) {
 		struct nvhost_job_gather *g = &job->gathers[i];
@@ -682,3 +926,192 @@ void nvhost_job_dump(struct device *dev, struct nvhost_job *job)
 	dev_info(dev, "    NUM_HANDLES %d\n",
 		job->num_unpins);
 }
+
+static int job_cache_show(struct seq_file *s, void *unused)
+{
+	struct nvhost_master *host = s->private;
+	int i, b;
+
+	seq_printf(s, "%-4s %6s %10s %10s %10s %10s %8s\n", "ch", "cached",
+		   "job_hits", "job_miss", "ts_hits", "ts_miss", "ts_used");
+
+	for (i = 0; i < nvhost_channel_nb_channels(host); i++) {
+		struct nvhost_channel *ch = host->chlist[i];
+		struct nvhost_job_cache *cache;
+		u64 job_hits, job_misses, ts_hits, ts_misses;
+		u32 cached = 0, ts_used;
+
+		if (!ch)
+			continue;
+
+		cache = &ch->job_cache;
+		spin_lock(&cache->lock);
+		for (b = 0; b < NVHOST_JOB_CACHE_BUCKETS; b++)
+			cached += cache->count[b];
+		job_hits = cache->job_hits;
+		job_misses = cache->job_misses;
+		ts_hits = cache->ts_hits;
+		ts_misses = cache->ts_misses;
+		ts_used = bitmap_weight(cache->ts_used, NVHOST_JOB_TS_SLOTS);
+		spin_unlock(&cache->lock);
+
+		if (!job_hits && !job_misses)
+			continue;
+
+		seq_printf(s, "%-4d %6u %10llu %10llu %10llu %10llu %8u\n",
+			   ch->chid, cached, job_hits, job_misses,
+			   ts_hits, ts_misses, ts_used);
+	}
+
+	return 0;
+}
+
+static int job_cache_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, job_cache_show, inode->i_private);
+}
+
+static const struct file_operations job_cache_fops = {
+	.open		= job_cache_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+/*
+ * Submit path microbenchmark: allocate and release jobs of a few typical
+ * shapes on a stub channel, once with recycling disabled and once with it
+ * enabled. Write the iteration count to job_bench, read it for results.
+ */
+static const struct {
+	const char *name;
+	int cmdbufs, relocs, waitchks, syncpts;
+} job_bench_shapes[] = {
+	{ "small",  1,   0, 0, 1 },
+	{ "medium", 4,  32, 2, 1 },
+	{ "large", 16, 128, 8, 2 },
+};
+
+static DEFINE_MUTEX(job_bench_lock);
+static u32 job_bench_iters;
+static u64 job_bench_ns[ARRAY_SIZE(job_bench_shapes)][2];
+
+static int job_bench_run(struct nvhost_master *host, u32 iters)
+{
+	struct nvhost_device_data *pdata = platform_get_drvdata(host->dev);
+	struct nvhost_channel *ch;
+	struct nvhost_job *job;
+	int i, cached, err = 0;
+	ktime_t start;
+	u32 n;
+
+	/* the stub channel has no vm to carve timestamp slots from */
+	if (pdata->enable_timestamps)
+		return -EINVAL;
+
+	ch = kzalloc(sizeof(*ch), GFP_KERNEL);
+	if (!ch)
+		return -ENOMEM;
+
+	ch->dev = host->dev;
+	ch->chid = -1;
+	nvhost_job_cache_init(&ch->job_cache);
+
+	for (i = 0; i < ARRAY_SIZE(job_bench_shapes) && !err; i++) {
+		for (cached = 0; cached < 2; cached++) {
+			ch->job_cache.depth = cached ?
+					      NVHOST_JOB_CACHE_DEPTH : 0;
+			start = ktime_get();
+			for (n = 0; n < iters; n++) {
+				job = nvhost_job_alloc(ch,
+					job_bench_shapes[i].cmdbufs,
+					job_bench_shapes[i].relocs,
+					job_bench_shapes[i].waitchks,
+					job_bench_shapes[i].syncpts);
+				if (!job) {
+					err = -ENOMEM;
+					break;
+				}
+				nvhost_job_put(job);
+			}
+			job_bench_ns[i][cached] =
+				ktime_to_ns(ktime_sub(ktime_get(), start));
+			nvhost_job_cache_drain(&ch->job_cache);
+		}
+	}
+
+	kfree(ch);
+	return err;
+}
+
+static int job_bench_show(struct seq_file *s, void *unused)
+{
+	int i;
+
+	mutex_lock(&job_bench_lock);
+	if (!job_bench_iters) {
+		mutex_unlock(&job_bench_lock);
+		return 0;
+	}
+
+	seq_printf(s, "iterations: %u\n", job_bench_iters);
+	seq_printf(s, "%-8s %8s %12s %12s\n", "shape", "size",
+		   "uncached_ns", "cached_ns");
+	for (i = 0; i < ARRAY_SIZE(job_bench_shapes); i++)
+		seq_printf(s, "%-8s %8zu %12llu %12llu\n",
+			   job_bench_shapes[i].name,
+			   job_size(job_bench_shapes[i].cmdbufs,
+				    job_bench_shapes[i].relocs,
+				    job_bench_shapes[i].waitchks,
+				    job_bench_shapes[i].syncpts),
+			   div_u64(job_bench_ns[i][0], job_bench_iters),
+			   div_u64(job_bench_ns[i][1], job_bench_iters));
+	mutex_unlock(&job_bench_lock);
+
+	return 0;
+}
+
+static int job_bench_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, job_bench_show, inode->i_private);
+}
+
+static ssize_t job_bench_write(struct file *file, const char __user *buf,
+			       size_t count, loff_t *ppos)
+{
+	struct seq_file *s = file->private_data;
+	u32 iters;
+	int err;
+
+	err = kstrtou32_from_user(buf, count, 0, &iters);
+	if (err)
+		return err;
+
+	if (!iters || iters > (1 << 20))
+		return -EINVAL;
+
+	mutex_lock(&job_bench_lock);
+	job_bench_iters = 0;
+	err = job_bench_run(s->private, iters);
+	if (!err)
+		job_bench_iters = iters;
+	mutex_unlock(&job_bench_lock);
+
+	return err ? err : count;
+}
+
+static const struct file_operations job_bench_fops = {
+	.open		= job_bench_open,
+	.read		= seq_read,
+	.write		= job_bench_write,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+void nvhost_job_debug_init(struct nvhost_master *master, struct dentry *de)
+{
+	debugfs_create_file("job_cache", S_IRUGO, de,
+			master, &job_cache_fops);
+	debugfs_create_file("job_bench", S_IRUGO|S_IWUSR, de,
+			master, &job_bench_fops);
+}
@@ -24,11 +24,43 @@
 #include <linux/nvhost_ioctl.h>
 #include <linux/kref.h>
 #include <linux/dma-buf.h>
+#include <linux/spinlock.h>
 
 struct nvhost_channel;
+struct nvhost_master;
 struct nvhost_waitchk;
 struct nvhost_syncpt;
 struct sg_table;
+struct dentry;
+
+/*
+ * Finished jobs are kept per channel in power of two size buckets, from
+ * 512 bytes up to 16 KiB, and reused by the next submit of similar shape.
+ */
+#define NVHOST_JOB_CACHE_MIN_SHIFT	9
+#define NVHOST_JOB_CACHE_BUCKETS	6
+#define NVHOST_JOB_CACHE_DEPTH		4
+
+/* Engine timestamp slots (two u64 each) carved from one coherent page */
+#define NVHOST_JOB_TS_SLOTS		256
+#define NVHOST_JOB_TS_POOL_SIZE		(NVHOST_JOB_TS_SLOTS * 2 * sizeof(u64))
+
+struct nvhost_job_cache {
+	spinlock_t lock;
+	struct list_head free[NVHOST_JOB_CACHE_BUCKETS];
+	u32 count[NVHOST_JOB_CACHE_BUCKETS];
+	u32 depth;		/* max jobs kept per bucket, 0 disables */
+
+	struct device *ts_dev;	/* device the slot page belongs to */
+	u64 *ts_ptr;
+	dma_addr_t ts_dma;
+	DECLARE_BITMAP(ts_used, NVHOST_JOB_TS_SLOTS);
+
+	u64 job_hits;
+	u64 job_misses;
+	u64 ts_hits;
+	u64 ts_misses;
+};
 
 struct nvhost_job_gather {
 	u32 words;
@@ -53,6 +85,12 @@ struct nvhost_pinid {
 	enum dma_data_direction direction;
 };
 
+/* Relocs sorted by patch location, so each cmdbuf is patched in one pass */
+struct nvhost_job_reloc_order {
+	u64 key;	/* cmdbuf_mem << 32 | cmdbuf_offset */
+	u32 index;	/* index into the reloc arrays */
+};
+
 struct nvhost_job_unpin {
 	struct sg_table *sgt;
 	struct dma_buf *buf;
@@ -91,6 +129,7 @@ struct nvhost_job {
 	struct nvhost_reloc *relocarray;
 	struct nvhost_reloc_shift *relocshiftarray;
 	struct nvhost_reloc_type *reloctypearray;
+	struct nvhost_job_reloc_order *reloc_order;
 	int num_relocs;
 	struct nvhost_job_unpin *unpins;
 	int num_unpins;
@@ -126,9 +165,29 @@ struct nvhost_job {
 	struct {
 		dma_addr_t dma;
 		u64 *ptr;
+		bool pooled;	/* slot from the channel job cache */
 	} engine_timestamps;
+
+	/* CLOCK_MONOTONIC submit and push buffer kick times, for cdma stats */
+	u64 submit_ns;
+	u64 push_ns;
 };
 
+/*
+ * Initialize a channel job cache.
+ */
+void nvhost_job_cache_init(struct nvhost_job_cache *cache);
+
+/*
+ * Free the cached jobs, and the timestamp slots if none are in use.
+ */
+void nvhost_job_cache_drain(struct nvhost_job_cache *cache);
+
+/*
+ * Create job cache statistics and benchmark debugfs nodes.
+ */
+void nvhost_job_debug_init(struct nvhost_master *master, struct dentry *de);
+
 /*
  * Add a gather to a job.
  */
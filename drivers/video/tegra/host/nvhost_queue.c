@@ -23,6 +23,9 @@
 #include <linux/dma-mapping.h>
 #include <linux/debugfs.h>
 #include <linux/dma-attrs.h>
+#include <linux/seq_file.h>
+#include <linux/ktime.h>
+#include <linux/shrinker.h>
 
 #include <linux/nvhost.h>
 
@@ -34,74 +37,195 @@
 
 #define CMDBUF_SIZE	4096
 
+/*
+ * Task memory is handed out in chunks of NVHOST_QUEUE_TASK_CHUNK tasks. A
+ * queue starts with enough chunks for the num_tasks given at allocation
+ * time, grows a chunk at a time when a burst runs out of slots and gives
+ * the extra chunks back from the shrinker under memory pressure.
+ */
+#define NVHOST_QUEUE_TASK_CHUNK		8
+#define NVHOST_QUEUE_MAX_TASK_CHUNKS	16
+#define NVHOST_QUEUE_MAX_TASKS		\
+	(NVHOST_QUEUE_TASK_CHUNK * NVHOST_QUEUE_MAX_TASK_CHUNKS)
+
+/**
+ * @brief Describe a chunk of task memory
+ *
+ * dma_addr		Physical address of the chunk
+ * va			Virtual address of the chunk, NULL if not allocated
+ * kmem_addr		Kernel memory for the task structs of the chunk
+ *
+ */
+struct nvhost_queue_task_chunk {
+	dma_addr_t dma_addr;
+	void *va;
+	void *kmem_addr;
+};
+
 /**
  * @brief Describe a task pool struct
  *
- * Array of fixed task memory is allocated during queue_alloc call.
- * The memory will be shared for various task based on availability
+ * Task memory is allocated in chunks during queue_alloc call and grown
+ * on demand. The memory will be shared for various task based on
+ * availability
  *
- * dma_addr		Physical address of task memory pool
- * va			Virtual address of the task memory pool
- * kmem_addr		Kernel memory for task struct
- * lock			Mutex lock for the array access.
+ * chunks		Task memory chunks
+ * lock			Mutex lock for growing and shrinking the pool
  * alloc_table		Keep track of the index being assigned
- *			and freed for a task
- * max_task_cnt		Maximum task count that can be supported.
+ *			and freed for a task. Slots of chunks that are
+ *			not allocated are kept set, so that slots can be
+ *			claimed and released without taking the lock.
+ * min_chunks		Chunks allocated with the queue, never shrunk
+ * num_chunks		Chunks currently allocated
+ * in_use		Task slots currently assigned
+ * high_water		Highest in_use seen
+ * chunks_high_water	Highest num_chunks seen
+ * grows		Number of chunks added on demand
+ * shrinks		Number of chunks released by the shrinker
+ * alloc_fails		Allocations that found the pool at its maximum size
  *
  */
 struct nvhost_queue_task_pool {
-	dma_addr_t dma_addr;
-	void *va;
-	void *kmem_addr;
+	struct nvhost_queue_task_chunk chunks[NVHOST_QUEUE_MAX_TASK_CHUNKS];
 	struct mutex lock;
 
-	unsigned long alloc_table;
-	unsigned long max_task_cnt;
+	DECLARE_BITMAP(alloc_table, NVHOST_QUEUE_MAX_TASKS);
+	unsigned int min_chunks;
+	unsigned int num_chunks;
+
+	atomic_t in_use;
+	atomic_t high_water;
+	unsigned int chunks_high_water;
+	unsigned long grows;
+	unsigned long shrinks;
+	atomic_t alloc_fails;
 };
 
 static DEFINE_DMA_ATTRS(task_dma_attrs);
 
-static int nvhost_queue_task_pool_alloc(struct platform_device *pdev,
-					struct nvhost_queue *queue,
-					unsigned int num_tasks)
+static int nvhost_queue_task_chunk_alloc(struct nvhost_queue *queue,
+					 unsigned int index)
 {
-	int err = 0;
-	struct nvhost_queue_task_pool *task_pool;
-
-	task_pool = queue->task_pool;
+	struct nvhost_queue_task_pool *task_pool = queue->task_pool;
+	struct nvhost_queue_task_chunk *chunk = &task_pool->chunks[index];
+	struct platform_device *pdev = queue->vm_pdev;
+	unsigned int i;
 
 	/* Allocate the kernel memory needed for the task */
 	if (queue->task_kmem_size) {
-		task_pool->kmem_addr = kcalloc(num_tasks,
+		chunk->kmem_addr = kcalloc(NVHOST_QUEUE_TASK_CHUNK,
 					queue->task_kmem_size, GFP_KERNEL);
-		if (!task_pool->kmem_addr) {
+		if (!chunk->kmem_addr) {
 			nvhost_err(&pdev->dev,
 				   "failed to allocate task_pool->kmem_addr");
-			err = -ENOMEM;
-			goto err_alloc_task_kmem;
+			return -ENOMEM;
 		}
 	}
 
 	/* Allocate memory for the task itself */
-	task_pool->va = dma_alloc_attrs(&pdev->dev,
-				queue->task_dma_size * num_tasks,
-				&task_pool->dma_addr, GFP_KERNEL,
+	chunk->va = dma_alloc_attrs(&pdev->dev,
+				queue->task_dma_size * NVHOST_QUEUE_TASK_CHUNK,
+				&chunk->dma_addr, GFP_KERNEL,
 				__DMA_ATTR(task_dma_attrs));
-
-	if (task_pool->va == NULL) {
+	if (chunk->va == NULL) {
 		nvhost_err(&pdev->dev, "failed to allocate task_pool->va");
-		err = -ENOMEM;
-		goto err_alloc_task_pool;
+		kfree(chunk->kmem_addr);
+		chunk->kmem_addr = NULL;
+		return -ENOMEM;
+	}
+
+	task_pool->num_chunks++;
+	task_pool->chunks_high_water = max(task_pool->chunks_high_water,
+					   task_pool->num_chunks);
+
+	/* publish the chunk before its slots become claimable */
+	for (i = 0; i < NVHOST_QUEUE_TASK_CHUNK; i++)
+		clear_bit_unlock(index * NVHOST_QUEUE_TASK_CHUNK + i,
+				 task_pool->alloc_table);
+
+	return 0;
+}
+
+static void nvhost_queue_task_chunk_free(struct nvhost_queue *queue,
+					 unsigned int index)
+{
+	struct nvhost_queue_task_pool *task_pool = queue->task_pool;
+	struct nvhost_queue_task_chunk *chunk = &task_pool->chunks[index];
+
+	dma_free_attrs(&queue->vm_pdev->dev,
+			queue->task_dma_size * NVHOST_QUEUE_TASK_CHUNK,
+			chunk->va, chunk->dma_addr,
+			__DMA_ATTR(task_dma_attrs));
+	kfree(chunk->kmem_addr);
+
+	chunk->va = NULL;
+	chunk->kmem_addr = NULL;
+	task_pool->num_chunks--;
+}
+
+/*
+ * Release a chunk that has no tasks assigned. All its slots are claimed
+ * first so that no allocation can race with the free; the slots stay set
+ * while the chunk is not allocated.
+ */
+static bool nvhost_queue_task_chunk_try_free(struct nvhost_queue *queue,
+					     unsigned int index)
+{
+	struct nvhost_queue_task_pool *task_pool = queue->task_pool;
+	unsigned int first = index * NVHOST_QUEUE_TASK_CHUNK;
+	unsigned int i;
+
+	for (i = 0; i < NVHOST_QUEUE_TASK_CHUNK; i++) {
+		if (test_and_set_bit(first + i, task_pool->alloc_table))
+			goto busy;
 	}
-	task_pool->max_task_cnt = num_tasks;
 
-	mutex_init(&task_pool->lock);
+	nvhost_queue_task_chunk_free(queue, index);
+	task_pool->shrinks++;
+
+	return true;
+
+busy:
+	while (i--)
+		clear_bit(first + i, task_pool->alloc_table);
+	return false;
+}
+
+static int nvhost_queue_task_pool_alloc(struct platform_device *pdev,
+					struct nvhost_queue *queue,
+					unsigned int num_tasks)
+{
+	int err = 0;
+	unsigned int i;
+	struct nvhost_queue_task_pool *task_pool;
+
+	task_pool = queue->task_pool;
+
+	num_tasks = clamp_t(unsigned int, num_tasks, 1,
+			    NVHOST_QUEUE_MAX_TASKS);
+
+	mutex_lock(&task_pool->lock);
+	bitmap_fill(task_pool->alloc_table, NVHOST_QUEUE_MAX_TASKS);
+	task_pool->min_chunks = DIV_ROUND_UP(num_tasks,
+					     NVHOST_QUEUE_TASK_CHUNK);
+	task_pool->num_chunks = 0;
+	atomic_set(&task_pool->in_use, 0);
+
+	for (i = 0; i < task_pool->min_chunks; i++) {
+		err = nvhost_queue_task_chunk_alloc(queue, i);
+		if (err < 0)
+			goto err_alloc_task_pool;
+	}
+	mutex_unlock(&task_pool->lock);
 
 	return err;
 
 err_alloc_task_pool:
-	kfree(task_pool->kmem_addr);
-err_alloc_task_kmem:
+	while (i--)
+		nvhost_queue_task_chunk_free(queue, i);
+	bitmap_fill(task_pool->alloc_table, NVHOST_QUEUE_MAX_TASKS);
+	task_pool->min_chunks = 0;
+	mutex_unlock(&task_pool->lock);
 	return err;
 }
 
@@ -110,17 +234,247 @@ static void nvhost_queue_task_free_pool(struct platform_device *pdev,
 {
 	struct nvhost_queue_task_pool *task_pool =
 		(struct nvhost_queue_task_pool *)queue->task_pool;
+	unsigned int i;
 
-	dma_free_attrs(&queue->vm_pdev->dev,
-			queue->task_dma_size * task_pool->max_task_cnt,
-			task_pool->va, task_pool->dma_addr,
-			__DMA_ATTR(task_dma_attrs));
+	mutex_lock(&task_pool->lock);
+	for (i = 0; i < NVHOST_QUEUE_MAX_TASK_CHUNKS; i++) {
+		if (task_pool->chunks[i].va)
+			nvhost_queue_task_chunk_free(queue, i);
+	}
+	task_pool->min_chunks = 0;
+	mutex_unlock(&task_pool->lock);
+}
+
+/*
+ * Add a chunk to the pool. Returns 0 when there are free slots to retry
+ * with, -EAGAIN when the pool is at its maximum size.
+ */
+static int nvhost_queue_task_pool_grow(struct nvhost_queue *queue)
+{
+	struct nvhost_queue_task_pool *task_pool = queue->task_pool;
+	unsigned int i;
+	int err = 0;
+
+	mutex_lock(&task_pool->lock);
+
+	/* someone else grew the pool or released a task meanwhile */
+	if (!bitmap_full(task_pool->alloc_table, NVHOST_QUEUE_MAX_TASKS))
+		goto out;
 
-	kfree(task_pool->kmem_addr);
-	task_pool->max_task_cnt = 0;
-	task_pool->alloc_table = 0;
+	for (i = 0; i < NVHOST_QUEUE_MAX_TASK_CHUNKS; i++) {
+		if (!task_pool->chunks[i].va)
+			break;
+	}
+
+	if (i == NVHOST_QUEUE_MAX_TASK_CHUNKS) {
+		atomic_inc(&task_pool->alloc_fails);
+		err = -EAGAIN;
+		goto out;
+	}
+
+	err = nvhost_queue_task_chunk_alloc(queue, i);
+	if (!err)
+		task_pool->grows++;
+
+out:
+	mutex_unlock(&task_pool->lock);
+	return err;
 }
 
+/* Claim a free slot starting the search at hint, without locking */
+static int nvhost_queue_task_slot_claim(
+			struct nvhost_queue_task_pool *task_pool,
+			unsigned long hint)
+{
+	unsigned long index = hint;
+
+	for (;;) {
+		index = find_next_zero_bit(task_pool->alloc_table,
+					   NVHOST_QUEUE_MAX_TASKS, index);
+		if (index >= NVHOST_QUEUE_MAX_TASKS) {
+			if (!hint)
+				return -1;
+			index = hint = 0;
+			continue;
+		}
+
+		if (!test_and_set_bit(index, task_pool->alloc_table))
+			return index;
+	}
+}
+
+static int nvhost_queue_task_slot_alloc(struct nvhost_queue *queue,
+					unsigned long hint)
+{
+	struct nvhost_queue_task_pool *task_pool = queue->task_pool;
+	int index, in_use, high_water;
+	int err;
+
+	while ((index = nvhost_queue_task_slot_claim(task_pool, hint)) < 0) {
+		err = nvhost_queue_task_pool_grow(queue);
+		if (err < 0)
+			return err;
+	}
+
+	in_use = atomic_inc_return(&task_pool->in_use);
+	high_water = atomic_read(&task_pool->high_water);
+	while (in_use > high_water) {
+		int old = atomic_cmpxchg(&task_pool->high_water,
+					 high_water, in_use);
+		if (old == high_water)
+			break;
+		high_water = old;
+	}
+
+	return index;
+}
+
+static void nvhost_queue_task_slot_free(struct nvhost_queue *queue, int index)
+{
+	struct nvhost_queue_task_pool *task_pool = queue->task_pool;
+
+	atomic_dec(&task_pool->in_use);
+	clear_bit_unlock(index, task_pool->alloc_table);
+}
+
+static void nvhost_queue_task_slot_info(struct nvhost_queue *queue,
+			int index, struct nvhost_queue_task_mem_info *info)
+{
+	struct nvhost_queue_task_pool *task_pool = queue->task_pool;
+	struct nvhost_queue_task_chunk *chunk =
+		&task_pool->chunks[index / NVHOST_QUEUE_TASK_CHUNK];
+	unsigned int slot = index % NVHOST_QUEUE_TASK_CHUNK;
+	int hw_offset = slot * queue->task_dma_size;
+	int sw_offset = slot * queue->task_kmem_size;
+
+	info->kmem_addr = (void *)((u8 *)chunk->kmem_addr + sw_offset);
+	info->va = (void *)((u8 *)chunk->va + hw_offset);
+	info->dma_addr = chunk->dma_addr + hw_offset;
+	info->pool_index = index;
+}
+
+static unsigned long nvhost_queue_shrink_count(struct shrinker *shrinker,
+					       struct shrink_control *sc)
+{
+	struct nvhost_queue_pool *pool =
+		container_of(shrinker, struct nvhost_queue_pool, shrinker);
+	struct nvhost_queue_task_pool *task_pools = pool->queue_task_pool;
+	unsigned long count = 0;
+	unsigned int i;
+
+	for (i = 0; i < pool->max_queue_cnt; i++) {
+		unsigned int num_chunks = READ_ONCE(task_pools[i].num_chunks);
+		unsigned int min_chunks = READ_ONCE(task_pools[i].min_chunks);
+
+		if (num_chunks > min_chunks)
+			count += num_chunks - min_chunks;
+	}
+
+	return count;
+}
+
+static unsigned long nvhost_queue_shrink_scan(struct shrinker *shrinker,
+					      struct shrink_control *sc)
+{
+	struct nvhost_queue_pool *pool =
+		container_of(shrinker, struct nvhost_queue_pool, shrinker);
+	unsigned long freed = 0;
+	unsigned long queue_id;
+
+	/* do not wait on a queue that may be allocating task memory */
+	if (!mutex_trylock(&pool->queue_lock))
+		return SHRINK_STOP;
+
+	for_each_set_bit(queue_id, &pool->alloc_table, pool->max_queue_cnt) {
+		struct nvhost_queue *queue = &pool->queues[queue_id];
+		struct nvhost_queue_task_pool *task_pool = queue->task_pool;
+		unsigned int i;
+
+		if (!queue->task_dma_size ||
+		    !mutex_trylock(&task_pool->lock))
+			continue;
+
+		/* release the extra chunks from the top down */
+		for (i = NVHOST_QUEUE_MAX_TASK_CHUNKS;
+		     i-- > task_pool->min_chunks && freed < sc->nr_to_scan;) {
+			if (task_pool->chunks[i].va &&
+			    nvhost_queue_task_chunk_try_free(queue, i))
+				freed++;
+		}
+
+		mutex_unlock(&task_pool->lock);
+	}
+
+	mutex_unlock(&pool->queue_lock);
+
+	return freed ? freed : SHRINK_STOP;
+}
+
+static int task_pools_show(struct seq_file *s, void *data)
+{
+	struct nvhost_queue_pool *pool = s->private;
+	struct nvhost_queue_task_pool *task_pools = pool->queue_task_pool;
+	unsigned int i;
+
+	seq_printf(s, "chunk: %u tasks, max: %u tasks\n",
+		   NVHOST_QUEUE_TASK_CHUNK, NVHOST_QUEUE_MAX_TASKS);
+	seq_puts(s, "queue  in_use high_water chunks min max grows shrinks fails\n");
+
+	mutex_lock(&pool->queue_lock);
+	for (i = 0; i < pool->max_queue_cnt; i++) {
+		struct nvhost_queue_task_pool *task_pool = &task_pools[i];
+
+		seq_printf(s, "%5u %7d %10d %6u %3u %3u %5lu %7lu %5d\n", i,
+			   atomic_read(&task_pool->in_use),
+			   atomic_read(&task_pool->high_water),
+			   task_pool->num_chunks, task_pool->min_chunks,
+			   task_pool->chunks_high_water,
+			   task_pool->grows, task_pool->shrinks,
+			   atomic_read(&task_pool->alloc_fails));
+	}
+	mutex_unlock(&pool->queue_lock);
+
+	return 0;
+}
+
+static int task_pools_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, task_pools_show, inode->i_private);
+}
+
+/* Any write clears the high-water marks and counters */
+static ssize_t task_pools_write(struct file *file, const char __user *buf,
+				size_t count, loff_t *ppos)
+{
+	struct seq_file *s = file->private_data;
+	struct nvhost_queue_pool *pool = s->private;
+	struct nvhost_queue_task_pool *task_pools = pool->queue_task_pool;
+	unsigned int i;
+
+	mutex_lock(&pool->queue_lock);
+	for (i = 0; i < pool->max_queue_cnt; i++) {
+		struct nvhost_queue_task_pool *task_pool = &task_pools[i];
+
+		atomic_set(&task_pool->high_water,
+			   atomic_read(&task_pool->in_use));
+		task_pool->chunks_high_water = task_pool->num_chunks;
+		task_pool->grows = 0;
+		task_pool->shrinks = 0;
+		atomic_set(&task_pool->alloc_fails, 0);
+	}
+	mutex_unlock(&pool->queue_lock);
+
+	return count;
+}
+
+static const struct file_operations task_pools_operations = {
+	.open = task_pools_open,
+	.read = seq_read,
+	.write = task_pools_write,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
 static int nvhost_queue_dump(struct nvhost_queue_pool *pool,
 		struct nvhost_queue *queue,
 		struct seq_file *s)
@@ -156,6 +510,321 @@ static const struct file_operations queue_expose_operations = {
 	.release = single_release,
 };
 
+/*
+ * Batch submit benchmark against a stub engine. The stub takes task memory
+ * from a private task pool sized like the engine's (one slot per call for
+ * submit, nvhost_queue_alloc_task_memory_batch() for submit_batch), writes
+ * the descriptors into it, queues the tasks under the list lock and rings
+ * a doorbell, which is a barrier and a single write. Tasks complete as soon
+ * as the call returns and their memory is released through
+ * nvhost_queue_free_task_memory(). Buffer pinning is not exercised, as it
+ * needs real dma_bufs. Write the number of tasks to submit per batch size
+ * to queue_bench, read it for tasks/sec.
+ */
+#define QUEUE_BENCH_MAX_BATCH	32
+
+static const unsigned int queue_bench_sizes[] = { 1, 2, 4, 8, 16, 32 };
+
+struct queue_bench_task {
+	struct list_head node;
+	struct nvhost_queue_task_mem_info *mem;
+};
+
+struct queue_bench {
+	struct nvhost_queue_pool pool;
+	struct nvhost_queue queue;
+	struct nvhost_queue_task_pool task_pool;
+	struct queue_bench_task tasks[QUEUE_BENCH_MAX_BATCH];
+	struct nvhost_queue_task_mem_info mem[QUEUE_BENCH_MAX_BATCH];
+	void *task_args[QUEUE_BENCH_MAX_BATCH];
+	u32 doorbell;
+};
+
+static DEFINE_MUTEX(queue_bench_lock);
+static u32 queue_bench_tasks;
+static size_t queue_bench_task_size;
+static u64 queue_bench_ns[ARRAY_SIZE(queue_bench_sizes)][2];
+
+static void queue_bench_write_task(struct nvhost_queue *queue,
+				   struct queue_bench_task *task)
+{
+	memset(task->mem->kmem_addr, 0xa5, queue->task_kmem_size);
+	memset(task->mem->va, 0x5a, queue->task_dma_size);
+}
+
+static void queue_bench_kick(struct nvhost_queue *queue)
+{
+	struct queue_bench *bench = container_of(queue, struct queue_bench,
+						 queue);
+
+	/* descriptors must be visible before the engine is told */
+	wmb();
+	WRITE_ONCE(bench->doorbell, queue->sequence++);
+}
+
+static int queue_bench_submit(struct nvhost_queue *queue, void *task_arg)
+{
+	struct queue_bench_task *task = task_arg;
+	int err;
+
+	err = nvhost_queue_alloc_task_memory(queue, task->mem);
+	if (err)
+		return err;
+
+	queue_bench_write_task(queue, task);
+
+	mutex_lock(&queue->list_lock);
+	list_add_tail(&task->node, &queue->tasklist);
+	queue_bench_kick(queue);
+	mutex_unlock(&queue->list_lock);
+
+	return 0;
+}
+
+static int queue_bench_submit_batch(struct nvhost_queue *queue,
+				    void **task_args, unsigned int num_tasks,
+				    unsigned int *num_submitted)
+{
+	struct queue_bench_task *first = task_args[0];
+	unsigned int i;
+	int err;
+
+	/* the bench hands out tasks with consecutive mem entries */
+	err = nvhost_queue_alloc_task_memory_batch(queue, first->mem,
+						   num_tasks);
+	if (err)
+		return err;
+
+	for (i = 0; i < num_tasks; i++)
+		queue_bench_write_task(queue, task_args[i]);
+
+	mutex_lock(&queue->list_lock);
+	for (i = 0; i < num_tasks; i++) {
+		struct queue_bench_task *task = task_args[i];
+
+		list_add_tail(&task->node, &queue->tasklist);
+	}
+	queue_bench_kick(queue);
+	mutex_unlock(&queue->list_lock);
+
+	*num_submitted = num_tasks;
+
+	return 0;
+}
+
+/* the stub engine completes everything it was handed right away */
+static void queue_bench_complete(struct nvhost_queue *queue)
+{
+	struct queue_bench_task *task, *tmp;
+
+	mutex_lock(&queue->list_lock);
+	list_for_each_entry_safe(task, tmp, &queue->tasklist, node) {
+		list_del(&task->node);
+		nvhost_queue_free_task_memory(queue, task->mem->pool_index);
+	}
+	mutex_unlock(&queue->list_lock);
+}
+
+static int queue_bench_run(struct nvhost_queue_pool *engine, u32 num_tasks)
+{
+	struct nvhost_queue_ops ops[2] = {
+		{ .submit = queue_bench_submit },
+		{ .submit = queue_bench_submit,
+		  .submit_batch = queue_bench_submit_batch },
+	};
+	struct queue_bench *bench;
+	struct nvhost_queue *queue;
+	unsigned int i, batched, submitted;
+	int err;
+
+	bench = kzalloc(sizeof(*bench), GFP_KERNEL);
+	if (!bench)
+		return -ENOMEM;
+
+	for (i = 0; i < QUEUE_BENCH_MAX_BATCH; i++) {
+		bench->tasks[i].mem = &bench->mem[i];
+		bench->task_args[i] = &bench->tasks[i];
+	}
+
+	/* same task sizes as the engine the node belongs to */
+	bench->pool.pdev = engine->pdev;
+	queue = &bench->queue;
+	queue->pool = &bench->pool;
+	queue->task_pool = &bench->task_pool;
+	queue->vm_pdev = engine->pdev;
+	if (engine->ops && engine->ops->get_task_size)
+		engine->ops->get_task_size(&queue->task_dma_size,
+					   &queue->task_kmem_size);
+	if (!queue->task_dma_size) {
+		err = -ENODEV;
+		goto out_free;
+	}
+	queue_bench_task_size = queue->task_dma_size;
+
+	mutex_init(&queue->list_lock);
+	INIT_LIST_HEAD(&queue->tasklist);
+	mutex_init(&bench->task_pool.lock);
+
+	err = nvhost_queue_task_pool_alloc(queue->vm_pdev, queue,
+					   QUEUE_BENCH_MAX_BATCH);
+	if (err)
+		goto out_destroy;
+
+	for (i = 0; i < ARRAY_SIZE(queue_bench_sizes); i++) {
+		unsigned int size = queue_bench_sizes[i];
+
+		for (batched = 0; batched < 2; batched++) {
+			u32 done;
+			u64 start;
+
+			bench->pool.ops = &ops[batched];
+			start = ktime_get_ns();
+			for (done = 0; done < num_tasks; done += size) {
+				err = nvhost_queue_submit_batch(queue,
+						bench->task_args, size,
+						&submitted);
+				queue_bench_complete(queue);
+				if (err)
+					goto out_free_pool;
+			}
+			queue_bench_ns[i][batched] = ktime_get_ns() - start;
+		}
+	}
+
+out_free_pool:
+	nvhost_queue_task_free_pool(queue->vm_pdev, queue);
+out_destroy:
+	mutex_destroy(&bench->task_pool.lock);
+	mutex_destroy(&queue->list_lock);
+out_free:
+	kfree(bench);
+	return err;
+}
+
+static u64 queue_bench_rate(u32 num_tasks, unsigned int size, u64 ns)
+{
+	u64 submitted = roundup(num_tasks, size);
+
+	return ns ? div64_u64(submitted * NSEC_PER_SEC, ns) : 0;
+}
+
+static int queue_bench_show(struct seq_file *s, void *data)
+{
+	unsigned int i;
+
+	mutex_lock(&queue_bench_lock);
+	if (queue_bench_tasks) {
+		seq_printf(s, "tasks: %u task_size: %zu\n",
+			   queue_bench_tasks, queue_bench_task_size);
+		seq_puts(s, "batch  per-task/s   batched/s\n");
+		for (i = 0; i < ARRAY_SIZE(queue_bench_sizes); i++)
+			seq_printf(s, "%5u %11llu %11llu\n",
+				   queue_bench_sizes[i],
+				   queue_bench_rate(queue_bench_tasks,
+						    queue_bench_sizes[i],
+						    queue_bench_ns[i][0]),
+				   queue_bench_rate(queue_bench_tasks,
+						    queue_bench_sizes[i],
+						    queue_bench_ns[i][1]));
+	}
+	mutex_unlock(&queue_bench_lock);
+
+	return 0;
+}
+
+static int queue_bench_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, queue_bench_show, inode->i_private);
+}
+
+static ssize_t queue_bench_write(struct file *file, const char __user *buf,
+				 size_t count, loff_t *ppos)
+{
+	struct seq_file *s = file->private_data;
+	struct nvhost_queue_pool *pool = s->private;
+	u32 num_tasks;
+	int err;
+
+	err = kstrtou32_from_user(buf, count, 0, &num_tasks);
+	if (err)
+		return err;
+
+	if (!num_tasks || num_tasks > (1 << 20))
+		return -EINVAL;
+
+	mutex_lock(&queue_bench_lock);
+	err = queue_bench_run(pool, num_tasks);
+	queue_bench_tasks = err ? 0 : num_tasks;
+	mutex_unlock(&queue_bench_lock);
+
+	return err ? err : count;
+}
+
+static const struct file_operations queue_bench_operations = {
+	.open = queue_bench_open,
+	.read = seq_read,
+	.write = queue_bench_write,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static int pin_cache_show(struct seq_file *s, void *data)
+{
+	struct nvhost_queue_pool *pool = s->private;
+	unsigned int i;
+
+	seq_puts(s, "queue       hits     misses evictions invalidations cached cached_kb\n");
+
+	for (i = 0; i < pool->max_queue_cnt; i++) {
+		struct nvhost_buffer_cache_stats *stats =
+			&pool->queues[i].pin_cache;
+
+		seq_printf(s, "%5u %10d %10d %9d %13d %6d %9ld\n", i,
+			   atomic_read(&stats->hits),
+			   atomic_read(&stats->misses),
+			   atomic_read(&stats->evictions),
+			   atomic_read(&stats->invalidations),
+			   atomic_read(&stats->cached),
+			   atomic_long_read(&stats->cached_bytes) >> 10);
+	}
+
+	return 0;
+}
+
+static int pin_cache_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, pin_cache_show, inode->i_private);
+}
+
+/* Any write clears the hit, miss and eviction counters */
+static ssize_t pin_cache_write(struct file *file, const char __user *buf,
+			       size_t count, loff_t *ppos)
+{
+	struct seq_file *s = file->private_data;
+	struct nvhost_queue_pool *pool = s->private;
+	unsigned int i;
+
+	for (i = 0; i < pool->max_queue_cnt; i++) {
+		struct nvhost_buffer_cache_stats *stats =
+			&pool->queues[i].pin_cache;
+
+		atomic_set(&stats->hits, 0);
+		atomic_set(&stats->misses, 0);
+		atomic_set(&stats->evictions, 0);
+		atomic_set(&stats->invalidations, 0);
+	}
+
+	return count;
+}
+
+static const struct file_operations pin_cache_operations = {
+	.open = pin_cache_open,
+	.read = seq_read,
+	.write = pin_cache_write,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
 struct nvhost_queue_pool *nvhost_queue_init(struct platform_device *pdev,
 					struct nvhost_queue_ops *ops,
 					unsigned int num_queues)
@@ -204,6 +873,15 @@ struct nvhost_queue_pool *nvhost_queue_init(struct platform_device *pdev,
 	debugfs_create_file("queues", S_IRUGO,
 			pdata->debugfs, pool,
 			&queue_expose_operations);
+	debugfs_create_file("queue_bench", S_IRUGO|S_IWUSR,
+			pdata->debugfs, pool,
+			&queue_bench_operations);
+	debugfs_create_file("task_pools", S_IRUGO|S_IWUSR,
+			pdata->debugfs, pool,
+			&task_pools_operations);
+	debugfs_create_file("pin_cache", S_IRUGO|S_IWUSR,
+			pdata->debugfs, pool,
+			&pin_cache_operations);
 
 
 	for (i = 0; i < num_queues; i++) {
@@ -211,9 +889,16 @@ struct nvhost_queue_pool *nvhost_queue_init(struct platform_device *pdev,
 		queue->id = i;
 		queue->pool = pool;
 		queue->task_pool = (void *)&task_pool[i];
+		mutex_init(&task_pool[i].lock);
 		nvhost_queue_get_task_size(queue);
 	}
 
+	/* give extra task memory back under memory pressure */
+	pool->shrinker.count_objects = nvhost_queue_shrink_count;
+	pool->shrinker.scan_objects = nvhost_queue_shrink_scan;
+	pool->shrinker.seeks = DEFAULT_SEEKS;
+	register_shrinker(&pool->shrinker);
+
 	return pool;
 
 fail_alloc_task_pool:
@@ -229,6 +914,7 @@ void nvhost_queue_deinit(struct nvhost_queue_pool *pool)
 	if (!pool)
 		return;
 
+	unregister_shrinker(&pool->shrinker);
 	kfree(pool->queue_task_pool);
 	kfree(pool->queues);
 	kfree(pool);
@@ -324,6 +1010,7 @@ struct nvhost_queue *nvhost_queue_alloc(struct nvhost_queue_pool *pool,
 	/* initialize task list */
 	INIT_LIST_HEAD(&queue->tasklist);
 	mutex_init(&queue->list_lock);
+	mutex_init(&queue->submit_lock);
 
 	/* initialize task list */
 	queue->attr = NULL;
@@ -386,6 +1073,36 @@ int nvhost_queue_submit(struct nvhost_queue *queue, void *task_arg)
 	return 0;
 }
 
+int nvhost_queue_submit_batch(struct nvhost_queue *queue, void **tasks,
+			      unsigned int num_tasks,
+			      unsigned int *num_submitted)
+{
+	struct nvhost_queue_pool *pool = queue->pool;
+	unsigned int i;
+	int err = 0;
+
+	*num_submitted = 0;
+
+	if (!pool->ops)
+		return 0;
+
+	if (pool->ops->submit_batch)
+		return pool->ops->submit_batch(queue, tasks, num_tasks,
+					       num_submitted);
+
+	if (!pool->ops->submit)
+		return 0;
+
+	for (i = 0; i < num_tasks; i++) {
+		err = pool->ops->submit(queue, tasks[i]);
+		if (err)
+			break;
+		(*num_submitted)++;
+	}
+
+	return err;
+}
+
 int nvhost_queue_set_attr(struct nvhost_queue *queue, void *arg)
 {
 	struct nvhost_queue_pool *pool = queue->pool;
@@ -545,58 +1262,59 @@ int nvhost_queue_alloc_task_memory(
 			struct nvhost_queue *queue,
 			struct nvhost_queue_task_mem_info *task_mem_info)
 {
-	int err = 0;
-	int index, hw_offset, sw_offset;
 	struct platform_device *pdev = queue->pool->pdev;
-	struct nvhost_queue_task_pool *task_pool =
-		(struct nvhost_queue_task_pool *)queue->task_pool;
-
-	mutex_lock(&task_pool->lock);
+	int index;
 
-	index = find_first_zero_bit(&task_pool->alloc_table,
-				    task_pool->max_task_cnt);
-
-	/* quit if pre-allocated task array is not free */
-	if (index >= task_pool->max_task_cnt) {
+	index = nvhost_queue_task_slot_alloc(queue, 0);
+	if (index < 0) {
 		dev_err(&pdev->dev,
 				"failed to get Task Pool Memory\n");
-		err = -EAGAIN;
-		goto err_alloc_task_mem;
+		return index;
 	}
 
-	/* assign the task array */
-	set_bit(index, &task_pool->alloc_table);
-	hw_offset = index * queue->task_dma_size;
-	sw_offset = index * queue->task_kmem_size;
-	task_mem_info->kmem_addr =
-			(void *)((u8 *)task_pool->kmem_addr + sw_offset);
-	task_mem_info->va = (void *)((u8 *)task_pool->va + hw_offset);
-	task_mem_info->dma_addr = task_pool->dma_addr + hw_offset;
-	task_mem_info->pool_index = index;
+	nvhost_queue_task_slot_info(queue, index, task_mem_info);
 
-err_alloc_task_mem:
-	mutex_unlock(&task_pool->lock);
+	return 0;
+}
 
-	return err;
+int nvhost_queue_alloc_task_memory_batch(
+			struct nvhost_queue *queue,
+			struct nvhost_queue_task_mem_info *task_mem_info,
+			unsigned int num_tasks)
+{
+	struct platform_device *pdev = queue->pool->pdev;
+	unsigned long hint = 0;
+	unsigned int i;
+	int index;
+
+	/* searching on from the previous slot keeps a batch adjacent */
+	for (i = 0; i < num_tasks; i++) {
+		index = nvhost_queue_task_slot_alloc(queue, hint);
+		if (index < 0)
+			goto err_alloc_task_mem;
+
+		nvhost_queue_task_slot_info(queue, index, &task_mem_info[i]);
+		hint = index + 1;
+	}
+
+	return 0;
+
+err_alloc_task_mem:
+	dev_err(&pdev->dev, "failed to get Task Pool Memory\n");
+	while (i--)
+		nvhost_queue_task_slot_free(queue,
+					    task_mem_info[i].pool_index);
+	return index;
 }
 
 void nvhost_queue_free_task_memory(struct nvhost_queue *queue, int index)
 {
-	int hw_offset, sw_offset;
-	u8 *task_kmem, *task_dma_va;
-	struct nvhost_queue_task_pool *task_pool =
-			(struct nvhost_queue_task_pool *)queue->task_pool;
+	struct nvhost_queue_task_mem_info task_mem_info;
 
 	/* clear task kernel and dma virtual memory contents*/
-	hw_offset = index * queue->task_dma_size;
-	sw_offset = index * queue->task_kmem_size;
-	task_kmem = (u8 *)task_pool->kmem_addr + sw_offset;
-	task_dma_va = (u8 *)task_pool->va + hw_offset;
-
-	memset(task_kmem, 0, queue->task_kmem_size);
-	memset(task_dma_va, 0, queue->task_dma_size);
+	nvhost_queue_task_slot_info(queue, index, &task_mem_info);
+	memset(task_mem_info.kmem_addr, 0, queue->task_kmem_size);
+	memset(task_mem_info.va, 0, queue->task_dma_size);
 
-	mutex_lock(&task_pool->lock);
-	clear_bit(index, &task_pool->alloc_table);
-	mutex_unlock(&task_pool->lock);
+	nvhost_queue_task_slot_free(queue, index);
 }
@@ -20,6 +20,9 @@
 #define __NVHOST_NVHOST_QUEUE_H__
 
 #include <linux/kref.h>
+#include <linux/shrinker.h>
+
+#include "nvhost_buffer.h"
 
 struct nvhost_queue_task_pool;
 
@@ -54,6 +57,7 @@ struct nvhost_queue_task_mem_info {
  * task_dma_size	dma size used in hardware for a task
  * task_kmem_size	kernel memory size for a task
  * attr			queue attribute associated with the host module
+ * pin_cache		buffer pin cache counters of the queue user
  *
  */
 struct nvhost_queue {
@@ -78,6 +82,11 @@ struct nvhost_queue {
 
 	struct mutex list_lock;
 	struct list_head tasklist;
+
+	/* held by engines that predict syncpoint thresholds before kicking */
+	struct mutex submit_lock;
+
+	struct nvhost_buffer_cache_stats pin_cache;
 };
 
 /**
@@ -86,6 +95,9 @@ struct nvhost_queue {
  * dump			dump the task information
  * abort		abort all tasks from a queue
  * submit		submit the given list of tasks to hardware
+ * submit_batch		submit an array of tasks to hardware in one call,
+ *			returning the number of tasks that reached hardware
+ *			(optional, defaults to calling submit for each task)
  * get_task_size	get the dma size needed for the task in hw
  *			and the kernel memory size needed for task.
  *
@@ -94,6 +106,9 @@ struct nvhost_queue_ops {
 	void (*dump)(struct nvhost_queue *queue, struct seq_file *s);
 	int (*abort)(struct nvhost_queue *queue);
 	int (*submit)(struct nvhost_queue *queue, void *task_arg);
+	int (*submit_batch)(struct nvhost_queue *queue, void **task_args,
+			    unsigned int num_tasks,
+			    unsigned int *num_submitted);
 	void (*get_task_size)(size_t *dma_size, size_t *kmem_size);
 	int (*set_attribute)(struct nvhost_queue *queue, void *arg);
 };
@@ -108,6 +123,8 @@ struct nvhost_queue_ops {
  * alloc_table		Bitmap of allocated queues
  * max_queue_cnt	Max number queues available for client
  * queue_task_pool	Pointer to the task memory pool for queues.
+ * shrinker		Releases task memory grown beyond the initial
+ *			size of each queue under memory pressure
  *
  */
 struct nvhost_queue_pool {
@@ -118,6 +135,7 @@ struct nvhost_queue_pool {
 	unsigned long alloc_table;
 	unsigned int max_queue_cnt;
 	void *queue_task_pool;
+	struct shrinker shrinker;
 };
 
 /**
@@ -174,7 +192,9 @@ void nvhost_queue_get(struct nvhost_queue *queue);
  * This function allocates a queue from the pool to client for the user.
  *
  * @param pool		Pointer to a queue pool table
- * @param num_tasks	Max number of tasks per queue
+ * @param num_tasks	Number of tasks the queue keeps memory for. The task
+ *			pool grows beyond this on demand and is shrunk back
+ *			under memory pressure.
  * @param use_channel	Determines whether the routine allocates a channel for
  *			the queue.
  *
@@ -219,6 +239,25 @@ int nvhost_queue_abort(struct nvhost_queue *queue);
  */
 int nvhost_queue_submit(struct nvhost_queue *queue, void *submit);
 
+/**
+ * @brief	submits an array of tasks to hardware
+ *
+ * This function submits num_tasks tasks in order, letting the engine
+ * amortize locking, power references and doorbells across the batch.
+ * On failure the first num_submitted tasks have reached the hardware and
+ * will complete normally; the rest were not submitted.
+ *
+ * @param queue		Pointer to an allocated queue
+ * @param tasks		Array of engine specific task pointers
+ * @param num_tasks	Number of tasks in the array
+ * @param num_submitted	Number of tasks submitted to hardware
+ * @return		0 on success or negative error code on failure.
+ *
+ */
+int nvhost_queue_submit_batch(struct nvhost_queue *queue, void **tasks,
+			      unsigned int num_tasks,
+			      unsigned int *num_submitted);
+
 /**
  * @brief	Get the Task Size needed
  *
@@ -248,6 +287,25 @@ int nvhost_queue_alloc_task_memory(
 			struct nvhost_queue *queue,
 			struct nvhost_queue_task_mem_info *task_mem_info);
 
+/**
+ * @brief	Allocate memory for a batch of tasks from task memory pool
+ *
+ * This function assigns num_tasks task memory slots under a single pool
+ * lock, preferring a contiguous run of slots so that the descriptors of a
+ * batch are adjacent in memory.
+ *
+ * @queue		Pointer to an allocated queue
+ * @task_mem_info	Array of num_tasks nvhost_queue_task_mem_info structs
+ * @num_tasks		Number of task memory slots to allocate
+ *
+ * @return	0 on success, otherwise a negative error code is returned
+ *
+ */
+int nvhost_queue_alloc_task_memory_batch(
+			struct nvhost_queue *queue,
+			struct nvhost_queue_task_mem_info *task_mem_info,
+			unsigned int num_tasks);
+
 /**
  * @brief	Free the assigned task memory
  *
@@ -26,6 +26,8 @@
 #include <linux/export.h>
 #include <linux/delay.h>
 #include <linux/nospec.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 #include <trace/events/nvhost.h>
 #include <soc/tegra/chip-id.h>
 #include "nvhost_syncpt.h"
@@ -213,12 +215,74 @@ static bool syncpt_update_min_is_expired(
 	return nvhost_syncpt_is_expired(sp, id, thresh);
 }
 
+/* Fold a completion latency into the per-syncpt average (weight 1/8). */
+static void syncpt_wait_avg_update(struct nvhost_syncpt *sp, u32 id, u64 delta)
+{
+	u32 avg = READ_ONCE(sp->wait_avg_ns[id]);
+	u32 lat = min_t(u64, delta, U32_MAX);
+
+	WRITE_ONCE(sp->wait_avg_ns[id], avg ? avg - avg / 8 + lat / 8 : lat);
+}
+
+/**
+ * Account a completed wait in the latency histogram and, if fold is set,
+ * in the moving average used to size the spin phase.
+ */
+static void syncpt_wait_account(struct nvhost_syncpt *sp, u32 id,
+				enum nvhost_syncpt_wait_mode mode, u64 start,
+				bool fold)
+{
+	u64 delta = ktime_get_ns() - start;
+	int bucket;
+
+	bucket = min_t(int, fls64(delta >> 10),
+		       NVHOST_SYNCPT_WAIT_HIST_BUCKETS - 1);
+	atomic_inc(&sp->wait_hist[mode][bucket]);
+
+	if (fold)
+		syncpt_wait_avg_update(sp, id, delta);
+}
+
+/**
+ * Spin on the syncpoint register for up to twice the recent average
+ * completion latency, bounded by wait_spin_max_ns. Syncpoints that
+ * usually take longer than the bound skip the spin; each skipped wait
+ * decays their average, so that spinning is tried again now and then.
+ * *spun tells whether the spin phase ran.
+ */
+static bool syncpt_spin_is_expired(struct nvhost_syncpt *sp, u32 id,
+				   u32 thresh, u64 start, bool *spun)
+{
+	u32 avg = READ_ONCE(sp->wait_avg_ns[id]);
+	u32 max_ns = READ_ONCE(sp->wait_spin_max_ns);
+	u64 budget;
+
+	*spun = avg <= max_ns;
+	if (!*spun) {
+		WRITE_ONCE(sp->wait_avg_ns[id], avg - avg / 8);
+		return false;
+	}
+
+	budget = avg ? min_t(u64, 2 * (u64)avg, max_ns) : max_ns;
+
+	do {
+		if (syncpt_update_min_is_expired(sp, id, thresh)) {
+			atomic_inc(&sp->wait_spin_hits);
+			return true;
+		}
+		cpu_relax();
+	} while (ktime_get_ns() - start < budget && !need_resched());
+
+	atomic_inc(&sp->wait_spin_misses);
+	return false;
+}
+
 /**
  * Main entrypoint for syncpoint value waits.
  */
-int nvhost_syncpt_wait_timeout(struct nvhost_syncpt *sp, u32 id,
+int nvhost_syncpt_wait_timeout_flags(struct nvhost_syncpt *sp, u32 id,
 			u32 thresh, u32 timeout, u32 *value,
-			struct nvhost_timespec *ts, bool interruptible)
+			struct nvhost_timespec *ts, u32 flags)
 {
 	void *ref = NULL;
 	struct nvhost_waitlist *waiter = NULL;
@@ -226,6 +290,9 @@ int nvhost_syncpt_wait_timeout(struct nvhost_syncpt *sp, u32 id,
 	u32 val, old_val, new_val;
 	struct nvhost_master *host;
 	bool syncpt_poll = false;
+	bool interruptible = flags & NVHOST_SYNCPT_WAIT_INTERRUPTIBLE;
+	bool spun = false;
+	u64 start;
 	bool (*syncpt_is_expired)(struct nvhost_syncpt *sp,
 			u32 id,
 			u32 thresh);
@@ -266,6 +333,8 @@ int nvhost_syncpt_wait_timeout(struct nvhost_syncpt *sp, u32 id,
 	if (err)
 		return err;
 
+	start = ktime_get_ns();
+
 	/* try to read from register */
 	val = syncpt_op().update_min(sp, id);
 	if (nvhost_syncpt_is_expired(sp, id, thresh)) {
@@ -273,6 +342,10 @@ int nvhost_syncpt_wait_timeout(struct nvhost_syncpt *sp, u32 id,
 			*value = val;
 		if (ts)
 			nvhost_ktime_get_ts(ts);
+		/* quick completions pull the average down too */
+		if (flags & NVHOST_SYNCPT_WAIT_HYBRID)
+			syncpt_wait_avg_update(sp, id,
+					       ktime_get_ns() - start);
 		goto done;
 	}
 
@@ -283,6 +356,18 @@ int nvhost_syncpt_wait_timeout(struct nvhost_syncpt *sp, u32 id,
 
 	old_val = val;
 
+	if ((flags & NVHOST_SYNCPT_WAIT_HYBRID) && !syncpt_poll &&
+	    !nvhost_dev_is_virtual(host->dev) &&
+	    syncpt_spin_is_expired(sp, id, thresh, start, &spun)) {
+		if (value)
+			*value = nvhost_syncpt_read_min(sp, id);
+		if (ts)
+			nvhost_ktime_get_ts(ts);
+		syncpt_wait_account(sp, id, NVHOST_SYNCPT_WAIT_MODE_SPIN,
+				    start, true);
+		goto done;
+	}
+
 	/* Set up a threshold interrupt waiter */
 	if (!syncpt_poll) {
 
@@ -362,6 +447,13 @@ int nvhost_syncpt_wait_timeout(struct nvhost_syncpt *sp, u32 id,
 				}
 			}
 
+			/*
+			 * A sleep includes the wakeup latency; only let it
+			 * raise the average when spinning was tried, or a
+			 * syncpt with spinning off could never get it back.
+			 */
+			syncpt_wait_account(sp, id,
+				NVHOST_SYNCPT_WAIT_MODE_SLEEP, start, spun);
 			err = 0;
 			break;
 		}
@@ -1130,6 +1222,8 @@ int nvhost_syncpt_init(struct platform_device *dev,
 		kzalloc(sizeof(atomic_t) * nvhost_syncpt_nb_mlocks(sp),
 			GFP_KERNEL);
 	sp->ref = kzalloc(sizeof(atomic_t) * nb_pts, GFP_KERNEL);
+	sp->wait_avg_ns = kzalloc(sizeof(u32) * nb_pts, GFP_KERNEL);
+	sp->wait_spin_max_ns = NVHOST_SYNCPT_WAIT_SPIN_MAX_NS;
 #ifdef CONFIG_TEGRA_GRHOST_SYNC
 	sp->timeline = kzalloc(sizeof(struct nvhost_sync_timeline *) *
 			nb_pts, GFP_KERNEL);
@@ -1152,7 +1246,8 @@ int nvhost_syncpt_init(struct platform_device *dev,
 	}
 
 	if (!(sp->assigned && sp->client_managed && sp->min_val && sp->max_val
-		     && sp->lock_counts && sp->in_use && sp->ref)) {
+		     && sp->lock_counts && sp->in_use && sp->ref
+		     && sp->wait_avg_ns)) {
 		nvhost_err(&dev->dev, "syncpt in a wrong state");
 		/* frees happen in the deinit */
 		err = -ENOMEM;
@@ -1286,6 +1381,9 @@ void nvhost_syncpt_deinit(struct nvhost_syncpt *sp)
 	kfree(sp->ref);
 	sp->ref = NULL;
 
+	kfree(sp->wait_avg_ns);
+	sp->wait_avg_ns = NULL;
+
 	kfree(sp->lock_counts);
 	sp->lock_counts = NULL;
 
@@ -1565,3 +1663,63 @@ void nvhost_syncpt_set_maxval(struct platform_device *dev, u32 id, u32 val)
 	smp_wmb();
 }
 EXPORT_SYMBOL(nvhost_syncpt_set_maxval);
+
+static int syncpt_wait_hist_show(struct seq_file *s, void *unused)
+{
+	struct nvhost_syncpt *sp = s->private;
+	int i;
+
+	seq_printf(s, "spin_hits: %d\n", atomic_read(&sp->wait_spin_hits));
+	seq_printf(s, "spin_misses: %d\n",
+		   atomic_read(&sp->wait_spin_misses));
+	seq_puts(s, "usec>=      spin      sleep\n");
+	for (i = 0; i < NVHOST_SYNCPT_WAIT_HIST_BUCKETS; i++)
+		seq_printf(s, "%6u %9d %10d\n", i ? 1U << (i - 1) : 0,
+			   atomic_read(&sp->wait_hist[
+				NVHOST_SYNCPT_WAIT_MODE_SPIN][i]),
+			   atomic_read(&sp->wait_hist[
+				NVHOST_SYNCPT_WAIT_MODE_SLEEP][i]));
+
+	return 0;
+}
+
+static int syncpt_wait_hist_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, syncpt_wait_hist_show, inode->i_private);
+}
+
+static ssize_t syncpt_wait_hist_write(struct file *file,
+				      const char __user *buf,
+				      size_t count, loff_t *ppos)
+{
+	struct seq_file *s = file->private_data;
+	struct nvhost_syncpt *sp = s->private;
+	int i, j;
+
+	/* any write clears the histogram */
+	atomic_set(&sp->wait_spin_hits, 0);
+	atomic_set(&sp->wait_spin_misses, 0);
+	for (i = 0; i < NVHOST_SYNCPT_WAIT_MODES; i++)
+		for (j = 0; j < NVHOST_SYNCPT_WAIT_HIST_BUCKETS; j++)
+			atomic_set(&sp->wait_hist[i][j], 0);
+
+	return count;
+}
+
+static const struct file_operations syncpt_wait_hist_fops = {
+	.open		= syncpt_wait_hist_open,
+	.read		= seq_read,
+	.write		= syncpt_wait_hist_write,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+void nvhost_syncpt_debug_init(struct nvhost_syncpt *sp, struct dentry *de)
+{
+	debugfs_create_file("syncpt_wait_hist", S_IRUGO|S_IWUSR, de,
+			sp, &syncpt_wait_hist_fops);
+	debugfs_create_u32("syncpt_wait_spin_max_ns", S_IRUGO|S_IWUSR, de,
+			&sp->wait_spin_max_ns);
+	debugfs_create_u32("syncpt_wait_hybrid", S_IRUGO|S_IWUSR, de,
+			&sp->wait_hybrid);
+}
@@ -36,6 +36,24 @@
 #define NVHOST_SYNCPT_FREE_WAIT_TIMEOUT (1 * HZ)
 
 struct nvhost_syncpt;
+struct dentry;
+
+/* flags for nvhost_syncpt_wait_timeout_flags() */
+#define NVHOST_SYNCPT_WAIT_INTERRUPTIBLE	(1 << 0)
+/* spin briefly on the register before arming a threshold interrupt */
+#define NVHOST_SYNCPT_WAIT_HYBRID		(1 << 1)
+
+/* default upper bound on the hybrid wait spin phase */
+#define NVHOST_SYNCPT_WAIT_SPIN_MAX_NS		20000
+
+enum nvhost_syncpt_wait_mode {
+	NVHOST_SYNCPT_WAIT_MODE_SPIN,
+	NVHOST_SYNCPT_WAIT_MODE_SLEEP,
+	NVHOST_SYNCPT_WAIT_MODES
+};
+
+/* log2(usec) buckets; the last one collects everything above 16ms */
+#define NVHOST_SYNCPT_WAIT_HIST_BUCKETS		16
 
 /* Attribute struct for sysfs min and max attributes */
 struct nvhost_syncpt_attr {
@@ -58,6 +76,13 @@ struct nvhost_syncpt {
 	const char **syncpt_names;
 	const char **last_used_by;
 	struct nvhost_syncpt_attr *syncpt_attrs;
+	u32 *wait_avg_ns;
+	u32 wait_spin_max_ns;
+	u32 wait_hybrid;	/* use hybrid waits for ctrl wait ioctls */
+	atomic_t wait_spin_hits;
+	atomic_t wait_spin_misses;
+	atomic_t wait_hist[NVHOST_SYNCPT_WAIT_MODES]
+			  [NVHOST_SYNCPT_WAIT_HIST_BUCKETS];
 #ifdef CONFIG_TEGRA_GRHOST_SYNC
 	struct nvhost_sync_timeline **timeline;
 	struct nvhost_sync_timeline *timeline_invalid;
@@ -159,9 +184,20 @@ u32 nvhost_syncpt_read(struct nvhost_syncpt *sp, u32 id);
 
 int nvhost_syncpt_incr(struct nvhost_syncpt *sp, u32 id);
 
-int nvhost_syncpt_wait_timeout(struct nvhost_syncpt *sp, u32 id, u32 thresh,
-			u32 timeout, u32 *value, struct nvhost_timespec *ts,
-			bool interruptible);
+int nvhost_syncpt_wait_timeout_flags(struct nvhost_syncpt *sp, u32 id,
+			u32 thresh, u32 timeout, u32 *value,
+			struct nvhost_timespec *ts, u32 flags);
+
+static inline int nvhost_syncpt_wait_timeout(struct nvhost_syncpt *sp, u32 id,
+			u32 thresh, u32 timeout, u32 *value,
+			struct nvhost_timespec *ts, bool interruptible)
+{
+	return nvhost_syncpt_wait_timeout_flags(sp, id, thresh, timeout,
+			value, ts,
+			interruptible ? NVHOST_SYNCPT_WAIT_INTERRUPTIBLE : 0);
+}
+
+void nvhost_syncpt_debug_init(struct nvhost_syncpt *sp, struct dentry *de);
 
 static inline int nvhost_syncpt_wait(struct nvhost_syncpt *sp, u32 id, u32 thresh)
 {
@@ -164,7 +164,9 @@ static int pva_submit(struct pva_private *priv, void *arg)
 		(struct pva_ioctl_submit_args *)arg;
 	struct pva_ioctl_submit_task *ioctl_tasks = NULL;
 	struct pva_submit_tasks tasks_header;
+	struct nvhost_queue_task_mem_info task_mem_info[PVA_MAX_TASKS];
 	struct pva_submit_task *task = NULL;
+	unsigned int num_allocated = 0;
 	int err = 0;
 	int i;
 
@@ -202,17 +204,17 @@ static int pva_submit(struct pva_private *priv, void *arg)
 		goto err_copy_tasks;
 	}
 
+	/* Allocate memory for the tasks and dma in one go */
+	err = nvhost_queue_alloc_task_memory_batch(priv->queue, task_mem_info,
+					ioctl_tasks_header->num_tasks);
+	if (err < 0)
+		goto err_get_task_buffer;
+	num_allocated = ioctl_tasks_header->num_tasks;
+
 	/* Go through the tasks and make a KMD representation of them */
 	for (i = 0; i < ioctl_tasks_header->num_tasks; i++) {
-
-		struct nvhost_queue_task_mem_info task_mem_info;
-
-		/* Allocate memory for the task and dma */
-		err = nvhost_queue_alloc_task_memory(priv->queue,
-							&task_mem_info);
-		task = task_mem_info.kmem_addr;
-		if ((err < 0) || !task)
-			goto err_get_task_buffer;
+		task = task_mem_info[i].kmem_addr;
+		tasks_header.tasks[i] = task;
 
 		err = pva_copy_task(ioctl_tasks + i, task);
 		if (err < 0)
@@ -222,11 +224,10 @@ static int pva_submit(struct pva_private *priv, void *arg)
 		task->queue = priv->queue;
 		task->buffers = priv->buffers;
 
-		task->dma_addr = task_mem_info.dma_addr;
-		task->va = task_mem_info.va;
-		task->pool_index = task_mem_info.pool_index;
+		task->dma_addr = task_mem_info[i].dma_addr;
+		task->va = task_mem_info[i].va;
+		task->pool_index = task_mem_info[i].pool_index;
 
-		tasks_header.tasks[i] = task;
 		tasks_header.num_tasks += 1;
 	}
 
@@ -260,13 +261,14 @@ static int pva_submit(struct pva_private *priv, void *arg)
 	return 0;
 
 err_submit_task:
-err_get_task_buffer:
 err_copy_tasks:
-	for (i = 0; i < tasks_header.num_tasks; i++) {
-		task = tasks_header.tasks[i];
+	/* Submitted tasks are released by the queue on completion */
+	for (i = tasks_header.num_submitted; i < num_allocated; i++) {
 		/* Release memory that was allocated for the task */
-		nvhost_queue_free_task_memory(task->queue, task->pool_index);
+		nvhost_queue_free_task_memory(priv->queue,
+					      task_mem_info[i].pool_index);
 	}
+err_get_task_buffer:
 err_alloc_task_mem:
 	kfree(ioctl_tasks);
 err_check_version:
@@ -759,6 +761,8 @@ static int pva_open(struct inode *inode, struct file *file)
 		goto err_alloc_buffer;
 	}
 
+	nvhost_buffer_set_cache_stats(priv->buffers, &priv->queue->pin_cache);
+
 	/* Ensure that the stashed attributes are valid */
 	mutex_lock(&priv->queue->attr_lock);
 	priv->queue->attr = attr;
@@ -622,7 +622,8 @@ static int pva_task_write_preactions(struct pva_submit_task *task,
 }
 
 static void pva_task_write_postactions(struct pva_submit_task *task,
-				       struct pva_hw_task *hw_task)
+				       struct pva_hw_task *hw_task,
+				       u32 thresh)
 {
 	dma_addr_t syncpt_addr = nvhost_syncpt_address(task->queue->vm_pdev,
 				task->queue->syncpt_id);
@@ -630,10 +631,7 @@ static void pva_task_write_postactions(struct pva_submit_task *task,
 				task->queue->syncpt_id);
 	u8 *hw_postactions = hw_task->postactions;
 	int ptr = 0, i = 0;
-	struct platform_device *host1x_pdev =
-			to_platform_device(task->pva->pdev->dev.parent);
 	dma_addr_t output_status_addr;
-	u32 thresh;
 
 	/* Write Output action status */
 	for (i = 0; i < task->num_output_task_status; i++) {
@@ -673,9 +671,8 @@ static void pva_task_write_postactions(struct pva_submit_task *task,
 	}
 
 	/* Make a syncpoint increment */
+	task->expected_thresh = thresh;
 	if (syncpt_gos_addr) {
-		thresh = nvhost_syncpt_read_maxval(host1x_pdev,
-				task->queue->syncpt_id) + 1;
 		ptr += pva_task_write_ptr_op(&hw_postactions[ptr],
 			TASK_ACT_PTR_WRITE_VAL, syncpt_gos_addr, thresh);
 	}
@@ -892,7 +889,13 @@ static int pva_task_write_opaque_data(struct pva_submit_task *task,
 	return 0;
 }
 
-static int pva_task_write(struct pva_submit_task *task, bool atomic)
+/*
+ * thresh is the syncpoint value the task will complete at. It is written
+ * into the GoS post-action, so it must match what the submit path later
+ * assigns to the task.
+ */
+static int pva_task_write(struct pva_submit_task *task, bool atomic,
+			  u32 thresh)
 {
 	struct pva_hw_task *hw_task;
 	int err;
@@ -907,7 +910,7 @@ static int pva_task_write(struct pva_submit_task *task, bool atomic)
 		return err;
 
 	/* Write the postaction list */
-	pva_task_write_postactions(task, hw_task);
+	pva_task_write_postactions(task, hw_task, thresh);
 
 	/* Initialize parameters */
 	pva_task_write_non_surfaces(task, hw_task);
@@ -1168,18 +1171,23 @@ static void pva_queue_dump(struct nvhost_queue *queue, struct seq_file *s)
 	mutex_unlock(&queue->list_lock);
 }
 
-static int pva_task_submit_channel_ccq(struct pva_submit_task *task,
+/*
+ * Channel CCQ mode can kick several tasks with one host1x job: each task
+ * gets its own CCQ write in a shared gather and the job carries one
+ * syncpoint increment per task. Only the first task of the group may
+ * have prefences since the waits are placed in front of the gather.
+ */
+static int pva_task_submit_channel_ccq(struct pva_submit_task **tasks,
+				       unsigned int num_tasks,
 				       u32 *thresh)
 {
+	struct pva_submit_task *task = tasks[0];
 	struct nvhost_queue *queue = task->queue;
 	u64 fifo_flags = PVA_FIFO_INT_ON_ERR;
-	u64 fifo_cmd = pva_fifo_submit(queue->id,
-				       task->dma_addr,
-				       fifo_flags);
 	u32 syncpt_wait_ids[PVA_MAX_PREFENCES];
 	u32 syncpt_wait_thresh[PVA_MAX_PREFENCES];
+	u32 cmdbuf[4 * PVA_MAX_TASKS];
 	unsigned int i;
-	u32 cmdbuf[4];
 	int err = 0;
 
 	/* Pick up fences... */
@@ -1196,18 +1204,25 @@ static int pva_task_submit_channel_ccq(struct pva_submit_task *task,
 	}
 
 	/* A simple command buffer: Write two words into the ccq
-	 * register
+	 * register for each task
 	 */
-	cmdbuf[0] = nvhost_opcode_setpayload(2);
-	cmdbuf[1] = nvhost_opcode_nonincr_w(cfg_ccq_r() >> 2);
-	cmdbuf[2] = (u32)(fifo_cmd >> 32);
-	cmdbuf[3] = (u32)(fifo_cmd & 0xffffffff);
+	for (i = 0; i < num_tasks; i++) {
+		u64 fifo_cmd = pva_fifo_submit(queue->id,
+					       tasks[i]->dma_addr,
+					       fifo_flags);
+		u32 *cmd = cmdbuf + 4 * i;
+
+		cmd[0] = nvhost_opcode_setpayload(2);
+		cmd[1] = nvhost_opcode_nonincr_w(cfg_ccq_r() >> 2);
+		cmd[2] = (u32)(fifo_cmd >> 32);
+		cmd[3] = (u32)(fifo_cmd & 0xffffffff);
+	}
 
 	/* Submit the command buffer and waits to channel */
 	err = nvhost_queue_submit_to_host1x(queue,
 					    cmdbuf,
-					    ARRAY_SIZE(cmdbuf),
-					    1,
+					    4 * num_tasks,
+					    num_tasks,
 					    syncpt_wait_ids,
 					    syncpt_wait_thresh,
 					    task->num_prefences,
@@ -1297,53 +1312,15 @@ err_submit:
 	return err;
 }
 
-static int pva_task_submit(struct pva_submit_task *task)
+static int pva_task_submit_finish(struct pva_submit_task *task,
+				  u32 thresh, u64 timestamp)
 {
 	struct platform_device *host1x_pdev =
 			to_platform_device(task->pva->pdev->dev.parent);
 	struct nvhost_queue *queue = task->queue;
 	unsigned int i;
-	u32 thresh = 0;
-	u64 timestamp;
 	int err = 0;
 
-	nvhost_dbg_info("Submitting task %p (0x%llx)", task,
-			(u64)task->dma_addr);
-
-	/* Get a reference of the queue to avoid it being reused. It
-	 * gets freed in the callback...
-	 */
-	nvhost_queue_get(queue);
-
-	/* Turn on the hardware */
-	err = nvhost_module_busy(task->pva->pdev);
-	if (err)
-		goto err_module_busy;
-
-	/*
-	 * TSC timestamp is same as CNTVCT. Task statistics are being
-	 * reported in TSC ticks.
-	 */
-	timestamp = arch_counter_get_cntvct();
-
-	/* Choose the submit policy based on the mode */
-	switch (task->pva->submit_mode) {
-	case PVA_SUBMIT_MODE_MAILBOX:
-		err = pva_task_submit_mailbox(task, &thresh);
-		break;
-
-	case PVA_SUBMIT_MODE_MMIO_CCQ:
-		err = pva_task_submit_mmio_ccq(task, &thresh);
-		break;
-
-	case PVA_SUBMIT_MODE_CHANNEL_CCQ:
-		err = pva_task_submit_channel_ccq(task, &thresh);
-		break;
-	}
-
-	if (err < 0)
-		goto err_submit;
-
 	nvhost_eventlib_log_submit(task->pva->pdev,
 				   queue->syncpt_id,
 				   thresh,
@@ -1354,6 +1331,13 @@ static int pva_task_submit(struct pva_submit_task *task)
 	nvhost_dbg_info("Postfence id=%u, value=%u",
 			queue->syncpt_id, thresh);
 
+	/* The GoS post-action was written with the threshold predicted
+	 * before the kick; a mismatch means GoS waiters see a wrong value.
+	 */
+	WARN(task->expected_thresh != thresh,
+	     "pva: task written for threshold %u, completes at %u",
+	     task->expected_thresh, thresh);
+
 	/* Return post-fences */
 	for (i = 0; i < task->num_postfences; i++) {
 		struct pva_fence *fence = task->postfences + i;
@@ -1407,21 +1391,128 @@ err_write_fences:
 					      pva_queue_update, queue));
 
 	return err;
+}
+
+/*
+ * Kick a group of tasks. Mailbox and MMIO CCQ modes take one task at a
+ * time; channel CCQ mode takes a whole group in one host1x job. Once the
+ * kick succeeds every task of the group is on the queue task list, even
+ * if returning its fences fails, and *num_queued is set accordingly.
+ */
+static int pva_task_submit(struct pva_submit_task **tasks,
+			   unsigned int num_tasks,
+			   unsigned int *num_queued)
+{
+	struct pva_submit_task *task = tasks[0];
+	struct nvhost_queue *queue = task->queue;
+	unsigned int i, num_busy = 0;
+	u32 thresh = 0;
+	u64 timestamp;
+	int err = 0;
+
+	*num_queued = 0;
+
+	for (i = 0; i < num_tasks; i++) {
+		nvhost_dbg_info("Submitting task %p (0x%llx)", tasks[i],
+				(u64)tasks[i]->dma_addr);
+
+		/* Get a reference of the queue to avoid it being reused. It
+		 * gets freed in the callback...
+		 */
+		nvhost_queue_get(queue);
+
+		/* Turn on the hardware */
+		err = nvhost_module_busy(task->pva->pdev);
+		if (err) {
+			nvhost_queue_put(queue);
+			goto err_module_busy;
+		}
+		num_busy++;
+	}
+
+	/*
+	 * TSC timestamp is same as CNTVCT. Task statistics are being
+	 * reported in TSC ticks.
+	 */
+	timestamp = arch_counter_get_cntvct();
+
+	/* Choose the submit policy based on the mode */
+	switch (task->pva->submit_mode) {
+	case PVA_SUBMIT_MODE_MAILBOX:
+		err = pva_task_submit_mailbox(task, &thresh);
+		break;
+
+	case PVA_SUBMIT_MODE_MMIO_CCQ:
+		err = pva_task_submit_mmio_ccq(task, &thresh);
+		break;
+
+	case PVA_SUBMIT_MODE_CHANNEL_CCQ:
+		err = pva_task_submit_channel_ccq(tasks, num_tasks, &thresh);
+		break;
+	}
+
+	if (err < 0)
+		goto err_submit;
+
+	/* The tasks of a group complete in order, one increment each */
+	for (i = 0; i < num_tasks; i++) {
+		int ret = pva_task_submit_finish(tasks[i],
+					thresh - (num_tasks - 1 - i),
+					timestamp);
+		if (ret < 0 && !err)
+			err = ret;
+	}
+	*num_queued = num_tasks;
+
+	return err;
 
 err_submit:
-	nvhost_module_idle(task->pva->pdev);
 err_module_busy:
-	nvhost_queue_put(queue);
+	for (i = 0; i < num_busy; i++) {
+		nvhost_module_idle(task->pva->pdev);
+		nvhost_queue_put(queue);
+	}
 	return err;
 }
 
+/* Number of leading tasks that can be kicked together */
+static unsigned int pva_task_group_size(struct pva_submit_task **tasks,
+					unsigned int num_tasks)
+{
+	unsigned int n = 1;
+
+	if (tasks[0]->pva->submit_mode != PVA_SUBMIT_MODE_CHANNEL_CCQ)
+		return 1;
+
+	while (n < num_tasks && tasks[n]->num_prefences == 0)
+		n++;
+
+	return n;
+}
+
 static int pva_queue_submit(struct nvhost_queue *queue, void *args)
 {
 	struct pva_submit_tasks *task_header = args;
+	struct platform_device *host1x_pdev =
+		to_platform_device(queue->pool->pdev->dev.parent);
+	unsigned int num_tasks = task_header->num_tasks;
+	unsigned int num_pinned = 0;
+	unsigned int i, n, num_queued;
+	u32 base;
 	int err = 0;
-	int i;
 
-	for (i = 0; i < task_header->num_tasks; i++) {
+	task_header->num_submitted = 0;
+
+	/*
+	 * Each task increments the queue syncpoint once and the tasks are
+	 * kicked in order, so task i completes at base + i + 1. Keep other
+	 * submitters on this queue out until the last task has been kicked.
+	 */
+	mutex_lock(&queue->submit_lock);
+	base = nvhost_syncpt_read_maxval(host1x_pdev, queue->syncpt_id);
+
+	/* Pin and write all tasks before kicking the engine */
+	for (i = 0; i < num_tasks; i++) {
 		struct pva_submit_task *task = task_header->tasks[i];
 
 		/* First, dump the task that we are submitting */
@@ -1430,16 +1521,31 @@ static int pva_queue_submit(struct nvhost_queue *queue, void *args)
 		/* Pin job memory */
 		err = pva_task_pin_mem(task);
 		if (err < 0)
-			break;
+			goto err_pin_mem;
+		num_pinned++;
 
 		/* Write the task data */
-		pva_task_write(task, false);
+		pva_task_write(task, false, base + i + 1);
+	}
 
-		err = pva_task_submit(task);
+	for (i = 0; i < num_tasks; i += n) {
+		n = pva_task_group_size(task_header->tasks + i,
+					num_tasks - i);
+
+		err = pva_task_submit(task_header->tasks + i, n,
+				      &num_queued);
+		task_header->num_submitted += num_queued;
 		if (err < 0)
 			break;
 	}
 
+err_pin_mem:
+	mutex_unlock(&queue->submit_lock);
+
+	/* Tasks that never reached the engine are not on the task list */
+	for (i = task_header->num_submitted; i < num_pinned; i++)
+		pva_task_unpin_mem(task_header->tasks[i]);
+
 	return err;
 }
 
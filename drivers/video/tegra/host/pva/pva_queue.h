@@ -92,6 +92,7 @@ struct pva_submit_task {
 	u64 timeout;
 	bool invalid;
 	u32 syncpt_thresh;
+	u32 expected_thresh;
 
 	/* Data provided by userspace "as is" */
 	struct pva_fence prefences[PVA_MAX_PREFENCES];
@@ -127,6 +128,7 @@ struct pva_submit_tasks {
 	struct pva_submit_task *tasks[PVA_MAX_TASKS];
 	u16 flags;
 	u16 num_tasks;
+	u16 num_submitted;
 };
 
 struct pva_queue_attribute {
@@ -74,6 +74,11 @@ void *__nvmap_kmap(struct nvmap_handle *h, unsigned int pagenum)
 			goto out;
 		kaddr = (ulong)area->addr;
 
+		if (nvmap_handle_populate(h, pagenum, 1)) {
+			free_vm_area(area);
+			goto out;
+		}
+
 		if (h->heap_pgalloc)
 			paddr = page_to_phys(nvmap_to_page(
 						h->pgalloc.pages[pagenum]));
@@ -161,6 +166,9 @@ void *__nvmap_mmap(struct nvmap_handle *h)
 	prot = nvmap_pgprot(h, PG_PROT_KERNEL);
 
 	if (h->heap_pgalloc) {
+		if (nvmap_handle_populate_all(h))
+			goto out;
+
 		pages = nvmap_pages(h->pgalloc.pages, h->size >> PAGE_SHIFT);
 		if (!pages)
 			goto out;
@@ -273,6 +281,11 @@ struct sg_table *__nvmap_sg_table(struct nvmap_client *client,
 
 		sg_set_page(sgt->sgl, page, h->size, offset_in_page(paddr));
 	} else {
+		/* first device pin backs the whole lazy handle */
+		err = nvmap_handle_populate_all(h);
+		if (err)
+			goto err;
+
 		pages = nvmap_pages(h->pgalloc.pages, npages);
 		if (!pages) {
 			err = -ENOMEM;
@@ -78,88 +78,61 @@ static struct page *nvmap_alloc_pages_exact(gfp_t gfp, size_t size)
 static uint s_nr_colors = 1;
 module_param_named(nr_colors, s_nr_colors, uint, 0644);
 
-#define NVMAP_MAX_COLORS 16
+#define NVMAP_HUGE_PAGE_SIZE	SZ_2M
 
-struct color_list {
-	u32 *counts;
-	u32 *heads;
-	u32 *list;
-	struct page **pages;
-	u32 page_count;
-	u32 length;
-};
+static bool s_huge_pages = true;
+module_param_named(huge_pages, s_huge_pages, bool, 0644);
 
-static struct color_list *alloc_color_list(u32 nr_pages, u32 nr_colors)
+/*
+ * Fill pages[] from @index with physically contiguous runs of order
+ * @max_order down to @min_order. Every run is naturally aligned within the
+ * buffer as long as @index is, since each order is only tried after all the
+ * larger ones, so a 2MB run lands on a 2MB aligned IOVA offset and the IOMMU
+ * can map it with a section PTE. The runs are split into 4K pages since the
+ * rest of nvmap frees and recycles pages one at a time, but they stay
+ * contiguous, so the sg table collapses each run into a single segment. Once
+ * an order fails it is not retried for the rest of the handle. Returns the
+ * index of the first unfilled page.
+ */
+static int nvmap_alloc_large_pages(struct page **pages, int index,
+				   int nr_page, gfp_t gfp,
+				   unsigned int max_order,
+				   unsigned int min_order,
+				   int pages_per_big_pg)
 {
-	struct color_list *list;
-	u32 *temp = NULL;
-	u32 nr_u32;
-
-	list = kzalloc(sizeof(struct color_list), GFP_KERNEL);
-	if (!list)
-		return NULL;
-
-	list->pages = vmalloc(nr_pages * sizeof(struct page *));
-	if (!list->pages) {
-		kfree(list);
-		return NULL;
-	}
-
-	/* Allocate counts, heads, and list with a single allocation */
-	nr_u32 = nr_pages + 2 * nr_colors;
-	temp = vmalloc(nr_u32 * sizeof(u32));
-	if (!temp)
-		goto fail;
-
-	memset(&temp[0], 0, 2 * nr_colors *  sizeof(u32));
-	list->counts = &temp[0];
-	list->heads = &temp[nr_colors];
-	list->list = &temp[2 * nr_colors];
+	/*
+	 * set the gfp not to trigger direct/kswapd reclaims and
+	 * not to use emergency reserves.
+	 */
+	gfp_t gfp_no_reclaim = (gfp | __GFP_NOMEMALLOC) & ~__GFP_RECLAIM;
+	unsigned int order;
+	int idx;
 
-	list->page_count = nr_pages;
+	for (order = max_order; order >= min_order && order > 0; order--) {
+		int run = 1 << order;
 
-	return list;
-fail:
-	if (list->pages)
-		vfree(list->pages);
-	kfree(list);
-	return NULL;
-}
+		while (nr_page - index >= run) {
+			struct page *page;
 
-static void free_color_list(struct color_list *list)
-{
-	vfree(list->pages);
-	vfree(list->counts);	/* Frees counts, heads, and list */
-	kfree(list);
-}
+			page = nvmap_alloc_pages_exact(gfp_no_reclaim,
+						       run << PAGE_SHIFT);
+			if (!page)
+				break;
 
-static struct page *list_pop_page(struct color_list *list, u32 color, char *who)
-{
-	u32 i;
-
-	/* Debug check */
-	if ((list->counts[color] == 0) || (list->counts[color] > 1 << 31)) {
-		pr_err("list_pop_page: OVER FREE!\n");
-		pr_err(" called from: %s\n", who);
-		for (i = 0; i < s_nr_colors; i++)
-			pr_err(" color = %d: %d\n", i, list->counts[i]);
-		BUG();
+			for (idx = 0; idx < run; idx++)
+				pages[index + idx] = nth_page(page, idx);
+			nvmap_clean_cache(&pages[index], run);
+			if ((run << PAGE_SHIFT) == NVMAP_HUGE_PAGE_SIZE)
+				nvmap_stats_inc(NS_HUGE_PAGES, 1);
+			else
+				nvmap_stats_inc(NS_BIG_PAGES,
+					max(run / pages_per_big_pg, 1));
+			index += run;
+		}
 	}
-	i = list->heads[color];
-	list->heads[color] = list->list[i];
-	list->counts[color]--;
-	return list->pages[i];
-}
 
-struct nvmap_alloc_state {
-	u32 nr_colors;
-	u32 (*addr_to_color)(uintptr_t phys);
-	u32 tile;
-	u32 output_count;
-	u32 nr_pages;
-	u32 max_color_per_tile;
-	struct color_list *list;
-};
+	return index;
+}
 
 #define CHANNEL_MASK_0 0x27af5200
 #define CHANNEL_MASK_1 0x563ca400
@@ -188,7 +161,7 @@ struct nvmap_alloc_state {
 	BIT_N((a), 25) ^ BIT_N((a), 26) ^ BIT_N((a), 27) ^ BIT_N((a), 28) ^ \
 	BIT_N((a), 29) ^ BIT_N((a), 30) ^ BIT_N((a), 31))
 
-static u32 addr_to_color_t19x(uintptr_t phys)
+u32 addr_to_color_t19x(uintptr_t phys)
 {
 	int color, chan, bank;
 	u32 addr = (u32)phys;
@@ -215,241 +188,37 @@ static u32 addr_to_color_t19x(uintptr_t phys)
 	return color;
 }
 
-static struct color_list *init_color_list(struct nvmap_page_pool *pool,
-					  struct nvmap_alloc_state *state,
-					  u32 nr_pages)
+#ifdef CONFIG_NVMAP_COLOR_PAGES
+/*
+ * Colored pages come from the per-color bins of the page pool, see
+ * nvmap_page_pool_alloc_colored(). Whatever the bins cannot cover is
+ * allocated fresh and run through the bins so it lands in color order too.
+ */
+static int alloc_colored(struct nvmap_page_pool *pool, u32 nr_pages,
+			 struct page **out_pages)
 {
-	struct color_list *list;
-	u32 color, i, page_index = 0;
 	gfp_t gfp = GFP_NVMAP | __GFP_ZERO;
+	u32 got, i;
 
-	list = alloc_color_list(nr_pages, state->nr_colors);
-	if (!list)
-		return NULL;
+	got = nvmap_page_pool_alloc_colored(pool, out_pages, nr_pages, 0);
+	if (got == nr_pages)
+		return 0;
 
-#ifdef CONFIG_NVMAP_PAGE_POOLS
-	/* Allocated page from nvmap page pool if possible */
-	page_index = nvmap_page_pool_alloc_lots(pool, list->pages, nr_pages);
-#endif
-	/* Fall back to general page allocator */
-	for (i = page_index; i < nr_pages; i++) {
-		list->pages[i] = nvmap_alloc_pages_exact(gfp, PAGE_SIZE);
-		if (!list->pages[i])
+	for (i = got; i < nr_pages; i++) {
+		out_pages[i] = nvmap_alloc_pages_exact(gfp, PAGE_SIZE);
+		if (!out_pages[i])
 			goto fail;
 	}
-	/* Clean the cache for any page that didn't come from the page pool */
-	if (page_index < nr_pages)
-		nvmap_clean_cache(&list->pages[page_index],
-				  nr_pages - page_index);
-
-	/* Create linked list of colors and compute the histogram */
-	for (i = 0; i < nr_pages; i++) {
-		color = state->addr_to_color((uintptr_t)
-					     page_to_phys(list->pages[i]));
-		list->list[i] = list->heads[color];
-		list->heads[color] = i;
-		list->counts[color]++;
-	}
-	return list;
+	nvmap_clean_cache(&out_pages[got], nr_pages - got);
+	nvmap_page_pool_color_pages(pool, &out_pages[got], nr_pages - got, got);
+	return 0;
+
 fail:
 	while (i--)
-		__free_page(list->pages[i]);
-	free_color_list(list);
-	return NULL;
-}
-
-static void smooth_pages(struct color_list *list, u32 nr_extra, u32 nr_colors)
-{
-	u32 i, j, color, max;
-	u32 counts[NVMAP_MAX_COLORS] = {0};
-
-	if (nr_extra == 0)
-		return;
-
-	/* Determine which colors need to be freed */
-	for (i = 0; i < nr_extra; i++) {
-		/* Find the max */
-		max = 0;
-		color = 0;
-		for (j = 0; j < nr_colors; j++) {
-			if (list->counts[j] - counts[j] > max) {
-				color = j;
-				max = list->counts[j] - counts[j];
-			}
-		}
-		counts[color]++;
-	}
-
-	/* Iterate through 0...nr_extra-1 in psuedorandom order */
-	do {
-		/* Pop the max off and free it */
-		for (color = 0; color < nr_colors; color++) {
-			while (counts[color]) {
-				__free_page(list_pop_page(list,
-						color, "smooth_pages"));
-				counts[color]--;
-				nr_extra--;
-			}
-		}
-	} while (nr_extra > 0);
-}
-
-static void add_perfect(struct nvmap_alloc_state *state, u32 nr_pages,
-			struct page **out_pages)
-{
-	u32 i;
-	u32 color;
-	struct page *page;
-	uintptr_t virt_addr;
-
-
-	/* create a perfect tile */
-	for (i = 0;
-	     i < state->nr_colors && state->output_count < nr_pages;
-	     i++) {
-		virt_addr = (i + (state->tile * state->nr_colors)) * PAGE_SIZE;
-		color = state->addr_to_color(virt_addr);
-		page = list_pop_page(state->list, color, "perfect");
-		out_pages[state->output_count++] = page;
-	}
-}
-
-static void add_imperfect(struct nvmap_alloc_state *state, u32 nr_pages,
-			  struct page **out_pages)
-{
-	u32 i, j;
-	u32 max_count;
-	u32 color;
-	struct page *page;
-	uintptr_t virt_addr;
-	u32 counts[NVMAP_MAX_COLORS] = {0};
-
-	/* Determine which colors will go into the tile */
-	for (i = 0; i < state->nr_colors; i++) {
-		max_count = 0;
-		color = 0;
-		for (j = 0; j < state->nr_colors; j++) {
-			u32 left = state->list->counts[j] - counts[j];
-
-			if (left > max_count &&
-			    counts[j] < state->max_color_per_tile) {
-				max_count = left;
-				color = j;
-			}
-		}
-		counts[color]++;
-	}
-
-	/* Arrange the colors into the tile */
-	for (i = 0;
-	     i < state->nr_colors && state->output_count < nr_pages;
-	     i++) {
-		virt_addr = (i + (i * state->nr_colors)) * PAGE_SIZE;
-		color = state->addr_to_color(virt_addr);
-		/* Find a substitute color */
-		if (counts[color] == 0) {
-			/* Find the color used the most in the tile */
-			max_count = 0;
-			for (j = 0; j < state->nr_colors; j++) {
-				if (counts[j] > max_count) {
-					max_count = counts[j];
-					color = j;
-				}
-			}
-		}
-		page = list_pop_page(state->list, color, "imperfect");
-		out_pages[state->output_count++] = page;
-		counts[color]--;
-	}
-}
-
-static int alloc_colored(struct nvmap_page_pool *pool, u32 nr_pages,
-			 struct page **out_pages, u32 chipid)
-{
-	struct nvmap_alloc_state state;
-	u32 nr_alloc, max_count, min_count;
-	u32 nr_tiles, nr_perfect, nr_imperfect;
-	int dither_state;
-	u32 i;
-
-	state.nr_colors = s_nr_colors;
-	state.addr_to_color = addr_to_color_t19x;
-
-	/* Allocate pages for full 32-page tiles */
-	nr_tiles = (nr_pages + state.nr_colors - 1) / state.nr_colors;
-	/* Overallocate pages by 1/16th */
-	nr_alloc  = state.nr_colors * nr_tiles;
-	nr_alloc += nr_alloc >> 4;
-
-	/* Create lists of each page color */
-	state.list = init_color_list(pool, &state, nr_alloc);
-	if (!state.list)
-		return -ENOMEM;
-
-	/* Smooth out the histogram by freeing over allocated pages */
-	smooth_pages(state.list, nr_alloc - state.nr_colors * nr_tiles,
-		     state.nr_colors);
-
-	max_count = 0;
-	min_count = state.list->counts[0];
-	for (i = 0; i < state.nr_colors; i++) {
-		if (state.list->counts[i] > max_count)
-			max_count = state.list->counts[i];
-		if (state.list->counts[i] < min_count)
-			min_count = state.list->counts[i];
-	}
-
-	/* Compute the number of perfect / imperfect tiles and the maximum
-	 * number of pages with the same color can be in a tile
-	 */
-	if (max_count / nr_tiles >= 3) {
-		/* It is not possible to create perfect tiles with
-		 * max_color_per_tile <= 3
-		 */
-		nr_perfect = 0;
-		state.max_color_per_tile = (max_count + nr_tiles - 1)
-					   / nr_tiles;
-	} else if (nr_tiles * 2 == max_count) {
-		/* All of the tiles can be perfect */
-		nr_perfect = nr_tiles;
-		state.max_color_per_tile = 2;
-	} else {
-		/* Some of the tiles can be perfect */
-		nr_perfect = nr_tiles - (max_count % nr_tiles);
-		state.max_color_per_tile = 3;
-	}
-	/* Check if the number of perfect tiles is bound by the color with the
-	 * minimum count
-	 */
-	if (nr_perfect * 2 > min_count)
-		nr_perfect = min_count / 2;
-
-	nr_imperfect = nr_tiles - nr_perfect;
-
-	/* Output tiles */
-	dither_state = nr_perfect - nr_imperfect;
-	state.output_count = 0;
-	for (state.tile = 0; state.tile < nr_tiles; state.tile++) {
-		if (dither_state > 0) {
-			add_perfect(&state, nr_pages, out_pages);
-			dither_state -= nr_imperfect;
-		} else {
-			add_imperfect(&state, nr_pages, out_pages);
-			dither_state += nr_perfect;
-		}
-	}
-
-	/* Free extra pages created when the buffer does not
-	 * fill the last tile
-	 */
-	for (i = 0; i < state.nr_colors; i++)
-		while (state.list->counts[i] > 0)
-			__free_page(list_pop_page(state.list, i, "free"));
-
-	free_color_list(state.list);
-
-	return 0;
+		__free_page(out_pages[i]);
+	return -ENOMEM;
 }
+#endif
 
 static int handle_page_alloc(struct nvmap_client *client,
 			     struct nvmap_handle *h, bool contiguous)
@@ -474,6 +243,20 @@ static int handle_page_alloc(struct nvmap_client *client,
 	if (!pages)
 		return -ENOMEM;
 
+	if (!contiguous && (h->userflags & NVMAP_HANDLE_LAZY_ALLOC)) {
+		/*
+		 * Only reserve the page array. Pages are backed on the first
+		 * CPU fault or device pin, see __nvmap_handle_populate().
+		 */
+		memset(pages, 0, nr_page * sizeof(*pages));
+		h->pgalloc.pages = pages;
+		h->pgalloc.contig = false;
+		h->pgalloc.lazy = true;
+		h->pgalloc.nr_populated = 0;
+		atomic_set(&h->pgalloc.ndirty, 0);
+		return 0;
+	}
+
 	if (contiguous) {
 		struct page *page;
 		page = nvmap_alloc_pages_exact(gfp, size);
@@ -484,54 +267,65 @@ static int handle_page_alloc(struct nvmap_client *client,
 			pages[i] = nth_page(page, i);
 
 	} else {
+		unsigned int big_order, huge_order;
+
 #ifdef CONFIG_NVMAP_PAGE_POOLS
-		/* Get as many big pages from the pool as possible. */
-		page_index = nvmap_page_pool_alloc_lots_bp(&nvmap_dev->pool, pages,
-								 nr_page);
 		pages_per_big_pg = nvmap_dev->pool.pages_per_big_pg;
 #endif
-		/* Try to allocate big pages from page allocator */
-		for (i = page_index;
-		     i < nr_page && pages_per_big_pg > 1 && (nr_page - i) >= pages_per_big_pg;
-		     i += pages_per_big_pg, page_index += pages_per_big_pg) {
-			struct page *page;
-			int idx;
-			/*
-			 * set the gfp not to trigger direct/kswapd reclaims and
-			 * not to use emergency reserves.
-			 */
-			gfp_t gfp_no_reclaim = (gfp | __GFP_NOMEMALLOC) & ~__GFP_RECLAIM;
-
-			page = nvmap_alloc_pages_exact(gfp_no_reclaim,
-					pages_per_big_pg << PAGE_SHIFT);
-			if (!page)
-				break;
+		big_order = pages_per_big_pg > 1 ? ilog2(pages_per_big_pg) : 0;
+		huge_order = get_order(NVMAP_HUGE_PAGE_SIZE);
 
-			for (idx = 0; idx < pages_per_big_pg; idx++)
-				pages[i + idx] = nth_page(page, idx);
-			nvmap_clean_cache(&pages[i], pages_per_big_pg);
+		/*
+		 * 2MB runs go first so they start on 2MB aligned offsets of
+		 * the buffer, then every order down to just above the big
+		 * page size.
+		 */
+		if (s_huge_pages && huge_order > big_order)
+			page_index = nvmap_alloc_large_pages(pages, page_index,
+					nr_page, gfp, huge_order,
+					big_order + 1, pages_per_big_pg);
+#ifdef CONFIG_NVMAP_PAGE_POOLS
+		/* Get as many big pages from the pool as possible. */
+		if (pages_per_big_pg > 1) {
+			int nr_bp;
+
+			nr_bp = nvmap_page_pool_alloc_lots_bp(&nvmap_dev->pool,
+					&pages[page_index],
+					nr_page - page_index);
+			nvmap_stats_inc(NS_BIG_PAGES, nr_bp / pages_per_big_pg);
+			page_index += nr_bp;
 		}
+#endif
+		/* Whatever big pages the pool could not cover */
+		if (big_order)
+			page_index = nvmap_alloc_large_pages(pages, page_index,
+					nr_page, gfp, big_order, big_order,
+					pages_per_big_pg);
+		i = page_index;
 		nvmap_big_page_allocs += page_index;
+		nvmap_stats_inc(NS_SMALL_PAGES, nr_page - page_index);
 
-		if (s_nr_colors <= 1) {
+#ifdef CONFIG_NVMAP_COLOR_PAGES
+		nvmap_page_pool_set_colors(&nvmap_dev->pool, s_nr_colors);
+		if (s_nr_colors > 1 && page_index < nr_page) {
+			/* colored pages are handed back already clean */
+			if (alloc_colored(&nvmap_dev->pool,
+			     nr_page - page_index, &pages[page_index]))
+				goto fail;
+			page_index = nr_page;
+		}
+#endif
 #ifdef CONFIG_NVMAP_PAGE_POOLS
-			/* Get as many 4K pages from the pool as possible. */
-			page_index += nvmap_page_pool_alloc_lots(
-				      &nvmap_dev->pool, &pages[page_index],
-				      nr_page - page_index);
+		/* Get as many 4K pages from the pool as possible. */
+		page_index += nvmap_page_pool_alloc_lots(
+			      &nvmap_dev->pool, &pages[page_index],
+			      nr_page - page_index);
 #endif
 
-			for (i = page_index; i < nr_page; i++) {
-				pages[i] = nvmap_alloc_pages_exact(gfp,
-								   PAGE_SIZE);
-				if (!pages[i])
-					goto fail;
-			}
-		} else if (page_index < nr_page) {
-			if (alloc_colored(&nvmap_dev->pool,
-			     nr_page - page_index, &pages[page_index], chipid))
+		for (i = page_index; i < nr_page; i++) {
+			pages[i] = nvmap_alloc_pages_exact(gfp, PAGE_SIZE);
+			if (!pages[i])
 				goto fail;
-			page_index = nr_page;
 		}
 		nvmap_total_page_allocs += nr_page;
 	}
@@ -559,6 +353,80 @@ fail:
 	return -ENOMEM;
 }
 
+#define NVMAP_POPULATE_BATCH	16
+
+/*
+ * Back pages [start_page, start_page + nr) of a lazily allocated handle.
+ * Pages come from the page pool when possible and are zeroed and cleaned
+ * out of the CPU caches before they are published in the page array, so
+ * lock-free readers only ever see NULL or a ready page.
+ */
+int __nvmap_handle_populate(struct nvmap_handle *h,
+			    u32 start_page, u32 nr)
+{
+	u32 nr_page = h->size >> PAGE_SHIFT;
+	u32 end, i, j, k;
+	int err = 0;
+
+	if (WARN_ON(!h->heap_pgalloc || start_page >= nr_page))
+		return -EINVAL;
+	end = min(start_page + nr, nr_page);
+
+	mutex_lock(&h->lock);
+	i = start_page;
+	while (h->pgalloc.lazy && i < end) {
+		struct page *run[NVMAP_POPULATE_BATCH];
+		u32 n = 0, got = 0;
+
+		if (h->pgalloc.pages[i]) {
+			i++;
+			continue;
+		}
+
+		while (i + n < end && n < NVMAP_POPULATE_BATCH &&
+		       !h->pgalloc.pages[i + n])
+			n++;
+
+#ifdef CONFIG_NVMAP_PAGE_POOLS
+		got = nvmap_page_pool_alloc_lots(&nvmap_dev->pool, run, n);
+#endif
+		for (j = got; j < n; j++) {
+			run[j] = nvmap_alloc_pages_exact(GFP_NVMAP | __GFP_ZERO,
+							 PAGE_SIZE);
+			if (!run[j])
+				break;
+		}
+		if (j > got)
+			nvmap_clean_cache(&run[got], j - got);
+
+		/* page contents must be visible before the page pointers */
+		smp_wmb();
+		for (k = 0; k < j; k++) {
+			if (h->pgalloc.nr_mapcount)
+				atomic_add(h->pgalloc.nr_mapcount,
+					   &run[k]->_mapcount);
+			WRITE_ONCE(h->pgalloc.pages[i + k], run[k]);
+		}
+
+		h->pgalloc.nr_populated += j;
+		nvmap_total_page_allocs += j;
+		nvmap_stats_inc(NS_LAZY_PAGES, j);
+		i += j;
+		if (j < n) {
+			err = -ENOMEM;
+			break;
+		}
+	}
+
+	if (h->pgalloc.lazy && h->pgalloc.nr_populated == nr_page) {
+		/* pairs with smp_rmb() in nvmap_handle_populate() */
+		smp_wmb();
+		WRITE_ONCE(h->pgalloc.lazy, false);
+	}
+	mutex_unlock(&h->lock);
+	return err;
+}
+
 static struct device *nvmap_heap_pgalloc_dev(unsigned long type)
 {
 	int ret = -EINVAL;
@@ -901,9 +769,92 @@ int nvmap_alloc_handle_from_va(struct nvmap_client *client,
 	return err;
 }
 
+/*
+ * Create a view: a handle covering [offset, offset + size) of an allocated
+ * parent. The view shares the parent's memory and holds a reference on it
+ * until freed, but has its own refcount and dma-buf, so it can be exported,
+ * mapped and cache maintained on its own.
+ */
+struct nvmap_handle_ref *nvmap_create_view(struct nvmap_client *client,
+					   struct nvmap_handle *parent,
+					   u64 offset, u64 size)
+{
+	struct nvmap_handle_ref *ref;
+	struct nvmap_handle *h;
+	int err = -EINVAL;
+
+	/* a view of a view is carved straight from the root handle */
+	if (parent->parent) {
+		offset += parent->view_offset;
+		parent = parent->parent;
+	}
+
+	parent = nvmap_handle_get(parent);
+	if (!parent)
+		return ERR_PTR(-EINVAL);
+
+	if (!parent->alloc || !size ||
+	    !PAGE_ALIGNED(offset) || !PAGE_ALIGNED(size) ||
+	    offset >= parent->size || size > parent->size - offset)
+		goto put_parent;
+
+	/* dirty bits live in the shared page array, counted per handle */
+	if (nvmap_handle_track_dirty(parent))
+		goto put_parent;
+
+	if (parent->heap_pgalloc) {
+		err = nvmap_handle_populate(parent, offset >> PAGE_SHIFT,
+					    size >> PAGE_SHIFT);
+		if (err)
+			goto put_parent;
+	}
+
+	ref = nvmap_create_handle(client, size);
+	if (IS_ERR(ref)) {
+		err = PTR_ERR(ref);
+		goto put_parent;
+	}
+	h = ref->handle;
+
+	if (parent->heap_pgalloc) {
+		h->pgalloc.pages = parent->pgalloc.pages +
+				   (offset >> PAGE_SHIFT);
+		h->pgalloc.contig = parent->pgalloc.contig;
+		atomic_set(&h->pgalloc.ndirty, 0);
+	} else {
+		h->carveout = kzalloc(sizeof(*h->carveout), GFP_KERNEL);
+		if (!h->carveout) {
+			nvmap_free_handle(client, h);
+			err = -ENOMEM;
+			goto put_parent;
+		}
+		h->carveout->base = parent->carveout->base + offset;
+		h->carveout->type = parent->carveout->type;
+		h->carveout->handle = h;
+		h->carveout->view = true;
+	}
+
+	h->parent = parent;
+	h->view_offset = offset;
+	h->heap_type = parent->heap_type;
+	h->heap_pgalloc = parent->heap_pgalloc;
+	/* ivm_id encodes the parent's whole range, a view gets none */
+	h->peer = parent->peer;
+	h->flags = parent->flags;
+	h->userflags = parent->userflags;
+	h->align = PAGE_SIZE;
+	mb();
+	h->alloc = true;
+	return ref;
+
+put_parent:
+	nvmap_handle_put(parent);
+	return ERR_PTR(err);
+}
+
 void _nvmap_handle_free(struct nvmap_handle *h)
 {
-	unsigned int i, nr_page, page_index = 0;
+	unsigned int i, nr_page, nr_present, page_index = 0;
 	struct nvmap_handle_dmabuf_priv *curr, *next;
 
 	list_for_each_entry_safe(curr, next, &h->dmabuf_priv, list) {
@@ -918,6 +869,28 @@ void _nvmap_handle_free(struct nvmap_handle *h)
 	if (!h->alloc)
 		goto out;
 
+	if (h->parent) {
+		/* the memory belongs to the parent, only drop the mappings */
+		if (h->heap_pgalloc) {
+			if (h->vaddr) {
+				nvmap_kmaps_dec(h);
+				vm_unmap_ram(h->vaddr, h->size >> PAGE_SHIFT);
+			}
+		} else {
+			if (h->vaddr) {
+				void *addr = h->vaddr;
+
+				addr -= (h->carveout->base & ~PAGE_MASK);
+				free_vm_area(find_vm_area(addr));
+			}
+			nvmap_kmaps_dec(h);
+			kfree(h->carveout);
+		}
+		h->vaddr = NULL;
+		nvmap_handle_put(h->parent);
+		goto out;
+	}
+
 	nvmap_stats_inc(NS_RELEASE, h->size);
 	nvmap_stats_dec(NS_TOTAL, h->size);
 	if (!h->heap_pgalloc) {
@@ -953,16 +926,21 @@ void _nvmap_handle_free(struct nvmap_handle *h)
 		h->vaddr = NULL;
 	}
 
-	for (i = 0; i < nr_page; i++)
-		h->pgalloc.pages[i] = nvmap_to_page(h->pgalloc.pages[i]);
+	/* pack the pages of partially populated lazy handles to the front */
+	for (i = 0, nr_present = 0; i < nr_page; i++) {
+		struct page *page = nvmap_to_page(h->pgalloc.pages[i]);
+
+		if (page)
+			h->pgalloc.pages[nr_present++] = page;
+	}
 
 #ifdef CONFIG_NVMAP_PAGE_POOLS
 	if (!h->from_va)
 		page_index = nvmap_page_pool_fill_lots(&nvmap_dev->pool,
-					h->pgalloc.pages, nr_page);
+					h->pgalloc.pages, nr_present);
 #endif
 
-	for (i = page_index; i < nr_page; i++) {
+	for (i = page_index; i < nr_present; i++) {
 		if (h->from_va)
 			put_page(h->pgalloc.pages[i]);
 		else
@@ -974,7 +952,8 @@ void _nvmap_handle_free(struct nvmap_handle *h)
 out:
 	NVMAP_TAG_TRACE(trace_nvmap_destroy_handle,
 		NULL, get_current()->pid, 0, NVMAP_TP_ARGS_H(h));
-	kfree(h);
+	/* nvmap_validate_get() may still be looking at h under RCU */
+	kfree_rcu(h, rcu);
 }
 
 void nvmap_free_handle(struct nvmap_client *client,
@@ -19,6 +19,7 @@
 #include <linux/io.h>
 #include <linux/debugfs.h>
 #include <linux/of.h>
+#include <linux/sort.h>
 #include <soc/tegra/chip-id.h>
 
 #include <trace/events/nvmap.h>
@@ -183,6 +184,10 @@ static void heap_page_cache_maint(
 	if (static_key_false(&nvmap_disable_vaddr_for_cache_maint))
 		goto per_page_cache_maint;
 
+	/* avoid backing a lazy handle just to maintain it */
+	if (READ_ONCE(h->pgalloc.lazy))
+		goto per_page_cache_maint;
+
 	if (inner) {
 		if (!h->vaddr) {
 			if (__nvmap_mmap(h))
@@ -210,6 +215,11 @@ per_page_cache_maint:
 
 		page = nvmap_to_page(h->pgalloc.pages[start >> PAGE_SHIFT]);
 		next = min(((start + PAGE_SIZE) & PAGE_MASK), end);
+		if (!page) {
+			start = next;
+			continue;
+		}
+
 		off = start & ~PAGE_MASK;
 		size = next - start;
 		paddr = page_to_phys(page) + off;
@@ -466,17 +476,43 @@ out:
 	return err;
 }
 
+/*
+ * Decisions taken by __nvmap_do_cache_maint_list(), exported via debugfs.
+ */
+static atomic64_t cache_maint_list_batches;
+static atomic64_t cache_maint_list_full;
+static atomic64_t cache_maint_list_by_range;
+static atomic64_t cache_maint_list_ranges_in;
+static atomic64_t cache_maint_list_ranges_merged;
+
+struct cache_maint_range {
+	struct nvmap_handle *h;
+	u64 start;
+	u64 end;
+};
+
+static int cache_maint_range_cmp(const void *a, const void *b)
+{
+	const struct cache_maint_range *ra = a, *rb = b;
+
+	if (ra->h != rb->h)
+		return (uintptr_t)ra->h < (uintptr_t)rb->h ? -1 : 1;
+	if (ra->start != rb->start)
+		return ra->start < rb->start ? -1 : 1;
+	return 0;
+}
+
 /*
  * Perform cache op on the list of memory regions within passed handles.
  * A memory region within handle[i] is identified by offsets[i], sizes[i]
  *
  * sizes[i] == 0  is a special case which causes handle wide operation,
- * this is done by replacing offsets[i] = 0, sizes[i] = handles[i]->size.
- * So, the input arrays sizes, offsets  are not guaranteed to be read-only
+ * the region is then taken as offset 0, size handles[i]->size.
  *
- * This will optimze the op if it can.
- * In the case that all the handles together are larger than the inner cache
- * maint threshold it is possible to just do an entire inner cache flush.
+ * The regions are sorted by handle and offset, and overlapping or adjacent
+ * regions of the same handle are merged. The choice between an entire inner
+ * cache flush and per-range maintenance is then made once for the whole
+ * list, from the number of bytes left after merging.
  *
  * NOTE: this omits outer cache operations which is fine for ARM64
  */
@@ -484,9 +520,13 @@ static int __nvmap_do_cache_maint_list(struct nvmap_handle **handles,
 				u64 *offsets, u64 *sizes, int op, int nr,
 				bool is_32)
 {
-	int i;
+	struct cache_maint_range *ranges;
+	u32 *offs_32 = (u32 *)offsets, *sizes_32 = (u32 *)sizes;
+	size_t bytes = sizeof(*ranges) * nr;
+	int i, n, nr_ranges = 0;
 	u64 total = 0;
 	u64 thresh = ~0;
+	int err = 0;
 
 	WARN(!IS_ENABLED(CONFIG_ARM64),
 		"cache list operation may not function properly");
@@ -494,28 +534,71 @@ static int __nvmap_do_cache_maint_list(struct nvmap_handle **handles,
 	if (nvmap_cache_maint_by_set_ways)
 		thresh = cache_maint_inner_threshold;
 
+	if (!nr)
+		return 0;
+
+	ranges = nvmap_altalloc(bytes);
+	if (!ranges)
+		return -ENOMEM;
+
 	for (i = 0; i < nr; i++) {
-		bool inner, outer;
-		u32 *sizes_32 = (u32 *)sizes;
+		struct cache_maint_range *r = &ranges[nr_ranges];
 		u64 size = is_32 ? sizes_32[i] : sizes[i];
+		u64 offset = is_32 ? offs_32[i] : offsets[i];
+		bool inner, outer;
 
 		nvmap_handle_get_cacheability(handles[i], &inner, &outer);
 
 		if (!inner && !outer)
 			continue;
 
-		if ((op == NVMAP_CACHE_OP_WB) && nvmap_handle_track_dirty(handles[i]))
-			total += atomic_read(&handles[i]->pgalloc.ndirty);
-		else
-			total += size ? size : handles[i]->size;
+		if (!size) {
+			offset = 0;
+			size = handles[i]->size;
+		}
+		r->h = handles[i];
+		r->start = offset;
+		r->end = offset + size;
+		nr_ranges++;
+	}
+
+	sort(ranges, nr_ranges, sizeof(*ranges), cache_maint_range_cmp, NULL);
+
+	for (i = 0, n = 0; i < nr_ranges; i++) {
+		struct cache_maint_range *prev = n ? &ranges[n - 1] : NULL;
+
+		if (prev && prev->h == ranges[i].h &&
+		    ranges[i].start <= prev->end) {
+			prev->end = max(prev->end, ranges[i].end);
+			continue;
+		}
+		ranges[n++] = ranges[i];
+	}
+	atomic64_add(nr_ranges, &cache_maint_list_ranges_in);
+	atomic64_add(n, &cache_maint_list_ranges_merged);
+	nr_ranges = n;
+
+	for (i = 0; i < nr_ranges; i++) {
+		struct nvmap_handle *h = ranges[i].h;
+
+		if ((op == NVMAP_CACHE_OP_WB) && nvmap_handle_track_dirty(h)) {
+			/* ndirty is per handle, count it once */
+			if (!i || ranges[i - 1].h != h)
+				total += atomic_read(&h->pgalloc.ndirty);
+		} else {
+			total += ranges[i].end - ranges[i].start;
+		}
 	}
 
 	if (!total)
-		return 0;
+		goto out;
+
+	atomic64_inc(&cache_maint_list_batches);
 
 	/* Full flush in the case the passed list is bigger than our
 	 * threshold. */
 	if (total >= thresh) {
+		atomic64_inc(&cache_maint_list_full);
 		for (i = 0; i < nr; i++) {
 			if (handles[i]->userflags &
 			    NVMAP_HANDLE_CACHE_SYNC) {
@@ -537,27 +620,25 @@ static int __nvmap_do_cache_maint_list(struct nvmap_handle **handles,
 					nvmap_stats_read(NS_CFLUSH_RQ),
 					nvmap_stats_read(NS_CFLUSH_DONE));
 	} else {
-		for (i = 0; i < nr; i++) {
-			u32 *offs_32 = (u32 *)offsets, *sizes_32 = (u32 *)sizes;
-			u64 size = is_32 ? sizes_32[i] : sizes[i];
-			u64 offset = is_32 ? offs_32[i] : offsets[i];
-			int err;
-
-			size = size ?: handles[i]->size;
-			offset = offset ?: 0;
-			err = __nvmap_do_cache_maint(handles[i]->owner,
-						     handles[i], offset,
-						     offset + size,
+		atomic64_inc(&cache_maint_list_by_range);
+		for (i = 0; i < nr_ranges; i++) {
+			struct nvmap_handle *h = ranges[i].h;
+
+			err = __nvmap_do_cache_maint(h->owner, h,
+						     ranges[i].start,
+						     ranges[i].end,
 						     op, false);
 			if (err) {
 				pr_err("cache maint per handle failed [%d]\n",
 						err);
-				return err;
+				break;
 			}
 		}
 	}
 
-	return 0;
+out:
+	nvmap_altfree(ranges, bytes);
+	return err;
 }
 
 inline int nvmap_do_cache_maint_list(struct nvmap_handle **handles,
@@ -630,6 +711,17 @@ static const struct file_operations cache_inner_threshold_fops = {
 	.write		= cache_inner_threshold_write,
 };
 
+static int cache_maint_list_stat_get(void *data, u64 *val)
+{
+	atomic64_t *ptr = data;
+
+	*val = atomic64_read(ptr);
+	return 0;
+}
+
+DEFINE_SIMPLE_ATTRIBUTE(cache_maint_list_stat_fops, cache_maint_list_stat_get,
+			NULL, "%llu\n");
+
 int nvmap_cache_debugfs_init(struct dentry *nvmap_root)
 {
 	struct dentry *cache_root;
@@ -654,6 +746,19 @@ int nvmap_cache_debugfs_init(struct dentry *nvmap_root)
 			    &cache_inner_threshold_fops);
 	}
 
+#define CACHE_LIST_STAT(name, var) \
+	debugfs_create_file(name, S_IRUGO, cache_root, &var, \
+			    &cache_maint_list_stat_fops)
+
+	CACHE_LIST_STAT("cache_maint_list_batches", cache_maint_list_batches);
+	CACHE_LIST_STAT("cache_maint_list_full_flushes", cache_maint_list_full);
+	CACHE_LIST_STAT("cache_maint_list_by_range", cache_maint_list_by_range);
+	CACHE_LIST_STAT("cache_maint_list_ranges_in",
+			cache_maint_list_ranges_in);
+	CACHE_LIST_STAT("cache_maint_list_ranges_merged",
+			cache_maint_list_ranges_merged);
+#undef CACHE_LIST_STAT
+
 	debugfs_create_atomic_t("nvmap_disable_vaddr_for_cache_maint",
 				S_IRUSR | S_IWUSR,
 				cache_root,
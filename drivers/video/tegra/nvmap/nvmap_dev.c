@@ -259,6 +259,12 @@ static void destroy_client(struct nvmap_client *client)
 	kfree(client);
 }
 
+void nvmap_client_put(struct nvmap_client *client)
+{
+	if (!atomic_dec_return(&client->count))
+		destroy_client(client);
+}
+
 static int nvmap_open(struct inode *inode, struct file *filp)
 {
 	struct miscdevice *miscdev = filp->private_data;
@@ -292,8 +298,7 @@ static int nvmap_release(struct inode *inode, struct file *filp)
 
 	trace_nvmap_release(priv, priv->name);
 
-	if (!atomic_dec_return(&priv->count))
-		destroy_client(priv);
+	nvmap_client_put(priv);
 
 	return 0;
 }
@@ -340,6 +345,10 @@ static long nvmap_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
 		err = nvmap_ioctl_create_from_va(filp, uarg);
 		break;
 
+	case NVMAP_IOC_CREATE_VIEW:
+		err = nvmap_ioctl_create_view(filp, uarg);
+		break;
+
 	case NVMAP_IOC_GET_FD:
 		err = nvmap_ioctl_getfd(filp, uarg);
 		break;
@@ -702,7 +711,7 @@ static void nvmap_get_total_mss(u64 *pss, u64 *total, u32 heap_type)
 		for (i = 0; i < h->size >> PAGE_SHIFT; i++) {
 			struct page *page = nvmap_to_page(h->pgalloc.pages[i]);
 
-			if (page_mapcount(page) > 0)
+			if (page && page_mapcount(page) > 0)
 				*pss += PAGE_SIZE;
 		}
 	}
@@ -1229,6 +1238,9 @@ int __init nvmap_probe(struct platform_device *pdev)
 #endif
 
 	spin_lock_init(&dev->handle_lock);
+	e = nvmap_handle_ids_init(dev);
+	if (e)
+		goto fail;
 	INIT_LIST_HEAD(&dev->clients);
 	dev->pids = RB_ROOT;
 	mutex_init(&dev->clients_lock);
@@ -1269,6 +1281,7 @@ int __init nvmap_probe(struct platform_device *pdev)
 				nvmap_dev->debug_root, &nvmap_init_time);
 #endif
 	nvmap_stats_init(nvmap_debug_root);
+	nvmap_replay_debugfs_init(nvmap_debug_root);
 	platform_set_drvdata(pdev, dev);
 
 	e = nvmap_dmabuf_stash_init();
@@ -1330,6 +1343,7 @@ int nvmap_remove(struct platform_device *pdev)
 		rb_erase(&h->node, &dev->handles);
 		kfree(h);
 	}
+	nvmap_handle_ids_destroy(dev);
 
 	for (i = 0; i < dev->nr_carveouts; i++) {
 		struct nvmap_carveout_node *node = &dev->heaps[i];
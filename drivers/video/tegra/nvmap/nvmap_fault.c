@@ -68,8 +68,13 @@ void nvmap_vma_open(struct vm_area_struct *vma)
 	vma_open_count = atomic_inc_return(&priv->count);
 	if (vma_open_count == 1 && h->heap_pgalloc) {
 		nr_page = h->size >> PAGE_SHIFT;
+		/* pages populated later pick the count up at populate time */
+		h->pgalloc.nr_mapcount++;
 		for (i = 0; i < nr_page; i++) {
 			struct page *page = nvmap_to_page(h->pgalloc.pages[i]);
+
+			if (!page)
+				continue;
 			/* This is necessry to avoid page being accounted
 			 * under NR_FILE_MAPPED. This way NR_FILE_MAPPED would
 			 * be fully accounted under NR_FILE_PAGES. This allows
@@ -158,10 +163,12 @@ static void nvmap_vma_close(struct vm_area_struct *vma)
 
 	if (__atomic_add_unless(&priv->count, -1, 0) == 1) {
 		if (h->heap_pgalloc) {
+			h->pgalloc.nr_mapcount--;
 			for (i = 0; i < nr_page; i++) {
 				struct page *page;
 				page = nvmap_to_page(h->pgalloc.pages[i]);
-				atomic_dec(&page->_mapcount);
+				if (page)
+					atomic_dec(&page->_mapcount);
 			}
 		}
 		mutex_unlock(&h->lock);
@@ -220,7 +227,14 @@ static int nvmap_vma_fault(struct vm_area_struct *vma, struct vm_fault *vmf)
 		offs >>= PAGE_SHIFT;
 		if (atomic_read(&priv->handle->pgalloc.reserved))
 			return VM_FAULT_SIGBUS;
-		page = nvmap_to_page(priv->handle->pgalloc.pages[offs]);
+		page = READ_ONCE(priv->handle->pgalloc.pages[offs]);
+		page = nvmap_to_page(page);
+		if (!page) {
+			/* first touch of a lazily allocated page */
+			if (nvmap_handle_populate(priv->handle, offs, 1))
+				return VM_FAULT_OOM;
+			page = nvmap_to_page(priv->handle->pgalloc.pages[offs]);
+		}
 
 		if (!nvmap_handle_track_dirty(priv->handle))
 			goto finish;
@@ -282,6 +296,9 @@ static bool nvmap_fixup_prot(struct vm_area_struct *vma,
 		goto unlock;
 
 	page = nvmap_to_page(priv->handle->pgalloc.pages[offs]);
+	/* not populated yet, so nothing can be cached for it */
+	if (!page)
+		goto unlock;
 	/* inner cache maint */
 	kaddr  = kmap(page);
 	BUG_ON(!kaddr);
@@ -3,7 +3,7 @@
  *
  * Handle allocation and freeing routines for nvmap
  *
- * Copyright (c) 2009-2017, NVIDIA CORPORATION. All rights reserved.
+ * Copyright (c) 2009-2018, NVIDIA CORPORATION. All rights reserved.
  *
  * This program is free software; you can redistribute it and/or modify it
  * under the terms and conditions of the GNU General Public License,
@@ -23,6 +23,9 @@
 #include <linux/list.h>
 #include <linux/mm.h>
 #include <linux/rbtree.h>
+#include <linux/rhashtable.h>
+#include <linux/jhash.h>
+#include <linux/ktime.h>
 #include <linux/dma-buf.h>
 #include <linux/moduleparam.h>
 #include <linux/nvmap.h>
@@ -59,14 +62,54 @@ struct nvmap_handle_ref *__nvmap_validate_locked(struct nvmap_client *c,
 
 	return NULL;
 }
-/* adds a newly-created handle to the device master tree */
-void nvmap_handle_add(struct nvmap_device *dev, struct nvmap_handle *h)
+
+/*
+ * Handle IDs are the handle addresses. The id table hashes the address
+ * stored in the lookup key and compares it against the object itself, so no
+ * separate key field is needed in struct nvmap_handle.
+ */
+static u32 nvmap_handle_id_hashfn(const void *data, u32 len, u32 seed)
+{
+	return jhash(data, len, seed);
+}
+
+static u32 nvmap_handle_id_obj_hashfn(const void *data, u32 len, u32 seed)
+{
+	const struct nvmap_handle *h = data;
+
+	return nvmap_handle_id_hashfn(&h, sizeof(h), seed);
+}
+
+static int nvmap_handle_id_obj_cmpfn(struct rhashtable_compare_arg *arg,
+				     const void *obj)
+{
+	return *(struct nvmap_handle * const *)arg->key != obj;
+}
+
+static const struct rhashtable_params nvmap_handle_id_params = {
+	.head_offset = offsetof(struct nvmap_handle, id_node),
+	.key_len = sizeof(struct nvmap_handle *),
+	.hashfn = nvmap_handle_id_hashfn,
+	.obj_hashfn = nvmap_handle_id_obj_hashfn,
+	.obj_cmpfn = nvmap_handle_id_obj_cmpfn,
+	.automatic_shrinking = true,
+};
+
+int nvmap_handle_ids_init(struct nvmap_device *dev)
+{
+	return rhashtable_init(&dev->handle_ids, &nvmap_handle_id_params);
+}
+
+void nvmap_handle_ids_destroy(struct nvmap_device *dev)
+{
+	rhashtable_destroy(&dev->handle_ids);
+}
+
+static void nvmap_handle_rb_insert(struct rb_root *root, struct nvmap_handle *h)
 {
-	struct rb_node **p;
+	struct rb_node **p = &root->rb_node;
 	struct rb_node *parent = NULL;
 
-	spin_lock(&dev->handle_lock);
-	p = &dev->handles.rb_node;
 	while (*p) {
 		struct nvmap_handle *b;
 
@@ -78,9 +121,29 @@ void nvmap_handle_add(struct nvmap_device *dev, struct nvmap_handle *h)
 			p = &parent->rb_left;
 	}
 	rb_link_node(&h->node, parent, p);
-	rb_insert_color(&h->node, &dev->handles);
+	rb_insert_color(&h->node, root);
+}
+
+/*
+ * Adds a newly-created handle to the device master tree and id table. The
+ * tree is kept for the debugfs and IVM walks which need to visit every
+ * handle; lookups by ID only use the id table.
+ */
+int nvmap_handle_add(struct nvmap_device *dev, struct nvmap_handle *h)
+{
+	int err;
+
+	spin_lock(&dev->handle_lock);
+	err = rhashtable_insert_fast(&dev->handle_ids, &h->id_node,
+				     nvmap_handle_id_params);
+	if (err) {
+		spin_unlock(&dev->handle_lock);
+		return err;
+	}
+	nvmap_handle_rb_insert(&dev->handles, h);
 	nvmap_lru_add(h);
 	spin_unlock(&dev->handle_lock);
+	return 0;
 }
 
 /* remove a handle from the device's tree of all handles; called
@@ -99,40 +162,151 @@ int nvmap_handle_remove(struct nvmap_device *dev, struct nvmap_handle *h)
 	BUG_ON(atomic_read(&h->ref) < 0);
 	BUG_ON(atomic_read(&h->pin) != 0);
 
-	nvmap_lru_del(h);
-	rb_erase(&h->node, &dev->handles);
+	/* a handle that failed nvmap_handle_add() was never linked */
+	if (!RB_EMPTY_NODE(&h->node)) {
+		nvmap_lru_del(h);
+		rb_erase(&h->node, &dev->handles);
+		rhashtable_remove_fast(&dev->handle_ids, &h->id_node,
+				       nvmap_handle_id_params);
+	}
 
 	spin_unlock(&dev->handle_lock);
 	return 0;
 }
 
-/* Validates that a handle is in the device master tree and that the
- * client has permission to access it. */
+/* Validates that a handle is in the device id table and that the
+ * client has permission to access it. The lookup is lockless; handles are
+ * only freed after an RCU grace period, so a handle found here stays valid
+ * memory until the reference is taken or refused. */
 struct nvmap_handle *nvmap_validate_get(struct nvmap_handle *id)
 {
-	struct nvmap_handle *h = NULL;
-	struct rb_node *n;
+	struct nvmap_handle *h;
 
-	spin_lock(&nvmap_dev->handle_lock);
+	rcu_read_lock();
+	h = rhashtable_lookup_fast(&nvmap_dev->handle_ids, &id,
+				   nvmap_handle_id_params);
+	if (h && !atomic_inc_not_zero(&h->ref))
+		h = NULL;
+	rcu_read_unlock();
 
-	n = nvmap_dev->handles.rb_node;
+	return h;
+}
+
+/*
+ * Lookup benchmark: writing N to handle_lookup_bench builds a private set of
+ * N dummy handles and reports the average cost of finding one of them via
+ * the id table and via a spinlock protected rb-tree walk, the scheme the id
+ * table replaced.
+ */
+#define NVMAP_LOOKUP_BENCH_ITERS	(1 << 20)
+
+static int handle_lookup_bench;
+
+static struct nvmap_handle *nvmap_handle_rb_find(struct rb_root *root,
+						 struct nvmap_handle *id)
+{
+	struct rb_node *n = root->rb_node;
 
 	while (n) {
-		h = rb_entry(n, struct nvmap_handle, node);
-		if (h == id) {
-			h = nvmap_handle_get(h);
-			spin_unlock(&nvmap_dev->handle_lock);
+		struct nvmap_handle *h = rb_entry(n, struct nvmap_handle, node);
+
+		if (h == id)
 			return h;
-		}
 		if (id > h)
 			n = n->rb_right;
 		else
 			n = n->rb_left;
 	}
-	spin_unlock(&nvmap_dev->handle_lock);
 	return NULL;
 }
 
+static int handle_lookup_bench_set(const char *arg,
+				   const struct kernel_param *kp)
+{
+	static DEFINE_SPINLOCK(bench_lock);
+	struct rb_root tree = RB_ROOT;
+	struct nvmap_handle **handles;
+	struct rhashtable ids;
+	u64 t, rb_ns, ht_ns;
+	u32 i, nr, found = 0;
+	int ret;
+
+	ret = param_set_int(arg, kp);
+	if (ret || handle_lookup_bench <= 0)
+		return ret;
+	nr = handle_lookup_bench;
+
+	handles = vzalloc(nr * sizeof(*handles));
+	if (!handles)
+		return -ENOMEM;
+
+	ret = rhashtable_init(&ids, &nvmap_handle_id_params);
+	if (ret)
+		goto free_array;
+
+	for (i = 0; i < nr; i++) {
+		handles[i] = kzalloc(sizeof(*handles[i]), GFP_KERNEL);
+		if (!handles[i]) {
+			ret = -ENOMEM;
+			goto free_handles;
+		}
+		nvmap_handle_rb_insert(&tree, handles[i]);
+		ret = rhashtable_insert_fast(&ids, &handles[i]->id_node,
+					     nvmap_handle_id_params);
+		if (ret)
+			goto free_handles;
+	}
+
+	t = ktime_get_ns();
+	for (i = 0; i < NVMAP_LOOKUP_BENCH_ITERS; i++) {
+		struct nvmap_handle *id = handles[(i * 2654435761U) % nr];
+
+		spin_lock(&bench_lock);
+		found += nvmap_handle_rb_find(&tree, id) == id;
+		spin_unlock(&bench_lock);
+	}
+	rb_ns = ktime_get_ns() - t;
+
+	t = ktime_get_ns();
+	for (i = 0; i < NVMAP_LOOKUP_BENCH_ITERS; i++) {
+		struct nvmap_handle *id = handles[(i * 2654435761U) % nr];
+
+		rcu_read_lock();
+		found += rhashtable_lookup_fast(&ids, &id,
+				nvmap_handle_id_params) == id;
+		rcu_read_unlock();
+	}
+	ht_ns = ktime_get_ns() - t;
+
+	WARN_ON(found != 2 * NVMAP_LOOKUP_BENCH_ITERS);
+	pr_info("%u handles: rb-tree %llu ns/lookup, id table %llu ns/lookup\n",
+		nr, div_u64(rb_ns, NVMAP_LOOKUP_BENCH_ITERS),
+		div_u64(ht_ns, NVMAP_LOOKUP_BENCH_ITERS));
+	ret = 0;
+
+free_handles:
+	rhashtable_destroy(&ids);
+	for (i = 0; i < nr && handles[i]; i++)
+		kfree(handles[i]);
+free_array:
+	vfree(handles);
+	handle_lookup_bench = 0;
+	return ret;
+}
+
+static int handle_lookup_bench_get(char *buff, const struct kernel_param *kp)
+{
+	return param_get_int(buff, kp);
+}
+
+static struct kernel_param_ops handle_lookup_bench_ops = {
+	.get = handle_lookup_bench_get,
+	.set = handle_lookup_bench_set,
+};
+
+module_param_cb(handle_lookup_bench, &handle_lookup_bench_ops,
+		&handle_lookup_bench, 0644);
+
 static void add_handle_ref(struct nvmap_client *client,
 			   struct nvmap_handle_ref *ref)
 {
@@ -190,6 +364,7 @@ struct nvmap_handle_ref *nvmap_create_handle(struct nvmap_client *client,
 	void *err = ERR_PTR(-ENOMEM);
 	struct nvmap_handle *h;
 	struct nvmap_handle_ref *ref = NULL;
+	int ret;
 
 	if (!client)
 		return ERR_PTR(-EINVAL);
@@ -213,6 +388,7 @@ struct nvmap_handle_ref *nvmap_create_handle(struct nvmap_client *client,
 	h->size = PAGE_ALIGN(size);
 	h->flags = NVMAP_HANDLE_WRITE_COMBINE;
 	h->peer = NVMAP_IVM_INVALID_PEER;
+	RB_CLEAR_NODE(&h->node);
 	mutex_init(&h->lock);
 	INIT_LIST_HEAD(&h->vmas);
 	INIT_LIST_HEAD(&h->lru);
@@ -228,7 +404,11 @@ struct nvmap_handle_ref *nvmap_create_handle(struct nvmap_client *client,
 		goto make_dmabuf_fail;
 	}
 
-	nvmap_handle_add(nvmap_dev, h);
+	ret = nvmap_handle_add(nvmap_dev, h);
+	if (ret) {
+		err = ERR_PTR(ret);
+		goto handle_add_fail;
+	}
 
 	/*
 	 * Major assumption here: the dma_buf object that the handle contains
@@ -240,6 +420,15 @@ struct nvmap_handle_ref *nvmap_create_handle(struct nvmap_client *client,
 	trace_nvmap_create_handle(client, client->name, h, size, ref);
 	return ref;
 
+handle_add_fail:
+	/*
+	 * The dma_buf holds its own handle ref, dropped when it is released;
+	 * the initial ref taken above still has to be put here.
+	 */
+	dma_buf_put(h->dmabuf);
+	nvmap_handle_put(h);
+	kfree(ref);
+	return err;
 make_dmabuf_fail:
 	kfree(ref);
 ref_alloc_fail:
@@ -260,7 +449,8 @@ struct nvmap_handle_ref *nvmap_try_duplicate_by_ivmid(
 	n = nvmap_dev->handles.rb_node;
 	for (n = rb_first(&nvmap_dev->handles); n; n = rb_next(n)) {
 		h = rb_entry(n, struct nvmap_handle, node);
-		if (h->ivm_id == ivm_id) {
+		/* a view's block cannot be handed back to the IVM heap */
+		if (h->ivm_id == ivm_id && !h->parent) {
 			BUG_ON(!virt_addr_valid(h));
 			/* get handle's ref only if non-zero */
 			if (atomic_inc_not_zero(&h->ref) == 0) {
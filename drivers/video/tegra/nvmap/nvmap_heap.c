@@ -29,6 +29,10 @@
 #include <linux/stat.h>
 #include <linux/sizes.h>
 #include <linux/io.h>
+#include <linux/idr.h>
+#include <linux/rbtree.h>
+#include <linux/seq_file.h>
+#include <linux/uaccess.h>
 #include <linux/version.h>
 
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 14, 0)
@@ -62,6 +66,50 @@ struct list_block {
 	size_t align;
 	struct nvmap_heap *heap;
 	struct list_head free_list;
+	bool from_fit;	/* address chosen by the heap's fit allocator */
+	bool in_fit;	/* range accounted as used in the fit index */
+};
+
+/*
+ * Segregated-fit index of the free space of a carveout. Free extents are kept
+ * in an address ordered rb-tree, used to coalesce neighbours on free, and on
+ * one free list per power-of-two size class. An allocation scans the classes
+ * upwards from the one matching its size and takes the best fitting extent of
+ * the first class that can satisfy it, so small requests do not split the
+ * large extents that big requests depend on.
+ */
+#define NVMAP_HEAP_FIT_CLASSES	BITS_PER_LONG
+
+struct nvmap_heap_extent {
+	struct rb_node node;
+	struct list_head class_list;
+	phys_addr_t base;
+	size_t size;
+};
+
+struct nvmap_heap_fit {
+	struct rb_root extents;
+	struct list_head classes[NVMAP_HEAP_FIT_CLASSES];
+	size_t total_free;
+	u64 nr_allocs;
+	u64 nr_fallback;	/* fit misses the DMA layer still satisfied */
+	u64 nr_failed;
+};
+
+/*
+ * Replay state for the alloc_replay debugfs file: a private fit allocator
+ * with the geometry of the heap and the live allocations of the trace.
+ */
+struct nvmap_heap_replay {
+	struct nvmap_heap_fit *fit;
+	struct idr ids;
+	u64 nr_ops;
+	u64 ns;
+};
+
+struct nvmap_heap_replay_alloc {
+	phys_addr_t base;
+	size_t size;
 };
 
 struct nvmap_heap {
@@ -80,8 +128,271 @@ struct nvmap_heap {
 	int peer; /* Used only if is_ivm == true */
 	int vm_id; /* Used only if is_ivm == true */
 	struct nvmap_pm_ops pm_ops;
+	struct nvmap_heap_fit *fit; /* NULL if the DMA layer picks addresses */
+	struct nvmap_heap_replay *replay;
 };
 
+static inline int nvmap_heap_fit_class(size_t size)
+{
+	return fls_long(size) - 1;
+}
+
+static void nvmap_heap_fit_insert(struct nvmap_heap_fit *fit,
+				  struct nvmap_heap_extent *e)
+{
+	struct rb_node **p = &fit->extents.rb_node;
+	struct rb_node *parent = NULL;
+
+	while (*p) {
+		struct nvmap_heap_extent *b;
+
+		parent = *p;
+		b = rb_entry(parent, struct nvmap_heap_extent, node);
+		if (e->base > b->base)
+			p = &parent->rb_right;
+		else
+			p = &parent->rb_left;
+	}
+	rb_link_node(&e->node, parent, p);
+	rb_insert_color(&e->node, &fit->extents);
+	list_add(&e->class_list, &fit->classes[nvmap_heap_fit_class(e->size)]);
+}
+
+static void nvmap_heap_fit_remove(struct nvmap_heap_fit *fit,
+				  struct nvmap_heap_extent *e)
+{
+	rb_erase(&e->node, &fit->extents);
+	list_del(&e->class_list);
+}
+
+static struct nvmap_heap_fit *nvmap_heap_fit_create(phys_addr_t base,
+						    size_t len)
+{
+	struct nvmap_heap_fit *fit;
+	struct nvmap_heap_extent *e;
+	int i;
+
+	fit = kzalloc(sizeof(*fit), GFP_KERNEL);
+	e = kzalloc(sizeof(*e), GFP_KERNEL);
+	if (!fit || !e) {
+		kfree(fit);
+		kfree(e);
+		return NULL;
+	}
+
+	fit->extents = RB_ROOT;
+	for (i = 0; i < NVMAP_HEAP_FIT_CLASSES; i++)
+		INIT_LIST_HEAD(&fit->classes[i]);
+
+	e->base = base;
+	e->size = len;
+	nvmap_heap_fit_insert(fit, e);
+	fit->total_free = len;
+	return fit;
+}
+
+static void nvmap_heap_fit_destroy(struct nvmap_heap_fit *fit)
+{
+	struct rb_node *n;
+
+	if (!fit)
+		return;
+
+	while ((n = rb_first(&fit->extents))) {
+		struct nvmap_heap_extent *e;
+
+		e = rb_entry(n, struct nvmap_heap_extent, node);
+		nvmap_heap_fit_remove(fit, e);
+		kfree(e);
+	}
+	kfree(fit);
+}
+
+/*
+ * Takes [start, start + len) out of the free extent e, which must contain
+ * it. Splitting e in three needs the preallocated spare extent; the
+ * function frees whatever it did not use.
+ */
+static void nvmap_heap_fit_take(struct nvmap_heap_fit *fit,
+				struct nvmap_heap_extent *e, phys_addr_t start,
+				size_t len, struct nvmap_heap_extent *spare)
+{
+	size_t head = start - e->base;
+	size_t tail = e->size - head - len;
+	struct nvmap_heap_extent *t;
+
+	nvmap_heap_fit_remove(fit, e);
+
+	if (head) {
+		e->size = head;
+		nvmap_heap_fit_insert(fit, e);
+		e = NULL;
+	}
+	if (tail) {
+		t = e ? e : spare;
+		if (t == spare)
+			spare = NULL;
+		t->base = start + len;
+		t->size = tail;
+		nvmap_heap_fit_insert(fit, t);
+		e = NULL;
+	}
+	kfree(e);
+	kfree(spare);
+
+	fit->total_free -= len;
+}
+
+static int nvmap_heap_fit_alloc(struct nvmap_heap_fit *fit, size_t len,
+				size_t align, phys_addr_t *base)
+{
+	struct nvmap_heap_extent *e, *best = NULL, *spare;
+	phys_addr_t start, best_start = 0;
+	int c;
+
+	if (!len)
+		return -EINVAL;
+
+	/* may be needed to split the chosen extent in three */
+	spare = kzalloc(sizeof(*spare), GFP_KERNEL);
+	if (!spare)
+		return -ENOMEM;
+
+	for (c = nvmap_heap_fit_class(len);
+	     c < NVMAP_HEAP_FIT_CLASSES && !best; c++) {
+		list_for_each_entry(e, &fit->classes[c], class_list) {
+			start = ALIGN(e->base, align);
+			if (start - e->base >= e->size ||
+			    e->size - (start - e->base) < len)
+				continue;
+			if (!best || e->size < best->size) {
+				best = e;
+				best_start = start;
+			}
+		}
+	}
+
+	if (!best) {
+		kfree(spare);
+		return -ENOMEM;
+	}
+
+	nvmap_heap_fit_take(fit, best, best_start, len, spare);
+	fit->nr_allocs++;
+	*base = best_start;
+	return 0;
+}
+
+/*
+ * Marks [base, base + len), which someone else placed, as used in the
+ * index. Returns false if the range is not free in the index.
+ */
+static bool nvmap_heap_fit_reserve(struct nvmap_heap_fit *fit,
+				   phys_addr_t base, size_t len)
+{
+	struct nvmap_heap_extent *e = NULL, *spare;
+	struct rb_node *n = fit->extents.rb_node;
+
+	while (n) {
+		struct nvmap_heap_extent *b;
+
+		b = rb_entry(n, struct nvmap_heap_extent, node);
+		if (base < b->base) {
+			n = n->rb_left;
+		} else {
+			e = b;
+			n = n->rb_right;
+		}
+	}
+
+	if (!len || !e || base - e->base >= e->size ||
+	    e->size - (base - e->base) < len)
+		return false;
+
+	spare = kzalloc(sizeof(*spare), GFP_KERNEL);
+	if (!spare)
+		return false;
+
+	nvmap_heap_fit_take(fit, e, base, len, spare);
+	return true;
+}
+
+static void nvmap_heap_fit_free(struct nvmap_heap_fit *fit,
+				phys_addr_t base, size_t len)
+{
+	struct nvmap_heap_extent *prev = NULL, *next = NULL, *e = NULL;
+	struct rb_node *n = fit->extents.rb_node;
+
+	fit->total_free += len;
+
+	while (n) {
+		struct nvmap_heap_extent *b;
+
+		b = rb_entry(n, struct nvmap_heap_extent, node);
+		if (base < b->base) {
+			next = b;
+			n = n->rb_left;
+		} else {
+			prev = b;
+			n = n->rb_right;
+		}
+	}
+
+	if (prev && prev->base + prev->size == base) {
+		nvmap_heap_fit_remove(fit, prev);
+		base = prev->base;
+		len += prev->size;
+		e = prev;
+	}
+	if (next && base + len == next->base) {
+		nvmap_heap_fit_remove(fit, next);
+		len += next->size;
+		if (e)
+			kfree(next);
+		else
+			e = next;
+	}
+
+	if (!e) {
+		e = kzalloc(sizeof(*e), GFP_KERNEL);
+		if (WARN_ON(!e)) {
+			/* the range is lost to the fit allocator */
+			fit->total_free -= len;
+			return;
+		}
+	}
+	e->base = base;
+	e->size = len;
+	nvmap_heap_fit_insert(fit, e);
+}
+
+static size_t nvmap_heap_fit_largest(struct nvmap_heap_fit *fit)
+{
+	struct nvmap_heap_extent *e;
+	size_t largest = 0;
+	int c;
+
+	for (c = NVMAP_HEAP_FIT_CLASSES - 1; c >= 0 && !largest; c--)
+		list_for_each_entry(e, &fit->classes[c], class_list)
+			largest = max(largest, e->size);
+
+	return largest;
+}
+
+static void nvmap_heap_fit_show(struct seq_file *s, struct nvmap_heap_fit *fit)
+{
+	size_t largest = nvmap_heap_fit_largest(fit);
+
+	seq_printf(s, "free: %zu\n", fit->total_free);
+	seq_printf(s, "largest_free: %zu\n", largest);
+	/* largest free block / total free, in per-mille */
+	seq_printf(s, "contiguity: %llu\n", fit->total_free ?
+		   div64_u64((u64)largest * 1000, fit->total_free) : 1000);
+	seq_printf(s, "allocs: %llu\n", fit->nr_allocs);
+	seq_printf(s, "fallback: %llu\n", fit->nr_fallback);
+	seq_printf(s, "failed: %llu\n", fit->nr_failed);
+}
+
 struct device *dma_dev_from_handle(unsigned long type)
 {
 	int i;
@@ -114,6 +425,175 @@ size_t nvmap_query_heap_size(struct nvmap_heap *heap)
 	return heap->len;
 }
 
+static int heap_fit_show(struct seq_file *s, void *unused)
+{
+	struct nvmap_heap *heap = s->private;
+
+	mutex_lock(&heap->lock);
+	nvmap_heap_fit_show(s, heap->fit);
+	mutex_unlock(&heap->lock);
+	return 0;
+}
+
+static int heap_fit_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, heap_fit_show, inode->i_private);
+}
+
+static const struct file_operations heap_fit_fops = {
+	.open		= heap_fit_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int nvmap_heap_replay_free_id(int id, void *p, void *data)
+{
+	kfree(p);
+	return 0;
+}
+
+static void nvmap_heap_replay_reset(struct nvmap_heap *heap)
+{
+	struct nvmap_heap_replay *replay = heap->replay;
+
+	if (!replay)
+		return;
+
+	idr_for_each(&replay->ids, nvmap_heap_replay_free_id, NULL);
+	idr_destroy(&replay->ids);
+	nvmap_heap_fit_destroy(replay->fit);
+	kfree(replay);
+	heap->replay = NULL;
+}
+
+/*
+ * Replays one trace line against the private allocator:
+ *   "a <id> <size> [align]"	allocate
+ *   "f <id>"			free
+ *   "reset"			drop the replay state
+ */
+static int nvmap_heap_replay_line(struct nvmap_heap *heap, char *line)
+{
+	struct nvmap_heap_replay *replay = heap->replay;
+	struct nvmap_heap_replay_alloc *a;
+	unsigned long long size, align = PAGE_SIZE;
+	u64 t;
+	int id, ret;
+
+	if (!strcmp(line, "reset")) {
+		nvmap_heap_replay_reset(heap);
+		return 0;
+	}
+
+	if (!replay) {
+		replay = kzalloc(sizeof(*replay), GFP_KERNEL);
+		if (!replay)
+			return -ENOMEM;
+		replay->fit = nvmap_heap_fit_create(heap->base, heap->len);
+		if (!replay->fit) {
+			kfree(replay);
+			return -ENOMEM;
+		}
+		idr_init(&replay->ids);
+		heap->replay = replay;
+	}
+
+	if (sscanf(line, "a %d %llu %llu", &id, &size, &align) >= 2) {
+		if (!align || (align & (align - 1)))
+			return -EINVAL;
+		a = kzalloc(sizeof(*a), GFP_KERNEL);
+		if (!a)
+			return -ENOMEM;
+		ret = idr_alloc(&replay->ids, a, id, id + 1, GFP_KERNEL);
+		if (ret < 0) {
+			kfree(a);
+			return ret;
+		}
+		a->size = size;
+		t = sched_clock();
+		ret = nvmap_heap_fit_alloc(replay->fit, a->size, align,
+					   &a->base);
+		replay->ns += sched_clock() - t;
+		replay->nr_ops++;
+		if (ret) {
+			/* a failed allocation is part of the result */
+			replay->fit->nr_failed++;
+			idr_remove(&replay->ids, id);
+			kfree(a);
+		}
+		return 0;
+	}
+
+	if (sscanf(line, "f %d", &id) == 1) {
+		a = idr_remove(&replay->ids, id);
+		if (!a)
+			return -ENOENT;
+		t = sched_clock();
+		nvmap_heap_fit_free(replay->fit, a->base, a->size);
+		replay->ns += sched_clock() - t;
+		replay->nr_ops++;
+		kfree(a);
+		return 0;
+	}
+
+	return -EINVAL;
+}
+
+static ssize_t heap_replay_write(struct file *file, const char __user *buf,
+				 size_t count, loff_t *pos)
+{
+	struct nvmap_heap *heap = file_inode(file)->i_private;
+	char *kbuf, *cur, *line;
+	int ret = 0;
+
+	kbuf = memdup_user_nul(buf, count);
+	if (IS_ERR(kbuf))
+		return PTR_ERR(kbuf);
+
+	mutex_lock(&heap->lock);
+	cur = kbuf;
+	while ((line = strsep(&cur, "\n")) != NULL) {
+		line = strim(line);
+		if (!*line)
+			continue;
+		ret = nvmap_heap_replay_line(heap, line);
+		if (ret)
+			break;
+	}
+	mutex_unlock(&heap->lock);
+
+	kfree(kbuf);
+	return ret ? ret : count;
+}
+
+static int heap_replay_show(struct seq_file *s, void *unused)
+{
+	struct nvmap_heap *heap = s->private;
+
+	mutex_lock(&heap->lock);
+	if (heap->replay) {
+		seq_printf(s, "ops: %llu\n", heap->replay->nr_ops);
+		seq_printf(s, "ns: %llu\n", heap->replay->ns);
+		nvmap_heap_fit_show(s, heap->replay->fit);
+	}
+	mutex_unlock(&heap->lock);
+	return 0;
+}
+
+static int heap_replay_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, heap_replay_show, inode->i_private);
+}
+
+static const struct file_operations heap_replay_fops = {
+	.open		= heap_replay_open,
+	.read		= seq_read,
+	.write		= heap_replay_write,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
 void nvmap_heap_debugfs_init(struct dentry *heap_root, struct nvmap_heap *heap)
 {
 	if (sizeof(heap->base) == sizeof(u64))
@@ -128,6 +608,11 @@ void nvmap_heap_debugfs_init(struct dentry *heap_root, struct nvmap_heap *heap)
 	else
 		debugfs_create_x32("size", S_IRUGO,
 			heap_root, (u32 *)&heap->len);
+	if (heap->fit)
+		debugfs_create_file("fragmentation", S_IRUGO,
+			heap_root, heap, &heap_fit_fops);
+	debugfs_create_file("alloc_replay", S_IRUGO | S_IWUSR,
+		heap_root, heap, &heap_replay_fops);
 }
 
 static phys_addr_t nvmap_alloc_mem(struct nvmap_heap *h, size_t len,
@@ -199,6 +684,46 @@ static void nvmap_free_mem(struct nvmap_heap *h, phys_addr_t base,
 	}
 }
 
+/*
+ * Picks the address with the heap's fit allocator and reserves exactly that
+ * range in the DMA coherent pool, so the pool stays consistent with any other
+ * user of the carveout device. Returns DMA_ERROR_CODE if no range was found
+ * or it could not be reserved.
+ */
+static phys_addr_t nvmap_fit_alloc_mem(struct nvmap_heap *h, size_t len,
+				       size_t align)
+{
+	struct device *dev = h->dma_dev;
+	DEFINE_DMA_ATTRS(attrs);
+	phys_addr_t pa;
+	void *ret;
+
+	if (nvmap_heap_fit_alloc(h->fit, len, align, &pa))
+		return DMA_ERROR_CODE;
+
+	dma_set_attr(DMA_ATTR_ALLOC_EXACT_SIZE, __DMA_ATTR(attrs));
+	ret = dma_mark_declared_memory_occupied(dev, pa, len,
+						__DMA_ATTR(attrs));
+	if (IS_ERR(ret)) {
+		dev_dbg(dev, "can't reserve (%pa) len(%zu)\n", &pa, len);
+		nvmap_heap_fit_free(h->fit, pa, len);
+		return DMA_ERROR_CODE;
+	}
+
+	return pa;
+}
+
+static void nvmap_fit_free_mem(struct nvmap_heap *h, phys_addr_t base,
+			       size_t len)
+{
+	DEFINE_DMA_ATTRS(attrs);
+
+	dma_set_attr(DMA_ATTR_ALLOC_EXACT_SIZE, __DMA_ATTR(attrs));
+	dma_mark_declared_memory_unoccupied(h->dma_dev, base, len,
+					    __DMA_ATTR(attrs));
+	nvmap_heap_fit_free(h->fit, base, len);
+}
+
 /*
  * base_max limits position of allocated chunk in memory.
  * if base_max is 0 then there is no such limitation.
@@ -234,8 +759,28 @@ static struct nvmap_heap_block *do_heap_alloc(struct nvmap_heap *heap,
 		goto fail_heap_block_alloc;
 	}
 
-	dev_base = nvmap_alloc_mem(heap, len, start);
+	dev_base = DMA_ERROR_CODE;
+	if (heap->fit) {
+		dev_base = nvmap_fit_alloc_mem(heap, len, align);
+		heap_block->from_fit = !dma_mapping_error(dev, dev_base);
+		heap_block->in_fit = heap_block->from_fit;
+	}
+	/* the DMA layer may still satisfy what the fit allocator could not */
+	if (!heap_block->from_fit) {
+		dev_base = nvmap_alloc_mem(heap, len, start);
+		/* keep the index in step with what the DMA layer handed out */
+		if (heap->fit && !dma_mapping_error(dev, dev_base)) {
+			heap->fit->nr_fallback++;
+			heap_block->in_fit = nvmap_heap_fit_reserve(heap->fit,
+							dev_base, len);
+			WARN_ONCE(!heap_block->in_fit,
+				  "%s: fallback block not in the fit index\n",
+				  heap->name);
+		}
+	}
 	if (dma_mapping_error(dev, dev_base)) {
+		if (heap->fit)
+			heap->fit->nr_failed++;
 		dev_err(dev, "failed to alloc mem of size (%zu)\n",
 			len);
 		if (dma_is_coherent_dev(dev)) {
@@ -271,7 +816,13 @@ static struct list_block *do_heap_free(struct nvmap_heap_block *block)
 
 	list_del(&b->all_list);
 
-	nvmap_free_mem(heap, block->base, b->size);
+	if (b->from_fit) {
+		nvmap_fit_free_mem(heap, block->base, b->size);
+	} else {
+		nvmap_free_mem(heap, block->base, b->size);
+		if (b->in_fit)
+			nvmap_heap_fit_free(heap->fit, block->base, b->size);
+	}
 	kmem_cache_free(heap_block_cache, b);
 
 	return b;
@@ -354,6 +905,10 @@ struct nvmap_heap_block *nvmap_heap_alloc(struct nvmap_heap *h,
 struct nvmap_heap *nvmap_block_to_heap(struct nvmap_heap_block *b)
 {
 	struct list_block *lb;
+
+	/* view blocks are not embedded in a list_block */
+	if (WARN_ON(b->view))
+		return NULL;
 	lb = container_of(b, struct list_block, block);
 	return lb->heap;
 }
@@ -368,6 +923,8 @@ void nvmap_heap_free(struct nvmap_heap_block *b)
 		return;
 
 	h = nvmap_block_to_heap(b);
+	if (!h)
+		return;
 	mutex_lock(&h->lock);
 
 	lb = container_of(b, struct list_block, block);
@@ -452,6 +1009,19 @@ struct nvmap_heap *nvmap_heap_create(struct device *parent,
 
 	INIT_LIST_HEAD(&h->all_list);
 	mutex_init(&h->lock);
+
+	/*
+	 * Let nvmap place allocations in carveouts it declared itself. CMA
+	 * backed heaps share their memory with the page allocator and IVM
+	 * heaps get their placement from the allocating partition, so both
+	 * keep using the DMA layer's allocator.
+	 */
+	if (!co->cma_dev && !co->is_ivm) {
+		h->fit = nvmap_heap_fit_create(base, len);
+		if (!h->fit)
+			dev_warn(parent, "%s: no fit allocator, using DMA\n",
+				 co->name);
+	}
 	if (!co->no_cpu_access &&
 		nvmap_cache_maint_phys_range(NVMAP_CACHE_OP_WB_INV,
 				base, base + len, true, true)) {
@@ -470,6 +1040,7 @@ struct nvmap_heap *nvmap_heap_create(struct device *parent,
 		co->name, (void *)(uintptr_t)base, len/1024);
 	return h;
 fail:
+	nvmap_heap_fit_destroy(h->fit);
 	kfree(h);
 	return NULL;
 }
@@ -485,6 +1056,8 @@ void nvmap_heap_destroy(struct nvmap_heap *heap)
 		list_del(&l->all_list);
 		kmem_cache_free(heap_block_cache, l);
 	}
+	nvmap_heap_replay_reset(heap);
+	nvmap_heap_fit_destroy(heap->fit);
 	kfree(heap);
 }
 
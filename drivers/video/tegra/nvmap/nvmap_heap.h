@@ -26,6 +26,7 @@ struct nvmap_heap_block {
 	phys_addr_t	base;
 	unsigned int	type;
 	struct nvmap_handle *handle;
+	bool		view;	/* a view's window, not owned by any heap */
 };
 
 struct nvmap_heap *nvmap_heap_create(struct device *parent,
@@ -273,6 +273,35 @@ int nvmap_ioctl_create_from_va(struct file *filp, void __user *arg)
 			arg, &op, sizeof(op), 1,  ref->handle->dmabuf);
 }
 
+int nvmap_ioctl_create_view(struct file *filp, void __user *arg)
+{
+	int fd;
+	struct nvmap_create_view op;
+	struct nvmap_handle_ref *ref;
+	struct nvmap_handle *parent;
+	struct nvmap_client *client = filp->private_data;
+
+	if (copy_from_user(&op, arg, sizeof(op)))
+		return -EFAULT;
+
+	if (!client)
+		return -ENODEV;
+
+	parent = nvmap_handle_get_from_fd(op.parent);
+	if (!parent)
+		return -EINVAL;
+
+	ref = nvmap_create_view(client, parent, op.offset, op.size);
+	nvmap_handle_put(parent);
+	if (IS_ERR(ref))
+		return PTR_ERR(ref);
+
+	fd = nvmap_get_dmabuf_fd(client, ref->handle);
+	op.handle = fd;
+	return nvmap_install_fd(client, ref->handle, fd,
+			arg, &op, sizeof(op), 1, ref->handle->dmabuf);
+}
+
 static int set_vpr_fail_data(void *user_addr, ulong user_stride,
 		       ulong elem_size, ulong count)
 {
@@ -551,6 +580,12 @@ int nvmap_ioctl_get_ivcid(struct file *filp, void __user *arg)
 		return -EFAULT;
 	}
 
+	/* views have no IVM id of their own */
+	if (h->parent) {
+		nvmap_handle_put(h);
+		return -EINVAL;
+	}
+
 	op.ivm_id = h->ivm_id;
 
 	nvmap_handle_put(h);
@@ -43,6 +43,8 @@ int nvmap_ioctl_create(struct file *filp, unsigned int cmd, void __user *arg);
 
 int nvmap_ioctl_create_from_va(struct file *filp, void __user *arg);
 
+int nvmap_ioctl_create_view(struct file *filp, void __user *arg);
+
 int nvmap_ioctl_create_from_ivc(struct file *filp, void __user *arg);
 
 int nvmap_ioctl_get_ivc_heap(struct file *filp, void __user *arg);
@@ -24,8 +24,11 @@
 #include <linux/shrinker.h>
 #include <linux/kthread.h>
 #include <linux/debugfs.h>
+#include <linux/seq_file.h>
 #include <linux/freezer.h>
 #include <linux/highmem.h>
+#include <linux/percpu.h>
+#include <linux/delay.h>
 #include <linux/version.h>
 
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 14, 0)
@@ -38,18 +41,33 @@
 #include "nvmap_priv.h"
 
 #define NVMAP_TEST_PAGE_POOL_SHRINKER     1
+#define NVMAP_TEST_PAGE_POOL_MAGAZINES    1
 #define PENDING_PAGES_SIZE                (SZ_1M / PAGE_SIZE)
 
 static bool enable_pp = 1;
+static bool enable_pp_mags = 1;
 static u32 pool_size;
 
-static struct task_struct *background_allocator;
+/*
+ * Background zeroing workers, one per CPU online at init. Each worker owns
+ * its batch array so they can drain zero_list concurrently.
+ */
+struct nvmap_pp_zero_worker {
+	struct task_struct *task;
+	struct page *pending_zero_pages[PENDING_PAGES_SIZE];
+};
+
+static struct nvmap_pp_zero_worker *zero_workers;
+static int nr_zero_workers;
+static u32 zero_batch = PENDING_PAGES_SIZE;
+static atomic64_t bg_zero_bytes;
+static atomic64_t bg_zero_ns;
 static DECLARE_WAIT_QUEUE_HEAD(nvmap_bg_wait);
 
 #ifdef CONFIG_NVMAP_PAGE_POOL_DEBUG
-static inline void __pp_dbg_var_add(u64 *dbg_var, u32 nr)
+static inline void __pp_dbg_var_add(atomic64_t *dbg_var, u32 nr)
 {
-	*dbg_var += nr;
+	atomic64_add(nr, dbg_var);
 }
 #else
 #define __pp_dbg_var_add(dbg_var, nr)
@@ -59,6 +77,9 @@ static inline void __pp_dbg_var_add(u64 *dbg_var, u32 nr)
 #define pp_fill_add(pool, nr)  __pp_dbg_var_add(&(pool)->fills, nr)
 #define pp_hit_add(pool, nr)   __pp_dbg_var_add(&(pool)->hits, nr)
 #define pp_miss_add(pool, nr)  __pp_dbg_var_add(&(pool)->misses, nr)
+#define pp_mag_hit_add(pool, nr)    __pp_dbg_var_add(&(pool)->mag_hits, nr)
+#define pp_mag_refill_add(pool, nr) __pp_dbg_var_add(&(pool)->mag_refills, nr)
+#define pp_mag_drain_add(pool, nr)  __pp_dbg_var_add(&(pool)->mag_drains, nr)
 
 static int __nvmap_page_pool_fill_lots_locked(struct nvmap_page_pool *pool,
 				       struct page **pages, u32 nr);
@@ -80,17 +101,77 @@ static inline struct page *get_zero_list_page(struct nvmap_page_pool *pool)
 	return page;
 }
 
+static inline u32 nvmap_pp_color(struct nvmap_page_pool *pool,
+				 phys_addr_t addr)
+{
+	return addr_to_color_t19x((uintptr_t)addr) % pool->nr_colors;
+}
+
+/*
+ * Take a page of @color off the color bins, or of the next non-empty color
+ * after it when that bin is empty.
+ *
+ * You must lock the page pool before using this.
+ */
+static struct page *nvmap_pp_pop_color_locked(struct nvmap_page_pool *pool,
+					      u32 color)
+{
+	struct page *page;
+	u32 i, c;
+
+	for (i = 0; i < pool->nr_colors; i++) {
+		c = (color + i) % pool->nr_colors;
+		if (!pool->color_count[c])
+			continue;
+
+		page = list_first_entry(&pool->color_list[c], struct page, lru);
+		list_del(&page->lru);
+		pool->color_count[c]--;
+		return page;
+	}
+
+	return NULL;
+}
+
+/*
+ * Put a zeroed page on page_list, or in its color bin when the pool is
+ * colored. The caller accounts for it in pool->count.
+ *
+ * You must lock the page pool before using this.
+ */
+static inline void nvmap_pp_add_clean_page_locked(struct nvmap_page_pool *pool,
+						  struct page *page)
+{
+	u32 c;
+
+	if (!pool->nr_colors) {
+		list_add_tail(&page->lru, &pool->page_list);
+		return;
+	}
+
+	c = nvmap_pp_color(pool, page_to_phys(page));
+	list_add_tail(&page->lru, &pool->color_list[c]);
+	pool->color_count[c]++;
+}
+
 static inline struct page *get_page_list_page(struct nvmap_page_pool *pool)
 {
 	struct page *page;
 
 	trace_get_page_list_page(pool->count);
 
-	if (list_empty(&pool->page_list))
+	if (!list_empty(&pool->page_list)) {
+		page = list_first_entry(&pool->page_list, struct page, lru);
+		list_del(&page->lru);
+	} else if (pool->nr_colors) {
+		/* spread uncolored users over the bins */
+		page = nvmap_pp_pop_color_locked(pool,
+				pool->color_next++ % pool->nr_colors);
+		if (!page)
+			return NULL;
+	} else {
 		return NULL;
-
-	page = list_first_entry(&pool->page_list, struct page, lru);
-	list_del(&page->lru);
+	}
 
 	pool->count--;
 
@@ -118,6 +199,180 @@ static inline bool nvmap_bg_should_run(struct nvmap_page_pool *pool)
 	return !list_empty(&pool->zero_list);
 }
 
+/*
+ * Number of pages that can still be added to the pool, counting the pages
+ * parked in the per-CPU magazines against pool->max.
+ */
+static inline u32 nvmap_pp_free_slots(struct nvmap_page_pool *pool)
+{
+	u32 used = pool->count + pool->to_zero + pool->under_zero +
+		   atomic_read(&pool->mag_count);
+
+	return used < pool->max ? pool->max - used : 0;
+}
+
+static inline bool nvmap_pp_mags_enabled(struct nvmap_page_pool *pool)
+{
+	return enable_pp && enable_pp_mags && pool->mags;
+}
+
+/*
+ * Move the freed pages of a magazine onto zero_list so the background
+ * thread can zero them. Pages which no longer fit in the pool are released.
+ *
+ * You must hold both the page pool lock and the magazine lock.
+ */
+static u32 nvmap_pp_mag_flush_dirty_locked(struct nvmap_page_pool *pool,
+					   struct nvmap_pp_magazine *mag)
+{
+	u32 nr = mag->nr_dirty;
+
+	while (mag->nr_dirty) {
+		struct page *page = mag->dirty[--mag->nr_dirty];
+
+		atomic_dec(&pool->mag_count);
+		if (nvmap_pp_free_slots(pool)) {
+			list_add_tail(&page->lru, &pool->zero_list);
+			pool->to_zero++;
+		} else {
+			__free_page(page);
+		}
+	}
+
+	return nr;
+}
+
+/*
+ * Return every page held in the per-CPU magazines to the global lists. This
+ * is needed before anything that wants an exact view of the pool contents:
+ * clearing, resizing and shrinking.
+ *
+ * You must lock the page pool before using this.
+ */
+static void nvmap_pp_drain_magazines_locked(struct nvmap_page_pool *pool)
+{
+	u32 nr = 0;
+	int cpu;
+
+	if (!pool->mags)
+		return;
+
+	for_each_possible_cpu(cpu) {
+		struct nvmap_pp_magazine *mag = per_cpu_ptr(pool->mags, cpu);
+
+		spin_lock(&mag->lock);
+		nr += mag->nr_clean;
+		while (mag->nr_clean) {
+			struct page *page = mag->clean[--mag->nr_clean];
+
+			atomic_dec(&pool->mag_count);
+			if (pool->count < pool->max) {
+				nvmap_pp_add_clean_page_locked(pool, page);
+				pool->count++;
+			} else {
+				__free_page(page);
+			}
+		}
+		nr += nvmap_pp_mag_flush_dirty_locked(pool, mag);
+		spin_unlock(&mag->lock);
+	}
+
+	pp_mag_drain_add(pool, nr);
+}
+
+/*
+ * Top up the local magazine with zeroed pages from page_list. Only already
+ * zeroed pages are cached; pages still on zero_list are left for the
+ * background thread.
+ *
+ * You must lock the page pool before using this.
+ */
+static void nvmap_pp_mag_refill_locked(struct nvmap_page_pool *pool)
+{
+	struct nvmap_pp_magazine *mag = raw_cpu_ptr(pool->mags);
+	u32 nr = 0;
+
+	spin_lock(&mag->lock);
+	while (mag->nr_clean < NVMAP_PP_MAG_BATCH) {
+		struct page *page = get_page_list_page(pool);
+
+		if (!page)
+			break;
+		mag->clean[mag->nr_clean++] = page;
+		nr++;
+	}
+	spin_unlock(&mag->lock);
+
+	atomic_add(nr, &pool->mag_count);
+	pp_mag_refill_add(pool, nr);
+}
+
+/*
+ * Take up to @nr zeroed pages from the local magazine without touching the
+ * page pool lock. Returns the number of pages placed in @pages.
+ */
+static u32 nvmap_pp_mag_alloc(struct nvmap_page_pool *pool,
+			      struct page **pages, u32 nr)
+{
+	struct nvmap_pp_magazine *mag;
+	u32 ind = 0;
+
+	if (!nvmap_pp_mags_enabled(pool))
+		return 0;
+
+	mag = raw_cpu_ptr(pool->mags);
+	spin_lock(&mag->lock);
+	while (ind < nr && mag->nr_clean)
+		pages[ind++] = mag->clean[--mag->nr_clean];
+	spin_unlock(&mag->lock);
+
+	atomic_sub(ind, &pool->mag_count);
+	pp_mag_hit_add(pool, ind);
+
+	return ind;
+}
+
+/*
+ * Park a small batch of freed pages in the local magazine. Either all @nr
+ * pages are consumed or none are. @flush is set once the magazine holds a
+ * full batch, telling the caller to move it to zero_list under the pool lock.
+ */
+static u32 nvmap_pp_mag_fill(struct nvmap_page_pool *pool,
+			     struct page **pages, u32 nr, bool *flush)
+{
+	struct nvmap_pp_magazine *mag;
+	u32 i;
+
+	if (!nvmap_pp_mags_enabled(pool) || nr > NVMAP_PP_MAG_BATCH)
+		return 0;
+
+	/* Racy, but the flush re-checks the limit under the pool lock. */
+	if (nvmap_pp_free_slots(pool) < nr)
+		return 0;
+
+	mag = raw_cpu_ptr(pool->mags);
+	spin_lock(&mag->lock);
+	if (mag->nr_dirty + nr > NVMAP_PP_MAG_SIZE) {
+		spin_unlock(&mag->lock);
+		*flush = true;
+		return 0;
+	}
+
+	for (i = 0; i < nr; i++) {
+		/* See nvmap_page_pool_fill_lots() for the refcount check. */
+		if (page_count(pages[i]) > 1) {
+			__free_page(pages[i]);
+		} else {
+			mag->dirty[mag->nr_dirty++] = pages[i];
+			atomic_inc(&pool->mag_count);
+		}
+	}
+	*flush = mag->nr_dirty >= NVMAP_PP_MAG_BATCH;
+	spin_unlock(&mag->lock);
+
+	return nr;
+}
+
 static void nvmap_pp_zero_pages(struct page **pages, int nr)
 {
 	int i;
@@ -130,19 +385,18 @@ static void nvmap_pp_zero_pages(struct page **pages, int nr)
 	trace_nvmap_pp_zero_pages(nr);
 }
 
-static void nvmap_pp_do_background_zero_pages(struct nvmap_page_pool *pool)
+static void nvmap_pp_do_background_zero_pages(struct nvmap_page_pool *pool,
+					struct nvmap_pp_zero_worker *worker)
 {
 	int i;
 	struct page *page;
 	int ret;
-	/*
-	 * Statically declared array of pages to be zeroed in a batch,
-	 * local to this thread but too big for the stack.
-	 */
-	static struct page *pending_zero_pages[PENDING_PAGES_SIZE];
+	u32 batch = clamp_t(u32, READ_ONCE(zero_batch), 1, PENDING_PAGES_SIZE);
+	struct page **pending_zero_pages = worker->pending_zero_pages;
+	u64 t;
 
 	rt_mutex_lock(&pool->lock);
-	for (i = 0; i < PENDING_PAGES_SIZE; i++) {
+	for (i = 0; i < batch; i++) {
 		page = get_zero_list_page(pool);
 		if (page == NULL)
 			break;
@@ -151,7 +405,16 @@ static void nvmap_pp_do_background_zero_pages(struct nvmap_page_pool *pool)
 	}
 	rt_mutex_unlock(&pool->lock);
 
+	/*
+	 * clear_highpage() ends up in the arch clear_page(), which on ARM64
+	 * zeroes whole cache lines with DC ZVA. That still allocates the lines
+	 * in the cache, but skips the read-for-ownership of their old contents
+	 * from DRAM; nvmap_clean_cache_page() then writes them back.
+	 */
+	t = sched_clock();
 	nvmap_pp_zero_pages(pending_zero_pages, i);
+	atomic64_add(sched_clock() - t, &bg_zero_ns);
+	atomic64_add((u64)i << PAGE_SHIFT, &bg_zero_bytes);
 
 	rt_mutex_lock(&pool->lock);
 	ret = __nvmap_page_pool_fill_lots_locked(pool, pending_zero_pages, i);
@@ -165,15 +428,20 @@ static void nvmap_pp_do_background_zero_pages(struct nvmap_page_pool *pool)
 }
 
 /*
- * This thread fills the page pools with zeroed pages. We avoid releasing the
+ * These threads fill the page pools with zeroed pages. We avoid releasing the
  * pages directly back into the page pools since we would then have to zero
  * them ourselves. Instead it is easier to just reallocate zeroed pages. This
  * happens in the background so that the overhead of allocating zeroed pages is
  * not directly seen by userspace. Of course if the page pools are empty user
  * space will suffer.
+ *
+ * One thread per CPU runs at SCHED_IDLE, each taking at most zero_batch
+ * pages off zero_list at a time, so a large free is zeroed by whichever
+ * CPUs are idle.
  */
 static int nvmap_background_zero_thread(void *arg)
 {
+	struct nvmap_pp_zero_worker *worker = arg;
 	struct nvmap_page_pool *pool = &nvmap_dev->pool;
 	struct sched_param param = { .sched_priority = 0 };
 
@@ -184,7 +452,7 @@ static int nvmap_background_zero_thread(void *arg)
 
 	while (!kthread_should_stop()) {
 		while (nvmap_bg_should_run(pool))
-			nvmap_pp_do_background_zero_pages(pool);
+			nvmap_pp_do_background_zero_pages(pool, worker);
 
 		wait_event_freezable(nvmap_bg_wait,
 				nvmap_bg_should_run(pool) ||
@@ -273,10 +541,21 @@ int nvmap_page_pool_alloc_lots(struct nvmap_page_pool *pool,
 	u32 ind = 0;
 	u32 non_zero_idx;
 	u32 non_zero_cnt = 0;
+	u32 i;
 
 	if (!enable_pp || !nr)
 		return 0;
 
+	ind = nvmap_pp_mag_alloc(pool, pages, nr);
+	if (IS_ENABLED(CONFIG_NVMAP_PAGE_POOL_DEBUG)) {
+		for (i = 0; i < ind; i++) {
+			nvmap_pgcount(pages[i], false);
+			BUG_ON(page_count(pages[i]) != 1);
+		}
+	}
+	if (ind == nr)
+		goto out;
+
 	rt_mutex_lock(&pool->lock);
 
 	while (ind < nr) {
@@ -301,15 +580,22 @@ int nvmap_page_pool_alloc_lots(struct nvmap_page_pool *pool,
 		}
 	}
 
+	/* Small requests leave the local magazine primed for the next one. */
+	if (nvmap_pp_mags_enabled(pool) && nr <= NVMAP_PP_MAG_BATCH)
+		nvmap_pp_mag_refill_locked(pool);
+
 	rt_mutex_unlock(&pool->lock);
 
 	/* Zero non-zeroed pages, if any */
 	if (non_zero_cnt)
 		nvmap_pp_zero_pages(&pages[non_zero_idx], non_zero_cnt);
 
+out:
 	pp_alloc_add(pool, ind);
 	pp_hit_add(pool, ind);
 	pp_miss_add(pool, nr - ind);
+	nvmap_stats_inc(NS_PP_HITS, ind);
+	nvmap_stats_inc(NS_PP_MISSES, nr - ind);
 
 	trace_nvmap_pp_alloc_lots(ind, nr);
 
@@ -401,7 +687,7 @@ static int __nvmap_page_pool_fill_lots_locked(struct nvmap_page_pool *pool,
 			real_nr -= pool->pages_per_big_pg;
 			pool->big_page_count += pool->pages_per_big_pg;
 		} else {
-			list_add_tail(&pages[ind++]->lru, &pool->page_list);
+			nvmap_pp_add_clean_page_locked(pool, pages[ind++]);
 			real_nr--;
 		}
 	}
@@ -418,31 +704,49 @@ int nvmap_page_pool_fill_lots(struct nvmap_page_pool *pool,
 {
 	int ret = 0;
 	int i;
+	u32 ind;
 	u32 save_to_zero;
+	bool flush = false;
+
+	ind = nvmap_pp_mag_fill(pool, pages, nr, &flush);
+	if (ind == nr && !flush)
+		return ind;
 
 	rt_mutex_lock(&pool->lock);
 
 	save_to_zero = pool->to_zero;
 
-	ret = min(nr, pool->max - pool->count - pool->to_zero - pool->under_zero);
+	if (flush) {
+		struct nvmap_pp_magazine *mag = raw_cpu_ptr(pool->mags);
+		u32 drained;
+
+		spin_lock(&mag->lock);
+		drained = nvmap_pp_mag_flush_dirty_locked(pool, mag);
+		spin_unlock(&mag->lock);
+		pp_mag_drain_add(pool, drained);
+	}
+
+	ret = min(nr - ind, nvmap_pp_free_slots(pool));
 
 	for (i = 0; i < ret; i++) {
+		struct page *page = pages[ind + i];
+
 		/* If page has additonal referecnces, Don't add it into
 		 * page pool. get_user_pages() on mmap'ed nvmap handle can
 		 * hold a refcount on the page. These pages can't be
 		 * reused till the additional refs are dropped.
 		 */
-		if (page_count(pages[i]) > 1) {
-			__free_page(pages[i]);
+		if (page_count(page) > 1) {
+			__free_page(page);
 		} else {
-			list_add_tail(&pages[i]->lru, &pool->zero_list);
+			list_add_tail(&page->lru, &pool->zero_list);
 			pool->to_zero++;
 		}
 	}
 
 	if (pool->to_zero)
 		wake_up_interruptible(&nvmap_bg_wait);
-	ret = i;
+	ret = ind + i;
 
 	trace_nvmap_pp_fill_zero_lots(save_to_zero, pool->to_zero,
 			ret, nr);
@@ -452,6 +756,104 @@ int nvmap_page_pool_fill_lots(struct nvmap_page_pool *pool,
 	return ret;
 }
 
+/*
+ * Switch the zeroed pages between page_list and the per-color bins. A
+ * @nr_colors of 0 or 1 turns the bins off.
+ */
+void nvmap_page_pool_set_colors(struct nvmap_page_pool *pool, u32 nr_colors)
+{
+	struct page *page, *tmp;
+	LIST_HEAD(pages);
+	u32 c;
+
+	if (nr_colors <= 1)
+		nr_colors = 0;
+	nr_colors = min_t(u32, nr_colors, NVMAP_MAX_COLORS);
+	if (READ_ONCE(pool->nr_colors) == nr_colors)
+		return;
+
+	rt_mutex_lock(&pool->lock);
+	list_splice_init(&pool->page_list, &pages);
+	for (c = 0; c < pool->nr_colors; c++) {
+		list_splice_init(&pool->color_list[c], &pages);
+		pool->color_count[c] = 0;
+	}
+
+	WRITE_ONCE(pool->nr_colors, nr_colors);
+	pool->color_next = 0;
+	list_for_each_entry_safe(page, tmp, &pages, lru) {
+		list_del(&page->lru);
+		nvmap_pp_add_clean_page_locked(pool, page);
+	}
+	rt_mutex_unlock(&pool->lock);
+}
+
+/*
+ * Fill @pages from the color bins so that page i gets the color of virtual
+ * page @first + i, falling back to the next non-empty color round-robin.
+ * Returns the number of pages placed; the pages are zeroed and clean.
+ */
+u32 nvmap_page_pool_alloc_colored(struct nvmap_page_pool *pool,
+				  struct page **pages, u32 nr, u32 first)
+{
+	u32 ind = 0;
+
+	if (!enable_pp || !nr || !READ_ONCE(pool->nr_colors))
+		return 0;
+
+	rt_mutex_lock(&pool->lock);
+	while (ind < nr && pool->nr_colors) {
+		phys_addr_t va = (phys_addr_t)(first + ind) << PAGE_SHIFT;
+		struct page *page;
+
+		page = nvmap_pp_pop_color_locked(pool,
+						 nvmap_pp_color(pool, va));
+		if (!page)
+			break;
+		pages[ind++] = page;
+	}
+	pool->count -= ind;
+	rt_mutex_unlock(&pool->lock);
+
+	pp_alloc_add(pool, ind);
+	pp_hit_add(pool, ind);
+	pp_miss_add(pool, nr - ind);
+	nvmap_stats_inc(NS_PP_HITS, ind);
+	nvmap_stats_inc(NS_PP_MISSES, nr - ind);
+
+	return ind;
+}
+
+/*
+ * Put @nr freshly allocated, zeroed and clean pages through the color bins
+ * and hand back as many in color order for virtual pages @first onwards.
+ * The pool size does not change, so this works whether or not the pool
+ * has room.
+ */
+void nvmap_page_pool_color_pages(struct nvmap_page_pool *pool,
+				 struct page **pages, u32 nr, u32 first)
+{
+	u32 i;
+
+	rt_mutex_lock(&pool->lock);
+	if (!pool->nr_colors)
+		goto out;
+
+	for (i = 0; i < nr; i++)
+		nvmap_pp_add_clean_page_locked(pool, pages[i]);
+
+	for (i = 0; i < nr; i++) {
+		phys_addr_t va = (phys_addr_t)(first + i) << PAGE_SHIFT;
+
+		pages[i] = nvmap_pp_pop_color_locked(pool,
+						     nvmap_pp_color(pool, va));
+		/* at least the nr pages just binned are available */
+		BUG_ON(!pages[i]);
+	}
+out:
+	rt_mutex_unlock(&pool->lock);
+}
+
 ulong nvmap_page_pool_get_unused_pages(void)
 {
 	int total = 0;
@@ -459,7 +861,8 @@ ulong nvmap_page_pool_get_unused_pages(void)
 	if (!nvmap_dev)
 		return 0;
 
-	total = nvmap_dev->pool.count + nvmap_dev->pool.to_zero;
+	total = nvmap_dev->pool.count + nvmap_dev->pool.to_zero +
+		atomic_read(&nvmap_dev->pool.mag_count);
 
 	return total;
 }
@@ -474,6 +877,7 @@ int nvmap_page_pool_clear(void)
 
 	rt_mutex_lock(&pool->lock);
 
+	nvmap_pp_drain_magazines_locked(pool);
 	(void)nvmap_page_pool_free_pages_locked(pool, pool->count + pool->to_zero);
 
 	/* For some reason, if an error occured... */
@@ -498,6 +902,7 @@ static void nvmap_page_pool_resize(struct nvmap_page_pool *pool, u32 size)
 
 	rt_mutex_lock(&pool->lock);
 
+	nvmap_pp_drain_magazines_locked(pool);
 	curr = nvmap_page_pool_get_unused_pages();
 	if (curr > size)
 		(void)nvmap_page_pool_free_pages_locked(pool, curr - size);
@@ -522,6 +927,7 @@ static unsigned long nvmap_page_pool_scan_objects(struct shrinker *shrinker,
 	pr_debug("sh_pages=%lu", sc->nr_to_scan);
 
 	rt_mutex_lock(&nvmap_dev->pool.lock);
+	nvmap_pp_drain_magazines_locked(&nvmap_dev->pool);
 	remaining = nvmap_page_pool_free_pages_locked(
 			&nvmap_dev->pool, sc->nr_to_scan);
 	rt_mutex_unlock(&nvmap_dev->pool.lock);
@@ -585,6 +991,115 @@ static struct kernel_param_ops shrink_ops = {
 module_param_cb(shrink_page_pools, &shrink_ops, &shrink_pp, 0644);
 #endif
 
+#if NVMAP_TEST_PAGE_POOL_MAGAZINES
+/*
+ * Allocation storm test: writing N to stress_page_pools runs 1..N threads
+ * that repeatedly allocate and free small batches of pages through the page
+ * pool, once with the per-CPU magazines and once without, and reports the
+ * achieved allocation rate for each configuration.
+ */
+#define PP_STRESS_BATCH                   4
+#define PP_STRESS_MSECS                   1000
+
+static int stress_pp;
+static atomic64_t pp_stress_pages;
+
+static int nvmap_pp_stress_thread(void *arg)
+{
+	struct nvmap_page_pool *pool = &nvmap_dev->pool;
+	struct page *pages[PP_STRESS_BATCH];
+	u64 nr_pages = 0;
+
+	while (!kthread_should_stop()) {
+		int got, filled, i;
+
+		got = nvmap_page_pool_alloc_lots(pool, pages, PP_STRESS_BATCH);
+		for (i = got; i < PP_STRESS_BATCH; i++) {
+			pages[i] = alloc_page(GFP_NVMAP | __GFP_ZERO);
+			if (!pages[i])
+				break;
+		}
+
+		filled = nvmap_page_pool_fill_lots(pool, pages, i);
+		for (; filled < i; filled++)
+			__free_page(pages[filled]);
+
+		nr_pages += i;
+		cond_resched();
+	}
+
+	atomic64_add(nr_pages, &pp_stress_pages);
+	return 0;
+}
+
+static u64 nvmap_pp_stress_run(int nr_threads)
+{
+	struct task_struct **threads;
+	int i, started = 0;
+
+	threads = kcalloc(nr_threads, sizeof(*threads), GFP_KERNEL);
+	if (!threads)
+		return 0;
+
+	atomic64_set(&pp_stress_pages, 0);
+	for (i = 0; i < nr_threads; i++) {
+		threads[i] = kthread_run(nvmap_pp_stress_thread, NULL,
+					 "nvmap-pp-stress/%d", i);
+		if (IS_ERR(threads[i]))
+			break;
+		started++;
+	}
+
+	msleep(PP_STRESS_MSECS);
+
+	for (i = 0; i < started; i++)
+		kthread_stop(threads[i]);
+	kfree(threads);
+
+	return atomic64_read(&pp_stress_pages) * MSEC_PER_SEC / PP_STRESS_MSECS;
+}
+
+static int stress_set(const char *arg, const struct kernel_param *kp)
+{
+	bool save_mags = enable_pp_mags;
+	int ret, nr_threads;
+
+	ret = param_set_int(arg, kp);
+	if (ret)
+		return ret;
+
+	for (nr_threads = 1; nr_threads <= stress_pp; nr_threads++) {
+		u64 with_mags, without_mags;
+
+		enable_pp_mags = true;
+		with_mags = nvmap_pp_stress_run(nr_threads);
+
+		enable_pp_mags = false;
+		nvmap_page_pool_clear();
+		without_mags = nvmap_pp_stress_run(nr_threads);
+
+		pr_info("threads=%d magazines=%llu pages/s global=%llu pages/s\n",
+			nr_threads, with_mags, without_mags);
+	}
+
+	enable_pp_mags = save_mags;
+	stress_pp = 0;
+	return 0;
+}
+
+static int stress_get(char *buff, const struct kernel_param *kp)
+{
+	return param_get_int(buff, kp);
+}
+
+static struct kernel_param_ops stress_ops = {
+	.get = stress_get,
+	.set = stress_set,
+};
+
+module_param_cb(stress_page_pools, &stress_ops, &stress_pp, 0644);
+#endif
+
 static int enable_pp_set(const char *arg, const struct kernel_param *kp)
 {
 	int ret;
@@ -610,6 +1125,7 @@ static struct kernel_param_ops enable_pp_ops = {
 };
 
 module_param_cb(enable_page_pools, &enable_pp_ops, &enable_pp, 0644);
+module_param_named(enable_page_pool_magazines, enable_pp_mags, bool, 0644);
 
 static int pool_size_set(const char *arg, const struct kernel_param *kp)
 {
@@ -632,6 +1148,68 @@ static struct kernel_param_ops pool_size_ops = {
 };
 
 module_param_cb(pool_size, &pool_size_ops, &pool_size, 0644);
+module_param(zero_batch, uint, 0644);
+
+static int zero_rate_show(struct seq_file *s, void *unused)
+{
+	u64 bytes = atomic64_read(&bg_zero_bytes);
+	u64 ns = atomic64_read(&bg_zero_ns);
+
+	seq_printf(s, "threads: %d\n", nr_zero_workers);
+	seq_printf(s, "bytes: %llu\n", bytes);
+	seq_printf(s, "busy_ns: %llu\n", ns);
+	/* bytes per ns is GB/s; print it in MB/s to keep some precision */
+	seq_printf(s, "MB/s per thread: %llu\n",
+		   ns ? div64_u64(bytes * 1000, ns) : 0);
+	return 0;
+}
+
+static int zero_rate_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, zero_rate_show, inode->i_private);
+}
+
+static const struct file_operations zero_rate_fops = {
+	.open		= zero_rate_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int colors_show(struct seq_file *s, void *unused)
+{
+	struct nvmap_page_pool *pool = &nvmap_dev->pool;
+	u32 c;
+
+	rt_mutex_lock(&pool->lock);
+	seq_printf(s, "colors: %u\n", pool->nr_colors);
+	for (c = 0; c < pool->nr_colors; c++)
+		seq_printf(s, "color %2u: %u\n", c, pool->color_count[c]);
+	rt_mutex_unlock(&pool->lock);
+	return 0;
+}
+
+static int colors_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, colors_show, inode->i_private);
+}
+
+static const struct file_operations colors_fops = {
+	.open		= colors_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+#ifdef CONFIG_NVMAP_PAGE_POOL_DEBUG
+static int pp_dbg_var_get(void *data, u64 *val)
+{
+	*val = atomic64_read((atomic64_t *)data);
+	return 0;
+}
+
+DEFINE_SIMPLE_ATTRIBUTE(pp_dbg_var_fops, pp_dbg_var_get, NULL, "%llu\n");
+#endif
 
 int nvmap_page_pool_debugfs_init(struct dentry *nvmap_root)
 {
@@ -650,6 +1228,9 @@ int nvmap_page_pool_debugfs_init(struct dentry *nvmap_root)
 	debugfs_create_u32("page_pool_pages_to_zero",
 			   S_IRUGO, pp_root,
 			   &nvmap_dev->pool.to_zero);
+	debugfs_create_atomic_t("page_pool_magazine_pages",
+			   S_IRUGO, pp_root,
+			   &nvmap_dev->pool.mag_count);
 	debugfs_create_u32("page_pool_available_big_pages",
 			   S_IRUGO, pp_root,
 			   &nvmap_dev->pool.big_page_count);
@@ -662,20 +1243,35 @@ int nvmap_page_pool_debugfs_init(struct dentry *nvmap_root)
 	debugfs_create_u64("total_page_allocs",
 			   S_IRUGO, pp_root,
 			   &nvmap_total_page_allocs);
+	debugfs_create_file("page_pool_zero_rate",
+			   S_IRUGO, pp_root, NULL,
+			   &zero_rate_fops);
+	debugfs_create_file("page_pool_colors",
+			   S_IRUGO, pp_root, NULL,
+			   &colors_fops);
 
 #ifdef CONFIG_NVMAP_PAGE_POOL_DEBUG
-	debugfs_create_u64("page_pool_allocs",
-			   S_IRUGO, pp_root,
-			   &nvmap_dev->pool.allocs);
-	debugfs_create_u64("page_pool_fills",
-			   S_IRUGO, pp_root,
-			   &nvmap_dev->pool.fills);
-	debugfs_create_u64("page_pool_hits",
-			   S_IRUGO, pp_root,
-			   &nvmap_dev->pool.hits);
-	debugfs_create_u64("page_pool_misses",
-			   S_IRUGO, pp_root,
-			   &nvmap_dev->pool.misses);
+	debugfs_create_file("page_pool_allocs",
+			   S_IRUGO, pp_root, &nvmap_dev->pool.allocs,
+			   &pp_dbg_var_fops);
+	debugfs_create_file("page_pool_fills",
+			   S_IRUGO, pp_root, &nvmap_dev->pool.fills,
+			   &pp_dbg_var_fops);
+	debugfs_create_file("page_pool_hits",
+			   S_IRUGO, pp_root, &nvmap_dev->pool.hits,
+			   &pp_dbg_var_fops);
+	debugfs_create_file("page_pool_misses",
+			   S_IRUGO, pp_root, &nvmap_dev->pool.misses,
+			   &pp_dbg_var_fops);
+	debugfs_create_file("page_pool_magazine_hits",
+			   S_IRUGO, pp_root, &nvmap_dev->pool.mag_hits,
+			   &pp_dbg_var_fops);
+	debugfs_create_file("page_pool_magazine_refills",
+			   S_IRUGO, pp_root, &nvmap_dev->pool.mag_refills,
+			   &pp_dbg_var_fops);
+	debugfs_create_file("page_pool_magazine_drains",
+			   S_IRUGO, pp_root, &nvmap_dev->pool.mag_drains,
+			   &pp_dbg_var_fops);
 #endif
 
 	return 0;
@@ -685,12 +1281,21 @@ int nvmap_page_pool_init(struct nvmap_device *dev)
 {
 	struct sysinfo info;
 	struct nvmap_page_pool *pool = &dev->pool;
+	int cpu, i;
 
 	memset(pool, 0x0, sizeof(*pool));
 	rt_mutex_init(&pool->lock);
 	INIT_LIST_HEAD(&pool->page_list);
 	INIT_LIST_HEAD(&pool->zero_list);
 	INIT_LIST_HEAD(&pool->page_list_bp);
+	for (i = 0; i < NVMAP_MAX_COLORS; i++)
+		INIT_LIST_HEAD(&pool->color_list[i]);
+
+	pool->mags = alloc_percpu(struct nvmap_pp_magazine);
+	if (!pool->mags)
+		goto fail;
+	for_each_possible_cpu(cpu)
+		spin_lock_init(&per_cpu_ptr(pool->mags, cpu)->lock);
 
 	pool->big_pg_sz = NVMAP_PP_BIG_PAGE_SIZE;
 	pool->pages_per_big_pg = NVMAP_PP_BIG_PAGE_SIZE >> PAGE_SHIFT;
@@ -712,9 +1317,35 @@ int nvmap_page_pool_init(struct nvmap_device *dev)
 	pr_info("nvmap page pool size: %u pages (%u MB)\n", pool->max,
 		(pool->max * info.mem_unit) >> 20);
 
-	background_allocator = kthread_run(nvmap_background_zero_thread,
-					    NULL, "nvmap-bz");
-	if (IS_ERR(background_allocator))
+	nr_zero_workers = num_online_cpus();
+	zero_workers = vzalloc(nr_zero_workers * sizeof(*zero_workers));
+	if (!zero_workers)
+		goto fail;
+
+	/*
+	 * Pin one worker to each online CPU. A worker whose CPU goes offline
+	 * is moved elsewhere by the scheduler and keeps running there.
+	 */
+	i = 0;
+	for_each_online_cpu(cpu) {
+		struct task_struct *task;
+
+		if (i == nr_zero_workers)
+			break;
+
+		task = kthread_create_on_node(nvmap_background_zero_thread,
+					      &zero_workers[i],
+					      cpu_to_node(cpu),
+					      "nvmap-bz/%d", cpu);
+		if (IS_ERR(task))
+			break;
+		set_cpus_allowed_ptr(task, cpumask_of(cpu));
+		zero_workers[i].task = task;
+		wake_up_process(task);
+		i++;
+	}
+	nr_zero_workers = i;
+	if (!nr_zero_workers)
 		goto fail;
 
 	register_shrinker(&nvmap_page_pool_shrinker);
@@ -734,9 +1365,23 @@ int nvmap_page_pool_fini(struct nvmap_device *dev)
 	 * properly initialized, then shrinker is also not
 	 * registered
 	 */
-	if (!IS_ERR_OR_NULL(background_allocator)) {
+	if (nr_zero_workers) {
+		int i;
+
 		unregister_shrinker(&nvmap_page_pool_shrinker);
-		kthread_stop(background_allocator);
+		for (i = 0; i < nr_zero_workers; i++)
+			kthread_stop(zero_workers[i].task);
+		nr_zero_workers = 0;
+	}
+	vfree(zero_workers);
+	zero_workers = NULL;
+
+	if (pool->mags) {
+		rt_mutex_lock(&pool->lock);
+		nvmap_pp_drain_magazines_locked(pool);
+		rt_mutex_unlock(&pool->lock);
+		free_percpu(pool->mags);
+		pool->mags = NULL;
 	}
 
 	WARN_ON(!list_empty(&pool->page_list));
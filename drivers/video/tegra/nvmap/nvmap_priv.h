@@ -23,6 +23,7 @@
 #include <linux/mutex.h>
 #include <linux/rtmutex.h>
 #include <linux/rbtree.h>
+#include <linux/rhashtable.h>
 #include <linux/sched.h>
 #include <linux/wait.h>
 #include <linux/atomic.h>
@@ -131,6 +132,9 @@ struct nvmap_pgalloc {
 	bool contig;			/* contiguous system memory */
 	atomic_t reserved;
 	atomic_t ndirty;	/* count number of dirty pages */
+	bool lazy;		/* pages are populated on first access */
+	u32 nr_populated;	/* pages backed so far, while lazy */
+	u32 nr_mapcount;	/* user mappings holding page _mapcount */
 };
 
 /* bit 31-29: IVM peer
@@ -157,6 +161,8 @@ struct nvmap_handle_dmabuf_priv {
 
 struct nvmap_handle {
 	struct rb_node node;	/* entry on global handle tree */
+	struct rhash_head id_node; /* entry on global handle id table */
+	struct rcu_head rcu;	/* handle is freed after an RCU grace period */
 	atomic_t ref;		/* reference count (i.e., # of duplications) */
 	atomic_t pin;		/* pin count */
 	u32 flags;		/* caching flags */
@@ -184,6 +190,8 @@ struct nvmap_handle {
 	struct list_head dmabuf_priv;
 	u64 ivm_id;
 	int peer;		/* Peer VM number */
+	struct nvmap_handle *parent;	/* handle a view is carved from */
+	size_t view_offset;	/* byte offset of a view into its parent */
 };
 
 struct nvmap_handle_info {
@@ -219,8 +227,29 @@ struct nvmap_handle_ref {
 
 #define NVMAP_PP_BIG_PAGE_SIZE           (0x10000)
 
+#define NVMAP_MAX_COLORS                 (16)
+
+/*
+ * Per-CPU magazines sit in front of the global page pool lists. Small
+ * allocations and frees are served from the local magazine; the magazine is
+ * refilled from page_list and drained into zero_list a batch at a time so
+ * that most callers never take pool->lock.
+ */
+#define NVMAP_PP_MAG_SIZE                (64)
+#define NVMAP_PP_MAG_BATCH               (NVMAP_PP_MAG_SIZE / 2)
+
+struct nvmap_pp_magazine {
+	spinlock_t lock;
+	u32 nr_clean;   /* Zeroed pages ready for allocation. */
+	u32 nr_dirty;   /* Freed pages waiting to be moved to zero_list. */
+	struct page *clean[NVMAP_PP_MAG_SIZE];
+	struct page *dirty[NVMAP_PP_MAG_SIZE];
+};
+
 struct nvmap_page_pool {
 	struct rt_mutex lock;
+	struct nvmap_pp_magazine __percpu *mags;
+	atomic_t mag_count; /* Number of pages held in the magazines. */
 	u32 count;      /* Number of pages in the page & dirty list. */
 	u32 max;        /* Max no. of pages in all lists. */
 	u32 to_zero;    /* Number of pages on the zero list */
@@ -232,11 +261,24 @@ struct nvmap_page_pool {
 	struct list_head zero_list;
 	struct list_head page_list_bp;
 
+	/*
+	 * With page coloring, zeroed pages live in per-color bins instead of
+	 * page_list. Binned pages are counted in count.
+	 */
+	u32 nr_colors;	/* 0 when the bins are not in use */
+	u32 color_next;	/* round-robin cursor for uncolored allocs */
+	struct list_head color_list[NVMAP_MAX_COLORS];
+	u32 color_count[NVMAP_MAX_COLORS];
+
 #ifdef CONFIG_NVMAP_PAGE_POOL_DEBUG
-	u64 allocs;
-	u64 fills;
-	u64 hits;
-	u64 misses;
+	/* bumped outside the pool lock by the magazine fast paths */
+	atomic64_t allocs;
+	atomic64_t fills;
+	atomic64_t hits;
+	atomic64_t misses;
+	atomic64_t mag_hits;
+	atomic64_t mag_refills;
+	atomic64_t mag_drains;
 #endif
 };
 
@@ -249,6 +291,11 @@ int nvmap_page_pool_alloc_lots_bp(struct nvmap_page_pool *pool,
 					struct page **pages, u32 nr);
 int nvmap_page_pool_fill_lots(struct nvmap_page_pool *pool,
 				       struct page **pages, u32 nr);
+void nvmap_page_pool_set_colors(struct nvmap_page_pool *pool, u32 nr_colors);
+u32 nvmap_page_pool_alloc_colored(struct nvmap_page_pool *pool,
+				  struct page **pages, u32 nr, u32 first);
+void nvmap_page_pool_color_pages(struct nvmap_page_pool *pool,
+				 struct page **pages, u32 nr, u32 first);
 int nvmap_page_pool_clear(void);
 int nvmap_page_pool_debugfs_init(struct dentry *nvmap_root);
 #endif
@@ -277,6 +324,7 @@ struct nvmap_vma_priv {
 
 struct nvmap_device {
 	struct rb_root	handles;
+	struct rhashtable handle_ids; /* RCU protected handle lookup */
 	spinlock_t	handle_lock;
 	struct miscdevice dev_user;
 	struct nvmap_carveout_node *heaps;
@@ -379,6 +427,8 @@ struct nvmap_handle_ref *__nvmap_validate_locked(struct nvmap_client *priv,
 						 struct nvmap_handle *h);
 
 struct nvmap_handle *nvmap_validate_get(struct nvmap_handle *h);
+int nvmap_handle_ids_init(struct nvmap_device *dev);
+void nvmap_handle_ids_destroy(struct nvmap_device *dev);
 
 struct nvmap_handle_ref *nvmap_create_handle(struct nvmap_client *client,
 					     size_t size);
@@ -411,13 +461,20 @@ int nvmap_alloc_handle_from_va(struct nvmap_client *client,
 			       ulong addr,
 			       unsigned int flags);
 
+struct nvmap_handle_ref *nvmap_create_view(struct nvmap_client *client,
+					   struct nvmap_handle *parent,
+					   u64 offset, u64 size);
+
+int __nvmap_handle_populate(struct nvmap_handle *h,
+			    u32 start_page, u32 nr);
+
 void nvmap_free_handle(struct nvmap_client *c, struct nvmap_handle *h);
 
 void nvmap_free_handle_fd(struct nvmap_client *c, int fd);
 
 int nvmap_handle_remove(struct nvmap_device *dev, struct nvmap_handle *h);
 
-void nvmap_handle_add(struct nvmap_device *dev, struct nvmap_handle *h);
+int nvmap_handle_add(struct nvmap_device *dev, struct nvmap_handle *h);
 
 int is_nvmap_vma(struct vm_area_struct *vma);
 
@@ -453,6 +510,7 @@ extern void (*inner_flush_cache_all)(void);
 extern void (*inner_clean_cache_all)(void);
 void nvmap_override_cache_ops(void);
 void nvmap_clean_cache(struct page **pages, int numpages);
+u32 addr_to_color_t19x(uintptr_t phys);
 void nvmap_clean_cache_page(struct page *page);
 void nvmap_flush_cache(struct page **pages, int numpages);
 int nvmap_cache_maint_phys_range(unsigned int op, phys_addr_t pstart,
@@ -464,6 +522,15 @@ int __nvmap_cache_maint(struct nvmap_client *client,
 			       struct nvmap_cache_op_64 *op);
 int nvmap_cache_debugfs_init(struct dentry *nvmap_root);
 
+#ifdef CONFIG_NVMAP_ALLOC_REPLAY
+int nvmap_replay_debugfs_init(struct dentry *nvmap_root);
+#else
+static inline int nvmap_replay_debugfs_init(struct dentry *nvmap_root)
+{
+	return 0;
+}
+#endif
+
 /* Internal API to support dmabuf */
 struct dma_buf *__nvmap_dmabuf_export(struct nvmap_client *client,
 				 struct nvmap_handle *handle);
@@ -483,6 +550,7 @@ int __nvmap_do_cache_maint(struct nvmap_client *client, struct nvmap_handle *h,
 			   unsigned int op, bool clean_only_dirty);
 struct nvmap_client *__nvmap_create_client(struct nvmap_device *dev,
 					   const char *name);
+void nvmap_client_put(struct nvmap_client *client);
 int __nvmap_dmabuf_fd(struct nvmap_client *client,
 		      struct dma_buf *dmabuf, int flags);
 
@@ -539,8 +607,12 @@ static inline int nvmap_handle_mk(struct nvmap_handle *h,
 		(offset < h->size) &&
 		(size <= h->size) &&
 		(offset <= (h->size - size))) {
-		for (i = start_page; i < end_page; i++)
+		for (i = start_page; i < end_page; i++) {
+			/* unpopulated pages of lazy handles are clean */
+			if (!h->pgalloc.pages[i])
+				continue;
 			nchanged += fn(&h->pgalloc.pages[i]) ? 1 : 0;
+		}
 	}
 	if (!locked)
 		mutex_unlock(&h->lock);
@@ -591,6 +663,24 @@ static inline struct page **nvmap_pages(struct page **pg_pages, u32 nr_pages)
 	return pages;
 }
 
+/* back pages of a lazily allocated handle before they are accessed */
+static inline int nvmap_handle_populate(struct nvmap_handle *h,
+					u32 start_page, u32 nr)
+{
+	if (!h->heap_pgalloc)
+		return 0;
+	if (!READ_ONCE(h->pgalloc.lazy)) {
+		smp_rmb();	/* pairs with __nvmap_handle_populate() */
+		return 0;
+	}
+	return __nvmap_handle_populate(h, start_page, nr);
+}
+
+static inline int nvmap_handle_populate_all(struct nvmap_handle *h)
+{
+	return nvmap_handle_populate(h, 0, h->size >> PAGE_SHIFT);
+}
+
 void nvmap_zap_handle(struct nvmap_handle *handle, u64 offset, u64 size);
 
 void nvmap_vma_open(struct vm_area_struct *vma);
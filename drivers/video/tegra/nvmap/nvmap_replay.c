@@ -0,0 +1,724 @@
+/*
+ * drivers/video/tegra/nvmap/nvmap_replay.c
+ *
+ * Allocation trace capture and replay
+ *
+ * Traces captured here can also be replayed off-target, against a model
+ * of the page pool, with tools/nvmap/nvmap-replay.
+ *
+ * Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ */
+
+#define pr_fmt(fmt) "nvmap: replay: " fmt
+
+#include <linux/debugfs.h>
+#include <linux/hashtable.h>
+#include <linux/idr.h>
+#include <linux/log2.h>
+#include <linux/seq_file.h>
+#include <linux/uaccess.h>
+#include <linux/version.h>
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 14, 0)
+#include <linux/sched/clock.h>
+#endif
+
+#include <trace/events/nvmap.h>
+#include <uapi/linux/nvmap_replay.h>
+
+#include "nvmap_priv.h"
+
+/*
+ * Replay latencies are kept in a log-linear histogram: values below
+ * 2^NVMAP_REPLAY_HIST_SUB_BITS ns have a bucket each, larger ones are split
+ * into 2^NVMAP_REPLAY_HIST_SUB_BITS buckets per power of two, so percentiles
+ * are within 1/16th of the true value whatever the trace length.
+ */
+#define NVMAP_REPLAY_HIST_SUB_BITS	4
+#define NVMAP_REPLAY_HIST_SUB		(1U << NVMAP_REPLAY_HIST_SUB_BITS)
+#define NVMAP_REPLAY_HIST_BUCKETS \
+	((32 - NVMAP_REPLAY_HIST_SUB_BITS + 1) << NVMAP_REPLAY_HIST_SUB_BITS)
+
+struct nvmap_replay_lat {
+	u32 hist[NVMAP_REPLAY_HIST_BUCKETS];
+	u32 max;
+	u64 nr;
+	u64 sum;
+};
+
+struct nvmap_replay_result {
+	struct nvmap_replay_lat lat[NVMAP_TRACE_NR_TYPES];
+	u32 nr_runs;
+	u32 alloc_failed;
+	u32 unmatched;
+	u32 invalid;
+	u64 stats[NS_NUM];
+	bool valid;
+};
+
+struct nvmap_replay_live {
+	struct hlist_node node;
+	u32 id;
+	struct nvmap_handle *h;
+};
+
+/* live handle to trace id, while capturing; under capture_lock */
+struct nvmap_trace_id {
+	struct hlist_node node;
+	const void *h;
+	u32 id;
+};
+
+static DEFINE_MUTEX(replay_lock);	/* capture control, trace and result */
+static DEFINE_SPINLOCK(capture_lock);	/* record append from the probes */
+static DEFINE_HASHTABLE(capture_ids, 10);
+static DEFINE_IDR(capture_idr);
+
+static struct nvmap_trace_rec *trace_recs;
+static u32 trace_nr_recs;
+static u32 trace_max_recs;
+static u32 trace_dropped;
+static size_t trace_loaded;		/* bytes written into a loaded trace */
+static bool capturing;
+static u64 capture_last_ns;
+
+static u32 capture_records = SZ_64K;
+static bool replay_native_heaps;
+static struct nvmap_replay_result result;
+
+static const char * const nvmap_trace_names[NVMAP_TRACE_NR_TYPES] = {
+	[NVMAP_TRACE_ALLOC] = "alloc",
+	[NVMAP_TRACE_FREE] = "free",
+	[NVMAP_TRACE_CACHE] = "cache",
+};
+
+/*
+ * Returns the trace id of h, handing out a new one for an allocation and
+ * releasing it on free. Called with capture_lock held.
+ */
+static u32 nvmap_trace_id(u8 type, const void *h)
+{
+	struct nvmap_trace_id *t;
+	int id;
+
+	hash_for_each_possible(capture_ids, t, node, (unsigned long)h) {
+		if (t->h != h)
+			continue;
+		id = t->id;
+		if (type == NVMAP_TRACE_FREE) {
+			hash_del(&t->node);
+			idr_remove(&capture_idr, id);
+			kfree(t);
+		}
+		return id;
+	}
+
+	if (type != NVMAP_TRACE_ALLOC)
+		return 0;
+
+	t = kmalloc(sizeof(*t), GFP_ATOMIC);
+	if (!t)
+		return 0;
+	id = idr_alloc(&capture_idr, t, 1, 0, GFP_ATOMIC);
+	if (id < 0) {
+		kfree(t);
+		return 0;
+	}
+	t->h = h;
+	t->id = id;
+	hash_add(capture_ids, &t->node, (unsigned long)h);
+	return id;
+}
+
+static void nvmap_trace_free_ids(void)
+{
+	struct nvmap_trace_id *t;
+	struct hlist_node *tmp;
+	int bkt;
+
+	hash_for_each_safe(capture_ids, bkt, tmp, t, node) {
+		hash_del(&t->node);
+		kfree(t);
+	}
+	idr_destroy(&capture_idr);
+}
+
+static void nvmap_trace_add(u8 type, u8 op, u16 flags, const void *h,
+			    u32 arg0, u32 arg1)
+{
+	struct nvmap_trace_rec *r;
+	unsigned long irqflags;
+	u64 now = local_clock();
+
+	spin_lock_irqsave(&capture_lock, irqflags);
+	if (!capturing)
+		goto unlock;
+	if (trace_nr_recs == trace_max_recs) {
+		trace_dropped++;
+		goto unlock;
+	}
+
+	r = &trace_recs[trace_nr_recs++];
+	r->type = type;
+	r->op = op;
+	r->flags = cpu_to_le16(flags);
+	r->delta_us = cpu_to_le32(min_t(u64, U32_MAX,
+			div_u64(now - capture_last_ns, NSEC_PER_USEC)));
+	r->id = cpu_to_le32(nvmap_trace_id(type, h));
+	r->arg0 = cpu_to_le32(arg0);
+	r->arg1 = cpu_to_le32(arg1);
+	capture_last_ns = now;
+unlock:
+	spin_unlock_irqrestore(&capture_lock, irqflags);
+}
+
+static void nvmap_trace_probe_alloc(void *data, struct nvmap_client *client,
+				    struct nvmap_handle *h, size_t size,
+				    u32 heap_mask, u32 align, u32 flags,
+				    u64 total, u64 alloc)
+{
+	nvmap_trace_add(NVMAP_TRACE_ALLOC,
+			align > 1 ? order_base_2(align) : 0, flags & 0xFFFF,
+			h, heap_mask, size >> PAGE_SHIFT);
+}
+
+static void nvmap_trace_probe_destroy(void *data, struct nvmap_client *client,
+				      pid_t pid, u32 dupes,
+				      struct nvmap_handle *h, u32 share,
+				      u64 base, size_t size, u32 flags,
+				      u32 tag, const char *tag_name)
+{
+	nvmap_trace_add(NVMAP_TRACE_FREE, 0, 0, h, 0, 0);
+}
+
+static void nvmap_trace_probe_cache(void *data, struct nvmap_client *client,
+				    struct nvmap_handle *h, ulong start,
+				    ulong end, u32 op, size_t size)
+{
+	nvmap_trace_add(NVMAP_TRACE_CACHE, op, 0, h, start, end - start);
+}
+
+static void nvmap_trace_free_recs(void)
+{
+	vfree(trace_recs);
+	trace_recs = NULL;
+	trace_nr_recs = 0;
+	trace_max_recs = 0;
+	trace_dropped = 0;
+	trace_loaded = 0;
+}
+
+static int nvmap_trace_alloc_recs(u32 nr)
+{
+	nvmap_trace_free_recs();
+	if (!nr)
+		return -EINVAL;
+	trace_recs = vmalloc((size_t)nr * sizeof(*trace_recs));
+	if (!trace_recs)
+		return -ENOMEM;
+	trace_max_recs = nr;
+	return 0;
+}
+
+static int nvmap_trace_start(void)
+{
+	int err;
+
+	err = nvmap_trace_alloc_recs(capture_records);
+	if (err)
+		return err;
+
+	capture_last_ns = local_clock();
+	spin_lock_irq(&capture_lock);
+	capturing = true;
+	spin_unlock_irq(&capture_lock);
+
+	err = register_trace_nvmap_alloc_handle(nvmap_trace_probe_alloc, NULL);
+	if (err)
+		goto fail;
+	err = register_trace_nvmap_destroy_handle(nvmap_trace_probe_destroy,
+						  NULL);
+	if (err)
+		goto fail_destroy;
+	err = register_trace_nvmap_cache_maint(nvmap_trace_probe_cache, NULL);
+	if (err)
+		goto fail_cache;
+	return 0;
+
+fail_cache:
+	unregister_trace_nvmap_destroy_handle(nvmap_trace_probe_destroy, NULL);
+fail_destroy:
+	unregister_trace_nvmap_alloc_handle(nvmap_trace_probe_alloc, NULL);
+fail:
+	spin_lock_irq(&capture_lock);
+	capturing = false;
+	spin_unlock_irq(&capture_lock);
+	tracepoint_synchronize_unregister();
+	nvmap_trace_free_ids();
+	nvmap_trace_free_recs();
+	return err;
+}
+
+static void nvmap_trace_stop(void)
+{
+	unregister_trace_nvmap_cache_maint(nvmap_trace_probe_cache, NULL);
+	unregister_trace_nvmap_destroy_handle(nvmap_trace_probe_destroy, NULL);
+	unregister_trace_nvmap_alloc_handle(nvmap_trace_probe_alloc, NULL);
+	tracepoint_synchronize_unregister();
+
+	spin_lock_irq(&capture_lock);
+	capturing = false;
+	spin_unlock_irq(&capture_lock);
+
+	nvmap_trace_free_ids();
+}
+
+static int capture_get(void *data, u64 *val)
+{
+	*val = capturing;
+	return 0;
+}
+
+static int capture_set(void *data, u64 val)
+{
+	int err = 0;
+
+	mutex_lock(&replay_lock);
+	if (val && !capturing)
+		err = nvmap_trace_start();
+	else if (!val && capturing)
+		nvmap_trace_stop();
+	mutex_unlock(&replay_lock);
+	return err;
+}
+DEFINE_SIMPLE_ATTRIBUTE(capture_fops, capture_get, capture_set, "%llu\n");
+
+static void nvmap_trace_fill_hdr(struct nvmap_trace_hdr *hdr)
+{
+	hdr->magic = cpu_to_le32(NVMAP_TRACE_MAGIC);
+	hdr->version = cpu_to_le16(NVMAP_TRACE_VERSION);
+	hdr->rec_size = cpu_to_le16(sizeof(struct nvmap_trace_rec));
+	hdr->nr_recs = cpu_to_le32(trace_nr_recs);
+	hdr->dropped = cpu_to_le32(trace_dropped);
+	hdr->page_shift = cpu_to_le32(PAGE_SHIFT);
+}
+
+static ssize_t trace_read(struct file *file, char __user *buf,
+			  size_t count, loff_t *pos)
+{
+	struct nvmap_trace_hdr hdr;
+	ssize_t ret;
+	loff_t off;
+
+	mutex_lock(&replay_lock);
+	if (capturing) {
+		ret = -EBUSY;
+		goto out;
+	}
+
+	nvmap_trace_fill_hdr(&hdr);
+	if (*pos < sizeof(hdr)) {
+		ret = simple_read_from_buffer(buf, count, pos, &hdr,
+					      sizeof(hdr));
+		goto out;
+	}
+
+	off = *pos - sizeof(hdr);
+	ret = simple_read_from_buffer(buf, count, &off, trace_recs,
+			(size_t)trace_nr_recs * sizeof(*trace_recs));
+	if (ret > 0)
+		*pos += ret;
+out:
+	mutex_unlock(&replay_lock);
+	return ret;
+}
+
+/*
+ * Loads a trace, typically one read back from this file on another
+ * system. The header must arrive in the first write at offset 0.
+ */
+static ssize_t trace_write(struct file *file, const char __user *buf,
+			   size_t count, loff_t *pos)
+{
+	struct nvmap_trace_hdr hdr;
+	size_t total;
+	ssize_t ret = count;
+	u32 nr;
+
+	mutex_lock(&replay_lock);
+	if (capturing) {
+		ret = -EBUSY;
+		goto out;
+	}
+
+	if (*pos == 0) {
+		if (count < sizeof(hdr) ||
+		    copy_from_user(&hdr, buf, sizeof(hdr))) {
+			ret = -EINVAL;
+			goto out;
+		}
+		nr = le32_to_cpu(hdr.nr_recs);
+		if (le32_to_cpu(hdr.magic) != NVMAP_TRACE_MAGIC ||
+		    le16_to_cpu(hdr.version) != NVMAP_TRACE_VERSION ||
+		    le16_to_cpu(hdr.rec_size) != sizeof(*trace_recs) ||
+		    !nr) {
+			ret = -EINVAL;
+			goto out;
+		}
+		ret = nvmap_trace_alloc_recs(nr);
+		if (ret)
+			goto out;
+		trace_dropped = le32_to_cpu(hdr.dropped);
+		buf += sizeof(hdr);
+		count -= sizeof(hdr);
+		*pos = sizeof(hdr);
+		ret = sizeof(hdr);
+	} else if (*pos != sizeof(hdr) + trace_loaded || !trace_recs) {
+		ret = -EINVAL;
+		goto out;
+	} else {
+		ret = 0;
+	}
+
+	total = (size_t)trace_max_recs * sizeof(*trace_recs);
+	count = min(count, total - trace_loaded);
+	if (copy_from_user((u8 *)trace_recs + trace_loaded, buf, count)) {
+		ret = -EFAULT;
+		goto out;
+	}
+	trace_loaded += count;
+	trace_nr_recs = trace_loaded / sizeof(*trace_recs);
+	*pos += count;
+	ret += count;
+out:
+	mutex_unlock(&replay_lock);
+	return ret;
+}
+
+static const struct file_operations trace_fops = {
+	.open		= simple_open,
+	.read		= trace_read,
+	.write		= trace_write,
+	.llseek		= default_llseek,
+};
+
+/* handles live in the replay, keyed by trace id; under replay_lock */
+static DEFINE_HASHTABLE(replay_live, 10);
+
+static struct nvmap_handle *nvmap_replay_find(u32 id, bool remove)
+{
+	struct nvmap_replay_live *l;
+	struct nvmap_handle *h;
+
+	hash_for_each_possible(replay_live, l, node, id) {
+		if (l->id != id)
+			continue;
+		h = l->h;
+		if (remove) {
+			hash_del(&l->node);
+			kfree(l);
+		}
+		return h;
+	}
+	return NULL;
+}
+
+static u32 nvmap_replay_hist_idx(u32 ns)
+{
+	u32 shift;
+
+	if (ns < NVMAP_REPLAY_HIST_SUB)
+		return ns;
+	shift = fls(ns) - 1 - NVMAP_REPLAY_HIST_SUB_BITS;
+	return ((shift + 1) << NVMAP_REPLAY_HIST_SUB_BITS) +
+		((ns >> shift) & (NVMAP_REPLAY_HIST_SUB - 1));
+}
+
+/* smallest value falling into bucket idx */
+static u64 nvmap_replay_hist_base(u32 idx)
+{
+	u32 shift;
+
+	if (idx < NVMAP_REPLAY_HIST_SUB)
+		return idx;
+	shift = (idx >> NVMAP_REPLAY_HIST_SUB_BITS) - 1;
+	return (u64)(NVMAP_REPLAY_HIST_SUB +
+		     (idx & (NVMAP_REPLAY_HIST_SUB - 1))) << shift;
+}
+
+static void nvmap_replay_lat_add(struct nvmap_replay_lat *lat, u32 ns)
+{
+	lat->hist[nvmap_replay_hist_idx(ns)]++;
+	lat->nr++;
+	lat->sum += ns;
+	lat->max = max(lat->max, ns);
+}
+
+/* Runs the loaded trace once, back to back, through a kernel client. */
+static int nvmap_replay_run_once(struct nvmap_client *client)
+{
+	struct nvmap_replay_live *l;
+	struct hlist_node *tmp;
+	int bkt, err = 0;
+	u32 i;
+
+	for (i = 0; i < trace_nr_recs; i++) {
+		const struct nvmap_trace_rec *r = &trace_recs[i];
+		struct nvmap_handle_ref *ref;
+		struct nvmap_handle *h;
+		u32 id = le32_to_cpu(r->id);
+		u32 arg0 = le32_to_cpu(r->arg0);
+		u32 arg1 = le32_to_cpu(r->arg1);
+		u64 t = local_clock();
+
+		if (!r->type || r->type >= NVMAP_TRACE_NR_TYPES)
+			continue;
+
+		/* the trace comes from userspace, don't trust op */
+		if ((r->type == NVMAP_TRACE_ALLOC &&
+		     r->op > NVMAP_TRACE_MAX_ALIGN_SHIFT) ||
+		    (r->type == NVMAP_TRACE_CACHE &&
+		     r->op > NVMAP_CACHE_OP_WB_INV)) {
+			result.invalid++;
+			continue;
+		}
+
+		/* handle not allocated while capturing */
+		if (!id) {
+			result.unmatched++;
+			continue;
+		}
+
+		switch (r->type) {
+		case NVMAP_TRACE_ALLOC:
+			/* a recycled id means its destroy was not captured */
+			h = nvmap_replay_find(id, true);
+			if (h)
+				nvmap_free_handle(client, h);
+
+			l = kzalloc(sizeof(*l), GFP_KERNEL);
+			if (!l) {
+				err = -ENOMEM;
+				goto out;
+			}
+
+			t = local_clock();
+			ref = nvmap_create_handle(client,
+					(size_t)max(arg1, 1U) << PAGE_SHIFT);
+			if (IS_ERR(ref)) {
+				kfree(l);
+				result.alloc_failed++;
+				break;
+			}
+			if (nvmap_alloc_handle(client, ref->handle,
+				replay_native_heaps ? arg0 : NVMAP_HEAP_IOVMM,
+				1UL << r->op, 0, le16_to_cpu(r->flags),
+				NVMAP_IVM_INVALID_PEER))
+				result.alloc_failed++;
+			l->id = id;
+			l->h = ref->handle;
+			hash_add(replay_live, &l->node, id);
+			break;
+		case NVMAP_TRACE_FREE:
+			h = nvmap_replay_find(id, true);
+			if (!h) {
+				/* never allocated, or allocated pre-capture */
+				result.unmatched++;
+				continue;
+			}
+			t = local_clock();
+			nvmap_free_handle(client, h);
+			break;
+		case NVMAP_TRACE_CACHE:
+			h = nvmap_replay_find(id, false);
+			if (!h || !h->alloc || arg0 >= h->size) {
+				result.unmatched++;
+				continue;
+			}
+			t = local_clock();
+			__nvmap_do_cache_maint(client, h, arg0,
+					min_t(u64, (u64)arg0 + arg1, h->size),
+					r->op, false);
+			break;
+		}
+
+		nvmap_replay_lat_add(&result.lat[r->type],
+				     min_t(u64, U32_MAX, local_clock() - t));
+		cond_resched();
+	}
+
+out:
+	hash_for_each_safe(replay_live, bkt, tmp, l, node) {
+		nvmap_free_handle(client, l->h);
+		hash_del(&l->node);
+		kfree(l);
+	}
+	return err;
+}
+
+static void nvmap_replay_free_result(void)
+{
+	memset(&result, 0, sizeof(result));
+}
+
+static int nvmap_replay_run(u32 runs)
+{
+	struct nvmap_client *client;
+	u64 collect;
+	u32 i;
+	int err = 0;
+
+	nvmap_replay_free_result();
+	if (!trace_nr_recs)
+		return -ENODATA;
+
+	client = __nvmap_create_client(nvmap_dev, "replay");
+	if (!client) {
+		err = -ENOMEM;
+		goto fail;
+	}
+	/* traces keep the flags but not the tag */
+	client->tag_warned = 1;
+
+	/* pool hit rates and page sizes come from the stats deltas */
+	collect = atomic64_xchg(&nvmap_stats.collect, 1);
+	for (i = 0; i < NS_NUM; i++)
+		result.stats[i] = nvmap_stats_read(i);
+
+	for (i = 0; i < runs && !err; i++) {
+		err = nvmap_replay_run_once(client);
+		result.nr_runs++;
+	}
+
+	for (i = 0; i < NS_NUM; i++)
+		result.stats[i] = nvmap_stats_read(i) - result.stats[i];
+	atomic64_set(&nvmap_stats.collect, collect);
+
+	nvmap_client_put(client);
+	if (err)
+		goto fail;
+
+	result.valid = true;
+	return 0;
+
+fail:
+	nvmap_replay_free_result();
+	return err;
+}
+
+static int run_set(void *data, u64 val)
+{
+	int err;
+
+	if (!val || val > 1000)
+		return -EINVAL;
+
+	mutex_lock(&replay_lock);
+	err = capturing ? -EBUSY : nvmap_replay_run(val);
+	mutex_unlock(&replay_lock);
+	return err;
+}
+DEFINE_SIMPLE_ATTRIBUTE(run_fops, NULL, run_set, "%llu\n");
+
+/* upper bound of the bucket holding the pct percentile, at most max */
+static u64 nvmap_replay_pct(const struct nvmap_replay_lat *lat, u32 pct)
+{
+	u64 rank = div64_u64((lat->nr - 1) * pct, 100);
+	u64 seen = 0;
+	u32 idx;
+
+	for (idx = 0; idx < NVMAP_REPLAY_HIST_BUCKETS - 1; idx++) {
+		seen += lat->hist[idx];
+		if (seen > rank)
+			break;
+	}
+	return min_t(u64, nvmap_replay_hist_base(idx + 1) - 1, lat->max);
+}
+
+static int results_show(struct seq_file *s, void *unused)
+{
+	u64 hits, misses;
+	int i;
+
+	mutex_lock(&replay_lock);
+	if (!result.valid) {
+		seq_puts(s, "no replay results\n");
+		goto out;
+	}
+
+	seq_printf(s, "runs %u records %u dropped %u alloc_failed %u unmatched %u invalid %u\n",
+		   result.nr_runs, trace_nr_recs, trace_dropped,
+		   result.alloc_failed, result.unmatched, result.invalid);
+	seq_printf(s, "%-6s %10s %10s %10s %10s %10s %10s\n", "op",
+		   "count", "mean_ns", "p50_ns", "p90_ns", "p99_ns", "max_ns");
+	for (i = 1; i < NVMAP_TRACE_NR_TYPES; i++) {
+		const struct nvmap_replay_lat *lat = &result.lat[i];
+
+		if (!lat->nr)
+			continue;
+		seq_printf(s, "%-6s %10llu %10llu %10llu %10llu %10llu %10u\n",
+			   nvmap_trace_names[i], lat->nr,
+			   div64_u64(lat->sum, lat->nr),
+			   nvmap_replay_pct(lat, 50), nvmap_replay_pct(lat, 90),
+			   nvmap_replay_pct(lat, 99), lat->max);
+	}
+
+	hits = result.stats[NS_PP_HITS];
+	misses = result.stats[NS_PP_MISSES];
+	seq_printf(s, "pool hits %llu misses %llu hit_rate %llu%%\n",
+		   hits, misses,
+		   hits + misses ? div64_u64(hits * 100, hits + misses) : 0);
+	seq_printf(s, "pages huge %llu big %llu small %llu lazy %llu\n",
+		   result.stats[NS_HUGE_PAGES], result.stats[NS_BIG_PAGES],
+		   result.stats[NS_SMALL_PAGES], result.stats[NS_LAZY_PAGES]);
+out:
+	mutex_unlock(&replay_lock);
+	return 0;
+}
+
+static int results_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, results_show, inode->i_private);
+}
+
+static const struct file_operations results_fops = {
+	.open		= results_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+int nvmap_replay_debugfs_init(struct dentry *nvmap_root)
+{
+	struct dentry *replay_root;
+
+	if (!nvmap_root)
+		return -ENODEV;
+
+	replay_root = debugfs_create_dir("replay", nvmap_root);
+	if (!replay_root)
+		return -ENODEV;
+
+	debugfs_create_file("capture", S_IRUGO | S_IWUSR,
+			    replay_root, NULL, &capture_fops);
+	debugfs_create_u32("capture_records", S_IRUGO | S_IWUSR,
+			   replay_root, &capture_records);
+	debugfs_create_file("trace", S_IRUGO | S_IWUSR,
+			    replay_root, NULL, &trace_fops);
+	debugfs_create_bool("native_heaps", S_IRUGO | S_IWUSR,
+			    replay_root, &replay_native_heaps);
+	debugfs_create_file("run", S_IWUSR,
+			    replay_root, NULL, &run_fops);
+	debugfs_create_file("results", S_IRUGO,
+			    replay_root, NULL, &results_fops);
+	return 0;
+}
@@ -76,6 +76,12 @@ void nvmap_stats_init(struct dentry *nvmap_debug_root)
 		CREATE_DF(ucflush_done, nvmap_stats.stats[NS_UCFLUSH_DONE]);
 		CREATE_DF(kcflush_rq, nvmap_stats.stats[NS_KCFLUSH_RQ]);
 		CREATE_DF(kcflush_done, nvmap_stats.stats[NS_KCFLUSH_DONE]);
+		CREATE_DF(huge_pages, nvmap_stats.stats[NS_HUGE_PAGES]);
+		CREATE_DF(big_pages, nvmap_stats.stats[NS_BIG_PAGES]);
+		CREATE_DF(small_pages, nvmap_stats.stats[NS_SMALL_PAGES]);
+		CREATE_DF(lazy_pages, nvmap_stats.stats[NS_LAZY_PAGES]);
+		CREATE_DF(pp_hits, nvmap_stats.stats[NS_PP_HITS]);
+		CREATE_DF(pp_misses, nvmap_stats.stats[NS_PP_MISSES]);
 		CREATE_DF(total_memory, nvmap_stats.stats[NS_TOTAL]);
 
 		debugfs_create_file("collect", S_IRUGO | S_IWUSR,
@@ -27,6 +27,12 @@ enum nvmap_stats_t {
 	NS_UCFLUSH_DONE,
 	NS_KCFLUSH_RQ,
 	NS_KCFLUSH_DONE,
+	NS_HUGE_PAGES,		/* 2MB runs allocated for page handles */
+	NS_BIG_PAGES,		/* big page (64KB) runs allocated */
+	NS_SMALL_PAGES,		/* 4K pages allocated one at a time */
+	NS_LAZY_PAGES,		/* pages populated on demand for lazy handles */
+	NS_PP_HITS,		/* pages handed out by the page pool */
+	NS_PP_MISSES,		/* pages requested from the pool but not found */
 	NS_TOTAL,
 	NS_NUM,
 };
@@ -230,6 +230,10 @@ struct nvhost_device_data {
 	struct nvhost_device_power_attr *power_attrib;	/* sysfs attributes */
 	struct dentry *debugfs;		/* debugfs directory */
 
+	/* submit argument copy and parse time: [0] legacy, [1] packed */
+	atomic64_t submit_parse_ns[2];
+	atomic64_t submit_parse_count[2];
+
 	u32 nvhost_timeout_default;
 
 	/* Data for devfreq usage */
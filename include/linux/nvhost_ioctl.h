@@ -208,6 +208,43 @@ struct nvhost32_submit_args {
 #define NVHOST_SUBMIT_FLAG_SYNC_FENCE_FD	0
 #define NVHOST_SUBMIT_MAX_NUM_SYNCPT_INCRS	10
 
+/*
+ * Packed submit descriptor: a header followed by the submit arrays in one
+ * user buffer. Array locations are byte offsets from the start of the
+ * descriptor, 4 byte aligned; an offset of 0 marks an optional array as
+ * absent. The kernel copies the whole descriptor once and parses it in
+ * place instead of copying each array separately.
+ */
+#define NVHOST_SUBMIT_PACKED_VERSION		1
+#define NVHOST_SUBMIT_PACKED_MAX_SIZE		(64 * 1024)
+
+struct nvhost_submit_packed_hdr {
+	__u32 version;		/* NVHOST_SUBMIT_PACKED_VERSION */
+	__u32 size;		/* total descriptor size in bytes */
+	__u32 num_syncpt_incrs;
+	__u32 num_cmdbufs;
+	__u32 num_relocs;
+	__u32 num_waitchks;
+	__u32 timeout;
+	__u32 flags;		/* NVHOST_SUBMIT_FLAG_* */
+
+	__u32 syncpt_incrs;	/* struct nvhost_syncpt_incr[] */
+	__u32 cmdbufs;		/* struct nvhost_cmdbuf[] */
+	__u32 cmdbuf_exts;	/* struct nvhost_cmdbuf_ext[], optional */
+	__u32 class_ids;	/* __u32[], optional */
+	__u32 relocs;		/* struct nvhost_reloc[] */
+	__u32 reloc_shifts;	/* struct nvhost_reloc_shift[] */
+	__u32 reloc_types;	/* struct nvhost_reloc_type[], optional */
+	__u32 waitchks;		/* struct nvhost_waitchk[] */
+};
+
+struct nvhost_submit_packed_args {
+	__u64 desc;		/* pointer to the packed descriptor */
+	__u64 fences;		/* optional __u32[num_syncpt_incrs] output */
+	__u32 desc_size;	/* size of the descriptor buffer */
+	__u32 fence;		/* Return value */
+};
+
 struct nvhost_submit_args {
 	__u32 submit_version;
 	__u32 num_syncpt_incrs;
@@ -325,6 +362,9 @@ struct nvhost_channel_map_buffer_args {
 #define NVHOST_IOCTL_CHANNEL_SET_SYNCPOINT_NAME	\
 	_IOW(NVHOST_IOCTL_MAGIC, 30, struct nvhost_set_syncpt_name_args)
 
+#define NVHOST_IOCTL_CHANNEL_SUBMIT_PACKED	\
+	_IOWR(NVHOST_IOCTL_MAGIC, 31, struct nvhost_submit_packed_args)
+
 #define NVHOST_IOCTL_CHANNEL_SET_ERROR_NOTIFIER  \
 	_IOWR(NVHOST_IOCTL_MAGIC, 111, struct nvhost_set_error_notifier)
 #define NVHOST_IOCTL_CHANNEL_OPEN	\
@@ -53,6 +53,7 @@
 #define NVMAP_HANDLE_PHYS_CONTIG     (0x1ul << 6)
 #define NVMAP_HANDLE_CACHE_SYNC      (0x1ul << 7)
 #define NVMAP_HANDLE_CACHE_SYNC_AT_RESERVE      (0x1ul << 8)
+#define NVMAP_HANDLE_LAZY_ALLOC      (0x1ul << 9)
 
 #if defined(__KERNEL__)
 
@@ -183,6 +184,13 @@ struct nvmap_create_handle_from_va {
 	};
 };
 
+struct nvmap_create_view {
+	__u32 parent;		/* handle the view is carved from */
+	__u32 handle;		/* returns nvmap handle of the view */
+	__u64 offset;		/* page aligned byte offset into parent */
+	__u64 size;		/* page aligned size of the view */
+};
+
 struct nvmap_gup_test {
 	__u64 va;		/* FromVA*/
 	__u32 handle;		/* returns nvmap handle */
@@ -452,6 +460,10 @@ struct nvmap_heap_size {
 #define NVMAP_IOC_GET_HEAP_SIZE \
 	_IOR(NVMAP_IOC_MAGIC, 26, struct nvmap_heap_size)
 
+/* Create a handle sharing an offset/size slice of an allocated handle */
+#define NVMAP_IOC_CREATE_VIEW \
+	_IOWR(NVMAP_IOC_MAGIC, 27, struct nvmap_create_view)
+
 /* START of T124 IOCTLS */
 /* Actually allocates memory for the specified handle, with kind */
 #define NVMAP_IOC_ALLOC_KIND _IOW(NVMAP_IOC_MAGIC, 100, struct nvmap_alloc_kind_handle)
@@ -384,6 +384,35 @@ TRACE_EVENT(nvhost_cdma_end,
 	TP_printk("name=%s", __entry->name)
 );
 
+TRACE_EVENT(nvhost_cdma_job_stats,
+	TP_PROTO(const char *name, u64 submit_push_ns, u64 push_complete_ns,
+		 u64 complete_cleanup_ns, u32 num_slots),
+
+	TP_ARGS(name, submit_push_ns, push_complete_ns, complete_cleanup_ns,
+		num_slots),
+
+	TP_STRUCT__entry(
+		__field(const char *, name)
+		__field(u64, submit_push_ns)
+		__field(u64, push_complete_ns)
+		__field(u64, complete_cleanup_ns)
+		__field(u32, num_slots)
+	),
+
+	TP_fast_assign(
+		__entry->name = name;
+		__entry->submit_push_ns = submit_push_ns;
+		__entry->push_complete_ns = push_complete_ns;
+		__entry->complete_cleanup_ns = complete_cleanup_ns;
+		__entry->num_slots = num_slots;
+	),
+
+	TP_printk("name=%s submit_push_ns=%llu push_complete_ns=%llu complete_cleanup_ns=%llu num_slots=%u",
+		__entry->name, __entry->submit_push_ns,
+		__entry->push_complete_ns, __entry->complete_cleanup_ns,
+		__entry->num_slots)
+);
+
 TRACE_EVENT(nvhost_cdma_flush,
 	TP_PROTO(const char *name, int timeout),
 
@@ -0,0 +1,63 @@
+/*
+ * include/uapi/linux/nvmap_replay.h
+ *
+ * nvmap allocation trace format, shared by the capture in
+ * drivers/video/tegra/nvmap/nvmap_replay.c and tools/nvmap/nvmap-replay
+ *
+ * Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ */
+
+#ifndef _UAPI_LINUX_NVMAP_REPLAY_H
+#define _UAPI_LINUX_NVMAP_REPLAY_H
+
+#include <linux/types.h>
+
+/*
+ * A trace is a struct nvmap_trace_hdr followed by nr_recs packed, little
+ * endian struct nvmap_trace_rec entries. Handles are identified by an id
+ * handed out when their allocation is captured, which is unique among
+ * live handles; an id may be reused once the handle it named has been
+ * destroyed. Handles allocated before the capture started have id 0.
+ */
+#define NVMAP_TRACE_MAGIC	0x50524d4e	/* "NMRP" */
+#define NVMAP_TRACE_VERSION	1
+
+/* alignments come from a u32, larger shifts are corrupt records */
+#define NVMAP_TRACE_MAX_ALIGN_SHIFT	31
+
+enum {
+	NVMAP_TRACE_ALLOC = 1,
+	NVMAP_TRACE_FREE,
+	NVMAP_TRACE_CACHE,
+	NVMAP_TRACE_NR_TYPES,
+};
+
+struct nvmap_trace_hdr {
+	__le32 magic;
+	__le16 version;
+	__le16 rec_size;
+	__le32 nr_recs;
+	__le32 dropped;		/* records lost to a full capture buffer */
+	__le32 page_shift;
+} __attribute__((packed));
+
+struct nvmap_trace_rec {
+	__u8 type;		/* NVMAP_TRACE_* */
+	__u8 op;		/* alloc: log2 alignment, cache: cache op */
+	__le16 flags;		/* alloc: user flags without the tag */
+	__le32 delta_us;	/* time since the previous record */
+	__le32 id;
+	__le32 arg0;		/* alloc: heap mask, cache: start offset */
+	__le32 arg1;		/* alloc: size in pages, cache: length */
+} __attribute__((packed));
+
+#endif
@@ -705,6 +705,56 @@ struct tegra_dc_ext_flip_4 {
 	__u64 __user data; /* pointer to struct tegra_dc_ext_flip_user_data*/
 };
 
+/*
+ * tegra_dc_ext_flip_multi : Flips several heads as one update. Each entry of
+ * heads carries a complete FLIP4 request for one head, which is identified by
+ * an open tegra_dc_ext file descriptor (dc_fd), or -1 for the head the ioctl
+ * is issued on. A head may appear only once, and at most one head may carry
+ * an IMP flip tag.
+ */
+#define TEGRA_DC_EXT_FLIP_MULTI_MAX_HEADS	4
+
+struct tegra_dc_ext_flip_multi_head {
+	__s32 dc_fd;
+	__u32 reserved; /* unused - must be 0 */
+	struct tegra_dc_ext_flip_4 flip;
+};
+
+struct tegra_dc_ext_flip_multi {
+	__u64 __user heads; /* pointer to struct tegra_dc_ext_flip_multi_head */
+	__u8 nr_heads;
+	__u8 reserved[7]; /* unused - must be 0 */
+};
+
+/*
+ * tegra_dc_ext_flip_queue : Flip queue configuration of one window, which
+ * the caller must have acquired with TEGRA_DC_EXT_GET_WINDOW. It is reset to
+ * the defaults (all 0) when the window is put.
+ *
+ * mode: TEGRA_DC_EXT_FLIP_QUEUE_FIFO presents every flip in order.
+ *	TEGRA_DC_EXT_FLIP_QUEUE_MAILBOX drops a flip that has not been latched
+ *	yet as soon as a newer flip is queued for the window.
+ * depth: FIFO mode only. Number of flips that may be queued for the window
+ *	and not yet picked up by the flip worker. Further flips fail with
+ *	-EAGAIN. 0 means no limit. Ignored in mailbox mode, where a new flip
+ *	always replaces the one not latched yet.
+ * latch_margin_us: mailbox mode only. Once a flip is ready, hold it back
+ *	until this long before the next vblank, so that a newer flip can still
+ *	replace it. 0 latches as soon as the flip is ready. Not supported on
+ *	one-shot outputs, which have no periodic vblank.
+ */
+enum {
+	TEGRA_DC_EXT_FLIP_QUEUE_FIFO,
+	TEGRA_DC_EXT_FLIP_QUEUE_MAILBOX,
+};
+
+struct tegra_dc_ext_flip_queue {
+	__u32 win;
+	__u32 mode;
+	__u32 depth;
+	__u32 latch_margin_us;
+};
+
 /*
  * vblank control - enable or disable vblank events
  */
@@ -1438,6 +1488,38 @@ struct tegra_dc_ext_scanline_info {
 #define TEGRA_DC_EXT_CRC_GET \
 	_IOWR('D', 0x28, struct tegra_dc_ext_crc_arg)
 
+/* Flip windows on several heads at once. All requests are validated and
+ * their bandwidth negotiated before any of them is queued. Bandwidth is
+ * reserved head by head; if a head cannot be reserved, or the flip fails
+ * before it is queued, the reservations grown for the other heads are
+ * released again. A reservation that another flip on the same head has
+ * changed in the meantime is left to that flip. Every head then
+ * waits for all the others to be ready (pre-fences signalled, windows
+ * programmed) before requesting the update, so that the heads latch the
+ * new frame together. Output fences and flip IDs are returned per head,
+ * exactly as with TEGRA_DC_EXT_FLIP4.
+ *
+ * Returns
+ * -EINVAL   if nr_heads is 0 or too large, a head is given twice, more than
+ *           one head carries an IMP flip tag, or any head's request is
+ *           invalid
+ * -EBADF    if dc_fd is not an open tegra_dc_ext device
+ * -EBUSY    if the combined bandwidth of the heads cannot be reserved
+ * otherwise any error TEGRA_DC_EXT_FLIP4 can return for one of the heads
+ */
+#define TEGRA_DC_EXT_FLIP_MULTI \
+	_IOWR('D', 0x29, struct tegra_dc_ext_flip_multi)
+
+/* Configure the flip queue of a window, see struct tegra_dc_ext_flip_queue.
+ *
+ * Returns
+ * -EINVAL   if win is not a valid window, or mode is unknown
+ * -EACCES   if the window is not owned by the caller
+ * -EOPNOTSUPP if latch_margin_us is set in mailbox mode on a one-shot output
+ */
+#define TEGRA_DC_EXT_SET_FLIP_QUEUE \
+	_IOW('D', 0x2A, struct tegra_dc_ext_flip_queue)
+
 enum tegra_dc_ext_control_output_type {
 	TEGRA_DC_EXT_DSI,
 	TEGRA_DC_EXT_LVDS,
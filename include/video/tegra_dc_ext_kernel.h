@@ -147,6 +147,18 @@ struct tegra_dc_win {
 	struct nvmap_handle_ref	*cur_handle;
 	unsigned		bandwidth;
 	unsigned		new_bandwidth;
+	/* last tegra_dc_calc_win_bandwidth() result, keyed by its inputs */
+	struct {
+		bool		valid;
+		u32		fmt;
+		u32		flags;
+		fixed20_12	w;
+		fixed20_12	h;
+		unsigned	out_w;
+		unsigned	out_h;
+		unsigned long	pclk;
+		unsigned	bw;
+	} bw_cache;
 	struct tegra_dc_lut	lut;
 	struct tegra_dc_nvdisp_lut	nvdisp_lut;
 	u8	block_height_log2;
@@ -175,8 +187,20 @@ struct tegra_dc_win {
 
 struct tegra_dc *tegra_dc_get_dc(unsigned idx);
 #ifdef CONFIG_TEGRA_ISOMGR
+/* A reservation grown by tegra_dc_bandwidth_negotiate_bw_heads() */
+struct tegra_dc_bw_undo {
+	u32 reserved_bw;	/* reservation before the negotiation */
+	u32 bw_kbps;
+	u32 new_reserved_bw;	/* 0 if the reservation was not grown */
+};
+
 int tegra_dc_bandwidth_negotiate_bw(struct tegra_dc *dc,
 			struct tegra_dc_win *windows[], int n);
+int tegra_dc_bandwidth_negotiate_bw_heads(struct tegra_dc *dcs[],
+			struct tegra_dc_win **windows[], int n[], int nr_heads,
+			struct tegra_dc_bw_undo undo[]);
+void tegra_dc_bandwidth_undo_heads(struct tegra_dc *dcs[],
+			struct tegra_dc_bw_undo undo[], int nr_heads);
 #endif
 int tegra_dc_get_numof_dispheads(void);
 int tegra_dc_get_numof_dispwindows(void);
@@ -0,0 +1,478 @@
+/*
+ * tools/nvmap/nvmap-replay.c
+ *
+ * Host side replay of nvmap allocation traces
+ *
+ * Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * Replays a trace read from nvmap/replay/trace in debugfs on any Linux
+ * machine, no Tegra hardware or nvmap driver needed. Handles are backed by
+ * individually allocated pages, the page pool is modelled after nvmap_pp.c:
+ * freed pages are zeroed outside of the timed path, as the background
+ * zeroing thread does, and refill the pool up to its capacity; allocations
+ * take zeroed pages from the pool first and fall back to fresh zeroed and
+ * cleaned pages. Cache maintenance walks the range line by line with the
+ * CPU's clean/flush instructions. Every allocation is treated as an IOVMM
+ * one, whatever heap it was recorded against.
+ */
+
+#define _GNU_SOURCE
+#include <endian.h>
+#include <errno.h>
+#include <getopt.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <linux/nvmap_replay.h>
+
+/* from include/linux/nvmap.h */
+#define NVMAP_CACHE_OP_WB	0
+#define NVMAP_CACHE_OP_INV	1
+#define NVMAP_CACHE_OP_WB_INV	2
+
+/* same log-linear latency histogram as nvmap_replay.c */
+#define HIST_SUB_BITS	4
+#define HIST_SUB	(1U << HIST_SUB_BITS)
+#define HIST_BUCKETS	((32 - HIST_SUB_BITS + 1) << HIST_SUB_BITS)
+
+#define LIVE_BUCKETS	4096
+
+struct lat {
+	uint32_t hist[HIST_BUCKETS];
+	uint32_t max;
+	uint64_t nr;
+	uint64_t sum;
+};
+
+struct handle {
+	struct handle *next;
+	uint32_t id;
+	uint32_t nr_pages;
+	void *pages[];
+};
+
+static const char * const trace_names[NVMAP_TRACE_NR_TYPES] = {
+	[NVMAP_TRACE_ALLOC] = "alloc",
+	[NVMAP_TRACE_FREE] = "free",
+	[NVMAP_TRACE_CACHE] = "cache",
+};
+
+static struct nvmap_trace_rec *recs;
+static uint32_t nr_recs;
+static size_t page_size;
+static size_t line_size;
+
+static void **pool;
+static uint32_t pool_count;
+static uint32_t pool_max = 16384;
+
+static struct handle *live[LIVE_BUCKETS];
+
+static struct lat lat[NVMAP_TRACE_NR_TYPES];
+static uint64_t pool_hits, pool_misses, alloc_failed, unmatched, invalid;
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static uint32_t hist_idx(uint32_t ns)
+{
+	uint32_t shift;
+
+	if (ns < HIST_SUB)
+		return ns;
+	shift = 31 - __builtin_clz(ns) - HIST_SUB_BITS;
+	return ((shift + 1) << HIST_SUB_BITS) +
+		((ns >> shift) & (HIST_SUB - 1));
+}
+
+static uint64_t hist_base(uint32_t idx)
+{
+	uint32_t shift;
+
+	if (idx < HIST_SUB)
+		return idx;
+	shift = (idx >> HIST_SUB_BITS) - 1;
+	return (uint64_t)(HIST_SUB + (idx & (HIST_SUB - 1))) << shift;
+}
+
+static void lat_add(struct lat *l, uint64_t ns)
+{
+	uint32_t v = ns > UINT32_MAX ? UINT32_MAX : ns;
+
+	l->hist[hist_idx(v)]++;
+	l->nr++;
+	l->sum += v;
+	if (v > l->max)
+		l->max = v;
+}
+
+static uint64_t lat_pct(const struct lat *l, unsigned int pct)
+{
+	uint64_t rank = (l->nr - 1) * pct / 100, seen = 0, v;
+	uint32_t idx;
+
+	for (idx = 0; idx < HIST_BUCKETS - 1; idx++) {
+		seen += l->hist[idx];
+		if (seen > rank)
+			break;
+	}
+	v = hist_base(idx + 1) - 1;
+	return v < l->max ? v : l->max;
+}
+
+static void cache_line(void *p, int op)
+{
+#if defined(__aarch64__)
+	/* dc ivac is EL1 only, invalidate by clean+invalidate instead */
+	if (op == NVMAP_CACHE_OP_WB)
+		asm volatile("dc cvac, %0" : : "r" (p) : "memory");
+	else
+		asm volatile("dc civac, %0" : : "r" (p) : "memory");
+#elif defined(__x86_64__) || defined(__i386__)
+	(void)op;
+	asm volatile("clflush %0" : "+m" (*(volatile char *)p));
+#else
+	(void)op;
+	(void)*(volatile char *)p;
+#endif
+}
+
+static void cache_sync(void)
+{
+#if defined(__aarch64__)
+	asm volatile("dsb sy" : : : "memory");
+#elif defined(__x86_64__) || defined(__i386__)
+	asm volatile("mfence" : : : "memory");
+#else
+	__sync_synchronize();
+#endif
+}
+
+static void cache_range(void *start, size_t len, int op)
+{
+	char *p = (char *)((uintptr_t)start & ~(line_size - 1));
+	char *end = (char *)start + len;
+
+	for (; p < end; p += line_size)
+		cache_line(p, op);
+}
+
+static void *page_get(void)
+{
+	void *p;
+
+	if (pool_count) {
+		pool_hits++;
+		return pool[--pool_count];
+	}
+
+	pool_misses++;
+	p = aligned_alloc(page_size, page_size);
+	if (!p)
+		return NULL;
+	memset(p, 0, page_size);
+	cache_range(p, page_size, NVMAP_CACHE_OP_WB);
+	return p;
+}
+
+/* stands in for the background zeroing, kept out of the timed path */
+static void pages_zero(void **pages, uint32_t nr)
+{
+	uint32_t i;
+
+	for (i = 0; i < nr; i++)
+		memset(pages[i], 0, page_size);
+}
+
+static void pages_put(void **pages, uint32_t nr)
+{
+	uint32_t i;
+
+	for (i = 0; i < nr; i++) {
+		if (pool_count < pool_max)
+			pool[pool_count++] = pages[i];
+		else
+			free(pages[i]);
+	}
+}
+
+static struct handle *handle_find(uint32_t id, bool remove)
+{
+	struct handle **hp = &live[id % LIVE_BUCKETS], *h;
+
+	for (; (h = *hp); hp = &h->next) {
+		if (h->id != id)
+			continue;
+		if (remove)
+			*hp = h->next;
+		return h;
+	}
+	return NULL;
+}
+
+static void handle_release(struct handle *h)
+{
+	pages_zero(h->pages, h->nr_pages);
+	pages_put(h->pages, h->nr_pages);
+	free(h);
+}
+
+static struct handle *handle_alloc(uint32_t id, uint32_t nr_pages)
+{
+	struct handle *h;
+	uint32_t i;
+
+	h = malloc(sizeof(*h) + (size_t)nr_pages * sizeof(void *));
+	if (!h)
+		return NULL;
+	for (i = 0; i < nr_pages; i++) {
+		h->pages[i] = page_get();
+		if (!h->pages[i]) {
+			h->nr_pages = i;
+			handle_release(h);
+			return NULL;
+		}
+	}
+	cache_sync();
+	h->id = id;
+	h->nr_pages = nr_pages;
+	return h;
+}
+
+static void handle_cache(struct handle *h, uint64_t start, uint64_t end,
+			 int op)
+{
+	while (start < end) {
+		uint64_t pg = start / page_size, off = start % page_size;
+		uint64_t len = page_size - off;
+
+		if (len > end - start)
+			len = end - start;
+		cache_range((char *)h->pages[pg] + off, len, op);
+		start += len;
+	}
+	cache_sync();
+}
+
+static void replay_once(void)
+{
+	struct handle *h;
+	uint32_t i, b;
+
+	for (i = 0; i < nr_recs; i++) {
+		const struct nvmap_trace_rec *r = &recs[i];
+		uint32_t id = le32toh(r->id);
+		uint32_t arg0 = le32toh(r->arg0);
+		uint32_t arg1 = le32toh(r->arg1);
+		uint64_t t, size;
+
+		if (!r->type || r->type >= NVMAP_TRACE_NR_TYPES)
+			continue;
+
+		if ((r->type == NVMAP_TRACE_ALLOC &&
+		     r->op > NVMAP_TRACE_MAX_ALIGN_SHIFT) ||
+		    (r->type == NVMAP_TRACE_CACHE &&
+		     r->op > NVMAP_CACHE_OP_WB_INV)) {
+			invalid++;
+			continue;
+		}
+
+		if (!id) {
+			unmatched++;
+			continue;
+		}
+
+		switch (r->type) {
+		case NVMAP_TRACE_ALLOC:
+			/* a recycled id means its destroy was not captured */
+			h = handle_find(id, true);
+			if (h)
+				handle_release(h);
+
+			t = now_ns();
+			h = handle_alloc(id, arg1 ? arg1 : 1);
+			lat_add(&lat[r->type], now_ns() - t);
+			if (!h) {
+				alloc_failed++;
+				continue;
+			}
+			h->next = live[id % LIVE_BUCKETS];
+			live[id % LIVE_BUCKETS] = h;
+			continue;
+		case NVMAP_TRACE_FREE:
+			h = handle_find(id, true);
+			if (!h) {
+				unmatched++;
+				continue;
+			}
+			pages_zero(h->pages, h->nr_pages);
+			t = now_ns();
+			pages_put(h->pages, h->nr_pages);
+			free(h);
+			lat_add(&lat[r->type], now_ns() - t);
+			continue;
+		case NVMAP_TRACE_CACHE:
+			h = handle_find(id, false);
+			size = h ? (uint64_t)h->nr_pages * page_size : 0;
+			if (arg0 >= size) {
+				unmatched++;
+				continue;
+			}
+			t = now_ns();
+			handle_cache(h, arg0, (uint64_t)arg0 + arg1 < size ?
+				     (uint64_t)arg0 + arg1 : size, r->op);
+			lat_add(&lat[r->type], now_ns() - t);
+			continue;
+		}
+	}
+
+	for (b = 0; b < LIVE_BUCKETS; b++) {
+		while ((h = live[b])) {
+			live[b] = h->next;
+			handle_release(h);
+		}
+	}
+}
+
+static int load_trace(const char *path)
+{
+	struct nvmap_trace_hdr hdr;
+	uint32_t shift, dropped;
+	FILE *f;
+	int err = -EINVAL;
+
+	f = strcmp(path, "-") ? fopen(path, "rb") : stdin;
+	if (!f) {
+		perror(path);
+		return -errno;
+	}
+
+	if (fread(&hdr, sizeof(hdr), 1, f) != 1 ||
+	    le32toh(hdr.magic) != NVMAP_TRACE_MAGIC ||
+	    le16toh(hdr.version) != NVMAP_TRACE_VERSION ||
+	    le16toh(hdr.rec_size) != sizeof(*recs)) {
+		fprintf(stderr, "%s: not an nvmap trace\n", path);
+		goto out;
+	}
+
+	shift = le32toh(hdr.page_shift);
+	if (shift < 12 || shift > 16) {
+		fprintf(stderr, "%s: bad page shift %u\n", path, shift);
+		goto out;
+	}
+	page_size = (size_t)1 << shift;
+
+	nr_recs = le32toh(hdr.nr_recs);
+	recs = calloc(nr_recs ? nr_recs : 1, sizeof(*recs));
+	if (!recs) {
+		err = -ENOMEM;
+		goto out;
+	}
+	if (fread(recs, sizeof(*recs), nr_recs, f) != nr_recs) {
+		fprintf(stderr, "%s: truncated trace\n", path);
+		goto out;
+	}
+
+	dropped = le32toh(hdr.dropped);
+	if (dropped)
+		fprintf(stderr, "%s: %u records were dropped while capturing\n",
+			path, dropped);
+	err = 0;
+out:
+	if (f != stdin)
+		fclose(f);
+	return err;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-n runs] [-p pool_pages] trace\n"
+		"  -n runs        replay the trace back to back N times (1)\n"
+		"  -p pool_pages  page pool capacity in pages (%u)\n"
+		"  trace          file read from nvmap/replay/trace, - for stdin\n",
+		prog, pool_max);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long runs = 1, i;
+	long ls;
+	int c;
+
+	while ((c = getopt(argc, argv, "n:p:h")) != -1) {
+		switch (c) {
+		case 'n':
+			runs = strtoul(optarg, NULL, 0);
+			break;
+		case 'p':
+			pool_max = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			usage(argv[0]);
+			return c == 'h' ? 0 : 1;
+		}
+	}
+	if (optind != argc - 1 || !runs) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	if (load_trace(argv[optind]))
+		return 1;
+
+	ls = sysconf(_SC_LEVEL1_DCACHE_LINESIZE);
+	line_size = ls > 0 ? (size_t)ls : 64;
+
+	pool = calloc(pool_max ? pool_max : 1, sizeof(*pool));
+	if (!pool) {
+		perror("pool");
+		return 1;
+	}
+
+	for (i = 0; i < runs; i++)
+		replay_once();
+
+	printf("runs %lu records %u alloc_failed %llu unmatched %llu invalid %llu\n",
+	       runs, nr_recs, (unsigned long long)alloc_failed,
+	       (unsigned long long)unmatched, (unsigned long long)invalid);
+	printf("%-6s %10s %10s %10s %10s %10s %10s\n", "op",
+	       "count", "mean_ns", "p50_ns", "p90_ns", "p99_ns", "max_ns");
+	for (c = 1; c < NVMAP_TRACE_NR_TYPES; c++) {
+		const struct lat *l = &lat[c];
+
+		if (!l->nr)
+			continue;
+		printf("%-6s %10llu %10llu %10llu %10llu %10llu %10u\n",
+		       trace_names[c], (unsigned long long)l->nr,
+		       (unsigned long long)(l->sum / l->nr),
+		       (unsigned long long)lat_pct(l, 50),
+		       (unsigned long long)lat_pct(l, 90),
+		       (unsigned long long)lat_pct(l, 99), l->max);
+	}
+	printf("pool hits %llu misses %llu hit_rate %llu%%\n",
+	       (unsigned long long)pool_hits, (unsigned long long)pool_misses,
+	       pool_hits + pool_misses ?
+	       (unsigned long long)(pool_hits * 100 /
+				    (pool_hits + pool_misses)) : 0);
+	return 0;
+}